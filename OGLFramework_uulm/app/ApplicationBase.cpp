@@ -45,6 +45,7 @@ namespace cgu {
     {
         texManager.reset(new TextureManager(this));
         volManager.reset(new VolumeManager(this));
+        meshManager.reset(new MeshManager(this));
         matManager.reset(new MaterialLibManager(this));
         shaderManager.reset(new ShaderManager(this));
         programManager.reset(new GPUProgramManager(this));
@@ -89,6 +90,15 @@ namespace cgu {
         return volManager.get();
     }
 
+    /**
+     * Returns the mesh manager.
+     * @return  the mesh manager
+     */
+    MeshManager* ApplicationBase::GetMeshManager() const
+    {
+        return meshManager.get();
+    }
+
     /**
      * Returns the material lib manager.
      * @return the material lib manager
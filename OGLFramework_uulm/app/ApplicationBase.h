@@ -19,6 +19,7 @@
 #include "gfx/CameraView.h"
 #include "main.h"
 #include "core/VolumeManager.h"
+#include "core/MeshManager.h"
 #include "gfx/glrenderer/ScreenQuadRenderable.h"
 
 namespace cgu {
@@ -60,6 +61,7 @@ namespace cgu {
 
         TextureManager* GetTextureManager() const;
         VolumeManager* GetVolumeManager() const;
+        MeshManager* GetMeshManager() const;
         MaterialLibManager* GetMaterialLibManager() const;
         ShaderManager* GetShaderManager() const;
         GPUProgramManager* GetGPUProgramManager() const;
@@ -109,6 +111,8 @@ namespace cgu {
         std::unique_ptr<TextureManager> texManager;
         /** Holds the volume manager. */
         std::unique_ptr<VolumeManager> volManager;
+        /** Holds the mesh manager. */
+        std::unique_ptr<MeshManager> meshManager;
         /** Holds the material lib manager. */
         std::unique_ptr<MaterialLibManager> matManager;
         /** Holds the shader manager. */
@@ -22,7 +22,10 @@ namespace cgu {
         pauseOnKillFocus(false),
         resourceBase("resources"),
         useCUDA(true),
-        cudaDevice(-1)
+        cudaDevice(-1),
+        numWorkerThreads(0),
+        volumeSlabBudgetMB(1024),
+        compressVolumeBricks(true)
     {
     }
 
@@ -41,6 +44,7 @@ namespace cgu {
     {
         return os << config.fullscreen << config.backbufferBits << config.windowLeft << config.windowTop
             << config.windowWidth << config.windowHeight << config.useSRGB << config.pauseOnKillFocus
-            << config.resourceBase << config.useCUDA << config.cudaDevice;
+            << config.resourceBase << config.useCUDA << config.cudaDevice << config.numWorkerThreads
+            << config.volumeSlabBudgetMB << config.compressVolumeBricks;
     }
 }
@@ -53,6 +53,12 @@ namespace cgu {
         bool useCUDA;
         /** Holds the used CUDA device if CUDA is used. */
         int cudaDevice;
+        /** Holds the number of worker threads used for loading resources (0 uses all hardware threads). */
+        unsigned int numWorkerThreads;
+        /** Holds the memory budget for reading volume files and for subtrees bricked in parallel (in MB each). */
+        unsigned int volumeSlabBudgetMB;
+        /** Holds whether volume bricks are stored compressed in the brick cache. */
+        bool compressVolumeBricks;
 
     private:
         /** Needed for serialization */
@@ -86,10 +92,19 @@ namespace cgu {
                 ar & BOOST_SERIALIZATION_NVP(useCUDA);
                 ar & BOOST_SERIALIZATION_NVP(cudaDevice);
             }
+            if (version >= 5) {
+                ar & BOOST_SERIALIZATION_NVP(numWorkerThreads);
+            }
+            if (version >= 6) {
+                ar & BOOST_SERIALIZATION_NVP(volumeSlabBudgetMB);
+            }
+            if (version >= 7) {
+                ar & BOOST_SERIALIZATION_NVP(compressVolumeBricks);
+            }
         }
     };
 }
 
-BOOST_CLASS_VERSION(cgu::Configuration, 4)
+BOOST_CLASS_VERSION(cgu::Configuration, 7)
 
 #endif /* CONFIGURATION_H */
@@ -0,0 +1,40 @@
+/**
+ * @file   MeshManager.cpp
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.18
+ *
+ * @brief  Contains the implementation of MeshManager.
+ */
+
+#include "MeshManager.h"
+
+namespace cgu {
+
+    /**
+     * Constructor.
+     * @param app the application object for resolving dependencies.
+     */
+    MeshManager::MeshManager(ApplicationBase* app) :
+        ResourceManagerBase(app)
+    {
+    }
+
+    /** Default copy constructor. */
+    MeshManager::MeshManager(const MeshManager&) = default;
+    /** Default copy assignment operator. */
+    MeshManager& MeshManager::operator=(const MeshManager&) = default;
+
+    /** Default move constructor. */
+    MeshManager::MeshManager(MeshManager&& rhs) : ResourceManagerBase(std::move(rhs)) {}
+
+    /** Default move assignment operator. */
+    MeshManager& MeshManager::operator=(MeshManager&& rhs)
+    {
+        ResourceManagerBase* tResMan = this;
+        *tResMan = static_cast<ResourceManagerBase&&>(std::move(rhs));
+        return *this;
+    }
+
+    /** Default destructor. */
+    MeshManager::~MeshManager() = default;
+}
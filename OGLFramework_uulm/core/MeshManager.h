@@ -0,0 +1,34 @@
+/**
+ * @file   MeshManager.h
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.18
+ *
+ * @brief  Contains the definition of MeshManager.
+ */
+
+#ifndef MESHMANAGER_H
+#define MESHMANAGER_H
+
+#include "gfx/OBJMesh.h"
+
+namespace cgu {
+
+    /**
+    * @brief  ResourceManager implementation for OBJMesh resources.
+    *
+    * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+    * @date   2015.09.18
+    */
+    class MeshManager final : public ResourceManager<OBJMesh>
+    {
+    public:
+        explicit MeshManager(ApplicationBase* app);
+        MeshManager(const MeshManager&);
+        MeshManager& operator=(const MeshManager&);
+        MeshManager(MeshManager&&);
+        MeshManager& operator=(MeshManager&&);
+        virtual ~MeshManager();
+    };
+}
+
+#endif // MESHMANAGER_H
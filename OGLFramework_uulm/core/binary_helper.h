@@ -0,0 +1,155 @@
+/**
+ * @file   binary_helper.h
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.18
+ *
+ * @brief  Contains helpers for reading and writing binary cache files.
+ */
+
+#ifndef BINARY_HELPER_H
+#define BINARY_HELPER_H
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/** Contains helpers for reading and writing binary cache files. */
+namespace binary_help
+{
+    /**
+     * Writes a plain value.
+     * @param out the stream to write to.
+     * @param value the value to write.
+     */
+    template<class T> void write(std::ostream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    /**
+     * Writes a vector of plain values (prefixed by its size).
+     * @param out the stream to write to.
+     * @param values the values to write.
+     */
+    template<class T> void writeVector(std::ostream& out, const std::vector<T>& values)
+    {
+        write(out, static_cast<std::uint64_t>(values.size()));
+        if (!values.empty()) out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    /**
+     * Writes a string (prefixed by its size).
+     * @param out the stream to write to.
+     * @param str the string to write.
+     */
+    inline void writeString(std::ostream& out, const std::string& str)
+    {
+        write(out, static_cast<std::uint64_t>(str.size()));
+        out.write(str.data(), str.size());
+    }
+
+    /**
+     * Reads a plain value.
+     * @param p the current position, will be advanced behind the value.
+     * @param end the end of the data.
+     * @param value the value read.
+     * @throws std::out_of_range if the data is too short.
+     */
+    template<class T> void read(const char*& p, const char* end, T& value)
+    {
+        if (static_cast<std::size_t>(end - p) < sizeof(T)) throw std::out_of_range("Binary data truncated.");
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+    }
+
+    /**
+     * Reads a vector of plain values (prefixed by its size).
+     * @param p the current position, will be advanced behind the values.
+     * @param end the end of the data.
+     * @param values the values read.
+     * @throws std::out_of_range if the data is too short.
+     */
+    template<class T> void readVector(const char*& p, const char* end, std::vector<T>& values)
+    {
+        std::uint64_t size;
+        read(p, end, size);
+        if (static_cast<std::uint64_t>(end - p) / sizeof(T) < size) throw std::out_of_range("Binary data truncated.");
+        values.resize(static_cast<std::size_t>(size));
+        if (size > 0) std::memcpy(values.data(), p, values.size() * sizeof(T));
+        p += values.size() * sizeof(T);
+    }
+
+    /**
+     * Reads a string (prefixed by its size).
+     * @param p the current position, will be advanced behind the string.
+     * @param end the end of the data.
+     * @param str the string read.
+     * @throws std::out_of_range if the data is too short.
+     */
+    inline void readString(const char*& p, const char* end, std::string& str)
+    {
+        std::uint64_t size;
+        read(p, end, size);
+        if (static_cast<std::uint64_t>(end - p) < size) throw std::out_of_range("Binary data truncated.");
+        str.assign(p, static_cast<std::size_t>(size));
+        p += str.size();
+    }
+
+    /**
+     * Calculates a 64 bit hash of a stream of data incrementally (not cryptographic, used to detect changed files).
+     * The data is processed in 8 byte words so hashing is bound by memory bandwidth. As the total size is part of the
+     * hash it needs to be known in advance, all blocks but the last need a size divisible by 8.
+     */
+    class ByteHasher
+    {
+    public:
+        /**
+         * Constructor.
+         * @param totalSize the size of all data to hash.
+         */
+        explicit ByteHasher(std::size_t totalSize) : h(0xCBF29CE484222325ull ^ (totalSize * prime)) {}
+
+        /**
+         * Adds a block of data to the hash.
+         * @param data the data to hash.
+         * @param size the size of the data.
+         */
+        void Update(const char* data, std::size_t size)
+        {
+            std::size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                std::uint64_t w;
+                std::memcpy(&w, data + i, 8);
+                h = (h ^ w) * prime;
+                h ^= h >> 29;
+            }
+            for (; i < size; ++i) h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+        }
+
+        /** Returns the hash value of all data added. */
+        std::uint64_t Finish() const { return h ^ (h >> 32); }
+
+    private:
+        static const std::uint64_t prime = 0x9E3779B97F4A7C15ull;
+        /** Holds the current hash state. */
+        std::uint64_t h;
+    };
+
+    /**
+     * Calculates a 64 bit hash of a block of data (not cryptographic, used to detect changed files).
+     * @param data the data to hash.
+     * @param size the size of the data.
+     * @return the hash value.
+     */
+    inline std::uint64_t hashBytes(const char* data, std::size_t size)
+    {
+        ByteHasher hasher(size);
+        hasher.Update(data, size);
+        return hasher.Finish();
+    }
+}
+
+#endif /* BINARY_HELPER_H */
@@ -110,6 +110,25 @@ namespace cguMath {
         return false;
     }
 
+    /**
+     *  Calculates the barycentric coordinates of a point (projected to the triangles plane).
+     *  @param real the floating point type used.
+     *  @param tri the triangle.
+     *  @param p the point.
+     *  @return the weights of the triangles vertices (zero for degenerated triangles).
+     */
+    template<typename real>
+    glm::tvec3<real, glm::highp> barycentricCoordinates(const Tri3<real>& tri, const glm::tvec3<real, glm::highp>& p) {
+        using vec3 = glm::tvec3<real, glm::highp>;
+
+        vec3 tn = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+        real nn = glm::dot(tn, tn);
+        if (nn == static_cast<real>(0)) return vec3(static_cast<real>(0));
+        real b0 = glm::dot(glm::cross(tri[2] - tri[1], p - tri[1]), tn) / nn;
+        real b1 = glm::dot(glm::cross(tri[0] - tri[2], p - tri[2]), tn) / nn;
+        return vec3(b0, b1, static_cast<real>(1) - b0 - b1);
+    }
+
     /**
      *  Tests if a point is inside an AABB2.
      *  @param real the floating point type used.
@@ -217,6 +236,26 @@ namespace cguMath {
         return x + 1;
     }
 
+    /**
+     *  Calculates the 3D Morton code (z-order) of a grid cell.
+     *  @param x the cells x coordinate (10 bits).
+     *  @param y the cells y coordinate (10 bits).
+     *  @param z the cells z coordinate (10 bits).
+     *  @return the 30 bit Morton code.
+     */
+    inline uint32_t mortonCode3(uint32_t x, uint32_t y, uint32_t z)
+    {
+        auto spread = [](uint32_t v) {
+            v &= 0x000003FF;
+            v = (v | (v << 16)) & 0xFF0000FF;
+            v = (v | (v << 8)) & 0x0300F00F;
+            v = (v | (v << 4)) & 0x030C30C3;
+            v = (v | (v << 2)) & 0x09249249;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+    }
+
     /**
      *  Returns the next power of two (even if x is already a power of two).
      *  @param x value to round up.
@@ -0,0 +1,50 @@
+/**
+ * @file   parallel_helper.h
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.16
+ *
+ * @brief  Contains helpers for running independent work on multiple threads.
+ */
+
+#ifndef PARALLEL_HELPER_H
+#define PARALLEL_HELPER_H
+
+#include <future>
+#include <thread>
+#include <vector>
+
+/** Contains helpers for running independent work on multiple threads. */
+namespace parallel_help
+{
+    /**
+     * Returns the number of threads to use.
+     * @param requested the requested number of threads (0 uses all hardware threads).
+     */
+    inline unsigned int numThreads(unsigned int requested)
+    {
+        if (requested != 0) return requested;
+        auto hwThreads = std::thread::hardware_concurrency();
+        return hwThreads == 0 ? 1 : hwThreads;
+    }
+
+    /**
+     * Calls a function for each task index on its own thread and waits for all of them.
+     * The first task is run on the calling thread, exceptions are passed on to the caller.
+     * @param numTasks the number of tasks.
+     * @param fn the function called with the task index.
+     */
+    template<class Fn>
+    void parallelFor(std::size_t numTasks, Fn fn)
+    {
+        if (numTasks == 0) return;
+        std::vector<std::future<void>> tasks;
+        tasks.reserve(numTasks - 1);
+        for (std::size_t i = 1; i < numTasks; ++i) {
+            tasks.push_back(std::async(std::launch::async, [&fn, i]() { fn(i); }));
+        }
+        fn(0);
+        for (auto& task : tasks) task.get();
+    }
+}
+
+#endif /* PARALLEL_HELPER_H */
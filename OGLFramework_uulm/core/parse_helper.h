@@ -0,0 +1,191 @@
+/**
+ * @file   parse_helper.h
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.14
+ *
+ * @brief  Contains locale independent helpers for hand written text parsers.
+ */
+
+#ifndef PARSE_HELPER_H
+#define PARSE_HELPER_H
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/** Contains locale independent helpers for hand written text parsers. */
+namespace parse_help
+{
+    /**
+     * Checks if a character is a blank (whitespace but not a line break).
+     * @param c the character to check.
+     */
+    inline bool isBlank(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    /**
+     * Checks if a character is a decimal digit.
+     * @param c the character to check.
+     */
+    inline bool isDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    /**
+     * Skips all blanks.
+     * @param p the current position.
+     * @param end the end of the text.
+     * @return the first non blank position.
+     */
+    inline const char* skipBlanks(const char* p, const char* end)
+    {
+        while (p != end && isBlank(*p)) ++p;
+        return p;
+    }
+
+    /**
+     * Removes trailing blanks.
+     * @param begin the start of the text.
+     * @param end the end of the text.
+     * @return the new end of the text.
+     */
+    inline const char* trimBlanksBack(const char* begin, const char* end)
+    {
+        while (end != begin && isBlank(*(end - 1))) --end;
+        return end;
+    }
+
+    /**
+     * Finds the end of a token (the next blank).
+     * @param p the current position.
+     * @param end the end of the text.
+     * @return the position after the token.
+     */
+    inline const char* findTokenEnd(const char* p, const char* end)
+    {
+        while (p != end && !isBlank(*p)) ++p;
+        return p;
+    }
+
+    /**
+     * Parses an integer.
+     * @param p the current position, will be advanced behind the integer.
+     * @param end the end of the text.
+     * @param result the parsed value.
+     * @return whether an integer could be parsed (<code>false</code> if it does not fit into an int).
+     */
+    inline bool parseInt(const char*& p, const char* end, int& result)
+    {
+        auto s = p;
+        auto neg = false;
+        if (s != end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+        if (s == end || !isDigit(*s)) return false;
+
+        const auto limit = static_cast<unsigned int>(INT_MAX) + (neg ? 1u : 0u);
+        auto value = 0u;
+        for (; s != end && isDigit(*s); ++s) {
+            auto digit = static_cast<unsigned int>(*s - '0');
+            if (value > (limit - digit) / 10) return false;
+            value = value * 10 + digit;
+        }
+        result = neg && value != 0 ? -static_cast<int>(value - 1) - 1 : static_cast<int>(value);
+        p = s;
+        return true;
+    }
+
+    /**
+     * Parses a floating point value (with optional exponent).
+     * Values with up to 19 significant digits, a mantissa exactly representable as double and small
+     * exponents are converted in double precision without the C library. The remaining cases (and the
+     * few values where rounding the double to float again is ambiguous) fall back to <code>strtof</code>.
+     * @param p the current position, will be advanced behind the value.
+     * @param end the end of the text.
+     * @param result the parsed value.
+     * @return whether a value could be parsed.
+     */
+    inline bool parseFloat(const char*& p, const char* end, float& result)
+    {
+        static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        const std::uint64_t maxExactMantissa = 1ull << 53;
+
+        auto s = p;
+        auto neg = false;
+        if (s != end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+
+        std::uint64_t mantissa = 0;
+        auto exponent = 0;
+        auto numDigits = 0;
+        auto hasDigits = false;
+        auto exact = true;
+        for (; s != end && isDigit(*s); ++s) {
+            hasDigits = true;
+            if (numDigits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                if (mantissa != 0) ++numDigits;
+            } else {
+                ++exponent;
+                exact = false;
+            }
+        }
+        if (s != end && *s == '.') {
+            for (++s; s != end && isDigit(*s); ++s) {
+                hasDigits = true;
+                if (numDigits < 19) {
+                    mantissa = mantissa * 10 + (*s - '0');
+                    if (mantissa != 0) ++numDigits;
+                    --exponent;
+                } else {
+                    exact = false;
+                }
+            }
+        }
+        if (!hasDigits) return false;
+
+        auto expValue = 0;
+        if (s != end && (*s == 'e' || *s == 'E')) {
+            auto e = s + 1;
+            if (!parseInt(e, end, expValue)) return false;
+            exponent += expValue;
+            s = e;
+        }
+
+        if (exact && mantissa <= maxExactMantissa && exponent >= -22 && exponent <= 22) {
+            // both operands are exact so the double result is correctly rounded. Rounding it to float again is
+            // only wrong if it lies exactly between two floats (the 29 bits dropped are 100...0).
+            auto value = static_cast<double>(mantissa);
+            value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+            std::uint64_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            const std::uint64_t droppedMask = (1ull << 29) - 1;
+            if ((bits & droppedMask) != (1ull << 28)) {
+                result = static_cast<float>(neg ? -value : value);
+                p = s;
+                return true;
+            }
+        }
+
+        // the decimal point depends on the locale, so pass the digits only and move it into the exponent.
+        std::string token;
+        auto fractionDigits = 0ll;
+        auto inFraction = false;
+        if (neg) token.push_back('-');
+        for (auto c = p; c != s && *c != 'e' && *c != 'E'; ++c) {
+            if (isDigit(*c)) {
+                token.push_back(*c);
+                if (inFraction) ++fractionDigits;
+            } else if (*c == '.') inFraction = true;
+        }
+        token += "e" + std::to_string(static_cast<long long>(expValue) - fractionDigits);
+        result = std::strtof(token.c_str(), nullptr);
+        p = s;
+        return true;
+    }
+}
+
+#endif /* PARSE_HELPER_H */
@@ -171,6 +171,17 @@ namespace cgu {
         return std::move(CalcViewFrustum(mvp));
     }
 
+    /**
+     *  Calculates the view frustum for a different view (e.g. a predicted camera) with this cameras projection.
+     *  @param modelM the model matrix.
+     *  @param viewM the view matrix.
+     */
+    cguMath::Frustum<float> CameraView::GetViewFrustum(const glm::mat4& modelM, const glm::mat4& viewM) const
+    {
+        auto mvp = perspective * viewM * modelM;
+        return std::move(CalcViewFrustum(mvp));
+    }
+
     cguMath::Frustum<float> CameraView::CalcViewFrustum(const glm::mat4& m) const
     {
         cguMath::Frustum<float> f;
@@ -50,6 +50,7 @@ namespace cgu {
         void UpdateCamera();
         const glm::mat4& GetViewMatrix() const { return view; }
         cguMath::Frustum<float> GetViewFrustum(const glm::mat4& modelM) const;
+        cguMath::Frustum<float> GetViewFrustum(const glm::mat4& modelM, const glm::mat4& viewM) const;
         const glm::vec3& GetPosition() const { return camPos; }
         float GetSignedDistanceToUnitAABB2(const glm::mat4& world) const;
         float GetFOV() const { return fovY; }
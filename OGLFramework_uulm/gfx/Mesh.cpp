@@ -10,11 +10,10 @@
 
 #include "Mesh.h"
 #include "core/math/math.h"
+#include "core/binary_helper.h"
+#include "core/parallel_helper.h"
 
-#include <boost/geometry/geometries/point.hpp>
-#include <boost/geometry/geometries/box.hpp>
-#include <boost/geometry/geometries/polygon.hpp>
-#include <boost/geometry/index/rtree.hpp>
+#include <algorithm>
 
 #undef min
 #undef max
@@ -22,6 +21,265 @@
 
 namespace cgu {
 
+    /** Holds the version of the binary mesh layout, increase this on every change to it. */
+    const std::uint32_t binaryMeshVersion = 2;
+    /** Marks a material chunk without material in the binary layout. */
+    const std::uint32_t binaryNoMaterial = 0xFFFFFFFF;
+
+    /**
+     * Writes a sub-meshes data in binary form.
+     * @param out the stream to write to.
+     * @param submesh the sub-mesh to write.
+     * @param materials the materials table used to reference the chunks materials.
+     */
+    void writeSubMeshBinary(std::ostream& out, const SubMesh& submesh, const std::vector<const Material*>& materials)
+    {
+        binary_help::writeString(out, submesh.objectName);
+        binary_help::write(out, static_cast<std::uint8_t>(submesh.lineHasTexture));
+        binary_help::write(out, static_cast<std::uint8_t>(submesh.faceHasTexture));
+        binary_help::write(out, static_cast<std::uint8_t>(submesh.faceHasNormal));
+        binary_help::writeVector(out, submesh.pointIndices);
+        binary_help::writeVector(out, submesh.lineIndices);
+        binary_help::writeVector(out, submesh.faceIndices);
+
+        binary_help::write(out, static_cast<std::uint64_t>(submesh.mtlChunks.size()));
+        for (const auto& chunk : submesh.mtlChunks) {
+            auto matIt = std::find(materials.begin(), materials.end(), chunk.material);
+            binary_help::write(out, matIt == materials.end() ? binaryNoMaterial
+                : static_cast<std::uint32_t>(matIt - materials.begin()));
+            std::array<unsigned int, 6> seq{ { chunk.point_seq_begin, chunk.point_seq_num,
+                chunk.line_seq_begin, chunk.line_seq_num, chunk.face_seq_begin, chunk.face_seq_num } };
+            binary_help::write(out, seq);
+        }
+
+        binary_help::write(out, submesh.firstTriIndex);
+        binary_help::write(out, submesh.numTriangles);
+        binary_help::write(out, submesh.aabb.minmax);
+    }
+
+    /**
+     * Reads a sub-meshes data in binary form (the object name has to be read before).
+     * @param data the current position in the data, will be advanced.
+     * @param dataEnd the end of the data.
+     * @param submesh the sub-mesh to read.
+     * @param materials the materials table used to resolve the chunks materials.
+     */
+    void readSubMeshBinary(const char*& data, const char* dataEnd, SubMesh& submesh,
+        const std::vector<const Material*>& materials)
+    {
+        std::uint8_t flag;
+        binary_help::read(data, dataEnd, flag);
+        submesh.lineHasTexture = flag != 0;
+        binary_help::read(data, dataEnd, flag);
+        submesh.faceHasTexture = flag != 0;
+        binary_help::read(data, dataEnd, flag);
+        submesh.faceHasNormal = flag != 0;
+        binary_help::readVector(data, dataEnd, submesh.pointIndices);
+        binary_help::readVector(data, dataEnd, submesh.lineIndices);
+        binary_help::readVector(data, dataEnd, submesh.faceIndices);
+
+        std::uint64_t numChunks;
+        binary_help::read(data, dataEnd, numChunks);
+        submesh.mtlChunks.clear();
+        for (std::uint64_t i = 0; i < numChunks; ++i) {
+            std::uint32_t matIdx;
+            std::array<unsigned int, 6> seq;
+            binary_help::read(data, dataEnd, matIdx);
+            binary_help::read(data, dataEnd, seq);
+            SubMeshMaterialChunk chunk(matIdx < materials.size() ? materials[matIdx] : nullptr);
+            chunk.point_seq_begin = seq[0];
+            chunk.point_seq_num = seq[1];
+            chunk.line_seq_begin = seq[2];
+            chunk.line_seq_num = seq[3];
+            chunk.face_seq_begin = seq[4];
+            chunk.face_seq_num = seq[5];
+            submesh.mtlChunks.push_back(chunk);
+        }
+
+        binary_help::read(data, dataEnd, submesh.firstTriIndex);
+        binary_help::read(data, dataEnd, submesh.numTriangles);
+        binary_help::read(data, dataEnd, submesh.aabb.minmax);
+    }
+
+    /**
+     * Checks if all indices of a list are below a bound.
+     * @param indices the (unsigned) indices to check.
+     * @param bound the number of elements the indices refer to.
+     */
+    template<typename C> bool indicesBelow(const C& indices, std::size_t bound)
+    {
+        return std::all_of(indices.begin(), indices.end(),
+            [bound](typename C::value_type i) { return static_cast<std::size_t>(i) < bound; });
+    }
+
+    /**
+     * Checks if a range [begin, begin + num) lies within [0, size) without overflowing.
+     * @param begin the first element of the range.
+     * @param num the number of elements in the range.
+     * @param size the number of elements available.
+     */
+    inline bool rangeWithin(unsigned int begin, unsigned int num, std::size_t size)
+    {
+        return static_cast<std::uint64_t>(begin) + num <= size;
+    }
+
+    /**
+     * Validates the indices of a sub-mesh read in binary form against the meshes data.
+     * @param submesh the sub-mesh to validate.
+     * @param mesh the mesh holding the vertex data and triangles.
+     * @throws std::out_of_range if an index or range is out of bounds.
+     */
+    void validateSubMeshBinary(const SubMesh& submesh, const Mesh& mesh)
+    {
+        if (!indicesBelow(submesh.pointIndices, mesh.vertices.size())
+            || !indicesBelow(submesh.lineIndices, mesh.lineVertices.size())
+            || !indicesBelow(submesh.faceIndices, mesh.faceVertices.size())) {
+            throw std::out_of_range("Binary sub-mesh \"" + submesh.objectName + "\" has indices out of bounds.");
+        }
+        if (!rangeWithin(submesh.firstTriIndex, submesh.numTriangles, mesh.triangleConnect.size())) {
+            throw std::out_of_range("Binary sub-mesh \"" + submesh.objectName + "\" triangle range out of bounds.");
+        }
+        for (const auto& chunk : submesh.mtlChunks) {
+            if (!rangeWithin(chunk.point_seq_begin, chunk.point_seq_num, submesh.pointIndices.size())
+                || !rangeWithin(chunk.line_seq_begin, chunk.line_seq_num, submesh.lineIndices.size())
+                || !rangeWithin(chunk.face_seq_begin, chunk.face_seq_num, submesh.faceIndices.size())) {
+                throw std::out_of_range("Binary sub-mesh \"" + submesh.objectName + "\" material range out of bounds.");
+            }
+        }
+    }
+
+    /**
+     * Holds a half-edge used for building the triangle connectivity.
+     * @internal
+     */
+    struct ConnectHalfEdge
+    {
+        /** Holds the edges key (the smaller vertex index in the upper bits). */
+        std::uint64_t key;
+        /** Holds the half-edge index (triangle index * 3 + index of the opposite vertex). */
+        unsigned int halfEdge;
+    };
+
+    /**
+     * Holds a slot in the edge hash table used for pairing half-edges.
+     * @internal
+     */
+    struct ConnectEdgeSlot
+    {
+        /** Holds the first half-edge with this edge (index into the bucket). */
+        unsigned int first;
+        /** Holds the second half-edge with this edge (index into the bucket). */
+        unsigned int second;
+        /** Holds the number of half-edges with this edge. */
+        unsigned int count;
+    };
+
+    /** Holds the minimum number of triangles per task when building the connectivity. */
+    const unsigned int connectMinTrianglesPerTask = 1 << 16;
+
+    /**
+     * Calculates the key of an undirected edge.
+     * @param v0 the first vertex index.
+     * @param v1 the second vertex index.
+     */
+    inline std::uint64_t connectEdgeKey(unsigned int v0, unsigned int v1)
+    {
+        return v0 < v1 ? (static_cast<std::uint64_t>(v0) << 32) | v1 : (static_cast<std::uint64_t>(v1) << 32) | v0;
+    }
+
+    /**
+     * Calculates the bucket of an edge, the upper bits of a multiplicative hash are used.
+     * @param key the edges key.
+     * @param bucketBits the number of bits of the bucket index.
+     */
+    inline std::size_t connectEdgeBucket(std::uint64_t key, unsigned int bucketBits)
+    {
+        if (bucketBits == 0) return 0;
+        return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - bucketBits));
+    }
+
+    /**
+     * Pairs the half-edges of one bucket with an open addressing hash table and sets the triangles neighbors.
+     * Every edge lies in exactly one bucket so buckets can be processed in parallel.
+     * @param halfEdges the half-edges of the bucket (ordered by half-edge index for each edge).
+     * @param numHalfEdges the number of half-edges in the bucket.
+     * @param tris the meshes triangles.
+     * @param nonManifoldEdges the list to add edges with more than two triangles to.
+     */
+    void pairConnectHalfEdges(const ConnectHalfEdge* halfEdges, std::size_t numHalfEdges, MeshConnectTriangle* tris,
+        std::vector<std::array<unsigned int, 2>>& nonManifoldEdges)
+    {
+        const auto emptySlot = 0xFFFFFFFFu;
+        std::size_t tableSize = 1;
+        while (tableSize < 2 * numHalfEdges) tableSize <<= 1;
+        auto mask = tableSize - 1;
+        std::vector<ConnectEdgeSlot> table(tableSize, ConnectEdgeSlot{ emptySlot, emptySlot, 0 });
+
+        for (unsigned int i = 0; i < numHalfEdges; ++i) {
+            auto key = halfEdges[i].key;
+            auto h = key * 0xFF51AFD7ED558CCDull;
+            auto slotIdx = static_cast<std::size_t>(h ^ (h >> 32)) & mask;
+            while (table[slotIdx].first != emptySlot && halfEdges[table[slotIdx].first].key != key) {
+                slotIdx = (slotIdx + 1) & mask;
+            }
+            auto& slot = table[slotIdx];
+            if (slot.count == 0) slot.first = i;
+            else if (slot.count == 1) slot.second = i;
+            ++slot.count;
+        }
+
+        for (const auto& slot : table) {
+            if (slot.count == 2) {
+                auto he0 = halfEdges[slot.first].halfEdge;
+                auto he1 = halfEdges[slot.second].halfEdge;
+                tris[he0 / 3].neighbors[he0 % 3] = static_cast<int>(he1 / 3);
+                tris[he1 / 3].neighbors[he1 % 3] = static_cast<int>(he0 / 3);
+            } else if (slot.count > 2) {
+                auto key = halfEdges[slot.first].key;
+                nonManifoldEdges.push_back({ { static_cast<unsigned int>(key >> 32), static_cast<unsigned int>(key) } });
+            }
+        }
+    }
+
+    /** Holds the number of triangles in a block of the normal calculation. */
+    const std::size_t normalsBlockSize = 256;
+
+    /**
+     * Holds a block of triangles for calculating their corner normals.
+     * The positions and normals are stored as structure of arrays (one row per corner and coordinate) and the rows
+     * are indexed with constants, so the compiler knows they do not overlap and can vectorize without runtime checks.
+     * @internal
+     */
+    struct NormalsBlock
+    {
+        /** Holds the positions of the triangles corners (row 3 * corner + coordinate). */
+        float positions[9][normalsBlockSize];
+        /** Holds the normals of the triangles corners (row 3 * corner + coordinate). */
+        float normals[9][normalsBlockSize];
+    };
+
+    /**
+     * Calculates the (area weighted) normals of one corner for all triangles of a block: the cross product of the two
+     * edges leaving the corner. Rows behind the blocks triangles hold old values and are calculated too.
+     * @tparam VI0 the corner index.
+     * @param block the block of triangles.
+     */
+    template<unsigned int VI0> void calculateCornerNormals(NormalsBlock& block)
+    {
+        const unsigned int p0 = 3 * VI0, p1 = 3 * ((VI0 + 1) % 3), p2 = 3 * ((VI0 + 2) % 3);
+        for (std::size_t j = 0; j < normalsBlockSize; ++j) {
+            auto e0x = block.positions[p1][j] - block.positions[p0][j];
+            auto e0y = block.positions[p1 + 1][j] - block.positions[p0 + 1][j];
+            auto e0z = block.positions[p1 + 2][j] - block.positions[p0 + 2][j];
+            auto e1x = block.positions[p2][j] - block.positions[p0][j];
+            auto e1y = block.positions[p2 + 1][j] - block.positions[p0 + 1][j];
+            auto e1z = block.positions[p2 + 2][j] - block.positions[p0 + 2][j];
+            block.normals[p0][j] = e0y * e1z - e1y * e0z;
+            block.normals[p0 + 1][j] = e0z * e1x - e1z * e0x;
+            block.normals[p0 + 2][j] = e0x * e1y - e1x * e0y;
+        }
+    }
+
     /** Default constructor. */
     Mesh::Mesh() : SubMesh() {}
 
@@ -35,7 +293,9 @@ namespace cgu {
         lineVertices(rhs.lineVertices),
         faceVertices(rhs.faceVertices),
         triangleConnect(rhs.triangleConnect),
-        verticesConnect(rhs.verticesConnect)
+        vertexTriangleOffsets(rhs.vertexTriangleOffsets),
+        vertexTriangles(rhs.vertexTriangles),
+        nonManifoldEdges(rhs.nonManifoldEdges)
     {
         for (const auto& submesh : rhs.subMeshes) {
             auto subMeshPtr = std::make_unique<SubMesh>(*submesh);
@@ -59,7 +319,9 @@ namespace cgu {
         std::swap(subMeshMap, tmp.subMeshMap);
         std::swap(subMeshes, tmp.subMeshes);
         std::swap(triangleConnect, tmp.triangleConnect);
-        std::swap(verticesConnect, tmp.verticesConnect);
+        std::swap(vertexTriangleOffsets, tmp.vertexTriangleOffsets);
+        std::swap(vertexTriangles, tmp.vertexTriangles);
+        std::swap(nonManifoldEdges, tmp.nonManifoldEdges);
         return *this;
     }
 
@@ -75,7 +337,9 @@ namespace cgu {
         subMeshMap(std::move(rhs.subMeshMap)),
         subMeshes(std::move(rhs.subMeshes)),
         triangleConnect(std::move(rhs.triangleConnect)),
-        verticesConnect(std::move(rhs.verticesConnect))
+        vertexTriangleOffsets(std::move(rhs.vertexTriangleOffsets)),
+        vertexTriangles(std::move(rhs.vertexTriangles)),
+        nonManifoldEdges(std::move(rhs.nonManifoldEdges))
     {
     }
 
@@ -94,7 +358,9 @@ namespace cgu {
         subMeshMap = std::move(rhs.subMeshMap);
         subMeshes = std::move(rhs.subMeshes);
         triangleConnect = std::move(rhs.triangleConnect);
-        verticesConnect = std::move(rhs.verticesConnect);
+        vertexTriangleOffsets = std::move(rhs.vertexTriangleOffsets);
+        vertexTriangles = std::move(rhs.vertexTriangles);
+        nonManifoldEdges = std::move(rhs.nonManifoldEdges);
         return *this;
     }
 
@@ -102,21 +368,21 @@ namespace cgu {
     Mesh::~Mesh() = default;
 
     /**
-     * Creates a new SubMesh in the mesh.
+     * Creates a new SubMesh in the mesh or returns the existing one with this name.
+     * Sub-meshes are appended to the sub-mesh list in the order they are created.
      * @param subMeshName the name of the sub-mesh (may be empty, then the data is saved in the mesh itself)
-     * @param countState the counts of the single objects to store
+     * @return the sub-mesh.
      */
-    void Mesh::createSubMesh(const std::string& subMeshName, ObjCountState& countState)
-    {
-        SubMesh* subMesh;
-        if (subMeshName.length() == 0) {
-            subMesh = this;
-        } else {
-            subMesh = new SubMesh(subMeshName);
-            subMeshMap[subMeshName] = std::unique_ptr<SubMesh>(subMesh);
-        }
+    SubMesh* Mesh::createSubMesh(const std::string& subMeshName)
+    {
+        if (subMeshName.length() == 0) return this;
 
-        subMesh->ReserveSubMesh(countState);
+        auto& subMesh = subMeshMap[subMeshName];
+        if (!subMesh) {
+            subMesh = std::make_unique<SubMesh>(subMeshName);
+            subMeshes.push_back(subMesh.get());
+        }
+        return subMesh.get();
     }
 
     /**
@@ -131,11 +397,7 @@ namespace cgu {
         paramVertices.reserve(countState.numParameterVerts);
         lineVertices.reserve(countState.numVerts);
         faceVertices.reserve(countState.numVerts);
-
-        subMeshes.reserve(subMeshMap.size());
-        for (const auto& submesh : subMeshMap) {
-            subMeshes.push_back(submesh.second.get());
-        }
+        ReserveSubMesh(countState);
     }
 
     /**
@@ -144,14 +406,76 @@ namespace cgu {
      */
     unsigned int Mesh::FindContainingTriangle(const glm::vec3 point)
     {
-        auto result = FindContainingTriangleSub(this, point);
+        auto result = FindContainingTriangleAll(point);
         if (result != -1) return result;
+        throw std::out_of_range("Containing triangle not found!");
+    }
 
-        for (auto submesh : subMeshes) {
-            result = FindContainingTriangleSub(submesh, point);
-            if (result != -1) return result;
+    /**
+     *  Finds the triangles containing a batch of points.
+     *  The queries are processed in Morton order of the points so consecutive queries traverse the same parts
+     *  of the hierarchies, and are distributed to threads in contiguous ranges of that order. Each query is
+     *  answered exactly as in FindContainingTriangle.
+     *  @param points the points to find the triangles for.
+     *  @param triangleIds the indices of the triangles containing the points (-1 if there is none).
+     *  @param barycentrics the barycentric coordinates of the points in their triangles (zero if there is none).
+     *  @param numThreads the maximum number of threads to use.
+     */
+    void Mesh::FindContainingTriangles(const std::vector<glm::vec3>& points, std::vector<int>& triangleIds,
+        std::vector<glm::vec3>& barycentrics, unsigned int numThreads) const
+    {
+        const std::size_t minPointsPerTask = 1 << 12;
+        const unsigned int mortonBits = 10;
+        const auto mortonMax = static_cast<float>((1 << mortonBits) - 1);
+        auto numPoints = points.size();
+        triangleIds.resize(numPoints);
+        barycentrics.resize(numPoints);
+        if (numPoints == 0) return;
+
+        auto pMin = points[0], pMax = points[0];
+        for (const auto& p : points) {
+            pMin = glm::min(pMin, p);
+            pMax = glm::max(pMax, p);
         }
-        throw std::out_of_range("Containing triangle not found!");
+        auto extent = pMax - pMin;
+        glm::vec3 gridScale(extent.x > 0.0f ? mortonMax / extent.x : 0.0f, extent.y > 0.0f ? mortonMax / extent.y : 0.0f,
+            extent.z > 0.0f ? mortonMax / extent.z : 0.0f);
+        auto toGrid = [mortonMax](float v) { return v >= 0.0f ? static_cast<std::uint32_t>(std::min(v, mortonMax)) : 0U; };
+        std::vector<std::uint32_t> codes(numPoints);
+        for (std::size_t i = 0; i < numPoints; ++i) {
+            auto c = (points[i] - pMin) * gridScale;
+            codes[i] = cguMath::mortonCode3(toGrid(c.x), toGrid(c.y), toGrid(c.z));
+        }
+
+        // radix sort of the query indices by their Morton codes.
+        std::vector<unsigned int> order(numPoints), sortTmp(numPoints);
+        for (std::size_t i = 0; i < numPoints; ++i) order[i] = static_cast<unsigned int>(i);
+        for (auto shift = 0U; shift < 3 * mortonBits; shift += mortonBits) {
+            std::vector<std::size_t> digitPos((1 << mortonBits) + 1, 0);
+            for (auto i : order) ++digitPos[((codes[i] >> shift) & ((1 << mortonBits) - 1)) + 1];
+            for (std::size_t d = 1; d < digitPos.size(); ++d) digitPos[d] += digitPos[d - 1];
+            for (auto i : order) sortTmp[digitPos[(codes[i] >> shift) & ((1 << mortonBits) - 1)]++] = i;
+            std::swap(order, sortTmp);
+        }
+
+        std::size_t numTasks = numPoints / minPointsPerTask;
+        if (numTasks > numThreads) numTasks = numThreads;
+        if (numTasks == 0) numTasks = 1;
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            for (auto k = (task * numPoints) / numTasks; k < ((task + 1) * numPoints) / numTasks; ++k) {
+                auto i = order[k];
+                auto triId = FindContainingTriangleAll(points[i]);
+                triangleIds[i] = triId;
+                if (triId == -1) {
+                    barycentrics[i] = glm::vec3(0.0f);
+                } else {
+                    const auto& tri = triangleConnect[triId];
+                    cguMath::Tri3<float> triPts{ { vertices[tri.vertex[0]].xyz(), vertices[tri.vertex[1]].xyz(),
+                        vertices[tri.vertex[2]].xyz() } };
+                    barycentrics[i] = cguMath::barycentricCoordinates(triPts, points[i]);
+                }
+            }
+        });
     }
 
     /**
@@ -168,112 +492,321 @@ namespace cgu {
     }
 
     /**
-     *  Creates the meshes geometry information and acceleration structures.
+     *  Writes the mesh including sub-meshes, material chunks, bounding boxes and connectivity in binary form.
+     *  The search trees are not written but rebuilt on reading.
+     *  @param out the stream to write to.
+     *  @param materials the materials table used to reference the material chunks materials.
      */
-    void Mesh::CreateGeomertyInfo()
+    void Mesh::WriteBinary(std::ostream& out, const std::vector<const Material*>& materials) const
     {
-        verticesConnect.resize(vertices.size());
-        unsigned int cid = 0;
-        for (auto& vc : verticesConnect) {
-            vc.idx = cid++;
+        binary_help::write(out, binaryMeshVersion);
+        binary_help::writeVector(out, vertices);
+        binary_help::writeVector(out, texCoords);
+        binary_help::writeVector(out, normals);
+        binary_help::writeVector(out, paramVertices);
+        binary_help::writeVector(out, lineVertices);
+        binary_help::writeVector(out, faceVertices);
+        binary_help::writeVector(out, triangleConnect);
+        binary_help::writeVector(out, vertexTriangleOffsets);
+        binary_help::writeVector(out, vertexTriangles);
+        binary_help::writeVector(out, nonManifoldEdges);
+
+        writeSubMeshBinary(out, *this, materials);
+        binary_help::write(out, static_cast<std::uint64_t>(subMeshes.size()));
+        for (const auto submesh : subMeshes) writeSubMeshBinary(out, *submesh, materials);
+    }
+
+    /**
+     *  Reads the mesh from its binary form (see WriteBinary) and rebuilds the search trees.
+     *  @param data the current position in the data, will be advanced.
+     *  @param dataEnd the end of the data.
+     *  @param materials the materials table used to resolve the material chunks materials.
+     *  @throws std::out_of_range if the data is truncated or an index or range is out of bounds.
+     *  @throws std::runtime_error if the data has a different version.
+     */
+    void Mesh::ReadBinary(const char*& data, const char* dataEnd, const std::vector<const Material*>& materials)
+    {
+        std::uint32_t version;
+        binary_help::read(data, dataEnd, version);
+        if (version != binaryMeshVersion) throw std::runtime_error("Binary mesh version mismatch.");
+
+        binary_help::readVector(data, dataEnd, vertices);
+        binary_help::readVector(data, dataEnd, texCoords);
+        binary_help::readVector(data, dataEnd, normals);
+        binary_help::readVector(data, dataEnd, paramVertices);
+        binary_help::readVector(data, dataEnd, lineVertices);
+        binary_help::readVector(data, dataEnd, faceVertices);
+        binary_help::readVector(data, dataEnd, triangleConnect);
+        binary_help::readVector(data, dataEnd, vertexTriangleOffsets);
+        binary_help::readVector(data, dataEnd, vertexTriangles);
+        binary_help::readVector(data, dataEnd, nonManifoldEdges);
+        if (vertexTriangleOffsets.size() != vertices.size() + 1 || vertexTriangleOffsets.back() != vertexTriangles.size()
+            || !std::is_sorted(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end())
+            || !indicesBelow(vertexTriangles, triangleConnect.size())) {
+            throw std::out_of_range("Binary mesh connectivity corrupted.");
+        }
+        for (const auto& tri : triangleConnect) {
+            auto validNeighbor = [this](int n) { return n >= -1 && n < static_cast<std::int64_t>(triangleConnect.size()); };
+            if (!indicesBelow(tri.vertex, vertices.size()) || !indicesBelow(tri.faceVertex, faceVertices.size())
+                || !std::all_of(tri.neighbors.begin(), tri.neighbors.end(), validNeighbor)) {
+                throw std::out_of_range("Binary mesh triangles corrupted.");
+            }
+        }
+        for (const auto& edge : nonManifoldEdges) {
+            if (!indicesBelow(edge, vertices.size())) throw std::out_of_range("Binary mesh connectivity corrupted.");
         }
 
+        binary_help::readString(data, dataEnd, objectName);
+        readSubMeshBinary(data, dataEnd, *this, materials);
+        std::uint64_t numSubMeshes;
+        binary_help::read(data, dataEnd, numSubMeshes);
+        for (std::uint64_t i = 0; i < numSubMeshes; ++i) {
+            std::string submeshName;
+            binary_help::readString(data, dataEnd, submeshName);
+            readSubMeshBinary(data, dataEnd, *createSubMesh(submeshName), materials);
+        }
+
+        validateSubMeshBinary(*this, *this);
+        for (const auto submesh : subMeshes) validateSubMeshBinary(*submesh, *this);
+        CreateTriangleSets(this);
+        CreateBVH(this);
+        for (auto submesh : subMeshes) {
+            CreateTriangleSets(submesh);
+            CreateBVH(submesh);
+        }
+    }
+
+    /**
+     *  Creates the meshes geometry information and acceleration structures.
+     *  @param numThreads the maximum number of threads to use.
+     */
+    void Mesh::CreateGeomertyInfo(unsigned int numThreads)
+    {
+        triangleConnect.clear();
+        nonManifoldEdges.clear();
         CreateGeomertyInfoSub(this);
 
         for (auto submesh : subMeshes) {
             CreateGeomertyInfoSub(submesh);
         }
+        CreateConnectivity(numThreads);
+        CreateVertexConnectivity();
+        std::sort(nonManifoldEdges.begin(), nonManifoldEdges.end());
     }
 
     /**
-     *  Find index of triangle that contains the given point.
-     *  @param submesh the sub mesh to find the triangle in.
+     *  Find index of triangle that contains the given point in the mesh or any sub mesh.
      *  @param point the point to find the triangle for.
+     *  @return the triangles index or -1 if no triangle contains the point.
      */
-    int Mesh::FindContainingTriangleSub(const SubMesh* submesh, const glm::vec3 pt)
+    int Mesh::FindContainingTriangleAll(const glm::vec3& point) const
     {
-        if (!cguMath::pointInAABB3Test(submesh->aabb, pt)) return -1;
+        auto result = FindContainingTriangleSub(this, point);
+        if (result != -1) return result;
 
-        std::vector<polyIdxBox> hits;
-        namespace bg = boost::geometry;
-        submesh->fastFindTree.query(bg::index::contains(point(pt.x, pt.y, pt.z)), std::back_inserter(hits));
-        for (const auto& polyBox : hits) {
-            auto triId = polyBox.second;
-            cguMath::Tri3<float> tri{ { vertices[triangleConnect[triId].vertex[0]].xyz(),
-                vertices[triangleConnect[triId].vertex[1]].xyz(), vertices[triangleConnect[triId].vertex[2]].xyz() } };
-            if (cguMath::pointInTriangleTest<float>(tri, pt, nullptr)) return triId;
+        for (auto submesh : subMeshes) {
+            result = FindContainingTriangleSub(submesh, point);
+            if (result != -1) return result;
         }
         return -1;
     }
 
     /**
-     *  Creates the meshes geometry information and acceleration structures.
-     *  @param submesh the sub mesh to create geometry information for.
+     *  Find index of triangle that contains the given point.
+     *  @param submesh the sub mesh to find the triangle in.
+     *  @param point the point to find the triangle for.
      */
-    void Mesh::CreateGeomertyInfoSub(SubMesh* submesh)
+    int Mesh::FindContainingTriangleSub(const SubMesh* submesh, const glm::vec3 pt) const
     {
-        CreateAABB(submesh);
-        CreateConnectivity(submesh);
-        CreateRTree(submesh);
+        if (!cguMath::pointInAABB3Test(submesh->aabb, pt)) return -1;
+        return submesh->fastFindTree.FindContainingTriangle(pt);
     }
 
     /**
-     *  Creates the sub meshes connectivity.
-     *  @param submesh the sub mesh to create the connectivity for.
+     *  Creates the sub meshes geometry information and acceleration structures and appends its triangles to the
+     *  meshes triangle list.
+     *  @param submesh the sub mesh to create geometry information for.
      */
-    void Mesh::CreateConnectivity(SubMesh* submesh)
+    void Mesh::CreateGeomertyInfoSub(SubMesh* submesh)
     {
+        CreateAABB(submesh);
         submesh->firstTriIndex = static_cast<unsigned int>(triangleConnect.size());
         submesh->numTriangles = static_cast<unsigned int>(submesh->trianglePtsIndices.size());
         triangleConnect.insert(triangleConnect.end(), submesh->trianglePtsIndices.begin(), submesh->trianglePtsIndices.end());
+        CreateBVH(submesh);
+    }
 
-        // set vertex connectivity
-        for (auto i = submesh->firstTriIndex; i < submesh->firstTriIndex + submesh->numTriangles; ++i) {
-            auto& tri = triangleConnect[i];
-            verticesConnect[tri.vertex[0]].triangles.push_back(i);
-            verticesConnect[tri.vertex[1]].triangles.push_back(i);
-            verticesConnect[tri.vertex[2]].triangles.push_back(i);
+    /**
+     *  Creates the triangle connectivity of the whole mesh in linear time.
+     *  The three half-edges of each triangle are distributed to buckets by the hash of their (undirected) edge,
+     *  then the half-edges of each bucket are paired using a hash table. Triangle ranges and buckets are
+     *  processed in parallel, the result does not depend on the number of threads.
+     *  Neighbors are searched in all sub meshes (as the former per vertex triangle lists did), but unlike these
+     *  lists the result is symmetric: a triangle also finds neighbors in sub meshes created after its own.
+     *  Edges with more than two triangles are non-manifold, they get no neighbors and are recorded.
+     *  @param numThreads the maximum number of threads to use.
+     */
+    void Mesh::CreateConnectivity(unsigned int numThreads)
+    {
+        if (triangleConnect.empty()) return;
+
+        auto tris = triangleConnect.data();
+        auto numTris = static_cast<unsigned int>(triangleConnect.size());
+        std::size_t numTasks = numTris / connectMinTrianglesPerTask;
+        if (numTasks > numThreads) numTasks = numThreads;
+        if (numTasks == 0) numTasks = 1;
+        auto bucketBits = 0U;
+        while ((std::size_t(1) << bucketBits) < 4 * numTasks && numTasks > 1) ++bucketBits;
+        std::size_t numBuckets = std::size_t(1) << bucketBits;
+        auto taskTriBegin = [numTris, numTasks](std::size_t task) {
+            return static_cast<unsigned int>((task * numTris) / numTasks);
+        };
+
+        // count the half-edges per task and bucket.
+        std::vector<std::size_t> bucketPos(numTasks * numBuckets, 0);
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            auto counts = bucketPos.data() + task * numBuckets;
+            for (auto i = taskTriBegin(task); i < taskTriBegin(task + 1); ++i) {
+                for (unsigned int ni = 0; ni < 3; ++ni) {
+                    auto key = connectEdgeKey(tris[i].vertex[(ni + 1) % 3], tris[i].vertex[(ni + 2) % 3]);
+                    ++counts[connectEdgeBucket(key, bucketBits)];
+                }
+            }
+        });
+
+        // bucket major prefix sum so each bucket is stored contiguously and in triangle order.
+        std::vector<std::size_t> bucketStart(numBuckets + 1, 0);
+        std::size_t halfEdgePos = 0;
+        for (std::size_t b = 0; b < numBuckets; ++b) {
+            bucketStart[b] = halfEdgePos;
+            for (std::size_t task = 0; task < numTasks; ++task) {
+                auto count = bucketPos[task * numBuckets + b];
+                bucketPos[task * numBuckets + b] = halfEdgePos;
+                halfEdgePos += count;
+            }
         }
-
-        // set triangle neighbors
-        for (auto i = submesh->firstTriIndex; i < submesh->firstTriIndex + submesh->numTriangles; ++i) {
-            auto& tri = triangleConnect[i];
-            for (unsigned int ni = 0; ni < 3; ++ni) {
-                auto vi0 = tri.vertex[(ni + 1) % 3];
-                auto vi1 = tri.vertex[(ni + 2) % 3];
-                std::vector<unsigned int> isect;
-                std::set_intersection(verticesConnect[vi0].triangles.begin(), verticesConnect[vi0].triangles.end(),
-                    verticesConnect[vi1].triangles.begin(), verticesConnect[vi1].triangles.end(), std::back_inserter(isect));
-                // if the mesh is planar and has borders only ONE triangle may be found!!!
-                // this triangle is the triangle itself not its neighbor
-                assert(isect.size() <= 2); // both this triangle and the neighbor should be found
-                if (isect.size() == 2) {
-                    tri.neighbors[ni] = isect[0] == i ? isect[1] : isect[0];
-                } else {
-                    tri.neighbors[ni] = -1;
+        bucketStart[numBuckets] = halfEdgePos;
+
+        std::vector<ConnectHalfEdge> halfEdges(halfEdgePos);
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            auto writePos = bucketPos.data() + task * numBuckets;
+            for (auto i = taskTriBegin(task); i < taskTriBegin(task + 1); ++i) {
+                for (unsigned int ni = 0; ni < 3; ++ni) {
+                    auto key = connectEdgeKey(tris[i].vertex[(ni + 1) % 3], tris[i].vertex[(ni + 2) % 3]);
+                    halfEdges[writePos[connectEdgeBucket(key, bucketBits)]++] = ConnectHalfEdge{ key, i * 3 + ni };
                 }
             }
+        });
+
+        std::vector<std::vector<std::array<unsigned int, 2>>> taskNonManifoldEdges(numTasks);
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            for (auto b = task; b < numBuckets; b += numTasks) {
+                pairConnectHalfEdges(halfEdges.data() + bucketStart[b], bucketStart[b + 1] - bucketStart[b],
+                    tris, taskNonManifoldEdges[task]);
+            }
+        });
+        for (const auto& edges : taskNonManifoldEdges) {
+            nonManifoldEdges.insert(nonManifoldEdges.end(), edges.begin(), edges.end());
         }
     }
 
     /**
-     *  Calculates the meshes normals.
+     *  Creates the list of triangles for each vertex (as compressed rows) from the triangle connectivity.
      */
-    void Mesh::CalculateNormals()
-    {
-        for (const auto& tc : triangleConnect) {
-            for (unsigned int vi0 = 0; vi0 < 3; ++vi0) {
-                auto vi1 = (vi0 + 1) % 3;
-                auto vi2 = (vi0 + 2) % 3;
-                auto v0 = vertices[tc.vertex[vi1]].xyz - vertices[tc.vertex[vi0]].xyz;
-                auto v1 = vertices[tc.vertex[vi2]].xyz - vertices[tc.vertex[vi0]].xyz;
-                faceVertices[tc.faceVertex[vi0]].normal += glm::cross(v0, v1);
-            }
+    void Mesh::CreateVertexConnectivity()
+    {
+        vertexTriangleOffsets.assign(vertices.size() + 1, 0);
+        for (const auto& tri : triangleConnect) {
+            for (auto vi : tri.vertex) ++vertexTriangleOffsets[vi + 1];
+        }
+        for (std::size_t i = 1; i < vertexTriangleOffsets.size(); ++i) {
+            vertexTriangleOffsets[i] += vertexTriangleOffsets[i - 1];
         }
 
-        for (auto& fv : faceVertices) {
-            fv.normal = glm::normalize(fv.normal);
+        vertexTriangles.resize(vertexTriangleOffsets.back());
+        std::vector<unsigned int> fillPos(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+        for (unsigned int i = 0; i < triangleConnect.size(); ++i) {
+            for (auto vi : triangleConnect[i].vertex) vertexTriangles[fillPos[vi]++] = i;
         }
+    }
+
+    /**
+     *  Calculates the meshes normals.
+     *  The (area weighted) normals of all triangle corners are calculated on blocks of triangles: the positions of
+     *  a blocks triangles are gathered into a NormalsBlock, so the cross products run over contiguous arrays
+     *  without indirection and are vectorized by the compiler. Then each face vertex
+     *  gathers the normals of its corners using the vertex connectivity, in triangle order. As each face vertex
+     *  belongs to one position only, threads working on different positions never write the same face vertex and
+     *  the result does not depend on the number of threads.
+     *  @param numThreads the maximum number of threads to use.
+     */
+    void Mesh::CalculateNormals(unsigned int numThreads)
+    {
+        const std::size_t minVerticesPerTask = 1 << 16;
+        auto numVertices = vertices.size();
+        auto numTris = triangleConnect.size();
+        std::size_t numTasks = std::max(numVertices, numTris) / minVerticesPerTask;
+        if (numTasks > numThreads) numTasks = numThreads;
+        if (numTasks == 0) numTasks = 1;
+        auto taskRange = [numTasks](std::size_t task, std::size_t size) { return (task * size) / numTasks; };
+
+        // corner normals (cross product of the two edges leaving the corner), stored per corner index.
+        std::vector<float> cornerX(3 * numTris), cornerY(3 * numTris), cornerZ(3 * numTris);
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            auto block = std::make_unique<NormalsBlock>();
+            auto taskEnd = taskRange(task + 1, numTris);
+            for (auto blockBegin = taskRange(task, numTris); blockBegin < taskEnd; blockBegin += normalsBlockSize) {
+                auto blockSize = std::min(normalsBlockSize, taskEnd - blockBegin);
+                for (std::size_t j = 0; j < blockSize; ++j) {
+                    const auto& tv = triangleConnect[blockBegin + j].vertex;
+                    for (unsigned int vi = 0; vi < 3; ++vi) {
+                        const auto& p = vertices[tv[vi]];
+                        block->positions[3 * vi][j] = p.x;
+                        block->positions[3 * vi + 1][j] = p.y;
+                        block->positions[3 * vi + 2][j] = p.z;
+                    }
+                }
+
+                calculateCornerNormals<0>(*block);
+                calculateCornerNormals<1>(*block);
+                calculateCornerNormals<2>(*block);
+                for (unsigned int vi = 0; vi < 3; ++vi) {
+                    auto corner = vi * numTris + blockBegin;
+                    std::copy_n(block->normals[3 * vi], blockSize, cornerX.begin() + corner);
+                    std::copy_n(block->normals[3 * vi + 1], blockSize, cornerY.begin() + corner);
+                    std::copy_n(block->normals[3 * vi + 2], blockSize, cornerZ.begin() + corner);
+                }
+            }
+        });
+
+        auto numFaceVertices = faceVertices.size();
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            for (auto i = taskRange(task, numFaceVertices); i < taskRange(task + 1, numFaceVertices); ++i) {
+                faceVertices[i].normal = glm::vec3(0.0f);
+            }
+        });
+
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            for (auto v = taskRange(task, numVertices); v < taskRange(task + 1, numVertices); ++v) {
+                for (auto k = vertexTriangleOffsets[v]; k < vertexTriangleOffsets[v + 1]; ++k) {
+                    auto t = vertexTriangles[k];
+                    // degenerated triangles are listed once per corner at this vertex.
+                    if (k > vertexTriangleOffsets[v] && vertexTriangles[k - 1] == t) continue;
+                    const auto& tc = triangleConnect[t];
+                    for (unsigned int vi0 = 0; vi0 < 3; ++vi0) {
+                        if (tc.vertex[vi0] != v) continue;
+                        auto c = vi0 * numTris + t;
+                        faceVertices[tc.faceVertex[vi0]].normal += glm::vec3(cornerX[c], cornerY[c], cornerZ[c]);
+                    }
+                }
+            }
+        });
+
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            for (auto i = taskRange(task, numFaceVertices); i < taskRange(task + 1, numFaceVertices); ++i) {
+                faceVertices[i].normal = glm::normalize(faceVertices[i].normal);
+            }
+        });
 
         faceHasNormal = true;
     }
@@ -284,9 +817,9 @@ namespace cgu {
      */
     void Mesh::CreateAABB(SubMesh* submesh)
     {
-        if (trianglePtsIndices.empty()) return;
-        submesh->aabb.minmax[0] = submesh->aabb.minmax[1] = vertices[trianglePtsIndices.begin()->vertex[0]].xyz();
-        for (const auto& tri : trianglePtsIndices) {
+        if (submesh->trianglePtsIndices.empty()) return;
+        submesh->aabb.minmax[0] = submesh->aabb.minmax[1] = vertices[submesh->trianglePtsIndices.front().vertex[0]].xyz();
+        for (const auto& tri : submesh->trianglePtsIndices) {
             for (auto vi : tri.vertex) {
                 submesh->aabb.minmax[0] = glm::min(submesh->aabb.minmax[0], vertices[vi].xyz());
                 submesh->aabb.minmax[1] = glm::max(submesh->aabb.minmax[1], vertices[vi].xyz());
@@ -295,19 +828,29 @@ namespace cgu {
     }
 
     /**
-     *  Creates the sub meshes r-tree for faster point in triangle tests.
-     *  @param submesh the sub mesh to create the tree for.
+     *  Refills the sub meshes triangle list from the connectivity information.
+     *  @param submesh the sub mesh to fill the triangle list for.
      */
-    void Mesh::CreateRTree(SubMesh* submesh)
+    void Mesh::CreateTriangleSets(SubMesh* submesh)
     {
-        for (auto i = submesh->firstTriIndex; i < submesh->firstTriIndex + submesh->numTriangles; ++i) {
-            polygon poly;
-            for (unsigned int vi = 0; vi < 3; ++vi) {
-                auto vpt = vertices[triangleConnect[i].vertex[vi]].xyz();
-                poly.outer().push_back(point(vpt.x, vpt.y, vpt.z));
-            }
-            auto b = boost::geometry::return_envelope<box>(poly);
-            submesh->fastFindTree.insert(std::make_pair(b, i));
+        if (submesh->firstTriIndex + submesh->numTriangles > triangleConnect.size()) {
+            throw std::out_of_range("Sub mesh triangle range out of bounds.");
+        }
+        auto first = triangleConnect.begin() + submesh->firstTriIndex;
+        submesh->trianglePtsIndices.assign(first, first + submesh->numTriangles);
+    }
+
+    /**
+     *  Creates the sub meshes bounding volume hierarchy for faster point in triangle tests.
+     *  @param submesh the sub mesh to create the hierarchy for.
+     */
+    void Mesh::CreateBVH(SubMesh* submesh)
+    {
+        std::vector<cguMath::Tri3<float>> tris(submesh->numTriangles);
+        for (unsigned int i = 0; i < submesh->numTriangles; ++i) {
+            const auto& tri = triangleConnect[submesh->firstTriIndex + i];
+            tris[i] = { { vertices[tri.vertex[0]].xyz(), vertices[tri.vertex[1]].xyz(), vertices[tri.vertex[2]].xyz() } };
         }
+        submesh->fastFindTree.Build(std::move(tris), submesh->firstTriIndex);
     }
 }
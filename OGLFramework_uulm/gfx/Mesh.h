@@ -11,6 +11,7 @@
 
 #include "Vertices.h"
 #include "SubMesh.h"
+#include <iosfwd>
 
 namespace cgu {
 
@@ -30,11 +31,16 @@ namespace cgu {
         Mesh& operator=(Mesh&&);
         ~Mesh();
 
-        void createSubMesh(const std::string& subMeshName, ObjCountState& countState);
+        SubMesh* createSubMesh(const std::string& subMeshName);
         void ReserveMesh(ObjCountState& countState);
         unsigned int FindContainingTriangle(const glm::vec3 point);
+        void FindContainingTriangles(const std::vector<glm::vec3>& points, std::vector<int>& triangleIds,
+            std::vector<glm::vec3>& barycentrics, unsigned int numThreads) const;
         unsigned int GetNumberOfTriangles() const;
 
+        void WriteBinary(std::ostream& out, const std::vector<const Material*>& materials) const;
+        void ReadBinary(const char*& data, const char* dataEnd, const std::vector<const Material*>& materials);
+
         /** Holds all the single points used by the mesh (and its sub-meshes) as points or in vertices. */
         std::vector<glm::vec4> vertices;
         /** Holds all the single texture coordinates used by the mesh (and its sub-meshes). */
@@ -55,17 +61,24 @@ namespace cgu {
 
         /** Holds a list of triangles with connectivity information. */
         std::vector<MeshConnectTriangle> triangleConnect;
-        /** Holds a list of vertex connectivity information. */
-        std::vector<MeshConnectVertex> verticesConnect;
+        /** Holds the offsets of each vertexes triangles in vertexTriangles (one more than vertices). */
+        std::vector<unsigned int> vertexTriangleOffsets;
+        /** Holds the triangles of all vertices (ordered by vertex, then by triangle index). */
+        std::vector<unsigned int> vertexTriangles;
+        /** Holds the edges (as sorted vertex pairs) shared by more than two triangles. */
+        std::vector<std::array<unsigned int, 2>> nonManifoldEdges;
 
     protected:
-        void CalculateNormals();
-        void CreateGeomertyInfo();
-        int FindContainingTriangleSub(const SubMesh* submesh, const glm::vec3 point);
+        void CalculateNormals(unsigned int numThreads);
+        void CreateGeomertyInfo(unsigned int numThreads);
+        int FindContainingTriangleAll(const glm::vec3& point) const;
+        int FindContainingTriangleSub(const SubMesh* submesh, const glm::vec3 point) const;
         void CreateGeomertyInfoSub(SubMesh* submesh);
-        void CreateConnectivity(SubMesh* submesh);
+        void CreateConnectivity(unsigned int numThreads);
+        void CreateVertexConnectivity();
         void CreateAABB(SubMesh* submesh);
-        void CreateRTree(SubMesh* submesh);
+        void CreateBVH(SubMesh* submesh);
+        void CreateTriangleSets(SubMesh* submesh);
 
     };
 }
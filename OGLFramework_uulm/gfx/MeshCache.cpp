@@ -0,0 +1,146 @@
+/**
+ * @file   MeshCache.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Implementation of the persistent on disk cache for meshes.
+ */
+
+#include "MeshCache.h"
+#include "core/binary_helper.h"
+#include <codecvt>
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace cgu {
+
+    namespace bip = boost::interprocess;
+
+    /** Holds the identifier at the start of mesh cache files. */
+    static const std::array<char, 8> meshCacheMagic{ { 'C', 'G', 'U', 'M', 'E', 'S', 'H', '\0' } };
+    /** Holds the offset of the source files write time in the cache header. */
+    static const std::size_t meshCacheWriteTimeOffset = sizeof(meshCacheMagic) + sizeof(std::uint64_t);
+
+    /**
+     * Constructor.
+     * @param cacheFilename the name of the cache file.
+     * @param key the key identifying the source file (the hash is ignored).
+     * @param calculateSourceHash the function calculating the hash of the source file.
+     */
+    MeshCache::MeshCache(const std::string& cacheFilename, const MeshCacheKey& key,
+        const std::function<std::uint64_t()>& calculateSourceHash) :
+        cacheFilename(cacheFilename),
+        key(key),
+        calculateSourceHash(calculateSourceHash),
+        sourceHashValid(false)
+    {
+    }
+
+    /**
+     * Reads the content of the cache file if it is valid for the source file.
+     * @param readContent the function reading the content after the header.
+     * @return whether the cache was valid and its content read without errors.
+     */
+    bool MeshCache::Read(const ReadFunction& readContent)
+    {
+        if (!boost::filesystem::exists(cacheFilename) || boost::filesystem::file_size(cacheFilename) == 0) return false;
+
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        auto sourceTouched = false;
+        try {
+            bip::file_mapping cacheFile(cacheFilename.c_str(), bip::read_only);
+            bip::mapped_region cacheRegion(cacheFile, bip::read_only);
+            auto data = static_cast<const char*>(cacheRegion.get_address());
+            auto dataEnd = data + cacheRegion.get_size();
+
+            std::array<char, 8> magic;
+            MeshCacheKey cachedKey;
+            binary_help::read(data, dataEnd, magic);
+            binary_help::read(data, dataEnd, cachedKey.sourceSize);
+            binary_help::read(data, dataEnd, cachedKey.sourceWriteTime);
+            binary_help::read(data, dataEnd, cachedKey.sourceHash);
+            if (magic != meshCacheMagic || cachedKey.sourceSize != key.sourceSize) {
+                LOG(INFO) << L"Mesh cache \"" << converter.from_bytes(cacheFilename) << L"\" is outdated.";
+                return false;
+            }
+
+            // an unchanged write time means an unchanged file, only a touched file needs to be hashed.
+            sourceTouched = cachedKey.sourceWriteTime != key.sourceWriteTime;
+            if (!sourceTouched) {
+                key.sourceHash = cachedKey.sourceHash;
+                sourceHashValid = true;
+            } else if (GetSourceHash() != cachedKey.sourceHash) {
+                LOG(INFO) << L"Mesh cache \"" << converter.from_bytes(cacheFilename) << L"\" is outdated.";
+                return false;
+            }
+
+            readContent(data, dataEnd);
+        } catch (const std::exception& e) {
+            LOG(WARNING) << L"Could not read mesh cache \"" << converter.from_bytes(cacheFilename) << L"\": "
+                << converter.from_bytes(e.what());
+            return false;
+        }
+
+        if (sourceTouched) {
+            // the content did not change, store the new write time so the next start does not hash again.
+            std::fstream cacheStream(cacheFilename, std::ios::in | std::ios::out | std::ios::binary);
+            cacheStream.seekp(meshCacheWriteTimeOffset);
+            binary_help::write(cacheStream, key.sourceWriteTime);
+        }
+        return true;
+    }
+
+    /**
+     * Writes a new cache file replacing the old one.
+     * @param writeContent the function writing the content after the header.
+     * @return whether the cache file was written.
+     */
+    bool MeshCache::Write(const WriteFunction& writeContent)
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        auto tmpFilename = cacheFilename + ".tmp";
+        {
+            std::ofstream cacheFile(tmpFilename, std::ios::binary);
+            if (!cacheFile.is_open()) {
+                LOG(WARNING) << L"Could not create mesh cache \"" << converter.from_bytes(cacheFilename) << L"\".";
+                return false;
+            }
+
+            binary_help::write(cacheFile, meshCacheMagic);
+            binary_help::write(cacheFile, key.sourceSize);
+            binary_help::write(cacheFile, key.sourceWriteTime);
+            binary_help::write(cacheFile, GetSourceHash());
+            writeContent(cacheFile);
+
+            if (!cacheFile.good()) {
+                LOG(WARNING) << L"Could not write mesh cache \"" << converter.from_bytes(cacheFilename) << L"\".";
+                cacheFile.close();
+                boost::filesystem::remove(tmpFilename);
+                return false;
+            }
+        }
+
+        boost::system::error_code ec;
+        boost::filesystem::rename(tmpFilename, cacheFilename, ec);
+        if (ec) {
+            LOG(WARNING) << L"Could not replace mesh cache \"" << converter.from_bytes(cacheFilename) << L"\".";
+            boost::filesystem::remove(tmpFilename, ec);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Returns the hash of the source file, it is calculated on the first call if it was not taken from the cache.
+     */
+    std::uint64_t MeshCache::GetSourceHash()
+    {
+        if (!sourceHashValid) {
+            key.sourceHash = calculateSourceHash();
+            sourceHashValid = true;
+        }
+        return key.sourceHash;
+    }
+}
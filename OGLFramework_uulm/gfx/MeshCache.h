@@ -0,0 +1,67 @@
+/**
+ * @file   MeshCache.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Defines the persistent on disk cache for meshes loaded from source files.
+ */
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "main.h"
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+namespace cgu {
+
+    /** Identifies the source file of a mesh cache, a cache is only used if all values match. */
+    struct MeshCacheKey
+    {
+        /** Holds the size of the source file. */
+        std::uint64_t sourceSize;
+        /** Holds the last write time of the source file. */
+        std::int64_t sourceWriteTime;
+        /** Holds the hash of the source files content (only calculated if its size or write time changed). */
+        std::uint64_t sourceHash;
+    };
+
+    /**
+     * @brief  Persistent cache file for a mesh loaded from a source file (see Mesh::WriteBinary).
+     * The source file is identified by its size, write time and content hash. As for the brick caches the hash is
+     * only calculated if the write time differs from the one in the cache (and the size matches) or a new cache is
+     * written. If a touched source file has the same content the new write time is stored in the cache.
+     * New caches are written under a temporary name first so an interrupted write never leaves a broken cache.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.10.01
+     */
+    class MeshCache
+    {
+    public:
+        /** Function reading the content of a valid cache, advances the data pointer and throws on errors. */
+        using ReadFunction = std::function<void(const char*& data, const char* dataEnd)>;
+        /** Function writing the content of a new cache. */
+        using WriteFunction = std::function<void(std::ostream& out)>;
+
+        MeshCache(const std::string& cacheFilename, const MeshCacheKey& key,
+            const std::function<std::uint64_t()>& calculateSourceHash);
+
+        bool Read(const ReadFunction& readContent);
+        bool Write(const WriteFunction& writeContent);
+        std::uint64_t GetSourceHash();
+
+    private:
+        /** Holds the cache files name. */
+        std::string cacheFilename;
+        /** Holds the key of the cache. */
+        MeshCacheKey key;
+        /** Holds the function calculating the hash of the source file. */
+        std::function<std::uint64_t()> calculateSourceHash;
+        /** Holds whether the hash in the key is valid (taken from the cache or calculated). */
+        bool sourceHashValid;
+    };
+}
+
+#endif /* MESHCACHE_H */
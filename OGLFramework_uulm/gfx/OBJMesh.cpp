@@ -8,81 +8,26 @@
 
 #define GLM_SWIZZLE
 #include "OBJMesh.h"
+#include "MeshCache.h"
+#include "ObjParser.h"
 #include "app/ApplicationBase.h"
 #include "app/Configuration.h"
 
-#include <fstream>
+#include "core/binary_helper.h"
+#include "core/parallel_helper.h"
+
+#include <algorithm>
 #include <codecvt>
-#include <boost/algorithm/string/predicate.hpp>
-#include <boost/algorithm/string/trim.hpp>
-#include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 namespace cgu {
 
-    /** RegEx string for a lines vertex index. */
-    const std::string regstr_lindex = "\\s+(" + regex_help::integ
-        + "(/" + regex_help::integ + ")?)";
-    /** RegEx string for a faces vertex index. */
-    const std::string regstr_findex = "\\s+(" + regex_help::integ
-        + "(/" + regex_help::integ + "?/" + regex_help::integ + "|/" + regex_help::integ + ")?)";
-    /** RegEx string for a vertex index list. */
-    const std::string regstr_vlist = "(\\s+" + regex_help::integ + ")+";
-    /** RegEx string for a faces index list. */
-    const std::string regstr_fidxlist = "(" + regstr_findex + ")+";
-
-    /** RegEx for parsing the <code>o</code> statement. */
-    const boost::regex reg_o("^o\\s+(\\w+)$");
-
-    /** RegEx for parsing the <code>v</code> statement. */
-    const boost::regex reg_v("^v\\s+(" + regex_help::flt3 + "|" + regex_help::flt4 + ")$");
-    /** RegEx for parsing the <code>vt</code> statement. */
-    const boost::regex reg_vt("^vt\\s+(" + regex_help::flt2 + "|" + regex_help::flt3 + ")$");
-    /** RegEx for parsing the <code>vn</code> statement. */
-    const boost::regex reg_vn("^vn\\s+" + regex_help::flt3 + "$");
-    /** RegEx for parsing the <code>vp</code> statement. */
-    const boost::regex reg_vp("^vp\\s+(" + regex_help::flt2 + "|" + regex_help::flt3 + ")$");
-
-    /** RegEx for parsing the <code>p</code> statement. */
-    const boost::regex reg_p("^p" + regstr_vlist + "$");
-    /** RegEx for parsing the <code>l</code> statement. */
-    const boost::regex reg_l("^l(" + regstr_lindex + ")+$");
-    /** RegEx for parsing the <code>f</code> statement. */
-    const boost::regex reg_f("^f" + regstr_fidxlist + "$");
-
-    /** RegEx for parsing the <code>curv</code> statement. */
-    const boost::regex reg_curv("^curv\\s+" + regex_help::flt2 + regstr_vlist + "$");
-    /** RegEx for parsing the <code>curv2</code> statement. */
-    const boost::regex reg_curv2("^curv2" + regstr_vlist + "$");
-    /** RegEx for parsing the <code>surf</code> statement. */
-    const boost::regex reg_surf("^surf\\s+" + regex_help::flt4 + regstr_fidxlist + "$");
-
-    /** RegEx for parsing the <code>mtllib</code> statement. */
-    const boost::regex reg_mtllib("^mtllib\\s+(\\w+\\.mtl)$");
-    /** RegEx for parsing the <code>usemtl</code> statement. */
-    const boost::regex reg_usemtl("^usemtl\\s+(\\w+)$");
-
-    /** RegEx for counting/parsing point indices. */
-    const boost::regex reg_pcount(regex_help::integ);
-    /** RegEx for counting/parsing line vertices. */
-    const boost::regex reg_lcount(regstr_lindex);
-    /** RegEx for counting/parsing faces vertices. */
-    const boost::regex reg_fcount(regstr_findex);
-
-    /**
-     * Used for finding existing vertices.
-     * @internal
-     */
-    struct CacheEntry
-    {
-        /** Default constructor. */
-        CacheEntry() : index(-1), next(nullptr) {};
+    namespace bip = boost::interprocess;
 
-        /** Holds the vertices index in the vertex buffer. */
-        int index;
-        /** Holds the next cache entry for vertices with this position. */
-        std::unique_ptr<CacheEntry> next;
-    };
+    /** Holds the extension appended to .obj file names for their mesh cache files. */
+    const char* meshCacheExtension = ".meshcache";
 
     /**
      * Constructor.
@@ -100,7 +45,12 @@ namespace cgu {
     OBJMesh& OBJMesh::operator=(const OBJMesh&) = default;
 
     /** Default move constructor. */
-    OBJMesh::OBJMesh(OBJMesh&& rhs) : Resource(std::move(rhs)), Mesh(std::move(rhs)) {}
+    OBJMesh::OBJMesh(OBJMesh&& rhs) :
+        Resource(std::move(rhs)),
+        Mesh(std::move(rhs)),
+        materialIds(std::move(rhs.materialIds))
+    {
+    }
 
     /** Default move assignment operator. */
     OBJMesh& OBJMesh::operator=(OBJMesh&& rhs)
@@ -110,6 +60,7 @@ namespace cgu {
         *tRes = static_cast<Resource&&>(std::move(rhs));
         Mesh* tMesh = this;
         *tMesh = static_cast<Mesh&&>(std::move(rhs));
+        materialIds = std::move(rhs.materialIds);
         return *this;
     }
 
@@ -118,27 +69,39 @@ namespace cgu {
 
     void OBJMesh::Load()
     {
-        std::string currLine;
-        std::ifstream inFile(application->GetConfig().resourceBase + "/" + id);
-
-        if (!inFile.is_open()) {
+        auto filename = application->GetConfig().resourceBase + "/" + id;
+        if (!boost::filesystem::exists(filename)) {
             throw std::runtime_error("Could not open file: " + id);
         }
 
-        createMeshData(inFile);
-
-        inFile.clear();
-        inFile.seekg(0, std::ios_base::beg);
-
-        loadMeshData(inFile);
-
-        while (inFile.good()) {
-            std::getline(inFile, currLine);
-            boost::trim(currLine);
+        MeshCacheKey cacheKey;
+        cacheKey.sourceSize = static_cast<std::uint64_t>(boost::filesystem::file_size(filename));
+        cacheKey.sourceWriteTime = static_cast<std::int64_t>(boost::filesystem::last_write_time(filename));
 
-            if (currLine.length() == 0 || boost::starts_with(currLine, "#"))
-            // ReSharper disable once CppRedundantControlFlowJump
-                continue; // comment or empty line
+        std::unique_ptr<bip::mapped_region> sourceRegion;
+        const char* textBegin = nullptr;
+        if (cacheKey.sourceSize > 0) {
+            bip::file_mapping sourceFile(filename.c_str(), bip::read_only);
+            sourceRegion = std::make_unique<bip::mapped_region>(sourceFile, bip::read_only);
+            textBegin = static_cast<const char*>(sourceRegion->get_address());
+        }
+        auto textEnd = textBegin + cacheKey.sourceSize;
+
+        MeshCache cache(filename + meshCacheExtension, cacheKey, [textBegin, textEnd]() {
+            return binary_help::hashBytes(textBegin, static_cast<std::size_t>(textEnd - textBegin));
+        });
+        if (!cache.Read([this](const char*& data, const char* dataEnd) { readCacheContent(data, dataEnd); })) {
+            const Mesh emptyMesh;
+            static_cast<Mesh&>(*this) = emptyMesh;
+            materialIds.clear();
+
+            loadMeshData(textBegin, textEnd, parallel_help::numThreads(application->GetConfig().numWorkerThreads));
+            if (!nonManifoldEdges.empty()) {
+                std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+                LOG(WARNING) << L"Mesh \"" << converter.from_bytes(id) << L"\" has " << nonManifoldEdges.size()
+                    << L" non-manifold edges, their triangles have no neighbors there.";
+            }
+            cache.Write([this](std::ostream& out) { writeCacheContent(out); });
         }
         Resource::Load();
     }
@@ -149,348 +112,105 @@ namespace cgu {
     }
 
     /**
-     * Creates the internal structure of the mesh.
-     * @param file the mesh file to read
+     * Reads the mesh and its materials from the content of a valid cache file.
+     * @param data the current position in the caches data, will be advanced
+     * @param dataEnd the end of the caches data
      */
-    void OBJMesh::createMeshData(std::ifstream& file)
-    {
-        std::string currLine;
-        boost::smatch lineMatch;
-
-        std::string currGroup = "";
-        ObjCountState countState;
+    void OBJMesh::readCacheContent(const char*& data, const char* dataEnd)
+    {
+        std::uint64_t numMaterials;
+        binary_help::read(data, dataEnd, numMaterials);
+        std::vector<const Material*> materials;
+        for (std::uint64_t i = 0; i < numMaterials; ++i) {
+            std::pair<std::string, std::string> matId;
+            binary_help::readString(data, dataEnd, matId.first);
+            binary_help::readString(data, dataEnd, matId.second);
+            auto lib = application->GetMaterialLibManager()->GetResource(matId.first);
+            materials.push_back(lib->HasResource(matId.second) ? lib->GetResource(matId.second) : nullptr);
+            materialIds[materials.back()] = matId;
+        }
 
-        while (file.good()) {
-            std::getline(file, currLine);
-            boost::trim(currLine);
+        ReadBinary(data, dataEnd, materials);
+    }
 
-            if (currLine.length() == 0 || boost::starts_with(currLine, "#"))
-                continue; // comment or empty line
-            if (boost::regex_match(currLine, lineMatch, reg_o)) {
-                createSubMesh(currGroup, countState);
-                currGroup = lineMatch[1].str();
-            } else if (boost::regex_match(currLine, lineMatch, reg_v)) {
-                countState.numVerts++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_vt)) {
-                countState.numTexCoords++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_vn)) {
-                countState.numNormals++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_vp)) {
-                countState.numParameterVerts++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_p)) {
-                countState.numPoints += static_cast<unsigned int>(std::distance(
-                    boost::sregex_iterator(currLine.begin(),
-                    currLine.end(), reg_pcount), boost::sregex_iterator()));
-            } else if (boost::regex_match(currLine, lineMatch, reg_l)) {
-                auto lineInds = static_cast<unsigned int>(std::distance(
-                    boost::sregex_iterator(currLine.begin(), currLine.end(), reg_lcount),
-                    boost::sregex_iterator()));
-                countState.numLineIndices += (lineInds - 1) * 2;
-            } else if (boost::regex_match(currLine, lineMatch, reg_f)) {
-                auto faceInds = static_cast<unsigned int>(std::distance(
-                    boost::sregex_iterator(currLine.begin(), currLine.end(), reg_fcount),
-                    boost::sregex_iterator()));
-                countState.numFaceIndices += (faceInds - 2) * 3;
-            } else if (boost::regex_match(currLine, lineMatch, reg_curv)) {
-                countState.numCurv++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_curv2)) {
-                countState.numCurv2++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_surf)) {
-                countState.numSurf++;
-            } else if (boost::regex_match(currLine, lineMatch, reg_usemtl)) {
-                countState.numMtls++;
+    /**
+     * Writes the mesh and the names of its materials as content of a new cache file.
+     * @param out the stream to write to
+     */
+    void OBJMesh::writeCacheContent(std::ostream& out) const
+    {
+        std::vector<const Material*> materials;
+        auto addMaterials = [this, &materials](const SubMesh* submesh) {
+            for (const auto& chunk : submesh->mtlChunks) {
+                if (materialIds.count(chunk.material) == 1
+                    && std::find(materials.begin(), materials.end(), chunk.material) == materials.end()) {
+                    materials.push_back(chunk.material);
+                }
             }
+        };
+        addMaterials(this);
+        for (const auto submesh : subMeshes) addMaterials(submesh);
+
+        binary_help::write(out, static_cast<std::uint64_t>(materials.size()));
+        for (const auto mat : materials) {
+            const auto& matId = materialIds.at(mat);
+            binary_help::writeString(out, matId.first);
+            binary_help::writeString(out, matId.second);
         }
-        createSubMesh(currGroup, countState);
-
-        this->ReserveMesh(countState);
+        WriteBinary(out, materials);
     }
 
     /**
-     * Loads the mesh data from a file into a previously created mesh structure.
-     * @param file the file to load from
+     * Loads the mesh data from the files content (see ObjParser) and creates its geometry information.
+     * @param textBegin the start of the files content
+     * @param textEnd the end of the files content
+     * @param numThreads the maximum number of threads to use
      */
-    void OBJMesh::loadMeshData(std::ifstream& file)
+    void OBJMesh::loadMeshData(const char* textBegin, const char* textEnd, unsigned int numThreads)
     {
-        std::string currLine;
-        boost::smatch lineMatch;
-        SubMesh* subMesh = this;
         std::vector<MaterialLibrary*> mtlLibraries;
-        SubMeshMaterialChunk mtlChunk;
-        std::vector<std::unique_ptr<CacheEntry> > vfCache(vertices.capacity());
-        std::vector<std::unique_ptr<CacheEntry> > vlCache(vertices.capacity());
-
-        while (file.good()) {
-            std::getline(file, currLine);
-            boost::trim(currLine);
-
-            if (currLine.length() == 0 || boost::starts_with(currLine, "#"))
-                continue; // comment or empty line
-            if (boost::regex_match(currLine, lineMatch, reg_o)) {
-                subMesh->FinishMaterial(mtlChunk);
-                loadGroup(subMesh);
-
-                subMesh = subMeshMap[lineMatch[1].str()].get();
-                mtlChunk = SubMeshMaterialChunk(mtlChunk.material);
-            } else if (boost::regex_match(currLine, lineMatch, reg_v)) {
-                if (lineMatch[2].length() == 0) {
-                    vertices.push_back(glm::vec4(boost::lexical_cast<float>(lineMatch[5].str()),
-                        boost::lexical_cast<float>(lineMatch[6].str()),
-                        boost::lexical_cast<float>(lineMatch[7].str()),
-                        boost::lexical_cast<float>(lineMatch[8].str())));
-                } else {
-                    vertices.push_back(glm::vec4(boost::lexical_cast<float>(lineMatch[2].str()),
-                        boost::lexical_cast<float>(lineMatch[3].str()),
-                        boost::lexical_cast<float>(lineMatch[4].str()), 1.0f));
-                }
-            } else if (boost::regex_match(currLine, lineMatch, reg_vt)) {
-                if (lineMatch[2].length() == 0) {
-                    texCoords.push_back(glm::vec3(boost::lexical_cast<float>(lineMatch[4].str()),
-                        boost::lexical_cast<float>(lineMatch[5].str()),
-                        boost::lexical_cast<float>(lineMatch[6].str())));
-                } else {
-                    texCoords.push_back(glm::vec3(boost::lexical_cast<float>(lineMatch[2].str()),
-                        boost::lexical_cast<float>(lineMatch[3].str()), 1.0f));
-                }
-            } else if (boost::regex_match(currLine, lineMatch, reg_vn)) {
-                glm::vec3 vn(boost::lexical_cast<float>(lineMatch[1].str()),
-                    boost::lexical_cast<float>(lineMatch[2].str()),
-                    boost::lexical_cast<float>(lineMatch[3].str()));
-                normals.push_back(glm::normalize(vn));
-            } else if (boost::regex_match(currLine, lineMatch, reg_vp)) {
-                if (lineMatch[2].length() == 0) {
-                    paramVertices.push_back(glm::vec3(boost::lexical_cast<float>(lineMatch[4].str()),
-                        boost::lexical_cast<float>(lineMatch[5].str()),
-                        boost::lexical_cast<float>(lineMatch[6].str())));
-                } else {
-                    paramVertices.push_back(glm::vec3(boost::lexical_cast<float>(lineMatch[2].str()),
-                        boost::lexical_cast<float>(lineMatch[3].str()), 1.0f));
-                }
-            } else if (boost::regex_match(currLine, lineMatch, reg_p)) {
-                OBJMesh::addPointsToMesh(subMesh, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_l)) {
-                OBJMesh::addLineToMesh(subMesh, vlCache, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_f)) {
-                OBJMesh::addFaceToMesh(subMesh, vfCache, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_curv)) {
-                OBJMesh::addCurvToMesh(subMesh, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_curv2)) {
-                OBJMesh::addCurv2ToMesh(subMesh, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_surf)) {
-                OBJMesh::addSurfToMesh(subMesh, currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_mtllib)) {
-                mtlLibraries = getMtlLibraries(currLine);
-            } else if (boost::regex_match(currLine, lineMatch, reg_usemtl)) {
-                mtlChunk = addMtlChunkToMesh(subMesh, mtlChunk, mtlLibraries, lineMatch[1].str());
-            }
-        }
+        ObjParser parser([this, &mtlLibraries](const std::vector<std::string>& names) {
+            mtlLibraries = getMtlLibraries(names);
+        }, [this, &mtlLibraries](const std::string& mtlName) {
+            return findMaterial(mtlLibraries, mtlName);
+        });
+        parser.Parse(textBegin, textEnd, numThreads, *this);
 
-        subMesh->FinishMaterial(mtlChunk);
-        loadGroup(subMesh);
-        CreateGeomertyInfo();
-        if (!this->faceHasNormal) CalculateNormals();
+        CreateGeomertyInfo(numThreads);
+        if (!this->faceHasNormal) CalculateNormals(numThreads);
     }
 
-    std::vector<MaterialLibrary*> OBJMesh::getMtlLibraries(const std::string& line) const
+    /**
+     * Loads the material libraries of a mtllib statement.
+     * @param names the names of the libraries (relative to the .obj file)
+     * @return the material libraries
+     */
+    std::vector<MaterialLibrary*> OBJMesh::getMtlLibraries(const std::vector<std::string>& names) const
     {
-        boost::regex reg_mtllibname("\\s+(\\w+\\.mtl)");
-        boost::sregex_iterator i(line.begin(), line.end(), reg_mtllibname);
-        boost::sregex_iterator j;
         std::vector<MaterialLibrary*> result;
-        while (i != j) {
-            boost::filesystem::path meshFile{ id };
-            auto mtllibname = meshFile.parent_path().string() + "/" + (*i++)[1].str();
+        boost::filesystem::path meshFile{ id };
+        for (const auto& name : names) {
+            auto mtllibname = meshFile.parent_path().string() + "/" + name;
             result.push_back(application->GetMaterialLibManager()->GetResource(mtllibname));
         }
         return result;
     }
 
-    void OBJMesh::loadGroup(SubMesh*)
-    {
-    }
-
-    SubMeshMaterialChunk OBJMesh::addMtlChunkToMesh(SubMesh* mesh, SubMeshMaterialChunk& oldChunk,
-        std::vector<MaterialLibrary*> matLibs, const std::string& newMtl)
-    {
-        mesh->FinishMaterial(oldChunk);
-
-        // get new material
-        const Material* newMat = nullptr;
-        for (const auto lib : matLibs) {
-            if (lib->HasResource(newMtl)) {
-                newMat = lib->GetResource(newMtl);
-            }
-        }
-        return SubMeshMaterialChunk(oldChunk, newMat);
-    }
-
-    void OBJMesh::addPointsToMesh(SubMesh* mesh, const std::string& line) const
-    {
-        boost::sregex_token_iterator i(line.begin(), line.end(), reg_pcount);
-        boost::sregex_token_iterator j;
-        while (i != j) {
-            auto pi = boost::lexical_cast<int>(*i++);
-            mesh->pointIndices.push_back(pi > 0 ? static_cast<GLuint> (pi - 1)
-                : static_cast<GLuint>(vertices.size() - pi));
-        }
-    }
-
     /**
-     * Adds a new vertex to an array of vertices checking if it does already exist.
-     * @tparam VT the vertex type
-     * @param[in,out] vertices the vertex array to add the vertex to
-     * @param[in] v the vertex to add
-     * @param[in] pidx the index of the vertices position (used for faster finding existing vertices)
-     * @param[in,out] cache a caching array used for faster finding existing vertices
-     * @return the index (in vertices) of the vertex to add
+     * Finds the material of a usemtl statement and remembers its library (for writing the cache).
+     * @param matLibs the current material libraries
+     * @param mtlName the name of the material
+     * @return the material (the one of the last library defining it) or nullptr if no library defines it
      */
-    template<class VT>
-    unsigned int addVertex(std::vector<VT>& vertices, const VT& v, unsigned int pidx,
-        std::vector<std::unique_ptr<CacheEntry> >& cache)
-    {
-        auto ce = cache[pidx].get();
-
-        while (ce != nullptr) {
-            unsigned int idx = ce->index;
-            if (vertices[idx] == v)
-                return idx;
-            ce = ce->next.get();
-        }
-
-        auto idx = static_cast<unsigned int>(vertices.size());
-        vertices.push_back(v);
-        ce = new CacheEntry;
-        ce->next = nullptr;
-        ce->index = idx;
-        if (cache[pidx] != nullptr) {
-            auto cei = cache[pidx].get();
-            while (cei->next != nullptr) {
-                cei = cei->next.get();
-            }
-            cei->next = std::unique_ptr<CacheEntry>(ce);
-        } else {
-            cache[pidx] = std::unique_ptr<CacheEntry>(ce);
-        }
-        return idx;
-    }
-
-    void OBJMesh::addLineToMesh(SubMesh* mesh, std::vector<std::unique_ptr<CacheEntry> >& cache, const std::string& line)
-    {
-        boost::sregex_iterator i(line.begin(), line.end(), reg_lcount);
-        boost::sregex_iterator j;
-        auto first = true;
-        while (i != j) {
-            LineVertex lv;
-            auto pi = boost::lexical_cast<int>((*i)[2].str());
-            pi = pi > 0 ? static_cast<unsigned int> (pi - 1) : static_cast<int>(vertices.size() - pi);
-            lv.pos = vertices[pi].xyz();
-            if ((*i)[4].length() > 0) {
-                mesh->lineHasTexture = true;
-                auto ti = boost::lexical_cast<int>((*i)[4].str());
-                lv.tex = texCoords[ti > 0 ? static_cast<unsigned int> (ti - 1)
-                    : static_cast<int>(texCoords.size() - ti)].xy();
-            }
-            ++i;
-
-            auto idx = addVertex(lineVertices, lv, pi, cache);
-            mesh->lineIndices.push_back(idx);
-            auto ti = i;
-            ++ti;
-            if (first || ti == j) {
-                first = false;
-            } else {
-                mesh->lineIndices.push_back(idx);
-            }
-        }
-    }
-
-    void OBJMesh::addFaceToMesh(SubMesh* mesh, std::vector<std::unique_ptr<CacheEntry> >& cache, const std::string& line)
+    const Material* OBJMesh::findMaterial(const std::vector<MaterialLibrary*>& matLibs, const std::string& mtlName)
     {
-        boost::sregex_iterator i(line.begin(), line.end(), reg_fcount);
-        boost::sregex_iterator j;
-        auto idx1 = -1;
-        auto idx2 = -1;
-        auto pidx1 = -1;
-        auto pidx2 = -1;
-        auto currentFace = mesh->trianglePtsIndices.end();
-        while (i != j) {
-            FaceVertex fv;
-            auto pi = boost::lexical_cast<int>((*i)[2].str());
-            pi = pi > 0 ? static_cast<unsigned int> (pi - 1) : static_cast<int>(vertices.size() - pi);
-            fv.pos = vertices[pi].xyz();
-            if (pidx1 == -1)
-                pidx1 = pi;
-            else if (pidx2 == -1)
-                pidx2 = pi;
-            else {
-                auto insResult = mesh->trianglePtsIndices.insert(MeshConnectTriangle({ { pidx1, pidx2, pi } }));
-                assert(insResult.second || "Check why this happened...");
-                currentFace = insResult.first;
-                pidx2 = pi;
-            }
-
-            if ((*i)[4].length() > 0) {
-                mesh->faceHasTexture = true;
-                mesh->faceHasNormal = true;
-                auto ti = boost::lexical_cast<int>((*i)[4].str());
-                auto ni = boost::lexical_cast<int>((*i)[5].str());
-                fv.tex = texCoords[ti > 0 ? static_cast<unsigned int> (ti - 1) : texCoords.size() - ti].xy();
-                fv.normal = normals[ni > 0 ? static_cast<unsigned int> (ni - 1) : normals.size() - ni];
-            } else if ((*i)[6].length() > 0) {
-                mesh->faceHasTexture = true;
-                mesh->faceHasNormal = false;
-                auto ti = boost::lexical_cast<int>((*i)[6].str());
-                fv.tex = texCoords[ti > 0 ? static_cast<unsigned int> (ti - 1) : texCoords.size() - ti].xy();
-                fv.normal = glm::vec3(0.0f);
-            } else if ((*i)[5].length() > 0) {
-                mesh->faceHasNormal = true;
-                mesh->faceHasTexture = false;
-                auto ni = boost::lexical_cast<int>((*i)[5].str());
-                fv.tex = glm::vec2(0.0f);
-                fv.normal = normals[ni > 0 ? static_cast<unsigned int> (ni - 1) : normals.size() - ni];
-            }
-            ++i;
-
-            auto idx = addVertex(faceVertices, fv, pi, cache);
-            if (idx1 == -1)
-                idx1 = idx;
-            else if (idx2 == -1)
-                idx2 = idx;
-            else {
-                mesh->faceIndices.push_back(idx1);
-                mesh->faceIndices.push_back(idx2);
-                mesh->faceIndices.push_back(idx);
-                currentFace->faceVertex[0] = idx1;
-                currentFace->faceVertex[1] = idx2;
-                currentFace->faceVertex[2] = idx;
-
-                idx2 = idx;
+        const Material* newMat = nullptr;
+        for (const auto lib : matLibs) {
+            if (lib->HasResource(mtlName)) {
+                newMat = lib->GetResource(mtlName);
+                materialIds[newMat] = std::make_pair(lib->getId(), mtlName);
             }
         }
-    }
-
-    void OBJMesh::addCurvToMesh(SubMesh*, const std::string & line)
-    {
-        notImplemented(line);
-    }
-
-    void OBJMesh::addCurv2ToMesh(SubMesh*, const std::string & line)
-    {
-        notImplemented(line);
-    }
-
-    void OBJMesh::addSurfToMesh(SubMesh*, const std::string & line)
-    {
-        notImplemented(line);
-    }
-
-    /**
-     * Logs a warning this feature is not implemented.
-     * @param feature the line with the feature to log
-     */
-    void OBJMesh::notImplemented(const std::string & feature)
-    {
-        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-        LOG(WARNING) << L"Feature not implemented: " << converter.from_bytes(feature);
+        return newMat;
     }
 }
@@ -15,9 +15,6 @@
 
 namespace cgu {
 
-    struct ObjCountState;
-    struct CacheEntry;
-
     /**
      * @brief  Resource implementation for .obj files.
      * This is used to generate renderable meshes from .obj files.
@@ -39,23 +36,15 @@ namespace cgu {
         void Unload() override;
 
     private:
-        void createMeshData(std::ifstream& file);
-        void loadMeshData(std::ifstream& file);
-
-        static void loadGroup(SubMesh* oldMesh);
-
-        std::vector<MaterialLibrary*> getMtlLibraries(const std::string& line) const;
-        static SubMeshMaterialChunk addMtlChunkToMesh(SubMesh* mesh, SubMeshMaterialChunk& oldChunk,
-            std::vector<MaterialLibrary*> matLibs, const std::string& newMtl);
+        void readCacheContent(const char*& data, const char* dataEnd);
+        void writeCacheContent(std::ostream& out) const;
+        void loadMeshData(const char* textBegin, const char* textEnd, unsigned int numThreads);
 
-        void addPointsToMesh(SubMesh* mesh, const std::string& line) const;
-        void addLineToMesh(SubMesh* mesh, std::vector<std::unique_ptr<CacheEntry> >& cache, const std::string& line);
-        void addFaceToMesh(SubMesh* mesh, std::vector<std::unique_ptr<CacheEntry> >& cache, const std::string& line);
-        static void addCurvToMesh(SubMesh* mesh, const std::string& line);
-        static void addCurv2ToMesh(SubMesh* mesh, const std::string& line);
-        static void addSurfToMesh(SubMesh* mesh, const std::string& line);
+        std::vector<MaterialLibrary*> getMtlLibraries(const std::vector<std::string>& names) const;
+        const Material* findMaterial(const std::vector<MaterialLibrary*>& matLibs, const std::string& mtlName);
 
-        static void notImplemented(const std::string & feature);
+        /** Holds the material library and material names of the materials used (for writing the cache). */
+        std::unordered_map<const Material*, std::pair<std::string, std::string>> materialIds;
     };
 }
 
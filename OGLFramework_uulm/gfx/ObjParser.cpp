@@ -0,0 +1,635 @@
+/**
+ * @file   ObjParser.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Contains the implementation of ObjParser.
+ */
+
+#define GLM_SWIZZLE
+#include "ObjParser.h"
+#include "Mesh.h"
+#include "VertexIndexCache.h"
+
+#include "core/parallel_helper.h"
+#include "core/parse_helper.h"
+
+#include <algorithm>
+#include <codecvt>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    /**
+     * The statements of an .obj file the loader knows about.
+     * @internal
+     */
+    enum class ObjStatement
+    {
+        Unknown,
+        Object,
+        Vertex,
+        TexCoord,
+        Normal,
+        ParamVertex,
+        Point,
+        Line,
+        Face,
+        Curv,
+        Curv2,
+        Surf,
+        MtlLib,
+        UseMtl
+    };
+
+    /**
+     * A statement of an .obj file that has to be applied to the mesh in file order.
+     * @internal
+     */
+    struct ObjStatementRecord
+    {
+        /** Holds the statement type. */
+        ObjStatement type;
+        /** Holds the start of the statements arguments (in the files content). */
+        const char* argsBegin;
+        /** Holds the end of the statements arguments (in the files content). */
+        const char* argsEnd;
+        /** Holds the first vertex index of the statement (in the chunks face or other index list). */
+        unsigned int firstIndex;
+        /** Holds the number of vertex indices of the statement. */
+        unsigned int numIndices;
+        /** Holds the number of positions in the chunk before the statement (for relative indices). */
+        unsigned int numVertices;
+        /** Holds the number of texture coordinates in the chunk before the statement. */
+        unsigned int numTexCoords;
+        /** Holds the number of normals in the chunk before the statement. */
+        unsigned int numNormals;
+    };
+
+    /**
+     * Holds the data parsed from a chunk of whole lines of an .obj file.
+     * Chunks are parsed independently and merged in file order afterwards.
+     * @internal
+     */
+    struct ObjChunk
+    {
+        /** Holds the positions defined in the chunk. */
+        std::vector<glm::vec4> vertices;
+        /** Holds the texture coordinates defined in the chunk. */
+        std::vector<glm::vec3> texCoords;
+        /** Holds the normals defined in the chunk. */
+        std::vector<glm::vec3> normals;
+        /** Holds the parameter vertices defined in the chunk. */
+        std::vector<glm::vec3> paramVertices;
+        /** Holds the vertex indices of all points and lines in the chunk. */
+        std::vector<ObjVertexIndex> vertexIndices;
+        /** Holds the vertex indices of all faces in the chunk. */
+        std::vector<ObjVertexIndex> faceIndices;
+        /** Holds the statements to apply in order. */
+        std::vector<ObjStatementRecord> statements;
+
+        /**
+         * Adds a statement to the chunk.
+         * @param type the statement type.
+         * @param argsBegin the start of the arguments.
+         * @param argsEnd the end of the arguments.
+         * @param firstIndex the first vertex index of the statement.
+         * @param numIndices the number of vertex indices of the statement.
+         */
+        void AddStatement(ObjStatement type, const char* argsBegin, const char* argsEnd, std::size_t firstIndex,
+            std::size_t numIndices)
+        {
+            ObjStatementRecord statement;
+            statement.type = type;
+            statement.argsBegin = argsBegin;
+            statement.argsEnd = argsEnd;
+            statement.firstIndex = static_cast<unsigned int>(firstIndex);
+            statement.numIndices = static_cast<unsigned int>(numIndices);
+            statement.numVertices = static_cast<unsigned int>(vertices.size());
+            statement.numTexCoords = static_cast<unsigned int>(texCoords.size());
+            statement.numNormals = static_cast<unsigned int>(normals.size());
+            statements.push_back(statement);
+        }
+    };
+
+    /**
+     * Checks if a keyword equals a string literal.
+     * @param keyBegin the start of the keyword.
+     * @param keyEnd the end of the keyword.
+     * @param str the literal to compare to.
+     */
+    template<std::size_t N>
+    bool keywordEquals(const char* keyBegin, const char* keyEnd, const char(&str)[N])
+    {
+        return static_cast<std::size_t>(keyEnd - keyBegin) == N - 1 && std::memcmp(keyBegin, str, N - 1) == 0;
+    }
+
+    /**
+     * Classifies a line of an .obj file by its leading keyword.
+     * @param keyBegin the start of the keyword.
+     * @param keyEnd the end of the keyword.
+     * @return the statement type.
+     */
+    ObjStatement classifyStatement(const char* keyBegin, const char* keyEnd)
+    {
+        switch (*keyBegin) {
+        case 'v':
+            if (keyEnd - keyBegin == 1) return ObjStatement::Vertex;
+            if (keywordEquals(keyBegin, keyEnd, "vt")) return ObjStatement::TexCoord;
+            if (keywordEquals(keyBegin, keyEnd, "vn")) return ObjStatement::Normal;
+            if (keywordEquals(keyBegin, keyEnd, "vp")) return ObjStatement::ParamVertex;
+            break;
+        case 'f': if (keyEnd - keyBegin == 1) return ObjStatement::Face; break;
+        case 'o': if (keyEnd - keyBegin == 1) return ObjStatement::Object; break;
+        case 'p': if (keyEnd - keyBegin == 1) return ObjStatement::Point; break;
+        case 'l': if (keyEnd - keyBegin == 1) return ObjStatement::Line; break;
+        case 'c':
+            if (keywordEquals(keyBegin, keyEnd, "curv")) return ObjStatement::Curv;
+            if (keywordEquals(keyBegin, keyEnd, "curv2")) return ObjStatement::Curv2;
+            break;
+        case 's': if (keywordEquals(keyBegin, keyEnd, "surf")) return ObjStatement::Surf; break;
+        case 'm': if (keywordEquals(keyBegin, keyEnd, "mtllib")) return ObjStatement::MtlLib; break;
+        case 'u': if (keywordEquals(keyBegin, keyEnd, "usemtl")) return ObjStatement::UseMtl; break;
+        default: break;
+        }
+        return ObjStatement::Unknown;
+    }
+
+    /**
+     * Parses a list of blank separated floats.
+     * @param p the start of the list.
+     * @param end the end of the list.
+     * @param values the array to store the values in.
+     * @param maxValues the maximum number of values allowed.
+     * @return the number of values parsed or 0 if the list is malformed.
+     */
+    unsigned int parseFloats(const char* p, const char* end, float* values, unsigned int maxValues)
+    {
+        unsigned int count = 0;
+        while ((p = parse_help::skipBlanks(p, end)) != end) {
+            if (count == maxValues || !parse_help::parseFloat(p, end, values[count])) return 0;
+            if (p != end && !parse_help::isBlank(*p)) return 0;
+            ++count;
+        }
+        return count;
+    }
+
+    /**
+     * Parses a list of blank separated vertex indices (<code>v</code>, <code>v/vt</code>,
+     * <code>v//vn</code> or <code>v/vt/vn</code>) and appends them to an index list.
+     * @param p the start of the list.
+     * @param end the end of the list.
+     * @param indices the index list to append to (is left unchanged if the list is malformed).
+     * @return the number of indices parsed or 0 if the list is malformed.
+     */
+    std::size_t parseVertexIndices(const char* p, const char* end, std::vector<ObjVertexIndex>& indices)
+    {
+        auto firstIndex = indices.size();
+        while ((p = parse_help::skipBlanks(p, end)) != end) {
+            ObjVertexIndex idx;
+            auto valid = parse_help::parseInt(p, end, idx.pos);
+            if (valid && p != end && *p == '/') {
+                valid = ++p != end && (*p == '/' || parse_help::parseInt(p, end, idx.tex));
+                if (valid && p != end && *p == '/') {
+                    ++p;
+                    valid = parse_help::parseInt(p, end, idx.normal);
+                }
+            }
+            if (!valid || idx.pos == 0 || (p != end && !parse_help::isBlank(*p))) {
+                indices.resize(firstIndex);
+                return 0;
+            }
+            indices.push_back(idx);
+        }
+        return indices.size() - firstIndex;
+    }
+
+    /**
+     * Converts a relative (negative) .obj index to an absolute (1-based) one and checks its range.
+     * @param idx the .obj index (0 if not given), is replaced by the absolute index.
+     * @param count the number of elements defined before the statement using the index.
+     * @param total the number of elements defined in the whole file.
+     * @return whether the index is not given or refers to a defined element.
+     */
+    inline bool resolveIndex(int& idx, std::size_t count, std::size_t total)
+    {
+        if (idx < 0) {
+            if (static_cast<std::size_t>(-static_cast<std::int64_t>(idx)) > count) return false;
+            idx = static_cast<int>(count) + idx + 1;
+        }
+        return static_cast<std::size_t>(idx) <= total;
+    }
+
+    /**
+     * Resolves the indices of a vertex.
+     * @param idx the .obj indices, are replaced by the absolute indices.
+     * @param counts the number of positions, texture coordinates and normals defined before the statement.
+     * @param totals the number of positions, texture coordinates and normals defined in the whole file.
+     * @return whether the vertex has a position and all its indices refer to defined elements.
+     */
+    inline bool resolveVertexIndex(ObjVertexIndex& idx, const std::size_t(&counts)[3], const std::size_t(&totals)[3])
+    {
+        return idx.pos != 0 && resolveIndex(idx.pos, counts[0], totals[0])
+            && resolveIndex(idx.tex, counts[1], totals[1]) && resolveIndex(idx.normal, counts[2], totals[2]);
+    }
+
+    /**
+     * Creates the face vertex for an index triple.
+     * @param mesh the mesh holding the positions, texture coordinates and normals.
+     * @param key the index triple (absolute indices).
+     * @return the face vertex.
+     */
+    FaceVertex createFaceVertex(const Mesh& mesh, const ObjVertexIndex& key)
+    {
+        FaceVertex fv;
+        fv.pos = mesh.vertices[key.pos - 1].xyz();
+        if (key.tex != 0) fv.tex = mesh.texCoords[key.tex - 1].xy();
+        if (key.normal != 0) fv.normal = mesh.normals[key.normal - 1];
+        return fv;
+    }
+
+    /**
+     * Constructor.
+     * @param mtlLib the function called for mtllib statements.
+     * @param useMtl the function called for usemtl statements.
+     * @param minChunkSize the minimum size of a chunk parsed by one thread.
+     */
+    ObjParser::ObjParser(const MtlLibFunction& mtlLib, const UseMtlFunction& useMtl, std::size_t minChunkSize) :
+        mtlLib(mtlLib),
+        useMtl(useMtl),
+        minChunkSize(std::max(minChunkSize, static_cast<std::size_t>(1)))
+    {
+    }
+
+    /**
+     * Parses the content of an .obj file into a mesh.
+     * Only the data of the .obj file is filled in, geometry information is not created.
+     * @param textBegin the start of the files content.
+     * @param textEnd the end of the files content.
+     * @param numThreads the maximum number of threads to use.
+     * @param mesh the (empty) mesh to fill.
+     */
+    void ObjParser::Parse(const char* textBegin, const char* textEnd, unsigned int numThreads, Mesh& mesh) const
+    {
+        auto textSize = static_cast<std::size_t>(textEnd - textBegin);
+        std::size_t numChunks = textSize / minChunkSize;
+        if (numChunks > numThreads) numChunks = numThreads;
+        if (numChunks == 0) numChunks = 1;
+
+        std::vector<const char*> chunkBounds(1, textBegin);
+        for (std::size_t i = 1; i < numChunks; ++i) {
+            auto splitPos = textBegin + (i * textSize) / numChunks;
+            if (splitPos < chunkBounds.back()) splitPos = chunkBounds.back();
+            auto lineEnd = static_cast<const char*>(std::memchr(splitPos, '\n', textEnd - splitPos));
+            chunkBounds.push_back(lineEnd == nullptr ? textEnd : lineEnd + 1);
+        }
+        chunkBounds.push_back(textEnd);
+
+        std::vector<ObjChunk> chunks(numChunks);
+        parallel_help::parallelFor(numChunks, [&chunks, &chunkBounds](std::size_t i) {
+            ParseChunk(chunkBounds[i], chunkBounds[i + 1], chunks[i]);
+        });
+        MergeChunks(chunks, numThreads, mesh);
+    }
+
+    /**
+     * Parses a chunk of whole lines of an .obj file.
+     * Each line is classified by its leading keyword and its arguments are parsed directly from the text.
+     * @param chunkBegin the start of the chunk.
+     * @param chunkEnd the end of the chunk.
+     * @param chunk the chunk data to fill.
+     */
+    void ObjParser::ParseChunk(const char* chunkBegin, const char* chunkEnd, ObjChunk& chunk)
+    {
+        float values[4];
+
+        for (auto lineBegin = chunkBegin; lineBegin < chunkEnd;) {
+            auto lineEnd = static_cast<const char*>(std::memchr(lineBegin, '\n', chunkEnd - lineBegin));
+            if (lineEnd == nullptr) lineEnd = chunkEnd;
+            auto keyBegin = parse_help::skipBlanks(lineBegin, lineEnd);
+            auto argsEnd = parse_help::trimBlanksBack(keyBegin, lineEnd);
+            lineBegin = lineEnd + 1;
+
+            if (keyBegin == argsEnd || *keyBegin == '#')
+                continue; // comment or empty line
+            auto keyEnd = parse_help::findTokenEnd(keyBegin, argsEnd);
+            auto argsBegin = parse_help::skipBlanks(keyEnd, argsEnd);
+            auto firstIndex = chunk.vertexIndices.size();
+            auto firstFaceIndex = chunk.faceIndices.size();
+            std::size_t numIndices = 0;
+
+            auto statement = classifyStatement(keyBegin, keyEnd);
+            switch (statement) {
+            case ObjStatement::Vertex:
+                switch (parseFloats(argsBegin, argsEnd, values, 4)) {
+                case 3: chunk.vertices.push_back(glm::vec4(values[0], values[1], values[2], 1.0f)); break;
+                case 4: chunk.vertices.push_back(glm::vec4(values[0], values[1], values[2], values[3])); break;
+                default: break;
+                }
+                break;
+            case ObjStatement::TexCoord:
+                switch (parseFloats(argsBegin, argsEnd, values, 3)) {
+                case 2: chunk.texCoords.push_back(glm::vec3(values[0], values[1], 1.0f)); break;
+                case 3: chunk.texCoords.push_back(glm::vec3(values[0], values[1], values[2])); break;
+                default: break;
+                }
+                break;
+            case ObjStatement::Normal:
+                if (parseFloats(argsBegin, argsEnd, values, 3) == 3) {
+                    chunk.normals.push_back(glm::normalize(glm::vec3(values[0], values[1], values[2])));
+                }
+                break;
+            case ObjStatement::ParamVertex:
+                switch (parseFloats(argsBegin, argsEnd, values, 3)) {
+                case 2: chunk.paramVertices.push_back(glm::vec3(values[0], values[1], 1.0f)); break;
+                case 3: chunk.paramVertices.push_back(glm::vec3(values[0], values[1], values[2])); break;
+                default: break;
+                }
+                break;
+            case ObjStatement::Point:
+                numIndices = parseVertexIndices(argsBegin, argsEnd, chunk.vertexIndices);
+                if (numIndices > 0) chunk.AddStatement(statement, argsBegin, argsEnd, firstIndex, numIndices);
+                break;
+            case ObjStatement::Line:
+                numIndices = parseVertexIndices(argsBegin, argsEnd, chunk.vertexIndices);
+                if (numIndices >= 2) chunk.AddStatement(statement, argsBegin, argsEnd, firstIndex, numIndices);
+                else chunk.vertexIndices.resize(firstIndex);
+                break;
+            case ObjStatement::Face:
+                numIndices = parseVertexIndices(argsBegin, argsEnd, chunk.faceIndices);
+                if (numIndices >= 3) chunk.AddStatement(statement, argsBegin, argsEnd, firstFaceIndex, numIndices);
+                else chunk.faceIndices.resize(firstFaceIndex);
+                break;
+            case ObjStatement::Object:
+            case ObjStatement::UseMtl:
+                if (argsBegin != argsEnd) chunk.AddStatement(statement, argsBegin, argsEnd, firstIndex, 0);
+                break;
+            case ObjStatement::MtlLib:
+                chunk.AddStatement(statement, argsBegin, argsEnd, firstIndex, 0);
+                break;
+            case ObjStatement::Curv:
+            case ObjStatement::Curv2:
+            case ObjStatement::Surf:
+                chunk.AddStatement(statement, keyBegin, argsEnd, firstIndex, 0);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    /**
+     * Merges the parsed chunks into the mesh in file order.
+     * Copying the chunks data and resolving their indices runs per chunk in parallel, the face vertices are
+     * deduplicated in parallel (see DeduplicateFaceVertices). The statements are then applied serially: this
+     * appends the already numbered face vertices to the sub-meshes and handles objects, points, lines and materials.
+     * @param chunks the parsed chunks (their data is released while merging).
+     * @param numThreads the maximum number of threads to use.
+     * @param mesh the mesh to fill.
+     */
+    void ObjParser::MergeChunks(std::vector<ObjChunk>& chunks, unsigned int numThreads, Mesh& mesh) const
+    {
+        // offsets of the chunks positions, texture coordinates, normals and parameter vertices in the mesh.
+        std::vector<std::array<std::size_t, 4>> chunkOffsets(chunks.size() + 1);
+        chunkOffsets[0] = { { mesh.vertices.size(), mesh.texCoords.size(), mesh.normals.size(), mesh.paramVertices.size() } };
+        for (std::size_t ci = 0; ci < chunks.size(); ++ci) {
+            chunkOffsets[ci + 1] = { { chunkOffsets[ci][0] + chunks[ci].vertices.size(),
+                chunkOffsets[ci][1] + chunks[ci].texCoords.size(), chunkOffsets[ci][2] + chunks[ci].normals.size(),
+                chunkOffsets[ci][3] + chunks[ci].paramVertices.size() } };
+        }
+        mesh.vertices.resize(chunkOffsets.back()[0]);
+        mesh.texCoords.resize(chunkOffsets.back()[1]);
+        mesh.normals.resize(chunkOffsets.back()[2]);
+        mesh.paramVertices.resize(chunkOffsets.back()[3]);
+
+        const std::size_t totals[3] = { mesh.vertices.size(), mesh.texCoords.size(), mesh.normals.size() };
+        std::vector<std::size_t> numInvalid(chunks.size(), 0);
+        parallel_help::parallelFor(chunks.size(), [&chunks, &chunkOffsets, &mesh, &totals, &numInvalid](std::size_t ci) {
+            auto& chunk = chunks[ci];
+            const auto& offsets = chunkOffsets[ci];
+            std::copy(chunk.vertices.begin(), chunk.vertices.end(), mesh.vertices.begin() + offsets[0]);
+            std::copy(chunk.texCoords.begin(), chunk.texCoords.end(), mesh.texCoords.begin() + offsets[1]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), mesh.normals.begin() + offsets[2]);
+            std::copy(chunk.paramVertices.begin(), chunk.paramVertices.end(), mesh.paramVertices.begin() + offsets[3]);
+            std::vector<glm::vec4>().swap(chunk.vertices);
+            std::vector<glm::vec3>().swap(chunk.texCoords);
+            std::vector<glm::vec3>().swap(chunk.normals);
+            std::vector<glm::vec3>().swap(chunk.paramVertices);
+
+            // statements with invalid indices are dropped, the face indices are compacted so only valid faces remain.
+            std::size_t numFaceIndices = 0;
+            for (auto& statement : chunk.statements) {
+                if (statement.numIndices == 0) continue;
+                auto isFace = statement.type == ObjStatement::Face;
+                auto& indexList = isFace ? chunk.faceIndices : chunk.vertexIndices;
+                auto indices = indexList.data() + statement.firstIndex;
+                const std::size_t counts[3] = { offsets[0] + statement.numVertices,
+                    offsets[1] + statement.numTexCoords, offsets[2] + statement.numNormals };
+                auto valid = true;
+                for (unsigned int i = 0; i < statement.numIndices && valid; ++i) {
+                    valid = resolveVertexIndex(indices[i], counts, totals);
+                }
+
+                if (!valid) {
+                    statement.type = ObjStatement::Unknown;
+                    ++numInvalid[ci];
+                } else if (isFace) {
+                    if (statement.firstIndex != numFaceIndices) {
+                        std::copy(indices, indices + statement.numIndices, chunk.faceIndices.begin() + numFaceIndices);
+                    }
+                    statement.firstIndex = static_cast<unsigned int>(numFaceIndices);
+                    numFaceIndices += statement.numIndices;
+                }
+            }
+            chunk.faceIndices.resize(numFaceIndices);
+        });
+
+        auto numInvalidStatements = std::accumulate(numInvalid.begin(), numInvalid.end(), static_cast<std::size_t>(0));
+        if (numInvalidStatements > 0) {
+            LOG(WARNING) << L"Skipped " << numInvalidStatements
+                << L" points, lines or faces with indices of undefined vertices.";
+        }
+
+        std::vector<unsigned int> faceVertexIds;
+        DeduplicateFaceVertices(chunks, numThreads, mesh, faceVertexIds);
+
+        SubMesh* subMesh = &mesh;
+        SubMeshMaterialChunk mtlChunk;
+        VertexIndexCache lineCache(1, static_cast<int>(mesh.vertices.size()) + 1);
+        auto faceIds = faceVertexIds.data();
+        for (auto& chunk : chunks) {
+            for (const auto& statement : chunk.statements) {
+                switch (statement.type) {
+                case ObjStatement::Object:
+                    subMesh->FinishMaterial(mtlChunk);
+                    subMesh = mesh.createSubMesh(std::string(statement.argsBegin, statement.argsEnd));
+                    mtlChunk = SubMeshMaterialChunk(mtlChunk.material);
+                    mtlChunk.point_seq_begin = static_cast<unsigned int>(subMesh->pointIndices.size());
+                    mtlChunk.line_seq_begin = static_cast<unsigned int>(subMesh->lineIndices.size());
+                    mtlChunk.face_seq_begin = static_cast<unsigned int>(subMesh->faceIndices.size());
+                    break;
+                case ObjStatement::Point:
+                    for (unsigned int i = 0; i < statement.numIndices; ++i) {
+                        subMesh->pointIndices.push_back(
+                            static_cast<unsigned int>(chunk.vertexIndices[statement.firstIndex + i].pos - 1));
+                    }
+                    break;
+                case ObjStatement::Line:
+                    for (unsigned int i = 0; i < statement.numIndices; ++i) {
+                        auto key = chunk.vertexIndices[statement.firstIndex + i];
+                        key.normal = 0;
+                        LineVertex lv;
+                        lv.pos = mesh.vertices[key.pos - 1].xyz();
+                        if (key.tex != 0) {
+                            subMesh->lineHasTexture = true;
+                            lv.tex = mesh.texCoords[key.tex - 1].xy();
+                        }
+
+                        // convert the poly-line to a line-list: inner vertices end one segment and start the next.
+                        auto idx = lineCache.FindOrInsert(key, static_cast<unsigned int>(mesh.lineVertices.size()));
+                        if (idx.second) mesh.lineVertices.push_back(lv);
+                        subMesh->lineIndices.push_back(idx.first);
+                        if (i != 0 && i + 1 != statement.numIndices) subMesh->lineIndices.push_back(idx.first);
+                    }
+                    break;
+                case ObjStatement::Face: {
+                    auto face = chunk.faceIndices.data() + statement.firstIndex;
+                    for (unsigned int i = 0; i < statement.numIndices; ++i) {
+                        if (face[i].tex != 0 || face[i].normal != 0) {
+                            subMesh->faceHasTexture = face[i].tex != 0;
+                            subMesh->faceHasNormal = face[i].normal != 0;
+                        }
+                    }
+
+                    // triangulate as a fan around the first vertex.
+                    for (unsigned int i = 2; i < statement.numIndices; ++i) {
+                        MeshConnectTriangle tri(std::array<unsigned int, 3>{ { static_cast<unsigned int>(face[0].pos - 1),
+                            static_cast<unsigned int>(face[i - 1].pos - 1), static_cast<unsigned int>(face[i].pos - 1) } });
+                        tri.faceVertex = { { faceIds[0], faceIds[i - 1], faceIds[i] } };
+                        subMesh->trianglePtsIndices.push_back(tri);
+                        subMesh->faceIndices.push_back(faceIds[0]);
+                        subMesh->faceIndices.push_back(faceIds[i - 1]);
+                        subMesh->faceIndices.push_back(faceIds[i]);
+                    }
+                    faceIds += statement.numIndices;
+                } break;
+                case ObjStatement::Curv:
+                case ObjStatement::Curv2:
+                case ObjStatement::Surf:
+                    NotImplemented(statement.argsBegin, statement.argsEnd);
+                    break;
+                case ObjStatement::MtlLib: {
+                    std::vector<std::string> names;
+                    auto p = parse_help::skipBlanks(statement.argsBegin, statement.argsEnd);
+                    while (p != statement.argsEnd) {
+                        auto nameEnd = parse_help::findTokenEnd(p, statement.argsEnd);
+                        names.emplace_back(p, nameEnd);
+                        p = parse_help::skipBlanks(nameEnd, statement.argsEnd);
+                    }
+                    if (mtlLib) mtlLib(names);
+                } break;
+                case ObjStatement::UseMtl:
+                    subMesh->FinishMaterial(mtlChunk);
+                    mtlChunk = SubMeshMaterialChunk(mtlChunk,
+                        useMtl ? useMtl(std::string(statement.argsBegin, statement.argsEnd)) : nullptr);
+                    break;
+                default:
+                    break;
+                }
+            }
+            chunk = ObjChunk();
+        }
+
+        subMesh->FinishMaterial(mtlChunk);
+    }
+
+    /**
+     * Deduplicates the face vertices of all chunks and creates them in the mesh.
+     * The face vertex uses are distributed to partitions of consecutive positions (faces of nearby positions share
+     * a partition), each partition finds the first use of each of its triples on its own thread. The first uses are then numbered in file order, so
+     * the face vertices get the same indices as with a serial pass over all faces.
+     * @param chunks the chunks with resolved indices.
+     * @param numThreads the maximum number of threads to use.
+     * @param mesh the mesh holding the vertex data, the face vertices are created in it.
+     * @param faceVertexIds the face vertex index of each face vertex use (in file order).
+     */
+    void ObjParser::DeduplicateFaceVertices(const std::vector<ObjChunk>& chunks, unsigned int numThreads,
+        Mesh& mesh, std::vector<unsigned int>& faceVertexIds)
+    {
+        std::vector<std::size_t> useOffsets(chunks.size() + 1, 0);
+        for (std::size_t ci = 0; ci < chunks.size(); ++ci) useOffsets[ci + 1] = useOffsets[ci] + chunks[ci].faceIndices.size();
+        auto numUses = useOffsets.back();
+        auto numPartitions = std::max(1u, numThreads);
+
+        // sort the uses (per chunk) into partitions of consecutive positions.
+        std::uint64_t numPositions = mesh.vertices.size();
+        std::vector<int> partitionFirstPos(numPartitions + 1);
+        for (std::size_t p = 0; p <= numPartitions; ++p) {
+            partitionFirstPos[p] = static_cast<int>((p * numPositions + numPartitions - 1) / numPartitions) + 1;
+        }
+        std::vector<std::vector<std::vector<unsigned int>>> partitionUses(chunks.size(),
+            std::vector<std::vector<unsigned int>>(numPartitions));
+        parallel_help::parallelFor(chunks.size(), [&chunks, &partitionUses, numPartitions, numPositions](std::size_t ci) {
+            const auto& faceIndices = chunks[ci].faceIndices;
+            for (std::size_t i = 0; i < faceIndices.size(); ++i) {
+                auto partition = (static_cast<std::uint64_t>(faceIndices[i].pos - 1) * numPartitions) / numPositions;
+                partitionUses[ci][partition].push_back(static_cast<unsigned int>(i));
+            }
+        });
+
+        // find the first use of each triple.
+        std::vector<unsigned int> firstUse(numUses);
+        parallel_help::parallelFor(numPartitions, [&](std::size_t partition) {
+            VertexIndexCache cache(partitionFirstPos[partition], partitionFirstPos[partition + 1]);
+            for (std::size_t ci = 0; ci < chunks.size(); ++ci) {
+                for (auto i : partitionUses[ci][partition]) {
+                    auto use = static_cast<unsigned int>(useOffsets[ci] + i);
+                    firstUse[use] = cache.FindOrInsert(chunks[ci].faceIndices[i], use).first;
+                }
+                std::vector<unsigned int>().swap(partitionUses[ci][partition]);
+            }
+        });
+
+        // number the first uses in file order and create their vertices.
+        std::vector<unsigned int> chunkFirstVertex(chunks.size() + 1, 0);
+        parallel_help::parallelFor(chunks.size(), [&](std::size_t ci) {
+            unsigned int numFirstUses = 0;
+            for (auto use = useOffsets[ci]; use < useOffsets[ci + 1]; ++use) if (firstUse[use] == use) ++numFirstUses;
+            chunkFirstVertex[ci + 1] = numFirstUses;
+        });
+        for (std::size_t ci = 0; ci < chunks.size(); ++ci) chunkFirstVertex[ci + 1] += chunkFirstVertex[ci];
+        auto firstFaceVertex = mesh.faceVertices.size();
+        mesh.faceVertices.resize(firstFaceVertex + chunkFirstVertex.back());
+
+        faceVertexIds.resize(numUses);
+        parallel_help::parallelFor(chunks.size(), [&](std::size_t ci) {
+            auto vertexId = static_cast<unsigned int>(firstFaceVertex + chunkFirstVertex[ci]);
+            for (auto use = useOffsets[ci]; use < useOffsets[ci + 1]; ++use) {
+                if (firstUse[use] != use) continue;
+                mesh.faceVertices[vertexId] = createFaceVertex(mesh, chunks[ci].faceIndices[use - useOffsets[ci]]);
+                faceVertexIds[use] = vertexId++;
+            }
+        });
+        parallel_help::parallelFor(chunks.size(), [&](std::size_t ci) {
+            for (auto use = useOffsets[ci]; use < useOffsets[ci + 1]; ++use) {
+                if (firstUse[use] != use) faceVertexIds[use] = faceVertexIds[firstUse[use]];
+            }
+        });
+    }
+
+    /**
+     * Logs a warning this feature is not implemented.
+     * @param lineBegin the start of the line with the feature to log.
+     * @param lineEnd the end of the line.
+     */
+    void ObjParser::NotImplemented(const char* lineBegin, const char* lineEnd)
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        LOG(WARNING) << L"Feature not implemented: " << converter.from_bytes(lineBegin, lineEnd);
+    }
+}
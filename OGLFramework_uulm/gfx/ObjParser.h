@@ -0,0 +1,66 @@
+/**
+ * @file   ObjParser.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Contains the parser filling meshes from the content of .obj files.
+ */
+
+#ifndef OBJPARSER_H
+#define OBJPARSER_H
+
+#include "main.h"
+#include <functional>
+
+namespace cgu {
+
+    class Material;
+    class Mesh;
+    struct ObjChunk;
+
+    /**
+     * @brief  Parses the content of .obj files into meshes.
+     * The content is split into chunks of whole lines that are parsed in parallel. The chunks are merged in file
+     * order: their data is copied and their indices are resolved per chunk in parallel, face vertices are
+     * deduplicated in parallel over partitions of their positions (numbered in order of their first use).
+     * Only appending the indices to the sub-meshes and handling objects, lines and materials is a serial pass,
+     * so the result is the same for any number of threads.
+     * Materials are resolved by callbacks, the parser itself does not depend on an application.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.10.01
+     */
+    class ObjParser
+    {
+    public:
+        /** Function called for a mtllib statement with the names of the libraries. */
+        using MtlLibFunction = std::function<void(const std::vector<std::string>& libraryNames)>;
+        /** Function called for a usemtl statement with the name of the material, returns the material or nullptr. */
+        using UseMtlFunction = std::function<const Material*(const std::string& materialName)>;
+
+        /** The default minimum size of a chunk (smaller files are not worth starting threads for). */
+        static const std::size_t DEFAULT_MIN_CHUNK_SIZE = 1 << 20;
+
+        ObjParser(const MtlLibFunction& mtlLib, const UseMtlFunction& useMtl,
+            std::size_t minChunkSize = DEFAULT_MIN_CHUNK_SIZE);
+
+        void Parse(const char* textBegin, const char* textEnd, unsigned int numThreads, Mesh& mesh) const;
+
+    private:
+        static void ParseChunk(const char* chunkBegin, const char* chunkEnd, ObjChunk& chunk);
+        void MergeChunks(std::vector<ObjChunk>& chunks, unsigned int numThreads, Mesh& mesh) const;
+        static void DeduplicateFaceVertices(const std::vector<ObjChunk>& chunks, unsigned int numThreads,
+            Mesh& mesh, std::vector<unsigned int>& faceVertexIds);
+
+        static void NotImplemented(const char* lineBegin, const char* lineEnd);
+
+        /** Holds the function called for mtllib statements. */
+        MtlLibFunction mtlLib;
+        /** Holds the function called for usemtl statements. */
+        UseMtlFunction useMtl;
+        /** Holds the minimum size of a chunk. */
+        std::size_t minChunkSize;
+    };
+}
+
+#endif /* OBJPARSER_H */
@@ -11,24 +11,21 @@
 
 #include "SubMeshMaterialChunk.h"
 #include "FreeFormObjects.h"
-#include <set>
-#include <boost/geometry.hpp>
+#include "TriangleBVH.h"
+#include <array>
 #include "core/math/math.h"
 
 namespace cgu {
 
-    /** Contains vertex connectivity information. */
-    struct MeshConnectVertex
-    {
-        /** Holds the vertex index. */
-        unsigned int idx;
-        /** Holds the vertexes triangles. */
-        std::vector<unsigned int> triangles;
-    };
-
     /** Contains indices for triangles vertices and connectivity. */
     struct MeshConnectTriangle
     {
+        MeshConnectTriangle() :
+            vertex({ { 0, 0, 0 } }),
+            faceVertex({ { 0, 0, 0 } }),
+            neighbors({ { -1, -1, -1 } })
+        {};
+
         explicit MeshConnectTriangle(const std::array<unsigned int, 3>& v) :
             vertex({ { v[0], v[1], v[2] } }),
             neighbors({ { -1, -1, -1 } })
@@ -54,8 +51,8 @@ namespace cgu {
         /** Holds the triangles vertices. */
         std::array<unsigned int, 3> vertex;
         /** Holds the triangles face vertices (not only position). */
-        mutable std::array<unsigned int, 3> faceVertex;
-        /** Holds the triangles neighbors. */
+        std::array<unsigned int, 3> faceVertex;
+        /** Holds the triangles neighbors (neighbor i is opposite to vertex i, -1 for borders and non-manifold edges). */
         std::array<int, 3> neighbors;
     };
 
@@ -133,27 +130,17 @@ namespace cgu {
         /** Holds the surfaces in this sub-mesh. */
         std::vector<surf> surfaces;
 
-        /** Holds a list of face (triangle) vertices (location only) to be used for
+        /** Holds a list of face (triangle) vertices (location only) in face order to be used for
          *  later calculation of triangle connectivity. */
-        std::set<MeshConnectTriangle> trianglePtsIndices;
+        std::vector<MeshConnectTriangle> trianglePtsIndices;
         /** Holds the first triangle index. */
         unsigned int firstTriIndex;
         /** Holds the number of triangles in this sub-mesh. */
         unsigned int numTriangles;
         /** Holds the bounding box of this sub-mesh. */
         cguMath::AABB3<float> aabb;
-
-    protected:
-        typedef boost::geometry::model::point<float, 3, boost::geometry::cs::cartesian> point;
-        typedef boost::geometry::model::box<point> box;
-        typedef boost::geometry::model::polygon<point, false, false> polygon; // CCW, open polygon
-        typedef std::pair<box, unsigned> polyIdxBox;
-
-        typedef boost::geometry::index::rtree<polyIdxBox, boost::geometry::index::quadratic<16>> RTreeType;
-
-    public:
         /** Holds the tree for fast finding points in triangles. */
-        RTreeType fastFindTree;
+        TriangleBVH fastFindTree;
     };
 }
 
@@ -0,0 +1,302 @@
+/**
+ * @file   TriangleBVH.cpp
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.21
+ *
+ * @brief  Contains the implementation of a bounding volume hierarchy for finding triangles containing points.
+ */
+
+#include "TriangleBVH.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRIANGLE_BVH_SSE2
+#endif
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    /** Holds the number of bins used for evaluating the surface area heuristic. */
+    const unsigned int bvhNumBins = 16;
+    /** Holds the number of triangles below which a node always becomes a leaf. */
+    const unsigned int bvhMinLeafTriangles = 4;
+    /** Holds the maximum number of triangles in a leaf. */
+    const unsigned int bvhMaxLeafTriangles = 16;
+    /** Holds the cost of traversing a node relative to a point in triangle test. */
+    const float bvhTraversalCost = 1.0f;
+
+#ifdef TRIANGLE_BVH_SSE2
+    static_assert(sizeof(TriangleBVHNode) == 32 && offsetof(TriangleBVHNode, boundsMax) == 16,
+        "The SSE2 box test loads the bounds of a node as two registers.");
+
+    /**
+     * Tests if a point lies inside (or on the border of) a nodes bounds.
+     * The bounds are loaded as two registers and compared to the point at once, the fourth lanes (holding the
+     * nodes indices) are ignored.
+     * @param node the node to test.
+     * @param point the point to test (x, y, z in the lower three lanes).
+     */
+    inline bool pointInNodeBounds(const TriangleBVHNode& node, __m128 point)
+    {
+        auto bMin = _mm_loadu_ps(&node.boundsMin.x);
+        auto bMax = _mm_loadu_ps(&node.boundsMax.x);
+        auto inside = _mm_and_ps(_mm_cmpge_ps(point, bMin), _mm_cmple_ps(point, bMax));
+        return (_mm_movemask_ps(inside) & 0x7) == 0x7;
+    }
+#else
+    /**
+     * Tests if a point lies inside (or on the border of) a nodes bounds without branches.
+     * @param node the node to test.
+     * @param point the point to test.
+     */
+    inline bool pointInNodeBounds(const TriangleBVHNode& node, const glm::vec3& point)
+    {
+        return ((point.x >= node.boundsMin.x) & (point.y >= node.boundsMin.y) & (point.z >= node.boundsMin.z)
+            & (point.x <= node.boundsMax.x) & (point.y <= node.boundsMax.y) & (point.z <= node.boundsMax.z)) != 0;
+    }
+#endif
+
+    /**
+     * Holds a bin used for evaluating the surface area heuristic.
+     * @internal
+     */
+    struct BVHBin
+    {
+        BVHBin() :
+            boundsMin(std::numeric_limits<float>::max()),
+            boundsMax(-std::numeric_limits<float>::max()),
+            count(0)
+        {};
+
+        void Grow(const glm::vec3& bMin, const glm::vec3& bMax)
+        {
+            boundsMin = glm::min(boundsMin, bMin);
+            boundsMax = glm::max(boundsMax, bMax);
+        }
+
+        /** Holds the minimum of the bins bounds. */
+        glm::vec3 boundsMin;
+        /** Holds the maximum of the bins bounds. */
+        glm::vec3 boundsMax;
+        /** Holds the number of triangles in the bin. */
+        unsigned int count;
+    };
+
+    /**
+     * Calculates half the surface area of a box (or 0 for empty boxes).
+     * @param bMin the minimum of the box.
+     * @param bMax the maximum of the box.
+     */
+    inline float bvhHalfArea(const glm::vec3& bMin, const glm::vec3& bMax)
+    {
+        auto e = bMax - bMin;
+        if (e.x < 0.0f || e.y < 0.0f || e.z < 0.0f) return 0.0f;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    }
+
+    /**
+     * Holds a triangles bounds while building the hierarchy.
+     * @internal
+     */
+    struct BVHBuildPrimitive
+    {
+        /** Holds the minimum of the triangles bounds. */
+        glm::vec3 boundsMin;
+        /** Holds the triangles index. */
+        unsigned int index;
+        /** Holds the maximum of the triangles bounds. */
+        glm::vec3 boundsMax;
+        /** Holds the center of the triangles bounds. */
+        glm::vec3 center;
+    };
+
+    /**
+     * Builds the hierarchy.
+     * Nodes are split at the best of 16 bins along each axis by the surface area heuristic and become leaves
+     * if no split is cheaper than testing all triangles. The triangle bounds are partitioned in place so each
+     * node works on a contiguous range.
+     * @param tris the triangles.
+     * @param firstTriIndex the mesh global index of the first triangle.
+     */
+    void TriangleBVH::Build(std::vector<cguMath::Tri3<float>> tris, unsigned int firstTriIndex)
+    {
+        Clear();
+        if (tris.empty()) return;
+
+        auto numTris = static_cast<unsigned int>(tris.size());
+        std::vector<BVHBuildPrimitive> prims(numTris);
+        for (unsigned int i = 0; i < numTris; ++i) {
+            prims[i].boundsMin = glm::min(glm::min(tris[i][0], tris[i][1]), tris[i][2]);
+            prims[i].boundsMax = glm::max(glm::max(tris[i][0], tris[i][1]), tris[i][2]);
+            prims[i].center = 0.5f * (prims[i].boundsMin + prims[i].boundsMax);
+            prims[i].index = i;
+        }
+
+        struct BuildTask
+        {
+            unsigned int node;
+            unsigned int begin;
+            unsigned int end;
+            unsigned int depth;
+        };
+
+        nodes.reserve(2 * (numTris / bvhMinLeafTriangles) + 1);
+        nodes.push_back(TriangleBVHNode());
+        std::vector<BuildTask> tasks(1, BuildTask{ 0, 0, numTris, 0 });
+        while (!tasks.empty()) {
+            auto task = tasks.back();
+            tasks.pop_back();
+            auto primsBegin = prims.begin() + task.begin;
+            auto primsEnd = prims.begin() + task.end;
+
+            glm::vec3 bMin(std::numeric_limits<float>::max()), bMax(-std::numeric_limits<float>::max());
+            glm::vec3 cMin(std::numeric_limits<float>::max()), cMax(-std::numeric_limits<float>::max());
+            for (auto it = primsBegin; it != primsEnd; ++it) {
+                bMin = glm::min(bMin, it->boundsMin);
+                bMax = glm::max(bMax, it->boundsMax);
+                cMin = glm::min(cMin, it->center);
+                cMax = glm::max(cMax, it->center);
+            }
+            nodes[task.node].boundsMin = bMin;
+            nodes[task.node].boundsMax = bMax;
+
+            auto count = task.end - task.begin;
+            auto cExtent = cMax - cMin;
+            auto splitAxis = cExtent.x >= cExtent.y && cExtent.x >= cExtent.z ? 0 : (cExtent.y >= cExtent.z ? 1 : 2);
+            auto mid = task.begin;
+            if (count > bvhMinLeafTriangles && cExtent[splitAxis] > 0.0f && task.depth < maxSAHDepth) {
+                glm::vec3 binScale;
+                for (auto axis = 0; axis < 3; ++axis) binScale[axis] = cExtent[axis] > 0.0f ? bvhNumBins / cExtent[axis] : 0.0f;
+                std::array<std::array<BVHBin, bvhNumBins>, 3> bins;
+                for (auto it = primsBegin; it != primsEnd; ++it) {
+                    for (auto axis = 0; axis < 3; ++axis) {
+                        auto b = std::min(static_cast<unsigned int>((it->center[axis] - cMin[axis]) * binScale[axis]), bvhNumBins - 1);
+                        bins[axis][b].Grow(it->boundsMin, it->boundsMax);
+                        ++bins[axis][b].count;
+                    }
+                }
+
+                auto bestCost = std::numeric_limits<float>::max();
+                auto bestAxis = 0;
+                auto bestBin = 0U;
+                for (auto axis = 0; axis < 3; ++axis) {
+                    if (cExtent[axis] <= 0.0f) continue;
+                    // sweep from the right to get the right side costs, then from the left.
+                    std::array<float, bvhNumBins> rightCost;
+                    BVHBin right;
+                    for (auto b = bvhNumBins - 1; b > 0; --b) {
+                        right.Grow(bins[axis][b].boundsMin, bins[axis][b].boundsMax);
+                        right.count += bins[axis][b].count;
+                        rightCost[b] = right.count * bvhHalfArea(right.boundsMin, right.boundsMax);
+                    }
+                    BVHBin left;
+                    for (auto b = 0U; b < bvhNumBins - 1; ++b) {
+                        left.Grow(bins[axis][b].boundsMin, bins[axis][b].boundsMax);
+                        left.count += bins[axis][b].count;
+                        auto cost = left.count * bvhHalfArea(left.boundsMin, left.boundsMax) + rightCost[b + 1];
+                        if (cost < bestCost) {
+                            bestCost = cost;
+                            bestAxis = axis;
+                            bestBin = b;
+                        }
+                    }
+                }
+
+                auto leafCost = count * bvhHalfArea(bMin, bMax);
+                auto splitCost = bvhTraversalCost * bvhHalfArea(bMin, bMax) + bestCost;
+                if (splitCost < leafCost || count > bvhMaxLeafTriangles) {
+                    auto axisScale = binScale[bestAxis];
+                    auto axisMin = cMin[bestAxis];
+                    mid = static_cast<unsigned int>(std::partition(primsBegin, primsEnd, [=](const BVHBuildPrimitive& prim) {
+                        return std::min(static_cast<unsigned int>((prim.center[bestAxis] - axisMin) * axisScale), bvhNumBins - 1) <= bestBin;
+                    }) - prims.begin());
+                }
+            } else if (count > bvhMaxLeafTriangles) {
+                // all centers are the same or the tree got too deep, just halve the node.
+                mid = task.begin + count / 2;
+                std::nth_element(primsBegin, prims.begin() + mid, primsEnd,
+                    [splitAxis](const BVHBuildPrimitive& p0, const BVHBuildPrimitive& p1) {
+                    return p0.center[splitAxis] < p1.center[splitAxis];
+                });
+            }
+
+            if (mid == task.begin || mid == task.end) {
+                nodes[task.node].firstChildOrTriangle = task.begin;
+                nodes[task.node].numTriangles = count;
+            } else {
+                auto firstChild = static_cast<unsigned int>(nodes.size());
+                nodes[task.node].firstChildOrTriangle = firstChild;
+                nodes[task.node].numTriangles = 0;
+                nodes.push_back(TriangleBVHNode());
+                nodes.push_back(TriangleBVHNode());
+                tasks.push_back(BuildTask{ firstChild + 1, mid, task.end, task.depth + 1 });
+                tasks.push_back(BuildTask{ firstChild, task.begin, mid, task.depth + 1 });
+            }
+        }
+        nodes.shrink_to_fit();
+
+        triangles.resize(numTris);
+        triangleIds.resize(numTris);
+        for (unsigned int i = 0; i < numTris; ++i) {
+            triangles[i] = tris[prims[i].index];
+            triangleIds[i] = firstTriIndex + prims[i].index;
+        }
+    }
+
+    /** Removes all nodes and triangles. */
+    void TriangleBVH::Clear()
+    {
+        std::vector<TriangleBVHNode>().swap(nodes);
+        std::vector<cguMath::Tri3<float>>().swap(triangles);
+        std::vector<unsigned int>().swap(triangleIds);
+    }
+
+    /**
+     *  Finds a triangle containing the given point.
+     *  @param point the point to find the triangle for.
+     *  @return the mesh global index of the triangle or -1 if no triangle contains the point.
+     */
+    int TriangleBVH::FindContainingTriangle(const glm::vec3& point) const
+    {
+        if (nodes.empty()) return -1;
+
+#ifdef TRIANGLE_BVH_SSE2
+        auto boxPoint = _mm_set_ps(0.0f, point.z, point.y, point.x);
+#else
+        const auto& boxPoint = point;
+#endif
+        std::array<unsigned int, stackSize> stack;
+        unsigned int stackTop = 0;
+        stack[stackTop++] = 0;
+        while (stackTop > 0) {
+            const auto& node = nodes[stack[--stackTop]];
+            if (!pointInNodeBounds(node, boxPoint)) continue;
+
+            if (node.numTriangles == 0) {
+                stack[stackTop++] = node.firstChildOrTriangle + 1;
+                stack[stackTop++] = node.firstChildOrTriangle;
+                continue;
+            }
+            for (auto i = node.firstChildOrTriangle; i < node.firstChildOrTriangle + node.numTriangles; ++i) {
+                if (cguMath::pointInTriangleTest<float>(triangles[i], point, nullptr)) return static_cast<int>(triangleIds[i]);
+            }
+        }
+        return -1;
+    }
+
+    /**
+     *  Returns the memory used by the hierarchy in bytes.
+     */
+    std::size_t TriangleBVH::GetMemorySize() const
+    {
+        return nodes.capacity() * sizeof(TriangleBVHNode) + triangles.capacity() * sizeof(cguMath::Tri3<float>)
+            + triangleIds.capacity() * sizeof(unsigned int);
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file   TriangleBVH.h
+ * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+ * @date   2015.09.21
+ *
+ * @brief  Contains the definition of a bounding volume hierarchy for finding triangles containing points.
+ */
+
+#ifndef TRIANGLEBVH_H
+#define TRIANGLEBVH_H
+
+#include "core/math/math.h"
+#include <vector>
+
+namespace cgu {
+
+    /**
+     * A node of a TriangleBVH. Inner nodes have two consecutive children, leaves a range of triangles.
+     * @internal
+     */
+    struct TriangleBVHNode
+    {
+        /** Holds the minimum of the nodes bounds. */
+        glm::vec3 boundsMin;
+        /** Holds the index of the first child (inner nodes) or the first triangle (leaves). */
+        unsigned int firstChildOrTriangle;
+        /** Holds the maximum of the nodes bounds. */
+        glm::vec3 boundsMax;
+        /** Holds the number of triangles (0 for inner nodes). */
+        unsigned int numTriangles;
+    };
+
+    /**
+     * @brief  Bounding volume hierarchy over triangles for point location.
+     * The hierarchy is built with a binned surface area heuristic and stored in flat arrays: the nodes in
+     * depth first order and copies of the triangles in leaf order, so queries do not chase pointers.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@googlemail.com>
+     * @date   2015.09.21
+     */
+    class TriangleBVH
+    {
+    public:
+        void Build(std::vector<cguMath::Tri3<float>> tris, unsigned int firstTriIndex);
+        void Clear();
+        int FindContainingTriangle(const glm::vec3& point) const;
+        std::size_t GetMemorySize() const;
+
+        /** Returns the number of nodes in the hierarchy. */
+        std::size_t GetNumberOfNodes() const { return nodes.size(); }
+
+    private:
+        /** Holds the maximum depth of the hierarchy, deeper nodes are split at the median. */
+        static const unsigned int maxSAHDepth = 56;
+        /** Holds the size of the traversal stack. */
+        static const unsigned int stackSize = 96;
+
+        /** Holds the nodes (depth first, root first). */
+        std::vector<TriangleBVHNode> nodes;
+        /** Holds the triangles in leaf order. */
+        std::vector<cguMath::Tri3<float>> triangles;
+        /** Holds the (mesh global) indices of the triangles in leaf order. */
+        std::vector<unsigned int> triangleIds;
+    };
+}
+
+#endif /* TRIANGLEBVH_H */
@@ -0,0 +1,133 @@
+/**
+ * @file   VertexIndexCache.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Contains the map used for deduplicating the vertices of .obj files.
+ */
+
+#ifndef VERTEXINDEXCACHE_H
+#define VERTEXINDEXCACHE_H
+
+#include <cassert>
+#include <utility>
+#include <vector>
+
+namespace cgu {
+
+    /**
+     * Holds the (1-based or relative) indices of a single point, line or face vertex in an .obj file.
+     * A value of 0 means the index was not given.
+     */
+    struct ObjVertexIndex
+    {
+        /** Default constructor. */
+        ObjVertexIndex() : pos(0), tex(0), normal(0) {};
+
+        /** Holds the position index. */
+        int pos;
+        /** Holds the texture coordinate index. */
+        int tex;
+        /** Holds the normal index. */
+        int normal;
+    };
+
+    /**
+     * @brief  Map from .obj index triples to vertex indices for a range of positions.
+     * Most positions are used with a single texture coordinate and normal, so the first triple of each position
+     * is stored in a dense array indexed by the position (faces using nearby positions stay in the cache). Further
+     * triples of a position (at texture or normal seams) are chained to it in a pool of entries, like the former
+     * per position lists of vertices but comparing indices instead of vertex data and without an allocation per
+     * entry. Finding a triple is linear in the number of triples of its position.
+     * Keys must be absolute indices with a position in the range of the map, the parser drops statements with
+     * indices that do not resolve to a defined element before deduplicating.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.10.01
+     */
+    class VertexIndexCache
+    {
+    public:
+        /**
+         * Constructor.
+         * @param firstPos the first (1-based) position index in the map.
+         * @param endPos the (1-based) position index behind the last one in the map.
+         */
+        VertexIndexCache(int firstPos, int endPos) :
+            firstPos(firstPos),
+            heads(static_cast<std::size_t>(endPos - firstPos))
+        {
+            assert(firstPos >= 1 && endPos >= firstPos);
+        }
+
+        /**
+         * Finds the vertex for an index triple or inserts a new one.
+         * @param key the index triple (absolute indices, the position must be in the range of the map).
+         * @param newIndex the vertex index to insert if the triple was not found.
+         * @return the vertex index and whether it was inserted.
+         */
+        std::pair<unsigned int, bool> FindOrInsert(const ObjVertexIndex& key, unsigned int newIndex)
+        {
+            assert(key.pos >= firstPos && static_cast<std::size_t>(key.pos - firstPos) < heads.size());
+            auto& head = heads[key.pos - firstPos];
+            if (head.index == NO_ENTRY) {
+                head = Entry(key, newIndex);
+                return std::make_pair(newIndex, true);
+            }
+            if (head.Matches(key)) return std::make_pair(head.index, false);
+
+            auto link = &head.next;
+            while (*link != NO_ENTRY) {
+                const auto& entry = seamEntries[*link];
+                if (entry.Matches(key)) return std::make_pair(entry.index, false);
+                link = &seamEntries[*link].next;
+            }
+            *link = static_cast<unsigned int>(seamEntries.size());
+            seamEntries.push_back(Entry(key, newIndex));
+            return std::make_pair(newIndex, true);
+        }
+
+        /** Returns the number of index triples in the map. */
+        std::size_t GetSize() const
+        {
+            std::size_t size = seamEntries.size();
+            for (const auto& head : heads) if (head.index != NO_ENTRY) ++size;
+            return size;
+        }
+
+    private:
+        /** Marks empty entries and the end of a chain. */
+        static const unsigned int NO_ENTRY = 0xFFFFFFFFu;
+
+        /** An entry of the map (the position is given by the head the entry is chained to). */
+        struct Entry
+        {
+            /** Constructs an empty entry. */
+            Entry() : tex(0), normal(0), index(NO_ENTRY), next(NO_ENTRY) {};
+            /** Constructs an entry for a triple. */
+            Entry(const ObjVertexIndex& key, unsigned int index) :
+                tex(key.tex), normal(key.normal), index(index), next(NO_ENTRY) {};
+
+            /** Returns whether the entry holds the texture coordinate and normal of a triple. */
+            bool Matches(const ObjVertexIndex& key) const { return tex == key.tex && normal == key.normal; }
+
+            /** Holds the texture coordinate index. */
+            int tex;
+            /** Holds the normal index. */
+            int normal;
+            /** Holds the vertex index. */
+            unsigned int index;
+            /** Holds the index of the next entry with the same position in the pool. */
+            unsigned int next;
+        };
+
+        /** Holds the first position index in the map. */
+        int firstPos;
+        /** Holds the first triple of each position. */
+        std::vector<Entry> heads;
+        /** Holds the pool of the further triples. */
+        std::vector<Entry> seamEntries;
+    };
+}
+
+#endif /* VERTEXINDEXCACHE_H */
@@ -28,6 +28,7 @@ namespace cgu {
         width(w),
         height(h),
         depth(arraySize),
+        mipLevels(1),
         hasMipMaps(false)
     {
         OGL_CALL(glGenTextures, 1, &id.textureId);
@@ -43,6 +44,7 @@ namespace cgu {
         width(size),
         height(1),
         depth(1),
+        mipLevels(1),
         hasMipMaps(false)
     {
         OGL_CALL(glGenTextures, 1, &id.textureId);
@@ -66,6 +68,7 @@ namespace cgu {
         width(w),
         height(h),
         depth(1),
+        mipLevels(1),
         hasMipMaps(false)
     {
         OGL_CALL(glGenTextures, 1, &id.textureId);
@@ -89,19 +92,44 @@ namespace cgu {
     * @param data the textures data
     */
     GLTexture::GLTexture(unsigned int w, unsigned int h, unsigned int d, const TextureDescriptor& desc, const void* data) :
+        GLTexture(w, h, d, 1, desc, data)
+    {
+    }
+
+    /**
+    * Constructor.
+    * Creates a 3d texture with mip maps.
+    * @param w the textures width
+    * @param h the textures height
+    * @param d the textures depth
+    * @param levels the number of mip map levels
+    * @param desc the textures format
+    * @param data the textures data (all mip map levels one after the other)
+    */
+    GLTexture::GLTexture(unsigned int w, unsigned int h, unsigned int d, unsigned int levels, const TextureDescriptor& desc,
+        const void* data) :
         id{ 0, GL_TEXTURE_3D },
         descriptor(desc),
         width(w),
         height(h),
         depth(d),
-        hasMipMaps(false)
+        mipLevels(levels),
+        hasMipMaps(levels > 1)
     {
         OGL_CALL(glGenTextures, 1, &id.textureId);
         OGL_CALL(glBindTexture, id.textureType, id.textureId);
-        OGL_CALL(glTexStorage3D, id.textureType, 1, descriptor.internalFormat, width, height, depth);
+        OGL_CALL(glTexStorage3D, id.textureType, mipLevels, descriptor.internalFormat, width, height, depth);
         if (data) {
-            OGL_CALL(glTexSubImage3D, id.textureType, 0, 0, 0, 0, width, height, depth,
-                descriptor.format, descriptor.type, data);
+            // the data is tightly packed (rows of RGB or 8 bit textures are not necessarily 4 byte aligned).
+            OGL_CALL(glPixelStorei, GL_UNPACK_ALIGNMENT, 1);
+            auto levelData = static_cast<const uint8_t*>(data);
+            for (unsigned int level = 0; level < mipLevels; ++level) {
+                glm::uvec3 levelSize{ glm::max(1u, width >> level), glm::max(1u, height >> level), glm::max(1u, depth >> level) };
+                OGL_CALL(glTexSubImage3D, id.textureType, level, 0, 0, 0, levelSize.x, levelSize.y, levelSize.z,
+                    descriptor.format, descriptor.type, levelData);
+                levelData += static_cast<std::size_t>(levelSize.x) * levelSize.y * levelSize.z * descriptor.bytesPP;
+            }
+            OGL_CALL(glPixelStorei, GL_UNPACK_ALIGNMENT, 4);
         }
         OGL_CALL(glBindTexture, id.textureType, 0);
         InitSampling();
@@ -118,6 +146,7 @@ namespace cgu {
         width(0),
         height(0),
         depth(0),
+        mipLevels(1),
         hasMipMaps(false)
     {
         OGL_CALL(glBindTexture, id.textureType, id.textureId);
@@ -286,45 +315,43 @@ namespace cgu {
     }
 
     /**
-     *  Generates MipMaps for the texture.
+     *  Uploads data to the texture from a pixel unpack buffer.
+     *  The upload is only issued, the caller needs to fence the buffer before writing to it again.
+     *  @param pbo the pixel unpack buffer holding the data.
+     *  @param pboOffset the offset of the data in the buffer (3d textures: all mip map levels one after the other).
      */
-    void GLTexture::GenerateMipMaps() const
+    void GLTexture::UploadData(GLuint pbo, std::size_t pboOffset) const
     {
+        OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, pbo);
         OGL_CALL(glBindTexture, id.textureType, id.textureId);
-        OGL_CALL(glGenerateMipmap, id.textureType);
+        auto offset = reinterpret_cast<const void*>(pboOffset);
+        if (id.textureType == GL_TEXTURE_3D) {
+            for (unsigned int level = 0; level < mipLevels; ++level) {
+                glm::uvec3 levelSize{ glm::max(1u, width >> level), glm::max(1u, height >> level), glm::max(1u, depth >> level) };
+                OGL_CALL(glTexSubImage3D, id.textureType, level, 0, 0, 0, levelSize.x, levelSize.y, levelSize.z,
+                    descriptor.format, descriptor.type, reinterpret_cast<const void*>(pboOffset));
+                pboOffset += static_cast<std::size_t>(levelSize.x) * levelSize.y * levelSize.z * descriptor.bytesPP;
+            }
+        } else if (id.textureType == GL_TEXTURE_2D_ARRAY) {
+            OGL_CALL(glTexSubImage3D, id.textureType, 0, 0, 0, 0, width, height, depth, descriptor.format, descriptor.type, offset);
+        } else if (id.textureType == GL_TEXTURE_2D || id.textureType == GL_TEXTURE_1D_ARRAY) {
+            OGL_CALL(glTexSubImage2D, id.textureType, 0, 0, 0, width, height, descriptor.format, descriptor.type, offset);
+        } else {
+            OGL_CALL(glTexSubImage1D, id.textureType, 0, 0, width, descriptor.format, descriptor.type, offset);
+        }
+
         OGL_CALL(glBindTexture, id.textureType, 0);
+        OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, 0);
     }
 
     /**
-     *  Generates min/max maps for the texture (only 4 components allowed, r: avg, g: min, b: max).
-     *  @param minMaxProg the program for generating the Min/Max MipMaps
-     *  @param uniformNames the names of the uniforms of the images used in the program
+     *  Generates MipMaps for the texture.
      */
-    void GLTexture::GenerateMinMaxMaps(GPUProgram* minMaxProg, const std::vector<BindingLocation>& uniformNames)
+    void GLTexture::GenerateMipMaps() const
     {
-        assert(descriptor.format == GL_RGBA || descriptor.format == GL_RGBA_INTEGER);
-
         OGL_CALL(glBindTexture, id.textureType, id.textureId);
         OGL_CALL(glGenerateMipmap, id.textureType);
-
-        auto max_res = glm::max(width, glm::max(height, depth));
-        auto firstMipRes = glm::ivec3(glm::ceil(glm::vec3(width, height, depth) * 0.5f));
-        auto numGroups = glm::ivec3(glm::ceil(glm::vec3(firstMipRes) / 8.0f));
-        unsigned int levels = glm::max(1, static_cast<int>(glm::log2(static_cast<float>(max_res))) + 1);
-
-        minMaxProg->UseProgram();
-        minMaxProg->SetUniform(uniformNames[0], 0);
-        minMaxProg->SetUniform(uniformNames[1], 1);
-        for (unsigned int i = 1; i < static_cast<unsigned int>(levels - 1); ++i) {
-            numGroups = glm::ivec3(glm::ceil(glm::vec3(numGroups) * 0.5f));
-            ActivateImage(0, i - 1, GL_READ_ONLY);
-            ActivateImage(1, i, GL_WRITE_ONLY);
-            OGL_CALL(glDispatchCompute, numGroups.x, numGroups.y, numGroups.z);
-            OGL_CALL(glMemoryBarrier, GL_ALL_BARRIER_BITS);
-            OGL_SCALL(glFinish);
-        }
-        hasMipMaps = true;
-        InitSampling();
+        OGL_CALL(glBindTexture, id.textureType, 0);
     }
 
     /**
@@ -65,6 +65,8 @@ namespace cgu {
         GLTexture(unsigned int width, unsigned int height, unsigned int arraySize, const TextureDescriptor& desc);
         GLTexture(unsigned int width, unsigned int height, const TextureDescriptor& desc, const void* data);
         GLTexture(unsigned int width, unsigned int height, unsigned int depth, const TextureDescriptor& desc, const void* data);
+        GLTexture(unsigned int width, unsigned int height, unsigned int depth, unsigned int levels, const TextureDescriptor& desc,
+            const void* data);
         virtual ~GLTexture();
 
         void ActivateTexture(GLenum textureUnit) const;
@@ -73,8 +75,8 @@ namespace cgu {
         void SetData(const void* data) const;
         void DownloadData(std::vector<uint8_t>& data) const;
         void UploadData(std::vector<uint8_t>& data) const;
+        void UploadData(GLuint pbo, std::size_t pboOffset) const;
         void GenerateMipMaps() const;
-        void GenerateMinMaxMaps(GPUProgram* minMaxProgram, const std::vector<BindingLocation>& uniformNames);
 
         void SampleWrapMirror() const;
         void SampleWrapClamp() const;
@@ -95,6 +97,8 @@ namespace cgu {
         unsigned int height;
         /** Holds the depth or number of array slices. */
         unsigned int depth;
+        /** Holds the number of mip map levels of the textures storage. */
+        unsigned int mipLevels;
         /** Holds whether the texture has mip maps. */
         bool hasMipMaps;
 
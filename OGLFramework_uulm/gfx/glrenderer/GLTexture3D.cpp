@@ -11,17 +11,46 @@
 #include "app/Configuration.h"
 #include <codecvt>
 #include <fstream>
+#include <sstream>
 #include "GLTexture.h"
-#include <boost/assign.hpp>
 #include "gfx/volumes/VolumeBrickOctree.h"
+#include "gfx/volumes/VolumeBrickCache.h"
+#include "gfx/volumes/VolumeBrickLayout.h"
+#include "gfx/volumes/VolumeMinMaxBuilder.h"
+#include "gfx/volumes/VolumeRawSlabReader.h"
+#include "core/parallel_helper.h"
+#include "core/binary_helper.h"
 #include <ios>
+#include <cstring>
 #include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #undef min
 #undef max
 
 namespace cgu {
 
+    namespace bip = boost::interprocess;
+
+    /**
+     *  Maps a raw volume file read only into memory.
+     *  @param rawFileName the name of the raw file.
+     *  @return the mapped region (empty for empty files).
+     */
+    std::unique_ptr<bip::mapped_region> mapRawFile(const std::string& rawFileName)
+    {
+        try {
+            if (boost::filesystem::file_size(rawFileName) == 0) return std::make_unique<bip::mapped_region>();
+            bip::file_mapping rawFile(rawFileName.c_str(), bip::read_only);
+            return std::make_unique<bip::mapped_region>(rawFile, bip::read_only);
+        } catch (const std::exception&) {
+            std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+            LOG(ERROR) << "Could not open file '" << converter.from_bytes(rawFileName) << "'.";
+            throw std::runtime_error("Could not open file '" + rawFileName + "'.");
+        }
+    }
+
     /**
      * Constructor.
      * @param texFilename the textures file name
@@ -35,7 +64,7 @@ namespace cgu {
         scaleValue(1),
         dataDim(1),
         texDesc(4, GL_R8, GL_RED, GL_UNSIGNED_BYTE),
-        fileStream(nullptr)
+        datHash(0)
     {
     }
 
@@ -56,7 +85,7 @@ namespace cgu {
         std::swap(scaleValue, tmp.scaleValue);
         std::swap(dataDim, tmp.dataDim);
         std::swap(texDesc, tmp.texDesc);
-        std::swap(fileStream, tmp.fileStream);
+        std::swap(datHash, tmp.datHash);
         std::swap(data, tmp.data);
         return *this;
     }
@@ -71,7 +100,7 @@ namespace cgu {
         scaleValue(std::move(rhs.scaleValue)),
         dataDim(std::move(rhs.dataDim)),
         texDesc(std::move(rhs.texDesc)),
-        fileStream(std::move(rhs.fileStream)),
+        datHash(std::move(rhs.datHash)),
         data(std::move(rhs.data))
     {
         
@@ -86,7 +115,7 @@ namespace cgu {
         scaleValue = std::move(rhs.scaleValue);
         dataDim = std::move(rhs.dataDim);
         texDesc = std::move(rhs.texDesc);
-        fileStream = std::move(rhs.fileStream);
+        datHash = std::move(rhs.datHash);
         data = std::move(rhs.data);
         return *this;
     }
@@ -111,13 +140,17 @@ namespace cgu {
                 << errdesc_info("Cannot load file, file type not supported.");
         }
 
-        std::ifstream ifs(filename);
-        if (!ifs.is_open()) {
+        std::ifstream datStream(filename, std::ios::binary);
+        if (!datStream.is_open()) {
             std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
             LOG(ERROR) << "Cannot open file '" << converter.from_bytes(filename) << "'.";
             throw resource_loading_error() << ::boost::errinfo_file_name(datFile.filename().string()) << resid_info(id)
                 << errdesc_info("Cannot open file.");
         }
+        std::string datContent{ std::istreambuf_iterator<char>(datStream), std::istreambuf_iterator<char>() };
+        datStream.close();
+        datHash = binary_help::hashBytes(datContent.data(), datContent.size());
+        std::istringstream ifs(datContent);
 
         std::string str, raw_file, format_str, obj_model;
 
@@ -133,7 +166,6 @@ namespace cgu {
             else if (str == "ObjectModel:")
                 ifs >> obj_model;
         }
-        ifs.close();
 
         if (raw_file == "" || volumeSize == glm::uvec3(0) || format_str == "") {
             LOG(ERROR) << "Could find all required fields in dat file.";
@@ -154,6 +186,18 @@ namespace cgu {
         } else if (format_str == "UINT") {
             texDesc.type = GL_UNSIGNED_INT;
             componentSize = 4;
+        } else if (format_str == "CHAR") {
+            texDesc.type = GL_BYTE;
+            componentSize = 1;
+        } else if (format_str == "SHORT") {
+            texDesc.type = GL_SHORT;
+            componentSize = 2;
+        } else if (format_str == "HALF") {
+            texDesc.type = GL_HALF_FLOAT;
+            componentSize = 2;
+        } else if (format_str == "FLOAT") {
+            texDesc.type = GL_FLOAT;
+            componentSize = 4;
         } else {
             std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
             LOG(ERROR) << "Format '" << converter.from_bytes(format_str) << "' is not supported.";
@@ -180,31 +224,16 @@ namespace cgu {
                 << errdesc_info("ObjectModel not supported.");
         }
 
+        // integer values are normalized by OpenGL (to [-1, 1] if signed), half and float values are kept.
+        static const GLint formats8[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+        static const GLint formats8Snorm[] = { GL_R8_SNORM, GL_RG8_SNORM, GL_RGB8_SNORM, GL_RGBA8_SNORM };
+        static const GLint formats16F[] = { GL_R16F, GL_RG16F, GL_RGB16F, GL_RGBA16F };
+        static const GLint formats32F[] = { GL_R32F, GL_RG32F, GL_RGB32F, GL_RGBA32F };
         texDesc.bytesPP = dataDim * componentSize;
-        if (texDesc.type == GL_UNSIGNED_BYTE && texDesc.format == GL_RED)
-            texDesc.internalFormat = GL_R8;
-        else if (texDesc.type == GL_UNSIGNED_BYTE && texDesc.format == GL_RG)
-            texDesc.internalFormat = GL_RG8;
-        else if (texDesc.type == GL_UNSIGNED_BYTE && texDesc.format == GL_RGB)
-            texDesc.internalFormat = GL_RGB8;
-        else if (texDesc.type == GL_UNSIGNED_BYTE && texDesc.format == GL_RGBA)
-            texDesc.internalFormat = GL_RGBA8;
-        else if (texDesc.type == GL_UNSIGNED_SHORT && texDesc.format == GL_RED)
-            texDesc.internalFormat = GL_R16F;
-        else if (texDesc.type == GL_UNSIGNED_SHORT && texDesc.format == GL_RG)
-            texDesc.internalFormat = GL_RG16F;
-        else if (texDesc.type == GL_UNSIGNED_SHORT && texDesc.format == GL_RGB)
-            texDesc.internalFormat = GL_RGB16F;
-        else if (texDesc.type == GL_UNSIGNED_SHORT && texDesc.format == GL_RGBA)
-            texDesc.internalFormat = GL_RGBA16F;
-        else if (texDesc.type == GL_UNSIGNED_INT && texDesc.format == GL_RED)
-            texDesc.internalFormat = GL_R32F;
-        else if (texDesc.type == GL_UNSIGNED_INT && texDesc.format == GL_RG)
-            texDesc.internalFormat = GL_RG32F;
-        else if (texDesc.type == GL_UNSIGNED_INT && texDesc.format == GL_RGB)
-            texDesc.internalFormat = GL_RGB32F;
-        else if (texDesc.type == GL_UNSIGNED_INT && texDesc.format == GL_RGBA)
-            texDesc.internalFormat = GL_RGBA32F;
+        if (texDesc.type == GL_UNSIGNED_BYTE) texDesc.internalFormat = formats8[dataDim - 1];
+        else if (texDesc.type == GL_BYTE) texDesc.internalFormat = formats8Snorm[dataDim - 1];
+        else if (componentSize == 2) texDesc.internalFormat = formats16F[dataDim - 1];
+        else texDesc.internalFormat = formats32F[dataDim - 1];
 
         scaleValue = (format_str == "USHORT_12") ? 16 : 1;
         rawFileName = path + "/" + raw_file;
@@ -223,48 +252,28 @@ namespace cgu {
 
     /**
      *  Loads the content of the volume to a single texture.
+     *  The raw file is memory mapped and uploaded directly if its values do not need to be converted.
      *  @return the loaded texture.
      */
     GLTexture* GLTexture3D::LoadToSingleTexture()
     {
-        std::ifstream ifsRaw(rawFileName, std::ios::in | std::ios::binary);
-        if (!ifsRaw || !ifsRaw.is_open()) {
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-            LOG(ERROR) << "Could not open file '" << converter.from_bytes(rawFileName) << "'.";
-            throw std::runtime_error("Could not open file '" + rawFileName + "'.");
+        auto rawRegion = mapRawFile(rawFileName);
+        auto rawData = static_cast<const char*>(rawRegion->get_address());
+        auto data_size = rawRegion->get_size();
+
+        std::size_t volumeNumBytes = static_cast<std::size_t>(volumeSize.x) * volumeSize.y * volumeSize.z * texDesc.bytesPP;
+        if (scaleValue == 1 && data_size >= volumeNumBytes) {
+            texture = std::make_unique<GLTexture>(volumeSize.x, volumeSize.y, volumeSize.z, texDesc, rawData);
+            return texture.get();
         }
 
-        ifsRaw.seekg(0, std::ios::end);
-        auto data_size = static_cast<unsigned int>(ifsRaw.tellg());
-        ifsRaw.seekg(0, std::ios::beg);
-
-        std::vector<char> rawData(data_size, 9);
-        ifsRaw.read(rawData.data(), data_size);
-        ifsRaw.close();
-
-        auto volumeNumBytes = volumeSize.x * volumeSize.y * volumeSize.z * texDesc.bytesPP;
         data.resize(volumeNumBytes);
-
-        if (texDesc.type == GL_UNSIGNED_BYTE) {
-            int size = std::min(data_size, volumeNumBytes);
-            auto ptr = reinterpret_cast<uint8_t*>(rawData.data());
-            for (auto i = 0; i < size; ++i) {
-                data[i] = ptr[i];
-            }
-        } else if (texDesc.type == GL_UNSIGNED_SHORT) {
-            auto elementSize = static_cast<unsigned int>(sizeof(uint16_t));
-            auto size = std::min(data_size, volumeNumBytes) / elementSize;
-            auto ptr = reinterpret_cast<uint16_t*>(rawData.data());
-            for (unsigned int i = 0; i < size; ++i) {
-                reinterpret_cast<uint16_t*>(data.data())[i] = ptr[i] * scaleValue;
-            }
-        } else if (texDesc.type == GL_UNSIGNED_INT) {
-            auto elementSize = static_cast<unsigned int>(sizeof(uint32_t));
-            auto size = std::min(data_size, volumeNumBytes) / elementSize;
-            auto ptr = reinterpret_cast<uint32_t*>(rawData.data());
-            for (unsigned int i = 0; i < size; ++i) {
-                reinterpret_cast<uint32_t*>(data.data())[i] = ptr[i];
-            }
+        auto size = std::min(data_size, volumeNumBytes);
+        if (scaleValue != 1) {
+            VolumeRawSlabReader::CopyScaledUShorts(reinterpret_cast<const uint8_t*>(rawData),
+                reinterpret_cast<uint8_t*>(data.data()), size / sizeof(std::uint16_t), static_cast<std::uint16_t>(scaleValue));
+        } else if (size > 0) {
+            std::memcpy(data.data(), rawData, size);
         }
 
         texture = std::make_unique<GLTexture>(volumeSize.x, volumeSize.y, volumeSize.z, texDesc, data.data());
@@ -286,99 +295,40 @@ namespace cgu {
 
     std::unique_ptr<VolumeBrickOctree> GLTexture3D::GetBrickedVolume(const glm::vec3& scale)
     {
-        assert(texDesc.format == GL_RED || texDesc.format == GL_RED_INTEGER);
-        std::ifstream ifs(rawFileName, std::ios::binary);
-        if (!ifs.is_open()) {
-            std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-            LOG(ERROR) << "Could not open file '" << converter.from_bytes(rawFileName) << "'.";
-            throw std::runtime_error("Could not open file '" + rawFileName + "'.");
-        }
-        fileStream = &ifs;
-
-        GPUProgram* minMaxProg;
-        if (texDesc.bytesPP == 1) minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxMipMaps8.cp");
-        else if (texDesc.bytesPP == 2) minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxMipMaps16.cp");
-        else if (texDesc.bytesPP == 4) minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxMipMaps32.cp");
-        else throw std::runtime_error("Texture bit depth is not supported for min/max octrees.");
-        auto uniformNames = minMaxProg->GetUniformLocations(boost::assign::list_of<std::string>("origTex")("nextLevelTex"));
-        std::unique_ptr<VolumeBrickOctree> result{ new VolumeBrickOctree(this, glm::uvec3(0), volumeSize,
-            scale * cellSize, minMaxProg, uniformNames, application) };
-
-        fileStream = nullptr;
-        return std::move(result);
-    }
-
-    void GLTexture3D::FillRaw(std::vector<uint8_t>& data, const glm::uvec3& pos, const glm::uvec3& dataSize, const glm::uvec3& texSize) const
-    {
-        assert(fileStream != nullptr);
-        assert(texDesc.format == GL_RED || texDesc.format == GL_RED_INTEGER);
-
-        data.resize(texSize.x * texSize.y * texSize.z * texDesc.bytesPP, 0);
-        auto lineSize = volumeSize.x * texDesc.bytesPP;
-        auto dataPtr = reinterpret_cast<char*>(data.data());
-
-        for (unsigned int z = 0; z < dataSize.z; ++z) {
-            for (unsigned int y = 0; y < dataSize.y; ++y) {
-                auto lineStartFile = ((pos.z + z) * volumeSize.y * lineSize) + ((pos.y + y) * lineSize) + pos.x * texDesc.bytesPP;
-                fileStream->seekg(lineStartFile, std::ios::beg);
-                fileStream->read(dataPtr, dataSize.x * texDesc.bytesPP);
-                dataPtr += texSize.x * texDesc.bytesPP;
+        auto slabBudget = static_cast<std::size_t>(application->GetConfig().volumeSlabBudgetMB) << 20;
+        VolumeRawSlabReader rawReader(rawFileName, slabBudget);
+
+        VolumeBrickCacheKey cacheKey;
+        cacheKey.headerHash = datHash;
+        cacheKey.rawSize = rawReader.GetFileSize();
+        cacheKey.rawWriteTime = rawReader.GetLastWriteTime();
+        cacheKey.rawHash = 0;
+        cacheKey.maxBrickSize = VolumeBrickOctree::MAX_SIZE;
+        cacheKey.bytesPerVoxel = texDesc.bytesPP;
+        auto reader = &rawReader;
+        auto brickCache = std::make_shared<VolumeBrickCache>(rawFileName + ".brickcache", cacheKey,
+            [reader]() { return reader->CalculateHash(); }, application->GetConfig().compressVolumeBricks);
+
+        // 12 bit values are scaled to 16 bit while reading, subtrees bricked in parallel get the slab budget as well.
+        BrickLayoutSource source{ &rawReader, volumeSize, texDesc.bytesPP, static_cast<std::uint16_t>(scaleValue),
+            VolumeBrickOctree::MAX_SIZE, slabBudget };
+        VolumeMinMaxBuilder minMaxBuilder(texDesc, parallel_help::numThreads(application->GetConfig().numWorkerThreads));
+        std::unique_ptr<VolumeBrickOctree> result;
+        if (brickCache->IsComplete()) {
+            try {
+                VolumeBrickLayout layout(source, scale * cellSize, minMaxBuilder, brickCache);
+                result = std::make_unique<VolumeBrickOctree>(layout);
+            } catch (const std::runtime_error& e) {
+                std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+                LOG(WARNING) << "Brick cache for '" << converter.from_bytes(rawFileName) << "' is invalid ("
+                    << converter.from_bytes(e.what()) << "), bricking the volume again.";
+                brickCache->Invalidate();
             }
         }
-
-        if (scaleValue != 1) {
-            for (auto& val : data) {
-                val *= scaleValue;
-            }
+        if (!result) {
+            VolumeBrickLayout layout(source, scale * cellSize, minMaxBuilder, brickCache);
+            result = std::make_unique<VolumeBrickOctree>(layout);
         }
-    }
-
-    std::unique_ptr<GLTexture> GLTexture3D::CreateMinMaxTexture(const glm::uvec3& pos, const glm::uvec3& size,
-        TextureDescriptor& minMaxDesc) const
-    {
-        assert(texDesc.format == GL_RED || texDesc.format == GL_RED_INTEGER);
-        std::vector<uint8_t> dataRaw;
-        auto dataSize = glm::min(size, volumeSize - pos);
-        glm::uvec3 actualSize;
-        if (dataSize.x == 1) actualSize.x = 2;
-        else actualSize.x = cguMath::roundupPow2(dataSize.x);
-        if (dataSize.y == 1) actualSize.y = 2;
-        else actualSize.y = cguMath::roundupPow2(dataSize.y);
-        if (dataSize.z == 1) actualSize.z = 2;
-        else actualSize.z = cguMath::roundupPow2(dataSize.z);
-
-        FillRaw(dataRaw, pos, dataSize, actualSize);
-
-        GPUProgram* minMaxProg;
-        minMaxDesc.bytesPP = texDesc.bytesPP * 4;
-        minMaxDesc.format = GL_RGBA;
-        minMaxDesc.type = texDesc.type;
-        if (texDesc.type == GL_UNSIGNED_BYTE) {
-            minMaxDesc.internalFormat = GL_RGBA8;
-            minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxTexture8.cp");
-        } else if (texDesc.type == GL_UNSIGNED_SHORT) {
-            minMaxDesc.internalFormat = GL_RGBA16F;
-            minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxTexture16.cp");
-        } else if (texDesc.type == GL_UNSIGNED_INT) {
-            minMaxDesc.internalFormat = GL_RGBA32F;
-            minMaxProg = application->GetGPUProgramManager()->GetResource("genMinMaxTexture32.cp");
-        } else throw std::runtime_error("Pixel-type not supported.");
-        auto uniformNames = minMaxProg->GetUniformLocations(boost::assign::list_of<std::string>("origTex")("minMaxTex"));
-
-        GLTexture origTex(actualSize.x, actualSize.y, actualSize.z, texDesc, dataRaw.data());
-        std::unique_ptr<GLTexture> result{ new GLTexture(actualSize.x, actualSize.y, actualSize.z, minMaxDesc, nullptr) };
-
-        minMaxProg->UseProgram();
-        minMaxProg->SetUniform(uniformNames[0], 0);
-        minMaxProg->SetUniform(uniformNames[1], 1);
-
-        auto numGroups = glm::ivec3(glm::ceil(glm::vec3(actualSize) / 8.0f));
-        origTex.ActivateImage(0, 0, GL_READ_ONLY);
-        result->ActivateImage(1, 0, GL_WRITE_ONLY);
-        OGL_CALL(glDispatchCompute, numGroups.x, numGroups.y, numGroups.z);
-        OGL_CALL(glMemoryBarrier, GL_ALL_BARRIER_BITS);
-        OGL_SCALL(glFinish);
-
         return std::move(result);
     }
 }
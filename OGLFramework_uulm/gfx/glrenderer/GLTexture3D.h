@@ -41,8 +41,6 @@ namespace cgu {
         const glm::vec3& GetScaling() const { return cellSize; }
 
         std::unique_ptr<VolumeBrickOctree> GetBrickedVolume(const glm::vec3& scale);
-        void FillRaw(std::vector<uint8_t>& data, const glm::uvec3& pos, const glm::uvec3& dataSize, const glm::uvec3& texSize) const;
-        std::unique_ptr<GLTexture> CreateMinMaxTexture(const glm::uvec3& pos, const glm::uvec3& size, TextureDescriptor& minMaxDesc) const;
         // const TextureDescriptor& GetTextureDescriptor() const;
         const glm::uvec3& GetSize() const { return volumeSize; }
 
@@ -61,8 +59,8 @@ namespace cgu {
         int dataDim;
         /** Holds the texture description. */
         TextureDescriptor texDesc;
-        /** Holds the open file stream. */
-        std::ifstream* fileStream;
+        /** Holds the hash of the .dat file (used to identify brick caches). */
+        std::uint64_t datHash;
         /** Holds the volumes raw data. */
         std::vector<int8_t> data;
 
@@ -0,0 +1,364 @@
+/**
+ * @file   VolumeBrickCache.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.22
+ *
+ * @brief  Implementation of the persistent on disk cache for volume bricks.
+ */
+
+#include "VolumeBrickCache.h"
+#include "VolumeBrickCodec.h"
+#include "VolumeMinMaxBuilder.h"
+#include "core/binary_helper.h"
+#include <codecvt>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace cgu {
+
+    namespace bip = boost::interprocess;
+
+    /** Holds the magic bytes at the start of a brick cache file. */
+    static const std::array<char, 8> brickCacheMagic{ { 'C', 'G', 'U', 'B', 'R', 'I', 'C', 'K' } };
+    /** Holds the version of the brick cache layout, increase this on every change to it. */
+    static const std::uint32_t brickCacheVersion = 4;
+    /** Holds the offset of the .raw files write time in the cache header. */
+    static const std::size_t brickCacheWriteTimeOffset = sizeof(brickCacheMagic) + sizeof(std::uint32_t)
+        + 2 * sizeof(std::uint64_t);
+    /** Holds the offset of the brick table offset in the cache header. */
+    static const std::size_t brickCacheTableOffsetOffset = brickCacheWriteTimeOffset + sizeof(std::int64_t)
+        + sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+    /** Holds the alignment of the brick data in the file. */
+    static const std::uint64_t brickCacheAlignment = 16;
+
+    /**
+     * Returns the size of the data of a brick with all its mip levels.
+     * @param texSize the size of the brick.
+     * @param bytesPP the size of a texel.
+     */
+    static std::uint64_t calculateBrickDataSize(const glm::uvec3& texSize, std::uint32_t bytesPP)
+    {
+        std::uint64_t size = 0;
+        for (unsigned int level = 0; level < VolumeMinMaxBuilder::CalculateNumMipLevels(texSize); ++level) {
+            auto mipSize = VolumeMinMaxBuilder::CalculateMipSize(texSize, level);
+            size += static_cast<std::uint64_t>(mipSize.x) * mipSize.y * mipSize.z * bytesPP;
+        }
+        return size;
+    }
+
+    /**
+     * Constructor, opens the cache file if it is valid for the key or starts a new one.
+     * The hash of the .raw file is only calculated if its size or write time differ from the ones in the cache
+     * or a new cache is written, otherwise the hash stored in the cache is used.
+     * @param cacheFilename the name of the cache file.
+     * @param key the key identifying the volume (the raw hash is ignored).
+     * @param calculateRawHash the function calculating the hash of the .raw file.
+     * @param compressBricks whether bricks are compressed when a new cache is written.
+     */
+    VolumeBrickCache::VolumeBrickCache(const std::string& cacheFilename, const VolumeBrickCacheKey& key,
+        const std::function<std::uint64_t()>& calculateRawHash, bool compressBricks) :
+        cacheFilename(cacheFilename),
+        removeWriteFile(false),
+        key(key),
+        calculateRawHash(calculateRawHash),
+        rawHashValid(false),
+        compressBricks(compressBricks),
+        nextBrick(0)
+    {
+        if (!OpenExisting()) CreateNew();
+    }
+
+    /** Destructor, removes unfinished and temporary files. */
+    VolumeBrickCache::~VolumeBrickCache()
+    {
+        region.reset();
+        boost::system::error_code ec;
+        if (writeStream.is_open()) {
+            writeStream.close();
+            boost::filesystem::remove(writeFilename, ec);
+        } else if (removeWriteFile) {
+            boost::filesystem::remove(writeFilename, ec);
+        }
+    }
+
+    /**
+     * Opens and maps an existing cache file.
+     * @return whether the file exists, is complete and matches the key.
+     */
+    bool VolumeBrickCache::OpenExisting()
+    {
+        if (!boost::filesystem::exists(cacheFilename) || boost::filesystem::file_size(cacheFilename) == 0) return false;
+
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        try {
+            bip::file_mapping cacheFile(cacheFilename.c_str(), bip::read_only);
+            auto cacheRegion = std::make_unique<bip::mapped_region>(cacheFile, bip::read_only);
+            auto dataBegin = static_cast<const char*>(cacheRegion->get_address());
+            auto dataEnd = dataBegin + cacheRegion->get_size();
+            auto data = dataBegin;
+
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            VolumeBrickCacheKey cachedKey;
+            std::uint64_t tableOffset;
+            binary_help::read(data, dataEnd, magic);
+            binary_help::read(data, dataEnd, version);
+            binary_help::read(data, dataEnd, cachedKey.headerHash);
+            binary_help::read(data, dataEnd, cachedKey.rawSize);
+            binary_help::read(data, dataEnd, cachedKey.rawWriteTime);
+            binary_help::read(data, dataEnd, cachedKey.rawHash);
+            binary_help::read(data, dataEnd, cachedKey.maxBrickSize);
+            binary_help::read(data, dataEnd, cachedKey.bytesPerVoxel);
+            binary_help::read(data, dataEnd, tableOffset);
+            if (magic != brickCacheMagic || version != brickCacheVersion || cachedKey.headerHash != key.headerHash
+                || cachedKey.rawSize != key.rawSize || cachedKey.maxBrickSize != key.maxBrickSize
+                || cachedKey.bytesPerVoxel != key.bytesPerVoxel || tableOffset == 0
+                || tableOffset > cacheRegion->get_size()) {
+                LOG(INFO) << L"Brick cache \"" << converter.from_bytes(cacheFilename) << L"\" is outdated.";
+                return false;
+            }
+
+            // an unchanged write time means an unchanged file, only a touched file needs to be hashed.
+            auto rawTouched = cachedKey.rawWriteTime != key.rawWriteTime;
+            if (!rawTouched) {
+                key.rawHash = cachedKey.rawHash;
+                rawHashValid = true;
+            } else if (GetRawHash() != cachedKey.rawHash) {
+                LOG(INFO) << L"Brick cache \"" << converter.from_bytes(cacheFilename) << L"\" is outdated.";
+                return false;
+            }
+
+            data = dataBegin + tableOffset;
+            binary_help::readVector(data, dataEnd, bricks);
+            for (const auto& brick : bricks) {
+                if (brick.offset > tableOffset || brick.storedSize > tableOffset - brick.offset
+                    || brick.encoding > static_cast<std::uint32_t>(BrickEncoding::LZ_DELTA_PLANES)) {
+                    throw std::out_of_range("Brick data out of bounds.");
+                }
+            }
+            region = std::move(cacheRegion);
+
+            if (rawTouched) {
+                // the content did not change, store the new write time so the next start does not hash again.
+                std::fstream cacheStream(cacheFilename, std::ios::in | std::ios::out | std::ios::binary);
+                cacheStream.seekp(brickCacheWriteTimeOffset);
+                binary_help::write(cacheStream, key.rawWriteTime);
+            }
+            return true;
+        } catch (const std::exception& e) {
+            LOG(WARNING) << L"Could not read brick cache \"" << converter.from_bytes(cacheFilename) << L"\": "
+                << converter.from_bytes(e.what());
+            bricks.clear();
+            return false;
+        }
+    }
+
+    /**
+     * Starts writing a new cache file. The file is written under a temporary name first so an interrupted
+     * write never leaves a broken cache. If the volumes directory is not writable a temporary file is used.
+     */
+    void VolumeBrickCache::CreateNew()
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        writeFilename = cacheFilename + ".tmp";
+        removeWriteFile = false;
+        writeStream.open(writeFilename, std::ios::binary | std::ios::trunc);
+        if (!writeStream.is_open()) {
+            LOG(WARNING) << L"Could not create brick cache \"" << converter.from_bytes(cacheFilename)
+                << L"\", using a temporary file.";
+            writeFilename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+            removeWriteFile = true;
+            writeStream.open(writeFilename, std::ios::binary | std::ios::trunc);
+            if (!writeStream.is_open()) throw std::runtime_error("Could not create brick cache file.");
+        }
+
+        binary_help::write(writeStream, brickCacheMagic);
+        binary_help::write(writeStream, brickCacheVersion);
+        binary_help::write(writeStream, key.headerHash);
+        binary_help::write(writeStream, key.rawSize);
+        binary_help::write(writeStream, key.rawWriteTime);
+        binary_help::write(writeStream, GetRawHash());
+        binary_help::write(writeStream, key.maxBrickSize);
+        binary_help::write(writeStream, key.bytesPerVoxel);
+        binary_help::write(writeStream, std::uint64_t(0)); // table offset, set when finished.
+    }
+
+    /**
+     * Returns the hash of the .raw file, it is calculated on the first call if it was not taken from the cache.
+     */
+    std::uint64_t VolumeBrickCache::GetRawHash()
+    {
+        if (!rawHashValid) {
+            key.rawHash = calculateRawHash();
+            rawHashValid = true;
+        }
+        return key.rawHash;
+    }
+
+    /**
+     * Stores a brick in a cache that is not complete, can be called from multiple threads.
+     * If compression is enabled the brick is encoded on the calling thread.
+     * @param texSize the size of the bricks texture.
+     * @param desc the descriptor of the bricks texture.
+     * @param data the bricks data.
+     * @return the id of the brick (in the order the bricks are stored).
+     */
+    unsigned int VolumeBrickCache::StoreBrick(const glm::uvec3& texSize, const TextureDescriptor& desc,
+        const std::vector<uint8_t>& data)
+    {
+        assert(!IsComplete());
+        std::vector<uint8_t> encoded;
+        auto encoding = BrickEncoding::RAW;
+        if (compressBricks) encoding = VolumeBrickCodec::Encode(data, desc.bytesPP, encoded);
+        const auto& storedData = compressBricks ? encoded : data;
+
+        std::lock_guard<std::mutex> lock(storeMutex);
+        auto offset = static_cast<std::uint64_t>(writeStream.tellp());
+        auto padding = (brickCacheAlignment - offset % brickCacheAlignment) % brickCacheAlignment;
+        for (std::uint64_t i = 0; i < padding; ++i) writeStream.put(0);
+
+        BrickRecord brick;
+        brick.offset = offset + padding;
+        brick.size = data.size();
+        brick.storedSize = storedData.size();
+        brick.texSize[0] = texSize.x;
+        brick.texSize[1] = texSize.y;
+        brick.texSize[2] = texSize.z;
+        brick.bytesPP = desc.bytesPP;
+        brick.internalFormat = desc.internalFormat;
+        brick.format = desc.format;
+        brick.type = desc.type;
+        brick.encoding = static_cast<std::uint32_t>(encoding);
+        writeStream.write(reinterpret_cast<const char*>(storedData.data()), storedData.size());
+        bricks.push_back(brick);
+        return static_cast<unsigned int>(bricks.size() - 1);
+    }
+
+    /**
+     * Reorders the table of the bricks stored so far, the data stays where it is.
+     * Bricks stored in parallel are reordered like this so the table has the order bricks are taken from a complete cache.
+     * @param order the ids returned by StoreBrick in the new order, brick i gets the id i.
+     */
+    void VolumeBrickCache::ReorderBricks(const std::vector<unsigned int>& order)
+    {
+        assert(!IsComplete() && order.size() == bricks.size());
+        std::vector<BrickRecord> orderedBricks;
+        orderedBricks.reserve(bricks.size());
+        for (auto id : order) orderedBricks.push_back(bricks[id]);
+        bricks = std::move(orderedBricks);
+    }
+
+    /**
+     * Takes the next brick from a complete cache.
+     * @param texSize the size of the bricks texture expected by the octree.
+     * @param desc the descriptor of the bricks texture (output).
+     * @return the id of the brick.
+     * @throws std::runtime_error if the cache does not match the octree.
+     */
+    unsigned int VolumeBrickCache::GetNextBrick(const glm::uvec3& texSize, TextureDescriptor& desc)
+    {
+        assert(IsComplete());
+        if (nextBrick >= bricks.size()) throw std::runtime_error("Brick cache has too few bricks.");
+        const auto& brick = bricks[nextBrick];
+        if (brick.texSize[0] != texSize.x || brick.texSize[1] != texSize.y || brick.texSize[2] != texSize.z
+            || brick.size != calculateBrickDataSize(texSize, brick.bytesPP)) {
+            throw std::runtime_error("Brick cache does not match the volume.");
+        }
+
+        desc.bytesPP = brick.bytesPP;
+        desc.internalFormat = brick.internalFormat;
+        desc.format = brick.format;
+        desc.type = brick.type;
+        return nextBrick++;
+    }
+
+    /**
+     * Finishes writing the cache and maps it for reading the bricks.
+     * @throws std::runtime_error if the cache could not be written.
+     */
+    void VolumeBrickCache::Finish()
+    {
+        if (IsComplete()) return;
+
+        auto tableOffset = static_cast<std::uint64_t>(writeStream.tellp());
+        std::uint64_t dataSize = 0, storedSize = 0;
+        for (const auto& brick : bricks) {
+            dataSize += brick.size;
+            storedSize += brick.storedSize;
+        }
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        LOG(INFO) << L"Brick cache \"" << converter.from_bytes(cacheFilename) << L"\" stores " << dataSize
+            << L" bytes of bricks in " << storedSize << L" bytes.";
+
+        binary_help::writeVector(writeStream, bricks);
+        writeStream.seekp(brickCacheTableOffsetOffset);
+        binary_help::write(writeStream, tableOffset);
+        auto writeOk = writeStream.good();
+        writeStream.close();
+        if (!writeOk) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(writeFilename, ec);
+            throw std::runtime_error("Could not write brick cache file.");
+        }
+
+        if (!removeWriteFile) {
+            boost::system::error_code ec;
+            boost::filesystem::rename(writeFilename, cacheFilename, ec);
+            if (ec) {
+                LOG(WARNING) << L"Could not replace brick cache \"" << converter.from_bytes(cacheFilename) << L"\".";
+                removeWriteFile = true;
+            } else {
+                writeFilename = cacheFilename;
+            }
+        }
+
+        bip::file_mapping cacheFile(writeFilename.c_str(), bip::read_only);
+        region = std::make_unique<bip::mapped_region>(cacheFile, bip::read_only);
+        nextBrick = static_cast<unsigned int>(bricks.size());
+    }
+
+    /**
+     * Drops a complete cache that did not match the octree and starts writing a new one.
+     */
+    void VolumeBrickCache::Invalidate()
+    {
+        region.reset();
+        bricks.clear();
+        nextBrick = 0;
+        CreateNew();
+    }
+
+    /**
+     * Reads (and decodes) the data of a brick in a complete cache, can be called from multiple threads.
+     * @param brickId the id of the brick.
+     * @param data the memory to write the bricks data to (GetBrickDataSize bytes).
+     * @param buffer a buffer for decoding (reused between calls to avoid allocations).
+     * @throws std::runtime_error if the bricks data is corrupt.
+     */
+    void VolumeBrickCache::ReadBrick(unsigned int brickId, void* data, std::vector<uint8_t>& buffer) const
+    {
+        assert(IsComplete());
+        const auto& brick = bricks[brickId];
+        VolumeBrickCodec::Decode(static_cast<BrickEncoding>(brick.encoding),
+            static_cast<const uint8_t*>(region->get_address()) + brick.offset, static_cast<std::size_t>(brick.storedSize),
+            brick.bytesPP, static_cast<uint8_t*>(data), static_cast<std::size_t>(brick.size), buffer);
+    }
+
+    /**
+     * Returns the size of a bricks (decoded) data.
+     * @param brickId the id of the brick.
+     */
+    std::size_t VolumeBrickCache::GetBrickDataSize(unsigned int brickId) const
+    {
+        return static_cast<std::size_t>(bricks[brickId].size);
+    }
+
+    /** Returns the size of the largest bricks data. */
+    std::size_t VolumeBrickCache::GetMaxBrickDataSize() const
+    {
+        std::uint64_t maxSize = 0;
+        for (const auto& brick : bricks) if (brick.size > maxSize) maxSize = brick.size;
+        return static_cast<std::size_t>(maxSize);
+    }
+}
@@ -0,0 +1,131 @@
+/**
+ * @file   VolumeBrickCache.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.22
+ *
+ * @brief  Defines the persistent on disk cache for volume bricks.
+ */
+
+#ifndef VOLUMEBRICKCACHE_H
+#define VOLUMEBRICKCACHE_H
+
+#include "main.h"
+#include "gfx/glrenderer/GLTexture.h"
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+
+namespace boost {
+    namespace interprocess {
+        class mapped_region;
+    }
+}
+
+namespace cgu {
+
+    /** Identifies the source of a brick cache, a cache is only used if all values match. */
+    struct VolumeBrickCacheKey
+    {
+        /** Holds the hash of the volumes .dat header. */
+        std::uint64_t headerHash;
+        /** Holds the size of the .raw file. */
+        std::uint64_t rawSize;
+        /** Holds the last write time of the .raw file. */
+        std::int64_t rawWriteTime;
+        /** Holds the hash of the .raw file (only calculated if the size or write time of the file changed). */
+        std::uint64_t rawHash;
+        /** Holds the maximum brick size used for bricking. */
+        std::uint32_t maxBrickSize;
+        /** Holds the bytes per voxel of the volume. */
+        std::uint32_t bytesPerVoxel;
+    };
+
+    /**
+     * @brief  Persistent cache file for the padded bricks of a VolumeBrickOctree.
+     * The cache stores the brick textures (values plus min/max data, all mip map levels) of all nodes in the order the
+     * octree creates them. If a valid cache exists the octree takes the bricks from it in the same order instead of bricking the
+     * volume again, otherwise the bricks are written to a new cache that replaces the old one when it is finished.
+     * Bricks may be stored from multiple threads in any order, the table is brought into creation order before finishing.
+     * Finished caches are memory mapped and bricks are decoded from the mapping, optionally bricks are stored compressed
+     * (see VolumeBrickCodec).
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.22
+     */
+    class VolumeBrickCache
+    {
+    public:
+        VolumeBrickCache(const std::string& cacheFilename, const VolumeBrickCacheKey& key,
+            const std::function<std::uint64_t()>& calculateRawHash, bool compressBricks);
+        ~VolumeBrickCache();
+
+        /** Returns whether the cache holds all bricks (bricks are taken from it instead of stored). */
+        bool IsComplete() const { return region != nullptr; }
+        unsigned int StoreBrick(const glm::uvec3& texSize, const TextureDescriptor& desc, const std::vector<uint8_t>& data);
+        void ReorderBricks(const std::vector<unsigned int>& order);
+        unsigned int GetNextBrick(const glm::uvec3& texSize, TextureDescriptor& desc);
+        void Finish();
+        void Invalidate();
+        void ReadBrick(unsigned int brickId, void* data, std::vector<uint8_t>& buffer) const;
+        std::size_t GetBrickDataSize(unsigned int brickId) const;
+        std::size_t GetMaxBrickDataSize() const;
+        /** Returns the number of bricks in the cache. */
+        std::size_t GetNumberOfBricks() const { return bricks.size(); }
+
+    private:
+        /** Describes a brick in the cache file. */
+        struct BrickRecord
+        {
+            /** Holds the offset of the bricks data in the file. */
+            std::uint64_t offset;
+            /** Holds the size of the bricks data. */
+            std::uint64_t size;
+            /** Holds the size of the bricks data in the file (encoded). */
+            std::uint64_t storedSize;
+            /** Holds the bricks texture size. */
+            std::uint32_t texSize[3];
+            /** Holds the bricks bytes per pixel. */
+            std::uint32_t bytesPP;
+            /** Holds the bricks internal format. */
+            std::int32_t internalFormat;
+            /** Holds the bricks format. */
+            std::uint32_t format;
+            /** Holds the bricks type. */
+            std::uint32_t type;
+            /** Holds the encoding of the bricks data (a BrickEncoding). */
+            std::uint32_t encoding;
+        };
+
+        bool OpenExisting();
+        void CreateNew();
+        std::uint64_t GetRawHash();
+
+        /** Holds the cache files name. */
+        std::string cacheFilename;
+        /** Holds the name of the file written to. */
+        std::string writeFilename;
+        /** Holds whether the written file is a temporary one to delete on destruction. */
+        bool removeWriteFile;
+        /** Holds the key of the cache. */
+        VolumeBrickCacheKey key;
+        /** Holds the function calculating the hash of the .raw file. */
+        std::function<std::uint64_t()> calculateRawHash;
+        /** Holds whether the hash in the key is valid (taken from the cache or calculated). */
+        bool rawHashValid;
+        /** Holds whether new bricks are stored compressed. */
+        bool compressBricks;
+        /** Holds the bricks. */
+        std::vector<BrickRecord> bricks;
+        /** Holds the index of the next brick to take from a complete cache. */
+        unsigned int nextBrick;
+        /** Holds the stream the bricks are written to. */
+        std::ofstream writeStream;
+        /** Holds the mutex for storing bricks from multiple threads. */
+        std::mutex storeMutex;
+        /** Holds the mapped cache file once it is complete. */
+        std::unique_ptr<boost::interprocess::mapped_region> region;
+    };
+}
+
+#endif // VOLUMEBRICKCACHE_H
@@ -0,0 +1,320 @@
+/**
+ * @file   VolumeBrickCodec.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.29
+ *
+ * @brief  Implementation of the compression of volume bricks in the brick cache.
+ */
+
+#include "VolumeBrickCodec.h"
+#include <cstring>
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    namespace {
+
+        /** Holds the minimum length of a match. */
+        const std::size_t lzMinMatch = 4;
+        /** Holds the maximum distance of a match. */
+        const std::size_t lzMaxOffset = 65535;
+        /** Holds the number of bits of the match finders hash table. */
+        const unsigned int lzHashBits = 16;
+        /** Holds the number of bytes decoding may write behind the data (copies are done in chunks of this size). */
+        const std::size_t lzCopySlack = 16;
+        /** Holds the largest texel size (4 channels with 4 bytes). */
+        const unsigned int maxBytesPP = 16;
+
+        inline uint32_t read32(const uint8_t* p)
+        {
+            uint32_t value;
+            std::memcpy(&value, p, sizeof(value));
+            return value;
+        }
+
+        inline uint32_t lzHash(uint32_t value) { return (value * 2654435761u) >> (32 - lzHashBits); }
+
+        /**
+         * Writes a length that does not fit into the 4 bits of a token (as a sequence of 255 terminated by a smaller byte).
+         * @param length the length minus 15.
+         * @param out the output to append to.
+         */
+        void lzWriteLength(std::size_t length, std::vector<uint8_t>& out)
+        {
+            for (; length >= 255; length -= 255) out.push_back(255);
+            out.push_back(static_cast<uint8_t>(length));
+        }
+
+        /**
+         * Appends a sequence (literals followed by a match) to the compressed output.
+         * The token holds the number of literals in its high and the match length minus 4 in its low 4 bits,
+         * the last sequence has no match.
+         * @param literals the literals.
+         * @param numLiterals the number of literals.
+         * @param offset the distance of the match.
+         * @param matchLength the length of the match (0 for the last sequence).
+         * @param out the output to append to.
+         */
+        void lzWriteSequence(const uint8_t* literals, std::size_t numLiterals, std::size_t offset, std::size_t matchLength,
+            std::vector<uint8_t>& out)
+        {
+            auto matchCode = matchLength == 0 ? 0 : matchLength - lzMinMatch;
+            out.push_back(static_cast<uint8_t>((std::min(numLiterals, std::size_t(15)) << 4) | std::min(matchCode, std::size_t(15))));
+            if (numLiterals >= 15) lzWriteLength(numLiterals - 15, out);
+            out.insert(out.end(), literals, literals + numLiterals);
+            if (matchLength == 0) return;
+            out.push_back(static_cast<uint8_t>(offset & 0xFF));
+            out.push_back(static_cast<uint8_t>(offset >> 8));
+            if (matchCode >= 15) lzWriteLength(matchCode - 15, out);
+        }
+
+        /**
+         * Compresses data with a greedy LZ77 match finder (one candidate per hash entry).
+         * Incompressible runs are skipped faster the longer they get.
+         * @param src the data to compress.
+         * @param size the size of the data.
+         * @param out the compressed data (output).
+         */
+        void lzCompress(const uint8_t* src, std::size_t size, std::vector<uint8_t>& out)
+        {
+            out.clear();
+            out.reserve(size / 2);
+            std::vector<uint32_t> hashTable(std::size_t(1) << lzHashBits, 0);
+
+            std::size_t anchor = 0, pos = 0;
+            while (pos + lzMinMatch <= size) {
+                auto value = read32(src + pos);
+                auto& entry = hashTable[lzHash(value)];
+                auto candidate = static_cast<std::size_t>(entry);
+                entry = static_cast<uint32_t>(pos + 1);
+                if (candidate != 0 && pos - (candidate - 1) <= lzMaxOffset && read32(src + candidate - 1) == value) {
+                    auto matchPos = candidate - 1;
+                    auto matchLength = lzMinMatch;
+                    while (pos + matchLength < size && src[matchPos + matchLength] == src[pos + matchLength]) ++matchLength;
+                    lzWriteSequence(src + anchor, pos - anchor, pos - matchPos, matchLength, out);
+                    pos += matchLength;
+                    anchor = pos;
+                } else pos += 1 + ((pos - anchor) >> 6);
+            }
+            if (anchor < size) lzWriteSequence(src + anchor, size - anchor, 0, 0, out);
+        }
+
+        /**
+         * Reads a length extending the 4 bits of a token.
+         * @param ip the current input position, will be advanced.
+         * @param end the end of the input.
+         * @return the additional length.
+         */
+        std::size_t lzReadLength(const uint8_t*& ip, const uint8_t* end)
+        {
+            std::size_t length = 0;
+            uint8_t value;
+            do {
+                if (ip == end) throw std::runtime_error("Compressed brick truncated.");
+                value = *ip++;
+                length += value;
+            } while (value == 255);
+            return length;
+        }
+
+        /**
+         * Decompresses LZ compressed data, all accesses are checked so corrupt data cannot write out of bounds.
+         * Short literal runs and matches are copied in fixed chunks that may write up to lzCopySlack bytes behind the
+         * decompressed data, the output needs to have room for this.
+         * @param src the compressed data.
+         * @param srcSize the size of the compressed data.
+         * @param dst the decompressed data (output, dstSize + lzCopySlack bytes).
+         * @param dstSize the size of the decompressed data.
+         * @throws std::runtime_error if the data is corrupt.
+         */
+        void lzDecompress(const uint8_t* src, std::size_t srcSize, uint8_t* dst, std::size_t dstSize)
+        {
+            auto ip = src;
+            auto ipEnd = src + srcSize;
+            auto op = dst;
+            auto opEnd = dst + dstSize;
+            while (ip < ipEnd) {
+                auto token = *ip++;
+                std::size_t numLiterals = token >> 4;
+                if (numLiterals == 15) numLiterals += lzReadLength(ip, ipEnd);
+                if (numLiterals > static_cast<std::size_t>(ipEnd - ip) || numLiterals > static_cast<std::size_t>(opEnd - op)) {
+                    throw std::runtime_error("Compressed brick corrupt.");
+                }
+                if (numLiterals <= lzCopySlack && static_cast<std::size_t>(ipEnd - ip) >= lzCopySlack) std::memcpy(op, ip, lzCopySlack);
+                else std::memcpy(op, ip, numLiterals);
+                ip += numLiterals;
+                op += numLiterals;
+                if (ip == ipEnd) break;
+
+                if (ipEnd - ip < 2) throw std::runtime_error("Compressed brick truncated.");
+                std::size_t offset = ip[0] | (static_cast<std::size_t>(ip[1]) << 8);
+                ip += 2;
+                std::size_t matchLength = token & 0xF;
+                if (matchLength == 15) matchLength += lzReadLength(ip, ipEnd);
+                matchLength += lzMinMatch;
+                if (offset == 0 || offset > static_cast<std::size_t>(op - dst) || matchLength > static_cast<std::size_t>(opEnd - op)) {
+                    throw std::runtime_error("Compressed brick corrupt.");
+                }
+
+                auto match = op - offset;
+                if (offset >= lzCopySlack) {
+                    // chunks never overlap the bytes they write, the last one may write into the slack.
+                    auto matchEnd = op + matchLength;
+                    for (; op < matchEnd; op += lzCopySlack, match += lzCopySlack) std::memcpy(op, match, lzCopySlack);
+                    op = matchEnd;
+                } else {
+                    while (matchLength-- > 0) *op++ = *match++;
+                }
+            }
+            if (op != opEnd) throw std::runtime_error("Compressed brick truncated.");
+        }
+
+        /**
+         * Splits texels into byte planes, optionally delta codes each plane.
+         * @param data the texel data.
+         * @param bytesPP the size of a texel (number of planes).
+         * @param delta whether to delta code the planes.
+         * @param planes the planes (output).
+         */
+        void splitPlanes(const std::vector<uint8_t>& data, unsigned int bytesPP, bool delta, std::vector<uint8_t>& planes)
+        {
+            auto numTexels = data.size() / bytesPP;
+            planes.resize(data.size());
+            for (unsigned int p = 0; p < bytesPP; ++p) {
+                auto plane = planes.data() + p * numTexels;
+                uint8_t previous = 0;
+                for (std::size_t i = 0; i < numTexels; ++i) {
+                    auto value = data[i * bytesPP + p];
+                    plane[i] = delta ? static_cast<uint8_t>(value - previous) : value;
+                    previous = value;
+                }
+            }
+        }
+
+        /**
+         * Merges byte planes into texels, writing the texels sequentially.
+         * @tparam BytesPP the size of a texel (number of planes).
+         * @tparam Delta whether the planes are delta coded.
+         * @param planes the planes.
+         * @param data the texel data (output).
+         * @param numTexels the number of texels.
+         */
+        template<unsigned int BytesPP, bool Delta>
+        void mergePlanes(const uint8_t* planes, uint8_t* data, std::size_t numTexels)
+        {
+            uint8_t texel[BytesPP] = { 0 };
+            for (std::size_t i = 0; i < numTexels; ++i) {
+                for (unsigned int p = 0; p < BytesPP; ++p) {
+                    if (Delta) texel[p] += planes[p * numTexels + i];
+                    else texel[p] = planes[p * numTexels + i];
+                }
+                std::memcpy(data + i * BytesPP, texel, BytesPP);
+            }
+        }
+
+        /**
+         * Merges byte planes into texels.
+         * @param planes the planes.
+         * @param bytesPP the size of a texel (number of planes).
+         * @param delta whether the planes are delta coded.
+         * @param data the texel data (output).
+         * @param dataSize the size of the texel data.
+         */
+        void mergePlanes(const uint8_t* planes, unsigned int bytesPP, bool delta, uint8_t* data, std::size_t dataSize)
+        {
+            auto numTexels = dataSize / bytesPP;
+            if (bytesPP == 4) delta ? mergePlanes<4, true>(planes, data, numTexels) : mergePlanes<4, false>(planes, data, numTexels);
+            else if (bytesPP == 8) delta ? mergePlanes<8, true>(planes, data, numTexels) : mergePlanes<8, false>(planes, data, numTexels);
+            else if (bytesPP == 16) delta ? mergePlanes<16, true>(planes, data, numTexels) : mergePlanes<16, false>(planes, data, numTexels);
+            else {
+                uint8_t texel[maxBytesPP] = { 0 };
+                for (std::size_t i = 0; i < numTexels; ++i) {
+                    for (unsigned int p = 0; p < bytesPP; ++p) {
+                        if (delta) texel[p] += planes[p * numTexels + i];
+                        else texel[p] = planes[p * numTexels + i];
+                        data[i * bytesPP + p] = texel[p];
+                    }
+                }
+            }
+        }
+    }
+
+    /**
+     * Encodes the data of a brick.
+     * @param data the bricks data (all mip levels).
+     * @param bytesPP the size of a texel.
+     * @param encoded the encoded data (output).
+     * @return the encoding used.
+     */
+    BrickEncoding VolumeBrickCodec::Encode(const std::vector<uint8_t>& data, unsigned int bytesPP, std::vector<uint8_t>& encoded)
+    {
+        if (bytesPP == 0 || bytesPP > maxBytesPP || data.size() % bytesPP != 0 || data.empty()) {
+            encoded = data;
+            return BrickEncoding::RAW;
+        }
+
+        auto isUniform = true;
+        for (std::size_t i = bytesPP; i < data.size() && isUniform; i += bytesPP) {
+            isUniform = std::memcmp(data.data(), data.data() + i, bytesPP) == 0;
+        }
+        if (isUniform) {
+            encoded.assign(data.begin(), data.begin() + bytesPP);
+            return BrickEncoding::UNIFORM;
+        }
+
+        std::vector<uint8_t> planes, compressed;
+        splitPlanes(data, bytesPP, false, planes);
+        lzCompress(planes.data(), planes.size(), encoded);
+        auto encoding = BrickEncoding::LZ_PLANES;
+
+        splitPlanes(data, bytesPP, true, planes);
+        lzCompress(planes.data(), planes.size(), compressed);
+        if (compressed.size() < encoded.size()) {
+            encoded.swap(compressed);
+            encoding = BrickEncoding::LZ_DELTA_PLANES;
+        }
+
+        if (encoded.size() >= data.size()) {
+            encoded = data;
+            return BrickEncoding::RAW;
+        }
+        return encoding;
+    }
+
+    /**
+     * Decodes the data of a brick.
+     * @param encoding the encoding of the data.
+     * @param encoded the encoded data.
+     * @param encodedSize the size of the encoded data.
+     * @param bytesPP the size of a texel.
+     * @param data the bricks data (output).
+     * @param dataSize the size of the bricks data.
+     * @param buffer a buffer for intermediate results (reused between calls to avoid allocations).
+     * @throws std::runtime_error if the encoded data is corrupt.
+     */
+    void VolumeBrickCodec::Decode(BrickEncoding encoding, const uint8_t* encoded, std::size_t encodedSize, unsigned int bytesPP,
+        uint8_t* data, std::size_t dataSize, std::vector<uint8_t>& buffer)
+    {
+        switch (encoding) {
+        case BrickEncoding::RAW:
+            if (encodedSize != dataSize) throw std::runtime_error("Brick data has the wrong size.");
+            std::memcpy(data, encoded, dataSize);
+            break;
+        case BrickEncoding::UNIFORM:
+            if (encodedSize != bytesPP || bytesPP == 0 || dataSize % bytesPP != 0) throw std::runtime_error("Uniform brick corrupt.");
+            for (std::size_t i = 0; i < dataSize; i += bytesPP) std::memcpy(data + i, encoded, bytesPP);
+            break;
+        case BrickEncoding::LZ_PLANES:
+        case BrickEncoding::LZ_DELTA_PLANES:
+            if (bytesPP == 0 || bytesPP > maxBytesPP || dataSize % bytesPP != 0) throw std::runtime_error("Compressed brick corrupt.");
+            buffer.resize(dataSize + lzCopySlack);
+            lzDecompress(encoded, encodedSize, buffer.data(), dataSize);
+            mergePlanes(buffer.data(), bytesPP, encoding == BrickEncoding::LZ_DELTA_PLANES, data, dataSize);
+            break;
+        default:
+            throw std::runtime_error("Unknown brick encoding.");
+        }
+    }
+}
@@ -0,0 +1,49 @@
+/**
+ * @file   VolumeBrickCodec.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.29
+ *
+ * @brief  Defines the compression of volume bricks in the brick cache.
+ */
+
+#ifndef VOLUMEBRICKCODEC_H
+#define VOLUMEBRICKCODEC_H
+
+#include "main.h"
+#include <cstdint>
+
+namespace cgu {
+
+    /** The encodings of bricks in the brick cache. */
+    enum class BrickEncoding : std::uint32_t
+    {
+        /** The data is stored as is. */
+        RAW = 0,
+        /** All texels are equal, only a single texel is stored. */
+        UNIFORM = 1,
+        /** The bytes of the texels are split into planes which are LZ compressed. */
+        LZ_PLANES = 2,
+        /** The bytes of the texels are split into planes which are delta coded and LZ compressed. */
+        LZ_DELTA_PLANES = 3
+    };
+
+    /**
+     * @brief  Compresses and decompresses the data of volume bricks.
+     * The bytes of the texels are split into one plane per byte (all low bytes of a channel, then all high bytes, ...)
+     * so similar bytes are next to each other, optionally delta coded and compressed with a byte oriented LZ codec
+     * that favors decompression speed. Bricks with only one value (air, noise floor clamped away) store a single texel.
+     * The smallest encoding is chosen per brick, bricks that do not compress are stored as is.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.29
+     */
+    class VolumeBrickCodec
+    {
+    public:
+        static BrickEncoding Encode(const std::vector<uint8_t>& data, unsigned int bytesPP, std::vector<uint8_t>& encoded);
+        static void Decode(BrickEncoding encoding, const uint8_t* encoded, std::size_t encodedSize, unsigned int bytesPP,
+            uint8_t* data, std::size_t dataSize, std::vector<uint8_t>& buffer);
+    };
+}
+
+#endif // VOLUMEBRICKCODEC_H
@@ -0,0 +1,379 @@
+/**
+ * @file   VolumeBrickLayout.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Implementation of the layout of the layered octree.
+ */
+
+#include "VolumeBrickLayout.h"
+#include "VolumeBrickCache.h"
+#include "VolumeMinMaxBuilder.h"
+#include "VolumeRawSlabReader.h"
+#include "VolumeRayCaster.h"
+#include "core/math/math.h"
+#include "core/parallel_helper.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    namespace cguOctreeMath {
+        inline unsigned int calculateOverlapPixels(unsigned int val, unsigned int maxBrickSize) {
+            return (val / maxBrickSize) << 1;
+        }
+    }
+
+    /**
+     *  Constructor, creates the layout of a whole volume.
+     *  @param source the raw volume to create the layout from.
+     *  @param scale the scale of a voxel in this tree.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     *  @param cache the brick cache, if it is complete the bricks are taken from it else they are stored in it.
+     *  @throws std::runtime_error if a complete cache does not match the tree.
+     */
+    VolumeBrickLayout::VolumeBrickLayout(const BrickLayoutSource& source, const glm::vec3& scale,
+        const VolumeMinMaxBuilder& minMaxBuilder, std::shared_ptr<VolumeBrickCache> cache) :
+        posOffset(0),
+        origSize(source.volumeSize),
+        voxelScale(scale),
+        level(0),
+        minTexValue(0.0f),
+        maxTexValue(1.0f),
+        maxLevel(0),
+        brickCache(std::move(cache)),
+        brickId(0),
+        dataSize(0),
+        brickTextureDesc(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE)
+    {
+        auto storeBricks = !brickCache->IsComplete();
+        std::atomic<std::size_t> parallelBudget(source.parallelBudget);
+        auto maxSize = source.maxBrickSize;
+        if (origSize.x > maxSize || origSize.y > maxSize || origSize.z > maxSize) {
+            auto ovlp = cguOctreeMath::calculateOverlapPixels(glm::max(origSize.x, glm::max(origSize.y, origSize.z)), maxSize);
+            glm::uvec3 sizeOverlap{ ovlp };
+            auto sizeWithOverlap = origSize + sizeOverlap;
+            glm::uvec3 sizePowerOfTwo{ cguMath::roundupPow2(origSize.x), cguMath::roundupPow2(origSize.y),
+                cguMath::roundupPow2(origSize.z) };
+            if (sizeWithOverlap.x > sizePowerOfTwo.x) {
+                sizeWithOverlap.x = cguMath::roundupPow2(sizeWithOverlap.x);
+                sizeOverlap <<= 1;
+            } else sizeWithOverlap.x = sizePowerOfTwo.x;
+            if (sizeWithOverlap.y > sizePowerOfTwo.y) {
+                sizeWithOverlap.y = cguMath::roundupPow2(sizeWithOverlap.y);
+                sizeOverlap <<= 1;
+            } else sizeWithOverlap.y = sizePowerOfTwo.y;
+            if (sizeWithOverlap.z > sizePowerOfTwo.z) {
+                sizeWithOverlap.z = cguMath::roundupPow2(sizeWithOverlap.z);
+                sizeOverlap <<= 1;
+            } else sizeWithOverlap.z = sizePowerOfTwo.z;
+            glm::uvec3 childSizeBase{ sizeWithOverlap.x >> 1, sizeWithOverlap.y >> 1, sizeWithOverlap.z >> 1 };
+
+            CreateNode(childSizeBase, source, minMaxBuilder, parallelBudget);
+        } else {
+            CreateLeafBrick(source, minMaxBuilder);
+        }
+        std::vector<uint8_t>().swap(brickData);
+        if (storeBricks) {
+            std::vector<unsigned int> storedIds;
+            AssignBrickIds(storedIds);
+            brickCache->ReorderBricks(storedIds);
+        }
+        brickCache->Finish();
+    }
+
+    VolumeBrickLayout::VolumeBrickLayout(const BrickLayoutSource& source, const glm::uvec3& pos,
+        const glm::uvec3& size, unsigned int lvl, const glm::vec3& scale, const VolumeMinMaxBuilder& minMaxBuilder,
+        std::shared_ptr<VolumeBrickCache> cache, std::atomic<std::size_t>& parallelBudget) :
+        posOffset(pos),
+        origSize(size),
+        voxelScale(scale),
+        level(lvl),
+        minTexValue(0.0f),
+        maxTexValue(1.0f),
+        maxLevel(0),
+        brickCache(std::move(cache)),
+        brickId(0),
+        dataSize(0),
+        brickTextureDesc(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE)
+    {
+        auto maxSize = source.maxBrickSize;
+        if (origSize.x > maxSize || origSize.y > maxSize || origSize.z > maxSize) {
+            glm::uvec3 sizePowerOfTwo{ cguMath::roundupPow2(origSize.x), cguMath::roundupPow2(origSize.y),
+                cguMath::roundupPow2(origSize.z) };
+            glm::uvec3 childSizeBase{ sizePowerOfTwo.x >> 1, sizePowerOfTwo.y >> 1, sizePowerOfTwo.z >> 1 };
+
+            CreateNode(childSizeBase, source, minMaxBuilder, parallelBudget);
+        } else {
+            CreateLeafBrick(source, minMaxBuilder);
+        }
+    }
+
+    /**
+     *  Destructor.
+     */
+    VolumeBrickLayout::~VolumeBrickLayout() = default;
+
+    /**
+     *  Creates the children of an inner node and its brick.
+     *  While bricking, sibling subtrees are independent and created in parallel as far as the parallel budget allows,
+     *  the threads of the min/max builder are shared between them.
+     *  @param childSizeBase the size of the children (including overlap).
+     *  @param source the raw volume to create the tree from.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     *  @param parallelBudget the remaining memory budget for subtrees created in parallel.
+     */
+    void VolumeBrickLayout::CreateNode(const glm::uvec3& childSizeBase, const BrickLayoutSource& source,
+        const VolumeMinMaxBuilder& minMaxBuilder, std::atomic<std::size_t>& parallelBudget)
+    {
+        glm::uvec3 posOffsets[8];
+        posOffsets[0] = glm::uvec3(0, 0, 0);
+        posOffsets[1] = glm::uvec3(0, 0, 1);
+        posOffsets[2] = glm::uvec3(0, 1, 0);
+        posOffsets[3] = glm::uvec3(0, 1, 1);
+        posOffsets[4] = glm::uvec3(1, 0, 0);
+        posOffsets[5] = glm::uvec3(1, 0, 1);
+        posOffsets[6] = glm::uvec3(1, 1, 0);
+        posOffsets[7] = glm::uvec3(1, 1, 1);
+
+        auto ovlp = cguOctreeMath::calculateOverlapPixels(glm::max(childSizeBase.x, glm::max(childSizeBase.y, childSizeBase.z)),
+            source.maxBrickSize);
+
+        glm::uvec3 childPos[8], childSize[8];
+        std::vector<unsigned int> childrenWithData, childrenWithoutData;
+        for (unsigned int i = 0; i < 8; ++i) {
+            auto childPosOffset = posOffsets[i] * (childSizeBase - glm::uvec3(ovlp));
+            childPos[i] = posOffset + childPosOffset;
+            childSize[i] = glm::uvec3(glm::max(glm::ivec3(0),
+                glm::ivec3(glm::min(origSize, childPosOffset + childSizeBase)) - glm::ivec3(childPosOffset)));
+
+            if (childSizeBase.x == ovlp && posOffsets[i].x == 1) childSize[i].x = 0;
+            if (childSizeBase.y == ovlp && posOffsets[i].y == 1) childSize[i].y = 0;
+            if (childSizeBase.z == ovlp && posOffsets[i].z == 1) childSize[i].z = 0;
+
+            if (childSize[i].x * childSize[i].y * childSize[i].z != 0) childrenWithData.push_back(i);
+            else childrenWithoutData.push_back(i);
+        }
+
+        auto numTasks = glm::min(minMaxBuilder.GetNumThreads(), static_cast<unsigned int>(childrenWithData.size()));
+        std::size_t reservedBudget = 0;
+        if (!brickCache->IsComplete() && numTasks > 1) {
+            numTasks = ReserveParallelTasks(numTasks, childSizeBase, source, minMaxBuilder, parallelBudget, reservedBudget);
+        }
+        if (brickCache->IsComplete() || numTasks <= 1) {
+            for (unsigned int i = 0; i < 8; ++i) {
+                children[i].reset(new VolumeBrickLayout(source, childPos[i], childSize[i], level + 1, voxelScale,
+                    minMaxBuilder, brickCache, parallelBudget));
+            }
+        } else {
+            VolumeMinMaxBuilder childBuilder(minMaxBuilder, glm::max(1u, minMaxBuilder.GetNumThreads() / numTasks));
+            parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+                for (auto j = task; j < childrenWithData.size(); j += numTasks) {
+                    auto i = childrenWithData[j];
+                    children[i].reset(new VolumeBrickLayout(source, childPos[i], childSize[i], level + 1, voxelScale,
+                        childBuilder, brickCache, parallelBudget));
+                }
+            });
+            for (auto i : childrenWithoutData) {
+                children[i].reset(new VolumeBrickLayout(source, childPos[i], childSize[i], level + 1, voxelScale,
+                    minMaxBuilder, brickCache, parallelBudget));
+            }
+        }
+        parallelBudget += reservedBudget;
+        texSize.x = (children[0]->texSize.x + children[4]->texSize.x) >> 1;
+        texSize.y = (children[0]->texSize.y + children[2]->texSize.y) >> 1;
+        texSize.z = (children[0]->texSize.z + children[1]->texSize.z) >> 1;
+
+        for (auto& child : children) {
+            maxLevel = glm::max(maxLevel, child->maxLevel);
+        }
+
+        CalculateTexBorders(source);
+
+        if (brickCache->IsComplete()) TakeBrickFromCache();
+        else {
+            CombineChildBricks(minMaxBuilder);
+            WriteBrickToCache(minMaxBuilder);
+        }
+    }
+
+    /**
+     *  Reserves the memory of the subtrees created in parallel beyond the first one from the parallel budget.
+     *  A subtree keeps the raw data and the min/max brick (less than 8/7 of its level 0 data with mip maps) of one
+     *  leaf, the level 0 data of the children of each of its inner levels until they are combined and the float
+     *  channels (avg, min, max) of two bricks the min/max builder decodes while combining.
+     *  @param numTasks the number of subtrees to create in parallel.
+     *  @param childSizeBase the size of the subtrees (including overlap).
+     *  @param source the raw volume to create the tree from.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     *  @param parallelBudget the remaining memory budget for subtrees created in parallel.
+     *  @param reserved the memory reserved from the budget (output).
+     *  @return the number of subtrees to create in parallel within the budget (at least 1).
+     */
+    unsigned int VolumeBrickLayout::ReserveParallelTasks(unsigned int numTasks, const glm::uvec3& childSizeBase,
+        const BrickLayoutSource& source, const VolumeMinMaxBuilder& minMaxBuilder,
+        std::atomic<std::size_t>& parallelBudget, std::size_t& reserved) const
+    {
+        auto numInnerLevels = 0u;
+        for (auto size = glm::max(childSizeBase.x, glm::max(childSizeBase.y, childSizeBase.z)); size > source.maxBrickSize;
+            size >>= 1) ++numInnerLevels;
+        std::size_t brickVoxels = static_cast<std::size_t>(source.maxBrickSize) * source.maxBrickSize * source.maxBrickSize;
+        auto brickLevel0Size = brickVoxels * minMaxBuilder.GetBrickTextureDescriptor().bytesPP;
+        auto subtreeSize = brickVoxels * source.bytesPerVoxel + brickLevel0Size * 8 / 7 + 8 * numInnerLevels * brickLevel0Size
+            + 2 * brickVoxels * 3 * sizeof(float);
+
+        auto available = parallelBudget.load();
+        std::size_t numExtraTasks;
+        do {
+            numExtraTasks = glm::min(static_cast<std::size_t>(numTasks - 1), available / subtreeSize);
+        } while (!parallelBudget.compare_exchange_weak(available, available - numExtraTasks * subtreeSize));
+        reserved = numExtraTasks * subtreeSize;
+        return static_cast<unsigned int>(numExtraTasks) + 1;
+    }
+
+    /**
+     *  Creates the brick of a leaf from the raw volume.
+     *  @param source the raw volume to create the tree from.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     */
+    void VolumeBrickLayout::CreateLeafBrick(const BrickLayoutSource& source, const VolumeMinMaxBuilder& minMaxBuilder)
+    {
+        texSize = origSize;
+        maxLevel = level;
+
+        if (texSize.x * texSize.y * texSize.z == 0) {
+            dataSize = 0;
+            return;
+        }
+
+        CalculateTexBorders(source);
+
+        if (brickCache->IsComplete()) TakeBrickFromCache();
+        else {
+            assert(source.reader != nullptr);
+            std::vector<uint8_t> rawData;
+            source.reader->ReadSubVolume(rawData, source.volumeSize, source.bytesPerVoxel, posOffset, origSize, texSize,
+                source.ushortScale);
+            brickTextureDesc = minMaxBuilder.GetBrickTextureDescriptor();
+            minMaxBuilder.CreateMinMaxBrick(rawData, texSize, brickData);
+            WriteBrickToCache(minMaxBuilder);
+        }
+    }
+
+    void VolumeBrickLayout::CalculateTexBorders(const BrickLayoutSource& source)
+    {
+        if (posOffset.x != 0) minTexValue.x = 1.0f / static_cast<float>(texSize.x);
+        if (posOffset.y != 0) minTexValue.y = 1.0f / static_cast<float>(texSize.y);
+        if (posOffset.z != 0) minTexValue.z = 1.0f / static_cast<float>(texSize.z);
+
+        if (posOffset.x + origSize.x < source.volumeSize.x) maxTexValue.x = (static_cast<float>(texSize.x) - 1.0f) / static_cast<float>(texSize.x);
+        if (posOffset.y + origSize.y < source.volumeSize.y) maxTexValue.y = (static_cast<float>(texSize.y) - 1.0f) / static_cast<float>(texSize.y);
+        if (posOffset.z + origSize.z < source.volumeSize.z) maxTexValue.z = (static_cast<float>(texSize.z) - 1.0f) / static_cast<float>(texSize.z);
+    }
+
+    /**
+     *  Gives the bricks of this subtree ids in the order a sequential creation would have stored them (children first).
+     *  @param storedIds the ids the bricks got when stored in the cache, in the new order (output).
+     */
+    void VolumeBrickLayout::AssignBrickIds(std::vector<unsigned int>& storedIds)
+    {
+        if (children[0]) for (auto& child : children) child->AssignBrickIds(storedIds);
+        if (dataSize == 0) return;
+        storedIds.push_back(brickId);
+        brickId = static_cast<unsigned int>(storedIds.size() - 1);
+    }
+
+    /**
+     *  Generates the min/max mip maps of the bricks data and writes it to the brick cache.
+     *  The data is kept as the parent node needs it to combine its own brick.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     */
+    void VolumeBrickLayout::WriteBrickToCache(const VolumeMinMaxBuilder& minMaxBuilder)
+    {
+        if (texSize.x * texSize.y * texSize.z == 0) {
+            dataSize = 0;
+            return;
+        }
+        minMaxBuilder.GenerateMinMaxMaps(texSize, brickData);
+
+        dataSize = static_cast<unsigned int>(brickData.size());
+        brickId = brickCache->StoreBrick(texSize, brickTextureDesc, brickData);
+    }
+
+    /**
+     *  Takes this nodes brick from a complete brick cache.
+     *  @throws std::runtime_error if the cache does not match the tree.
+     */
+    void VolumeBrickLayout::TakeBrickFromCache()
+    {
+        if (texSize.x * texSize.y * texSize.z == 0) {
+            dataSize = 0;
+            return;
+        }
+        brickId = brickCache->GetNextBrick(texSize, brickTextureDesc);
+        dataSize = static_cast<unsigned int>(brickCache->GetBrickDataSize(brickId));
+    }
+
+    /**
+     *  Combines the min/max data of this nodes 8 children to the data of this nodes brick.
+     *  The childrens data is released afterwards.
+     *  @param minMaxBuilder the builder creating the min/max data of the bricks.
+     */
+    void VolumeBrickLayout::CombineChildBricks(const VolumeMinMaxBuilder& minMaxBuilder)
+    {
+        if (texSize.x * texSize.y * texSize.z == 0) return;
+        brickTextureDesc = minMaxBuilder.GetBrickTextureDescriptor();
+
+        glm::uvec3 childShifts[8];
+        childShifts[0] = glm::uvec3(0, 0, 0);
+        childShifts[1] = glm::uvec3(0, 0, 1);
+        childShifts[2] = glm::uvec3(0, 1, 0);
+        childShifts[3] = glm::uvec3(0, 1, 1);
+        childShifts[4] = glm::uvec3(1, 0, 0);
+        childShifts[5] = glm::uvec3(1, 0, 1);
+        childShifts[6] = glm::uvec3(1, 1, 0);
+        childShifts[7] = glm::uvec3(1, 1, 1);
+
+        std::vector<MinMaxChildBrick> childBricks;
+        for (unsigned int i = 0; i < 8; ++i) {
+            if (children[i]->dataSize != 0) {
+                childBricks.push_back(MinMaxChildBrick{ children[i]->brickData.data(), children[i]->texSize, childShifts[i] });
+            }
+        }
+        minMaxBuilder.CombineChildBricks(childBricks, texSize, brickData);
+
+        for (auto& child : children) std::vector<uint8_t>().swap(child->brickData);
+    }
+
+    /**
+     *  Collects the bricks showing the volume at a fixed tree level.
+     *  Leaves above the level are used as they are.
+     *  @param lodLevel the tree level of the bricks (0 is the root).
+     *  @param world the world matrix of the volume.
+     *  @param result the bricks (output).
+     */
+    void VolumeBrickLayout::GetBricksAtLevel(unsigned int lodLevel, const glm::mat4& world,
+        std::vector<RayCastBrick>& result) const
+    {
+        if (dataSize == 0) return;
+        if (level < lodLevel && children[0]) {
+            for (auto& child : children) child->GetBricksAtLevel(lodLevel, world, result);
+            return;
+        }
+        result.push_back(RayCastBrick{ brickId, texSize, minTexValue, maxTexValue, GetLocalWorld(world), brickTextureDesc });
+    }
+
+    /**
+     *  Returns the matrix mapping the unit cube to this nodes brick (excluding overlap) in world space.
+     *  @param world the world matrix of the volume.
+     */
+    glm::mat4 VolumeBrickLayout::GetLocalWorld(const glm::mat4& world) const
+    {
+        auto scaleVoxelMat = glm::scale(glm::mat4(), glm::vec3(origSize) * (maxTexValue - minTexValue));
+        auto scaleToWorldMat = glm::scale(glm::mat4(), voxelScale);
+        auto translateOffsetMat = glm::translate(glm::mat4(), glm::vec3(posOffset) + (minTexValue * glm::vec3(texSize)));
+        return world * scaleToWorldMat * translateOffsetMat * scaleVoxelMat;
+    }
+}
@@ -0,0 +1,138 @@
+/**
+ * @file   VolumeBrickLayout.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Defines the layout of the layered octree for volume bricks.
+ */
+
+#ifndef VOLUMEBRICKLAYOUT_H
+#define VOLUMEBRICKLAYOUT_H
+
+#include "main.h"
+#include "gfx/glrenderer/GLTexture.h"
+#include <atomic>
+
+namespace cgu {
+
+    class VolumeBrickCache;
+    class VolumeMinMaxBuilder;
+    class VolumeRawSlabReader;
+    struct RayCastBrick;
+
+    /** Describes the raw volume a VolumeBrickLayout is created from. */
+    struct BrickLayoutSource
+    {
+        /** Holds the reader of the raw file (only used if the brick cache is not complete). */
+        VolumeRawSlabReader* reader;
+        /** Holds the size of the whole volume. */
+        glm::uvec3 volumeSize;
+        /** Holds the bytes per voxel of the volume. */
+        unsigned int bytesPerVoxel;
+        /** Holds the factor 16 bit values are multiplied with (1 to copy unchanged). */
+        std::uint16_t ushortScale;
+        /** Holds the maximum resolution per brick. */
+        unsigned int maxBrickSize;
+        /** Holds the memory budget for the data of the additional subtrees bricked in parallel in bytes. */
+        std::size_t parallelBudget;
+    };
+
+    /**
+     * @brief  Node of the layout of a VolumeBrickOctree.
+     * The layout holds the position, size and texture coordinates of each node and the id of its brick in the brick
+     * cache. It is created on the CPU only: if the brick cache is complete the bricks are taken from it, else the
+     * volume is bricked (leaves are read from the raw file, inner nodes combine their childrens min/max data) and the
+     * bricks are stored in the cache. While bricking, sibling subtrees are independent and created in parallel, the
+     * threads of the min/max builder are shared between them. Each subtree keeps the data of its children until they
+     * are combined, so subtrees beyond the one a sequential creation would hold are only started while their
+     * estimated memory fits into the parallel budget.
+     * The octree creates its nodes from the layout, the layout alone is enough to ray cast the bricks on the CPU.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.10.01
+     */
+    class VolumeBrickLayout
+    {
+    public:
+        VolumeBrickLayout(const BrickLayoutSource& source, const glm::vec3& scale,
+            const VolumeMinMaxBuilder& minMaxBuilder, std::shared_ptr<VolumeBrickCache> cache);
+        ~VolumeBrickLayout();
+
+        void GetBricksAtLevel(unsigned int lodLevel, const glm::mat4& world, std::vector<RayCastBrick>& result) const;
+        glm::mat4 GetLocalWorld(const glm::mat4& world) const;
+        /** Returns the brick cache holding the data of all bricks. */
+        const std::shared_ptr<VolumeBrickCache>& GetBrickCache() const { return brickCache; }
+        /** Returns the position offset of this node. */
+        const glm::uvec3& GetPosOffset() const { return posOffset; }
+        /** Returns the original size of the volume in this node. */
+        const glm::uvec3& GetSize() const { return origSize; }
+        /** Returns the scaling of a voxel. */
+        const glm::vec3& GetVoxelScale() const { return voxelScale; }
+        /** Returns the tree level of this node. */
+        unsigned int GetLevel() const { return level; }
+        /** Returns the maximum level of the sub-tree. */
+        unsigned int GetMaxLevel() const { return maxLevel; }
+        /** Returns the texture size of this nodes brick. */
+        const glm::uvec3& GetTexSize() const { return texSize; }
+        /** Returns the minimum value in texture space (excluding overlap). */
+        const glm::vec3& GetMinTexCoord() const { return minTexValue; }
+        /** Returns the maximum value in texture space (excluding overlap). */
+        const glm::vec3& GetMaxTexCoord() const { return maxTexValue; }
+        /** Returns the id of this nodes brick in the cache. */
+        unsigned int GetBrickId() const { return brickId; }
+        /** Returns the size of this nodes brick in the cache (0 if the node has no data). */
+        unsigned int GetDataSize() const { return dataSize; }
+        /** Returns the texture descriptor of this nodes brick. */
+        const TextureDescriptor& GetBrickTextureDescriptor() const { return brickTextureDesc; }
+        /** Returns a child of this node (nullptr for leaves). */
+        const VolumeBrickLayout* GetChild(unsigned int i) const { return children[i].get(); }
+
+    private:
+        VolumeBrickLayout(const BrickLayoutSource& source, const glm::uvec3& pos, const glm::uvec3& size,
+            unsigned int lvl, const glm::vec3& scale, const VolumeMinMaxBuilder& minMaxBuilder,
+            std::shared_ptr<VolumeBrickCache> cache, std::atomic<std::size_t>& parallelBudget);
+
+        void CreateNode(const glm::uvec3& childSizeBase, const BrickLayoutSource& source,
+            const VolumeMinMaxBuilder& minMaxBuilder, std::atomic<std::size_t>& parallelBudget);
+        unsigned int ReserveParallelTasks(unsigned int numTasks, const glm::uvec3& childSizeBase,
+            const BrickLayoutSource& source, const VolumeMinMaxBuilder& minMaxBuilder,
+            std::atomic<std::size_t>& parallelBudget, std::size_t& reserved) const;
+        void CreateLeafBrick(const BrickLayoutSource& source, const VolumeMinMaxBuilder& minMaxBuilder);
+        void CalculateTexBorders(const BrickLayoutSource& source);
+        void WriteBrickToCache(const VolumeMinMaxBuilder& minMaxBuilder);
+        void TakeBrickFromCache();
+        void CombineChildBricks(const VolumeMinMaxBuilder& minMaxBuilder);
+        void AssignBrickIds(std::vector<unsigned int>& storedIds);
+
+        /** Holds the position offset of this node. */
+        const glm::uvec3 posOffset;
+        /** Holds the original size of the volume (in this node). */
+        const glm::uvec3 origSize;
+        /** Holds the scaling of a voxel. */
+        const glm::vec3 voxelScale;
+        /** Holds the current tree level. */
+        unsigned int level;
+        /** Holds the actual texture size of this node. */
+        glm::uvec3 texSize;
+        /** Holds the minimum value in texture space (excluding overlap). */
+        glm::vec3 minTexValue;
+        /** Holds the maximum value in texture space (excluding overlap).*/
+        glm::vec3 maxTexValue;
+        /** Holds the maximum level of the current sub-tree. */
+        unsigned int maxLevel;
+        /** Holds the children in this layer. */
+        std::array<std::unique_ptr<VolumeBrickLayout>, 8> children;
+        /** Holds the brick cache with the data of the bricks. */
+        std::shared_ptr<VolumeBrickCache> brickCache;
+        /** Holds the id of this nodes brick in the cache. */
+        unsigned int brickId;
+        /** Holds the size of the data in the cache. */
+        unsigned int dataSize;
+        /** Holds the texture descriptor. */
+        TextureDescriptor brickTextureDesc;
+        /** Holds the min/max data of this brick while the tree is created (until the parent is combined). */
+        std::vector<uint8_t> brickData;
+    };
+}
+
+#endif // VOLUMEBRICKLAYOUT_H
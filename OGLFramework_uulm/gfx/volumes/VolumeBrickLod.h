@@ -0,0 +1,85 @@
+/**
+ * @file   VolumeBrickLod.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.25
+ *
+ * @brief  Defines the screen space error level of detail selection for volume bricks.
+ */
+
+#ifndef VOLUMEBRICKLOD_H
+#define VOLUMEBRICKLOD_H
+
+#include "main.h"
+#include <limits>
+
+namespace cgu {
+
+    /** Settings of the level of detail selection for volume bricks. */
+    struct BrickLodSettings
+    {
+        BrickLodSettings() : screenHeight(1080.0f), pixelError(1.0f), hysteresis(0.25f) {};
+        BrickLodSettings(float height, float error, float hyst) : screenHeight(height), pixelError(error), hysteresis(hyst) {};
+
+        /** Holds the height of the viewport in pixels. */
+        float screenHeight;
+        /** Holds the maximum size of a projected voxel in pixels. */
+        float pixelError;
+        /** Holds the relative width of the band around the error threshold in which the selection does not change. */
+        float hysteresis;
+    };
+
+    namespace cguOctreeMath {
+
+        /**
+         * Calculates the distance of the camera to a brick.
+         * @param localWorld the matrix mapping the unit cube to the brick in world space.
+         * @param camPos the camera position in world space.
+         * @return the distance (0 if the camera is inside the brick).
+         */
+        inline float distanceToBrick(const glm::mat4& localWorld, const glm::vec3& camPos)
+        {
+            auto localCamPos = glm::vec3(glm::inverse(localWorld) * glm::vec4(camPos, 1.0f));
+            auto closestPos = glm::vec3(localWorld * glm::vec4(glm::clamp(localCamPos, glm::vec3(0.0f), glm::vec3(1.0f)), 1.0f));
+            return glm::length(closestPos - camPos);
+        }
+
+        /**
+         * Calculates the screen space error of a brick as the projected size of its largest voxel at the point of
+         * the brick closest to the camera.
+         * @param localWorld the matrix mapping the unit cube to the brick (excluding overlap) in world space.
+         * @param voxels the number of voxels of the brick (excluding overlap).
+         * @param camPos the camera position in world space.
+         * @param fovY the vertical field of view in degrees.
+         * @param screenHeight the height of the viewport in pixels.
+         * @return the projected voxel size in pixels.
+         */
+        inline float brickScreenError(const glm::mat4& localWorld, const glm::vec3& voxels, const glm::vec3& camPos,
+            float fovY, float screenHeight)
+        {
+            auto voxelSize = glm::max(glm::length(glm::vec3(localWorld[0])) / voxels.x,
+                glm::max(glm::length(glm::vec3(localWorld[1])) / voxels.y, glm::length(glm::vec3(localWorld[2])) / voxels.z));
+            auto distance = distanceToBrick(localWorld, camPos);
+            auto pixelsPerUnit = screenHeight / (2.0f * glm::tan(0.5f * glm::radians(fovY)));
+            if (distance <= 0.0f) return std::numeric_limits<float>::infinity();
+            return voxelSize * pixelsPerUnit / distance;
+        }
+
+        /**
+         * Decides whether a bricks resolution is sufficient or it needs to be refined.
+         * A brick selected in the last frame stays selected until its error exceeds the threshold by the
+         * hysteresis, a refined brick is only selected again once its error is below the threshold by the
+         * hysteresis, so bricks do not pop back and forth at the threshold.
+         * @param screenError the screen space error of the brick.
+         * @param wasSufficient whether the brick was selected in the last frame.
+         * @param settings the level of detail settings.
+         * @return whether the brick is selected (its resolution is sufficient).
+         */
+        inline bool isBrickLodSufficient(float screenError, bool wasSufficient, const BrickLodSettings& settings)
+        {
+            auto threshold = settings.pixelError * (wasSufficient ? 1.0f + settings.hysteresis : 1.0f - settings.hysteresis);
+            return screenError <= threshold;
+        }
+    }
+}
+
+#endif // VOLUMEBRICKLOD_H
@@ -7,296 +7,390 @@
  */
 
 #include "VolumeBrickOctree.h"
-#include "gfx/glrenderer/GLTexture3D.h"
+#include "VolumeBrickCache.h"
+#include "VolumeBrickLayout.h"
+#include "VolumeBrickStreamer.h"
+#include "VolumeMinMaxBuilder.h"
 #include "gfx/glrenderer/GLTexture.h"
-#include "app/ApplicationBase.h"
+#include <functional>
 #include <boost/assign.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 namespace cgu {
 
-    namespace cguOctreeMath {
-        inline unsigned int calculateOverlapPixels(unsigned int val) {
-            return (val / VolumeBrickOctree::MAX_SIZE) << 1;
+    /**
+     * Upload sink staging streamed bricks in a persistently mapped pixel buffer.
+     * Each staging slot is fenced after its upload and reused once the fence signaled.
+     * @internal
+     */
+    class GLBrickUploadSink : public BrickUploadSink
+    {
+    public:
+        GLBrickUploadSink(unsigned int numSlots, std::size_t slotSize,
+            std::function<void(unsigned int, GLuint, std::size_t)> upload) :
+            stagingSlotSize(slotSize),
+            stagingFences(numSlots, nullptr),
+            uploadFn(std::move(upload))
+        {
+            auto bufferSize = static_cast<GLsizeiptr>(numSlots * slotSize);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            OGL_CALL(glGenBuffers, 1, &stagingPBO);
+            OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, stagingPBO);
+            OGL_CALL(glBufferStorage, GL_PIXEL_UNPACK_BUFFER, bufferSize, nullptr, flags);
+            stagingMemory = static_cast<uint8_t*>(OGL_CALL(glMapBufferRange, GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, flags));
+            OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, 0);
+            if (stagingMemory == nullptr) {
+                OGL_CALL(glDeleteBuffers, 1, &stagingPBO);
+                LOG(ERROR) << L"Could not map brick staging buffer.";
+                throw std::runtime_error("Could not map brick staging buffer.");
+            }
         }
-    }
 
-    VolumeBrickOctree::VolumeBrickOctree(const glm::uvec3& pos, const glm::uvec3& size, const glm::vec3& scale,
-        unsigned int lvl, GPUProgram* minMaxProg, const std::vector<BindingLocation> uniformNames) :
-        posOffset(pos),
-        origSize(size),
-        voxelScale(scale),
-        level(lvl),
-        hasAnyData(true),
-        minTexValue(0.0f),
-        maxTexValue(1.0f),
-        maxLevel(0),
-        streamFile(nullptr),
-        dataSize(0),
-        brickTextureDesc(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE),
-        minMaxMapProgram(minMaxProg),
-        minMaxMapUniformNames(uniformNames)
-    {
-    }
+        virtual ~GLBrickUploadSink()
+        {
+            for (auto sync : stagingFences) if (sync) OGL_CALL(glDeleteSync, sync);
+            OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, stagingPBO);
+            OGL_CALL(glUnmapBuffer, GL_PIXEL_UNPACK_BUFFER);
+            OGL_CALL(glBindBuffer, GL_PIXEL_UNPACK_BUFFER, 0);
+            OGL_CALL(glDeleteBuffers, 1, &stagingPBO);
+        }
+
+        void* GetStagingMemory(unsigned int slot) override { return stagingMemory + slot * stagingSlotSize; }
+
+        void UploadBrick(unsigned int brickId, unsigned int slot, std::size_t) override
+        {
+            uploadFn(brickId, stagingPBO, slot * stagingSlotSize);
+            stagingFences[slot] = OGL_CALL(glFenceSync, GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        bool IsStagingSlotFree(unsigned int slot) override
+        {
+            if (stagingFences[slot] == nullptr) return true;
+            auto result = OGL_CALL(glClientWaitSync, stagingFences[slot], 0, 0);
+            if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) return false;
+            OGL_CALL(glDeleteSync, stagingFences[slot]);
+            stagingFences[slot] = nullptr;
+            return true;
+        }
+
+    private:
+        /** Holds the staging buffer. */
+        GLuint stagingPBO;
+        /** Holds the mapped staging buffer. */
+        uint8_t* stagingMemory;
+        /** Holds the size of a staging slot. */
+        std::size_t stagingSlotSize;
+        /** Holds the fences of the staging slots. */
+        std::vector<GLsync> stagingFences;
+        /** Holds the function uploading a brick from the staging buffer. */
+        std::function<void(unsigned int, GLuint, std::size_t)> uploadFn;
+    };
 
     /**
-     *  Constructor.
-     *  @param texData the 3D texture resource to create the tree from.
-     *  @param pos the position in the texture.
-     *  @param size the size of this part of the tree (in voxels).
-     *  @param scale the scale of a voxel in this tree.
-     *  @param minMaxProg the program used to create Min-/Max-Maps.
-     *  @param uniformNames the uniform names of the minMaxProg.
-     *  @param app the application object.
+     *  Constructor, creates the nodes of a layout (and their children).
+     *  The root loads its brick and starts the residency management and streaming of the bricks.
+     *  @param layout the layout of the node.
      */
-    VolumeBrickOctree::VolumeBrickOctree(const GLTexture3D* texData, const glm::uvec3& pos, const glm::uvec3& size,
-        const glm::vec3& scale, GPUProgram* minMaxProg, const std::vector<BindingLocation> uniformNames,
-        ApplicationBase* app) :
-        VolumeBrickOctree(pos, size, scale, 0, minMaxProg, uniformNames)
+    VolumeBrickOctree::VolumeBrickOctree(const VolumeBrickLayout& layout) :
+        posOffset(layout.GetPosOffset()),
+        origSize(layout.GetSize()),
+        voxelScale(layout.GetVoxelScale()),
+        level(layout.GetLevel()),
+        texSize(layout.GetTexSize()),
+        hasAnyData(layout.GetLevel() == 0 && layout.GetDataSize() != 0),
+        minTexValue(layout.GetMinTexCoord()),
+        maxTexValue(layout.GetMaxTexCoord()),
+        maxLevel(layout.GetMaxLevel()),
+        brickCache(layout.GetBrickCache()),
+        brickId(layout.GetBrickId()),
+        dataSize(layout.GetDataSize()),
+        dataPending(false),
+        dataPrefetched(false),
+        lodSufficient(false),
+        brickInUse(false),
+        brickTextureDesc(layout.GetBrickTextureDescriptor())
     {
-        if (origSize.x > MAX_SIZE || origSize.y > MAX_SIZE || origSize.z > MAX_SIZE) {
-            auto ovlp = cguOctreeMath::calculateOverlapPixels(glm::max(origSize.x, glm::max(origSize.y, origSize.z)));
-            glm::uvec3 sizeOverlap{ ovlp };
-            auto sizeWithOverlap = origSize + sizeOverlap;
-            glm::uvec3 sizePowerOfTwo{ cguMath::roundupPow2(origSize.x), cguMath::roundupPow2(origSize.y),
-                cguMath::roundupPow2(origSize.z) };
-            if (sizeWithOverlap.x > sizePowerOfTwo.x) {
-                sizeWithOverlap.x = cguMath::roundupPow2(sizeWithOverlap.x);
-                sizeOverlap <<= 1;
-            } else sizeWithOverlap.x = sizePowerOfTwo.x;
-            if (sizeWithOverlap.y > sizePowerOfTwo.y) {
-                sizeWithOverlap.y = cguMath::roundupPow2(sizeWithOverlap.y);
-                sizeOverlap <<= 1;
-            } else sizeWithOverlap.y = sizePowerOfTwo.y;
-            if (sizeWithOverlap.z > sizePowerOfTwo.z) {
-                sizeWithOverlap.z = cguMath::roundupPow2(sizeWithOverlap.z);
-                sizeOverlap <<= 1;
-            } else sizeWithOverlap.z = sizePowerOfTwo.z;
-            glm::uvec3 childSizeBase{ sizeWithOverlap.x >> 1, sizeWithOverlap.y >> 1, sizeWithOverlap.z >> 1 };
-
-            CreateNode(childSizeBase, texData, app);
-        } else {
-            CreateLeafTexture(texData);
+        if (layout.GetChild(0)) {
+            for (unsigned int i = 0; i < 8; ++i) children[i].reset(new VolumeBrickOctree(*layout.GetChild(i)));
+        }
+        if (level == 0) {
+            ReloadData();
+            InitializeDataManagement();
         }
     }
 
-    VolumeBrickOctree::VolumeBrickOctree(const GLTexture3D* texData, const glm::uvec3& pos,
-        const glm::uvec3& size, unsigned int lvl, const glm::vec3& scale, GPUProgram* minMaxProg,
-        const std::vector<BindingLocation> uniformNames, ApplicationBase* app) :
-        VolumeBrickOctree(pos, size, scale, lvl, minMaxProg, uniformNames)
+    /**
+     *  Destructor.
+     */
+    VolumeBrickOctree::~VolumeBrickOctree() = default;
+
+    /**
+     *  Reloads all data from this tree node.
+     */
+    void VolumeBrickOctree::ReloadData()
     {
-        if (origSize.x > MAX_SIZE || origSize.y > MAX_SIZE || origSize.z > MAX_SIZE) {
-            glm::uvec3 sizePowerOfTwo{ cguMath::roundupPow2(origSize.x), cguMath::roundupPow2(origSize.y),
-                cguMath::roundupPow2(origSize.z) };
-            glm::uvec3 childSizeBase{ sizePowerOfTwo.x >> 1, sizePowerOfTwo.y >> 1, sizePowerOfTwo.z >> 1 };
+        if (dataSize == 0 || !brickCache->IsComplete()) return;
+        std::vector<uint8_t> data(brickCache->GetBrickDataSize(brickId)), decodeBuffer;
+        brickCache->ReadBrick(brickId, data.data(), decodeBuffer);
+        CreateBrickTexture(data.data());
+    }
 
-            CreateNode(childSizeBase, texData, app);
+    /**
+     *  Creates the brick texture from its data.
+     *  @param data the bricks data.
+     */
+    void VolumeBrickOctree::CreateBrickTexture(const void* data)
+    {
+        brickTexture.reset(new GLTexture(texSize.x, texSize.y, texSize.z, VolumeMinMaxBuilder::CalculateNumMipLevels(texSize),
+            brickTextureDesc, data));
+        brickTexture->SampleLinear();
+        brickTexture->SampleWrapClamp();
+        MakeBrickResident();
+    }
 
-        } else {
-            CreateLeafTexture(texData);
+    /**
+     *  Requests the data of this node, it is streamed asynchronously if a streamer exists.
+     *  @param priority the priority of the request (higher is loaded first).
+     */
+    void VolumeBrickOctree::RequestData(float priority)
+    {
+        hasAnyData = true;
+        if (!dataPending && residency && residency->Use(brickId)) {
+            brickInUse = true;
+            if (prefetch) prefetch->RecordUse(brickId);
+            return;
+        }
+        if (!streamer) {
+            ReloadData();
+            return;
         }
+        dataPending = true;
+        dataPrefetched = false;
+        streamer->RequestBrick(brickId, priority, false);
     }
-    
-    void VolumeBrickOctree::CreateNode(const glm::uvec3& childSizeBase, const GLTexture3D* texData, ApplicationBase* app)
+
+    /**
+     *  Creates the brick texture from streamed data (called by the streamers upload sink).
+     *  @param pbo the pixel buffer holding the data.
+     *  @param pboOffset the offset of the data in the buffer.
+     */
+    void VolumeBrickOctree::UploadStreamedData(GLuint pbo, std::size_t pboOffset)
     {
-        glm::uvec3 posOffsets[8];
-        posOffsets[0] = glm::uvec3(0, 0, 0);
-        posOffsets[1] = glm::uvec3(0, 0, 1);
-        posOffsets[2] = glm::uvec3(0, 1, 0);
-        posOffsets[3] = glm::uvec3(0, 1, 1);
-        posOffsets[4] = glm::uvec3(1, 0, 0);
-        posOffsets[5] = glm::uvec3(1, 0, 1);
-        posOffsets[6] = glm::uvec3(1, 1, 0);
-        posOffsets[7] = glm::uvec3(1, 1, 1);
-
-        auto ovlp = cguOctreeMath::calculateOverlapPixels(glm::max(childSizeBase.x, glm::max(childSizeBase.y, childSizeBase.z)));
-
-        for (unsigned int i = 0; i < 8; ++i) {
-            auto childPosOffset = posOffsets[i] * (childSizeBase - glm::uvec3(ovlp));
-            auto childPos = posOffset + childPosOffset;
-            auto childSize = glm::uvec3(glm::max(glm::ivec3(0),
-                glm::ivec3(glm::min(origSize, childPosOffset + childSizeBase)) - glm::ivec3(childPosOffset)));
-
-            if (childSizeBase.x == ovlp && posOffsets[i].x == 1) childSize.x = 0;
-            if (childSizeBase.y == ovlp && posOffsets[i].y == 1) childSize.y = 0;
-            if (childSizeBase.z == ovlp && posOffsets[i].z == 1) childSize.z = 0;
-
-            children[i].reset(new VolumeBrickOctree(texData, childPos, childSize, level + 1, voxelScale,
-                minMaxMapProgram, minMaxMapUniformNames, app));
-        }
-        texSize.x = (children[0]->texSize.x + children[4]->texSize.x) >> 1;
-        texSize.y = (children[0]->texSize.y + children[2]->texSize.y) >> 1;
-        texSize.z = (children[0]->texSize.z + children[1]->texSize.z) >> 1; 
+        dataPending = false;
+        brickTexture.reset(new GLTexture(texSize.x, texSize.y, texSize.z, VolumeMinMaxBuilder::CalculateNumMipLevels(texSize),
+            brickTextureDesc, nullptr));
+        brickTexture->UploadData(pbo, pboOffset);
+        brickTexture->SampleLinear();
+        brickTexture->SampleWrapClamp();
+        if (dataPrefetched) {
+            // prefetched bricks stay resident without being used until they are requested.
+            dataPrefetched = false;
+            residency->Insert(brickId, GetBrickMemorySize());
+            residency->Release(brickId);
+            prefetch->RecordLoad(brickId);
+        } else MakeBrickResident();
+    }
 
-        for (auto& child : children) {
-            maxLevel = glm::max(maxLevel, child->maxLevel);
+    /**
+     *  Requests the bricks selected for a predicted camera at low priority.
+     *  @param camera the current camera (for the projection).
+     *  @param predictedView the view matrix of the predicted camera.
+     *  @param predictedCamPos the position of the predicted camera.
+     *  @param world the world matrix of the parent node.
+     *  @param lodSettings the level of detail settings.
+     *  @param requests the bricks requested (output).
+     */
+    void VolumeBrickOctree::PrefetchPredicted(const cgu::CameraView& camera, const glm::mat4& predictedView,
+        const glm::vec3& predictedCamPos, const glm::mat4& world, const BrickLodSettings& lodSettings,
+        std::vector<unsigned int>& requests)
+    {
+        if (dataSize == 0) return;
+        auto localWorld = GetLocalWorld(world);
+        cguMath::AABB3<float> box{ { { glm::vec3(0.0f), glm::vec3(1.0f) } } };
+        if (!cguMath::AABBInFrustumTest(camera.GetViewFrustum(localWorld, predictedView), box)) return;
+
+        if (children[0]) {
+            auto screenError = cguOctreeMath::brickScreenError(localWorld, glm::vec3(texSize) * (maxTexValue - minTexValue),
+                predictedCamPos, camera.GetFOV(), lodSettings.screenHeight);
+            if (!cguOctreeMath::isBrickLodSufficient(screenError, lodSufficient, lodSettings)) {
+                for (auto& child : children) {
+                    child->PrefetchPredicted(camera, predictedView, predictedCamPos, world, lodSettings, requests);
+                }
+                return;
+            }
         }
 
-        CalculateTexBorders(texData);
+        if (brickTexture || (dataPending && !dataPrefetched)) return;
+        if (!dataPending) prefetch->RecordRequest();
+        dataPending = true;
+        dataPrefetched = true;
+        auto distance = cguOctreeMath::distanceToBrick(localWorld, predictedCamPos);
+        streamer->RequestBrick(brickId, -distance, true);
+        requests.push_back(brickId);
+    }
 
-        CombineChildTextures(app);
-        WriteBrickTextureToTempFile();
+    /**
+     *  Cancels a pending prefetch of this nodes brick.
+     */
+    void VolumeBrickOctree::CancelPrefetch()
+    {
+        if (!dataPending || !dataPrefetched) return;
+        streamer->CancelBrick(brickId);
+        dataPending = false;
+        dataPrefetched = false;
+        prefetch->RecordCancel();
+    }
 
-        for (auto& child : children) child->ResetAllData();
+    /**
+     *  Marks a newly created brick texture as in use and accounts for its memory.
+     */
+    void VolumeBrickOctree::MakeBrickResident()
+    {
+        brickInUse = true;
+        if (residency) residency->Insert(brickId, GetBrickMemorySize());
     }
 
-    void VolumeBrickOctree::CreateLeafTexture(const GLTexture3D* texData)
+    /**
+     *  Deletes the texture of a released brick evicted by the residency management.
+     */
+    void VolumeBrickOctree::EvictData()
     {
-        texSize = origSize;
-        maxLevel = level;
+        assert(!brickInUse);
+        if (prefetch) prefetch->RecordEviction(brickId);
+        brickTexture.reset(nullptr);
+    }
 
-        if (texSize.x * texSize.y * texSize.z == 0) {
-            dataSize = 0;
-            hasAnyData = false;
-            return;
+    /**
+     *  Returns the GPU memory of this nodes brick including its min/max mip maps.
+     */
+    std::size_t VolumeBrickOctree::GetBrickMemorySize() const
+    {
+        std::size_t memSize = 0;
+        auto levelSize = texSize;
+        while (true) {
+            memSize += static_cast<std::size_t>(levelSize.x) * levelSize.y * levelSize.z * brickTextureDesc.bytesPP;
+            if (levelSize == glm::uvec3(1)) break;
+            levelSize = glm::max(glm::uvec3(1), levelSize / 2u);
         }
-
-        CalculateTexBorders(texData);
-
-        brickTexture = texData->CreateMinMaxTexture(posOffset, origSize, brickTextureDesc);
-        WriteBrickTextureToTempFile();
+        return memSize;
     }
 
-    void VolumeBrickOctree::CalculateTexBorders(const GLTexture3D* texData)
+    /**
+     *  Sets the GPU memory budget for the bricks of this tree (root only).
+     *  @param memoryBudget the memory budget in bytes.
+     */
+    void VolumeBrickOctree::SetMemoryBudget(std::size_t memoryBudget)
     {
-        if (posOffset.x != 0) minTexValue.x = 1.0f / static_cast<float>(texSize.x);
-        if (posOffset.y != 0) minTexValue.y = 1.0f / static_cast<float>(texSize.y);
-        if (posOffset.z != 0) minTexValue.z = 1.0f / static_cast<float>(texSize.z);
-
-        if (posOffset.x + origSize.x < texData->GetSize().x) maxTexValue.x = (static_cast<float>(texSize.x) - 1.0f) / static_cast<float>(texSize.x);
-        if (posOffset.y + origSize.y < texData->GetSize().y) maxTexValue.y = (static_cast<float>(texSize.y) - 1.0f) / static_cast<float>(texSize.y);
-        if (posOffset.z + origSize.z < texData->GetSize().z) maxTexValue.z = (static_cast<float>(texSize.z) - 1.0f) / static_cast<float>(texSize.z);
+        if (residency) residency->SetBudget(memoryBudget);
     }
 
     /**
-     *  Destructor.
+     *  Returns the counters of the brick residency management.
      */
-    VolumeBrickOctree::~VolumeBrickOctree()
+    BrickResidencyStats VolumeBrickOctree::GetResidencyStats() const
     {
-        if (streamFile) std::fclose(streamFile);
-        streamFile = nullptr;
+        if (residency) return residency->GetStats();
+        return BrickResidencyStats();
     }
 
     /**
-     *  Reloads all data from this tree node.
+     *  Returns the counters of the brick prefetching.
      */
-    void VolumeBrickOctree::ReloadData()
+    BrickPrefetchStats VolumeBrickOctree::GetPrefetchStats() const
     {
-        if (dataSize == 0) return;
-        std::fseek(streamFile, 0, SEEK_SET);
-        std::vector<uint8_t> data;
-        data.resize(dataSize);
-        std::fread(data.data(), sizeof(uint8_t), dataSize, streamFile);
-
-        brickTexture.reset(new GLTexture(texSize.x, texSize.y, texSize.z, brickTextureDesc, nullptr));
-        brickTexture->UploadData(data);
-        brickTexture->GenerateMinMaxMaps(minMaxMapProgram, minMaxMapUniformNames);
-        brickTexture->SampleLinear();
-        brickTexture->SampleWrapClamp();
+        if (prefetch) return prefetch->GetStats();
+        return BrickPrefetchStats();
     }
 
     /**
-     *  Releases all the data from this tree node.
+     *  Returns whether this node or the children it is refined to still wait for streamed data.
      */
-    void VolumeBrickOctree::ResetData()
+    bool VolumeBrickOctree::HasPendingData() const
     {
-        brickTexture.reset(nullptr);
+        if (dataPending && !dataPrefetched) return true;
+        if (IsLoaded() || !hasAnyData || !children[0]) return false;
+        for (const auto& child : children) if (child->HasPendingData()) return true;
+        return false;
     }
 
     /**
-     *  Releases all the data from this tree node and its children.
+     *  Starts the residency management and the asynchronous streaming of bricks for this tree (root only).
+     *  Without persistent buffer mapping bricks are loaded synchronously.
      */
-    void VolumeBrickOctree::ResetAllData()
+    void VolumeBrickOctree::InitializeDataManagement()
     {
-        if (hasAnyData) {
-            brickTexture.reset(nullptr);
-            if (children[0]) for (auto& child : children) child->ResetAllData();
-            hasAnyData = false;
+        if (brickCache->GetNumberOfBricks() == 0) return;
+
+        brickNodes.assign(brickCache->GetNumberOfBricks(), nullptr);
+        CollectNodes(brickNodes);
+        auto brickResidency = std::make_shared<VolumeBrickResidency>(
+            static_cast<std::size_t>(DEFAULT_MEMORY_BUDGET_MB) * 1024 * 1024);
+        for (auto node : brickNodes) node->residency = brickResidency;
+        if (IsLoaded() && residency) residency->Insert(brickId, GetBrickMemorySize());
+
+        if (!GLEW_ARB_buffer_storage) return;
+        auto nodes = brickNodes;
+        auto sink = std::make_unique<GLBrickUploadSink>(NUM_STAGING_SLOTS, brickCache->GetMaxBrickDataSize(),
+            [nodes](unsigned int id, GLuint pbo, std::size_t offset) { nodes[id]->UploadStreamedData(pbo, offset); });
+        auto brickStreamer = std::make_shared<VolumeBrickStreamer>(brickCache, std::move(sink), NUM_STAGING_SLOTS);
+        auto brickPrefetch = std::make_shared<VolumeBrickPrefetch>();
+        for (auto node : brickNodes) {
+            node->streamer = brickStreamer;
+            node->prefetch = brickPrefetch;
         }
     }
 
     /**
-     *  Writes the brick texture to a temporary file.
+     *  Collects the nodes with data of the sub-tree indexed by their brick ids.
+     *  @param nodes the nodes.
      */
-    void VolumeBrickOctree::WriteBrickTextureToTempFile()
+    void VolumeBrickOctree::CollectNodes(std::vector<VolumeBrickOctree*>& nodes)
     {
-        if (texSize.x * texSize.y * texSize.z == 0) {
-            dataSize = 0;
-            hasAnyData = false;
-            return;
-        }
-        std::vector<uint8_t> data;
-        brickTexture->DownloadData(data);
-
-        dataSize = static_cast<unsigned int>(data.size());
-        streamFile = std::tmpfile();
-        std::fwrite(data.data(), sizeof(uint8_t), dataSize, streamFile);
-        ReloadData();
+        if (dataSize != 0) nodes[brickId] = this;
+        if (children[0]) for (auto& child : children) child->CollectNodes(nodes);
     }
 
     /**
-     *  Combines the 8 textures of this nodes children to a new texture.
-     *  @param app the application object.
+     *  Releases all the data from this tree node.
+     *  With residency management the texture stays resident until it is evicted.
      */
-    void VolumeBrickOctree::CombineChildTextures(ApplicationBase* app)
+    void VolumeBrickOctree::ResetData()
     {
-        if (texSize.x * texSize.y * texSize.z == 0) return;
-        GPUProgram* combineProg = nullptr;
-        brickTextureDesc.bytesPP = children[0]->brickTextureDesc.bytesPP;
-        brickTextureDesc.format = children[0]->brickTextureDesc.format;
-        brickTextureDesc.type = children[0]->brickTextureDesc.type;
-        brickTextureDesc.internalFormat = children[0]->brickTextureDesc.internalFormat;
-
-        if (brickTextureDesc.type == GL_UNSIGNED_BYTE) combineProg = app->GetGPUProgramManager()->GetResource("combineChildTextures8.cp");
-        else if (brickTextureDesc.type == GL_UNSIGNED_SHORT) combineProg = app->GetGPUProgramManager()->GetResource("combineChildTextures16.cp");
-        else if (brickTextureDesc.type == GL_UNSIGNED_INT) combineProg = app->GetGPUProgramManager()->GetResource("combineChildTextures32.cp");
-        else throw std::runtime_error("Pixel-type not supported.");
-
-        auto uniformNames = combineProg->GetUniformLocations({ "childTex", "combineTex", "childShift", "maxChunkSize" });
-        brickTexture.reset(new GLTexture(texSize.x, texSize.y, texSize.z, brickTextureDesc, nullptr));
-
-        //glm::uvec3 chunkSize = glm::uvec3(glm::ceil(glm::vec3(texSize) / 2.0f));
-        combineProg->UseProgram();
-        combineProg->SetUniform(uniformNames[0], 0);
-        combineProg->SetUniform(uniformNames[1], 1);
-
-        glm::uvec3 childShifts[8];
-        childShifts[0] = glm::uvec3(0, 0, 0);
-        childShifts[1] = glm::uvec3(0, 0, 1);
-        childShifts[2] = glm::uvec3(0, 1, 0);
-        childShifts[3] = glm::uvec3(0, 1, 1);
-        childShifts[4] = glm::uvec3(1, 0, 0);
-        childShifts[5] = glm::uvec3(1, 0, 1);
-        childShifts[6] = glm::uvec3(1, 1, 0);
-        childShifts[7] = glm::uvec3(1, 1, 1);
-
-        brickTexture->ActivateImage(1, 0, GL_WRITE_ONLY);
-        for (unsigned int i = 0; i < 8; ++i) {
-            if (children[i]->dataSize != 0) {
-                auto numGroups = glm::ivec3(glm::ceil(glm::vec3(children[i]->texSize) / 8.0f));
-
-                combineProg->SetUniform(uniformNames[3], children[i]->texSize);
-                combineProg->SetUniform(uniformNames[2], childShifts[i]);
-                children[i]->brickTexture->ActivateImage(0, 0, GL_READ_ONLY);
-                OGL_CALL(glDispatchCompute, numGroups.x, numGroups.y, numGroups.z);
-            }
+        if (dataPending && !dataPrefetched) {
+            streamer->CancelBrick(brickId);
+            dataPending = false;
         }
+        if (!residency) brickTexture.reset(nullptr);
+        else if (brickInUse) residency->Release(brickId);
+        brickInUse = false;
+    }
 
-        OGL_CALL(glMemoryBarrier, GL_ALL_BARRIER_BITS);
-        OGL_SCALL(glFinish);
+    /**
+     *  Releases all the data from this tree node and its children.
+     */
+    void VolumeBrickOctree::ResetAllData()
+    {
+        if (hasAnyData) {
+            ResetData();
+            if (children[0]) for (auto& child : children) child->ResetAllData();
+            hasAnyData = false;
+        }
     }
 
     /**
      *  Updates the loading state of the tree depending on the view frustum (in object space).
+     *  Nodes are refined until the projected size of their voxels is below the pixel error.
      *  @param camera the current camera to calculate the frustum for.
      *  @param world the world matrix of the parent node.
+     *  @param lodSettings the level of detail settings.
      *  @return whether there are any children with loaded data in the sub-tree.
      */
-    bool VolumeBrickOctree::UpdateFrustum(const cgu::CameraView& camera, const glm::mat4& world)
+    bool VolumeBrickOctree::UpdateFrustum(const cgu::CameraView& camera, const glm::mat4& world,
+        const BrickLodSettings& lodSettings)
     {
+        if (level == 0 && streamer) streamer->Update(MAX_UPLOADS_PER_FRAME);
+        if (level == 0 && prefetch) prefetch->AddCameraSample(camera.GetViewMatrix());
         if (dataSize == 0) return false;
-        auto isCorrectLod = false; // TODO: add LOD mechanism here. [8/26/2015 Sebastian Maisch]
-        // if (level == maxLevel - 1) isCorrectLod = true;
 
         auto localWorld = GetLocalWorld(world);
 
@@ -304,19 +398,40 @@ namespace cgu {
 
         if (!cguMath::AABBInFrustumTest(camera.GetViewFrustum(localWorld), box)) ResetAllData();
         else if (!children[0]) {
-            if (!IsLoaded()) { ReloadData(); hasAnyData = true; }
+            if (!IsLoaded()) RequestData(-camera.GetSignedDistanceToUnitAABB2(localWorld));
         } else {
-            if (isCorrectLod) {
+            auto screenError = cguOctreeMath::brickScreenError(localWorld, glm::vec3(texSize) * (maxTexValue - minTexValue),
+                camera.GetPosition(), camera.GetFOV(), lodSettings.screenHeight);
+            lodSufficient = cguOctreeMath::isBrickLodSufficient(screenError, lodSufficient, lodSettings);
+            if (lodSufficient) {
                 if (IsLoaded()) for (auto& child : children) child->ResetAllData();
-                else { ReloadData(); hasAnyData = true; }
+                else RequestData(-camera.GetSignedDistanceToUnitAABB2(localWorld));
             } else {
+                if (dataPending) ResetData();
+                hasAnyData = false;
+                for (auto& child : children) hasAnyData = child->UpdateFrustum(camera, world, lodSettings) || hasAnyData;
+                // keep this brick until the children finished streaming so no holes are rendered.
                 if (IsLoaded()) {
-                    ResetData();
+                    auto childrenPending = false;
+                    for (auto& child : children) childrenPending = childrenPending || child->HasPendingData();
+                    if (childrenPending) hasAnyData = true;
+                    else ResetData();
                 }
-                hasAnyData = false;
-                for (auto& child : children) hasAnyData = child->UpdateFrustum(camera, world) || hasAnyData;
             }
         }
+
+        if (level == 0 && prefetch) {
+            // request the bricks of the predicted camera after the visible ones so they get a lower priority.
+            glm::mat4 predictedView;
+            std::vector<unsigned int> prefetchRequests;
+            if (prefetch->PredictView(PREFETCH_FRAMES_AHEAD, predictedView)) {
+                auto predictedCamPos = glm::vec3(glm::inverse(predictedView)[3]);
+                PrefetchPredicted(camera, predictedView, predictedCamPos, world, lodSettings, prefetchRequests);
+            }
+            for (auto staleId : prefetch->UpdateRequests(std::move(prefetchRequests))) brickNodes[staleId]->CancelPrefetch();
+        }
+
+        if (level == 0 && residency) for (auto evictedId : residency->CollectEvictions()) brickNodes[evictedId]->EvictData();
         return hasAnyData;
     }
 
@@ -328,11 +443,29 @@ namespace cgu {
             auto childWorld = GetLocalWorld(world);
             result.push_back(std::make_pair(this, camera.GetSignedDistanceToUnitAABB2(childWorld)));
         }
-        else {
+        else if (children[0]) {
             for (auto& child : children) child->GetRenderedBricksList(camera, world, result);
         }
     }
 
+    /**
+     *  Collects the bricks showing the volume at a fixed tree level independent of the view and loading state.
+     *  Leaves above the level are used as they are.
+     *  @param lodLevel the tree level of the bricks (0 is the root).
+     *  @param world the world matrix of the parent node.
+     *  @param result the bricks (output).
+     */
+    void VolumeBrickOctree::GetBricksAtLevel(unsigned int lodLevel, const glm::mat4& world,
+        std::vector<RayCastBrick>& result) const
+    {
+        if (dataSize == 0) return;
+        if (level < lodLevel && children[0]) {
+            for (auto& child : children) child->GetBricksAtLevel(lodLevel, world, result);
+            return;
+        }
+        result.push_back(RayCastBrick{ brickId, texSize, minTexValue, maxTexValue, GetLocalWorld(world), brickTextureDesc });
+    }
+
     glm::mat4 VolumeBrickOctree::GetLocalWorld(const glm::mat4& world) const
     {
         // glm::mat4 scaleVoxelMat = glm::scale(glm::mat4(), glm::vec3(origSize));
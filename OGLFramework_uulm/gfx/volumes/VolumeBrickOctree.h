@@ -11,53 +11,70 @@
 
 #include "main.h"
 #include "gfx/glrenderer/GLTexture.h"
+#include "VolumeBrickResidency.h"
+#include "VolumeBrickLod.h"
+#include "VolumeBrickPrefetch.h"
+#include "VolumeRayCaster.h"
 
 namespace cgu {
 
-    class GLTexture3D;
-    class GPUProgram;
     class CameraView;
+    class VolumeBrickCache;
+    class VolumeBrickLayout;
+    class VolumeBrickStreamer;
 
     class VolumeBrickOctree
     {
     public:
-        VolumeBrickOctree(const GLTexture3D* texData, const glm::uvec3& posOffset, const glm::uvec3& size,
-            const glm::vec3& scale, GPUProgram* minMaxProg, const std::vector<BindingLocation> uniformNames,
-            ApplicationBase* app);
+        explicit VolumeBrickOctree(const VolumeBrickLayout& layout);
         ~VolumeBrickOctree();
 
-        bool UpdateFrustum(const cgu::CameraView& camera, const glm::mat4& world);
+        bool UpdateFrustum(const cgu::CameraView& camera, const glm::mat4& world, const BrickLodSettings& lodSettings);
         void GetRenderedBricksList(const cgu::CameraView& camera, const glm::mat4& world,
             std::vector<std::pair<const VolumeBrickOctree*, float>> &result) const;
+        void GetBricksAtLevel(unsigned int lodLevel, const glm::mat4& world, std::vector<RayCastBrick>& result) const;
+        /** Returns the brick cache holding the data of all bricks. */
+        const std::shared_ptr<VolumeBrickCache>& GetBrickCache() const { return brickCache; }
         glm::mat4 GetLocalWorld(const glm::mat4& world) const;
         glm::vec3 GetWorldScale() const { return voxelScale * glm::vec3(origSize) * (maxTexValue - minTexValue); }
         // glm::vec3 GetWorldScale() const { return voxelScale * glm::vec3(origSize); }
-        bool IsLoaded() const { return static_cast<bool>(brickTexture); }
+        bool IsLoaded() const { return brickInUse; }
         const GLTexture* GetTexture() const { return brickTexture.get(); }
         const glm::vec3& GetMinTexCoord() const { return minTexValue; }
         const glm::vec3& GetMaxTexCoord() const { return maxTexValue; }
+        void SetMemoryBudget(std::size_t memoryBudget);
+        BrickResidencyStats GetResidencyStats() const;
+        BrickPrefetchStats GetPrefetchStats() const;
 
 
-        /** Holds the maximum resolution per brick. */
+        /** Holds the maximum resolution per brick (see BrickLayoutSource::maxBrickSize). */
         static const unsigned int MAX_SIZE = 256;
+        /** Holds the number of staging slots for streaming bricks. */
+        static const unsigned int NUM_STAGING_SLOTS = 8;
+        /** Holds the maximum number of streamed bricks uploaded per frame. */
+        static const unsigned int MAX_UPLOADS_PER_FRAME = 4;
+        /** Holds the default GPU memory budget for resident bricks (in MB). */
+        static const unsigned int DEFAULT_MEMORY_BUDGET_MB = 1024;
+        /** Holds the number of frames the camera is predicted ahead for prefetching. */
+        static const unsigned int PREFETCH_FRAMES_AHEAD = 4;
 
     private:
-        VolumeBrickOctree(const glm::uvec3& pos, const glm::uvec3& size, const glm::vec3& scale, unsigned int lvl,
-            GPUProgram* minMaxProg, const std::vector<BindingLocation> uniformNames);
-        VolumeBrickOctree(const GLTexture3D* texData, const glm::uvec3& posOffset, const glm::uvec3& size,
-            unsigned int lvl, const glm::vec3& scale, GPUProgram* minMaxProg,
-            const std::vector<BindingLocation> uniformNames, ApplicationBase* app);
-
-        void CreateNode(const glm::uvec3& childSizeBase, const GLTexture3D* texData, ApplicationBase* app);
-        void CreateLeafTexture(const GLTexture3D* texData);
-
-        void CalculateTexBorders(const GLTexture3D* texData);
-
-        void WriteBrickTextureToTempFile();
         void ResetData();
         void ResetAllData();
         void ReloadData();
-        void CombineChildTextures(ApplicationBase* app);
+        void CreateBrickTexture(const void* data);
+        void RequestData(float priority);
+        void UploadStreamedData(GLuint pbo, std::size_t pboOffset);
+        bool HasPendingData() const;
+        void PrefetchPredicted(const cgu::CameraView& camera, const glm::mat4& predictedView,
+            const glm::vec3& predictedCamPos, const glm::mat4& world, const BrickLodSettings& lodSettings,
+            std::vector<unsigned int>& requests);
+        void CancelPrefetch();
+        void MakeBrickResident();
+        void EvictData();
+        std::size_t GetBrickMemorySize() const;
+        void InitializeDataManagement();
+        void CollectNodes(std::vector<VolumeBrickOctree*>& nodes);
 
         /** Holds the position offset of this node. */
         const glm::uvec3 posOffset;
@@ -81,18 +98,32 @@ namespace cgu {
         /** Holds the children in this layer. */
         std::array<std::unique_ptr<VolumeBrickOctree>, 8> children;
 
-        /** Holds the temporary file with data for streaming. */
-        std::FILE* streamFile;
-        /** Holds the size of the data in the file. */
+        /** Holds the brick cache with the data for streaming. */
+        std::shared_ptr<VolumeBrickCache> brickCache;
+        /** Holds the id of this nodes brick in the cache. */
+        unsigned int brickId;
+        /** Holds the size of the data in the cache. */
         unsigned int dataSize;
+        /** Holds the streamer loading the bricks asynchronously (empty if bricks are loaded synchronously). */
+        std::shared_ptr<VolumeBrickStreamer> streamer;
+        /** Holds whether this nodes brick is requested from the streamer. */
+        bool dataPending;
+        /** Holds whether the pending request is a prefetch. */
+        bool dataPrefetched;
+        /** Holds whether this nodes resolution was sufficient in the last frame (for LOD hysteresis). */
+        bool lodSufficient;
+        /** Holds whether this nodes brick is in use (a released brick may still be resident). */
+        bool brickInUse;
+        /** Holds the residency management deciding which released bricks stay on the GPU. */
+        std::shared_ptr<VolumeBrickResidency> residency;
+        /** Holds the prefetching of bricks for the predicted camera. */
+        std::shared_ptr<VolumeBrickPrefetch> prefetch;
+        /** Holds the nodes with data indexed by their brick ids (root only). */
+        std::vector<VolumeBrickOctree*> brickNodes;
         /** Holds the texture descriptor. */
         TextureDescriptor brickTextureDesc;
         /** Holds the texture of this brick. */
         std::unique_ptr<GLTexture> brickTexture;
-        /** Holds the GPUProgram for generating Min/Max MipMaps. */
-        GPUProgram* minMaxMapProgram;
-        /** Holds the binding locations for the Min/Max MipMaps. */
-        std::vector<BindingLocation> minMaxMapUniformNames;
     };
 }
 
@@ -0,0 +1,92 @@
+/**
+ * @file   VolumeBrickPrefetch.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.26
+ *
+ * @brief  Implementation of the prediction of camera motion for prefetching volume bricks.
+ */
+
+#include "VolumeBrickPrefetch.h"
+#include <algorithm>
+
+namespace cgu {
+
+    /** Constructor. */
+    VolumeBrickPrefetch::VolumeBrickPrefetch() :
+        numSamples(0)
+    {
+    }
+
+    /**
+     * Adds the camera of the current frame.
+     * @param view the view matrix of the camera.
+     */
+    void VolumeBrickPrefetch::AddCameraSample(const glm::mat4& view)
+    {
+        lastView = currentView;
+        currentView = view;
+        if (numSamples < 2) ++numSamples;
+    }
+
+    /**
+     * Predicts the camera some frames ahead.
+     * @param framesAhead the number of frames to predict.
+     * @param predictedView the predicted view matrix (output).
+     * @return whether the camera moves (the prediction differs from the current camera).
+     */
+    bool VolumeBrickPrefetch::PredictView(unsigned int framesAhead, glm::mat4& predictedView) const
+    {
+        if (numSamples < 2) return false;
+
+        // the motion of the camera in the last frame relative to the camera itself.
+        auto currentCamera = glm::inverse(currentView);
+        auto frameMotion = lastView * currentCamera;
+        auto predictedCamera = currentCamera;
+        for (unsigned int i = 0; i < framesAhead; ++i) predictedCamera = predictedCamera * frameMotion;
+        predictedView = glm::inverse(predictedCamera);
+        return true;
+    }
+
+    /**
+     * Sets the prefetch requests of the current frame.
+     * @param requests the bricks requested by prefetching in the current frame.
+     * @return the bricks requested in the last frame but not in the current one (to cancel).
+     */
+    std::vector<unsigned int> VolumeBrickPrefetch::UpdateRequests(std::vector<unsigned int> requests)
+    {
+        std::sort(requests.begin(), requests.end());
+        std::vector<unsigned int> staleRequests;
+        std::set_difference(lastRequests.begin(), lastRequests.end(), requests.begin(), requests.end(),
+            std::back_inserter(staleRequests));
+        lastRequests = std::move(requests);
+        return staleRequests;
+    }
+
+    /**
+     * Records a loaded prefetched brick.
+     * @param brickId the id of the brick.
+     */
+    void VolumeBrickPrefetch::RecordLoad(unsigned int brickId)
+    {
+        loadedBricks.insert(brickId);
+        ++stats.numLoaded;
+    }
+
+    /**
+     * Records the use of a resident brick, a hit if it was prefetched.
+     * @param brickId the id of the brick.
+     */
+    void VolumeBrickPrefetch::RecordUse(unsigned int brickId)
+    {
+        if (loadedBricks.erase(brickId) != 0) ++stats.numHits;
+    }
+
+    /**
+     * Records the eviction of a brick, a wasted load if it was prefetched and never used.
+     * @param brickId the id of the brick.
+     */
+    void VolumeBrickPrefetch::RecordEviction(unsigned int brickId)
+    {
+        if (loadedBricks.erase(brickId) != 0) ++stats.numWasted;
+    }
+}
@@ -0,0 +1,80 @@
+/**
+ * @file   VolumeBrickPrefetch.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.26
+ *
+ * @brief  Defines the prediction of camera motion for prefetching volume bricks.
+ */
+
+#ifndef VOLUMEBRICKPREFETCH_H
+#define VOLUMEBRICKPREFETCH_H
+
+#include "main.h"
+#include <unordered_set>
+
+namespace cgu {
+
+    /** Counters of the brick prefetching. */
+    struct BrickPrefetchStats
+    {
+        BrickPrefetchStats() : numRequests(0), numLoaded(0), numHits(0), numWasted(0), numCancelled(0) {};
+
+        /** Returns the ratio of loaded prefetched bricks that were used later. */
+        float GetHitRate() const { return numLoaded == 0 ? 0.0f : static_cast<float>(numHits) / static_cast<float>(numLoaded); }
+
+        /** Holds the number of prefetch requests. */
+        unsigned int numRequests;
+        /** Holds the number of prefetched bricks loaded. */
+        unsigned int numLoaded;
+        /** Holds the number of prefetched bricks used after loading. */
+        unsigned int numHits;
+        /** Holds the number of prefetched bricks evicted without being used. */
+        unsigned int numWasted;
+        /** Holds the number of prefetch requests cancelled before loading. */
+        unsigned int numCancelled;
+    };
+
+    /**
+     * @brief  Extrapolates the camera motion and keeps track of prefetched bricks.
+     * The motion between the last two camera samples is assumed to continue, so the predicted camera moves
+     * and turns the same way for the next frames. Prefetched bricks are followed until they are used or evicted.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.26
+     */
+    class VolumeBrickPrefetch
+    {
+    public:
+        VolumeBrickPrefetch();
+
+        void AddCameraSample(const glm::mat4& view);
+        bool PredictView(unsigned int framesAhead, glm::mat4& predictedView) const;
+        std::vector<unsigned int> UpdateRequests(std::vector<unsigned int> requests);
+
+        /** Records a new prefetch request. */
+        void RecordRequest() { ++stats.numRequests; }
+        /** Records a cancelled prefetch request. */
+        void RecordCancel() { ++stats.numCancelled; }
+        void RecordLoad(unsigned int brickId);
+        void RecordUse(unsigned int brickId);
+        void RecordEviction(unsigned int brickId);
+        /** Returns the counters. */
+        const BrickPrefetchStats& GetStats() const { return stats; }
+
+    private:
+        /** Holds the current camera view matrix. */
+        glm::mat4 currentView;
+        /** Holds the camera view matrix of the last frame. */
+        glm::mat4 lastView;
+        /** Holds the number of camera samples (up to 2). */
+        unsigned int numSamples;
+        /** Holds the prefetch requests of the last frame (sorted). */
+        std::vector<unsigned int> lastRequests;
+        /** Holds the prefetched bricks loaded but not used yet. */
+        std::unordered_set<unsigned int> loadedBricks;
+        /** Holds the counters. */
+        BrickPrefetchStats stats;
+    };
+}
+
+#endif // VOLUMEBRICKPREFETCH_H
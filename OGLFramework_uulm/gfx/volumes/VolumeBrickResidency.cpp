@@ -0,0 +1,106 @@
+/**
+ * @file   VolumeBrickResidency.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.24
+ *
+ * @brief  Implementation of the GPU memory residency management for volume bricks.
+ */
+
+#include "VolumeBrickResidency.h"
+
+namespace cgu {
+
+    /**
+     * Constructor.
+     * @param memoryBudget the memory budget for all resident bricks in bytes.
+     */
+    VolumeBrickResidency::VolumeBrickResidency(std::size_t memoryBudget)
+    {
+        stats.budget = memoryBudget;
+    }
+
+    /**
+     * Requests a brick, a resident brick is pinned.
+     * @param brickId the id of the brick.
+     * @return whether the brick is resident (hit) or needs to be loaded (miss).
+     */
+    bool VolumeBrickResidency::Use(unsigned int brickId)
+    {
+        auto brick = residentBricks.find(brickId);
+        if (brick == residentBricks.end()) {
+            ++stats.numMisses;
+            return false;
+        }
+
+        ++stats.numHits;
+        if (!brick->second.pinned) {
+            releasedBricks.erase(brick->second.lruPosition);
+            brick->second.pinned = true;
+        }
+        return true;
+    }
+
+    /**
+     * Adds a loaded brick, it is pinned until it is released.
+     * @param brickId the id of the brick.
+     * @param size the memory of the brick.
+     */
+    void VolumeBrickResidency::Insert(unsigned int brickId, std::size_t size)
+    {
+        Remove(brickId);
+        residentBricks[brickId] = ResidentBrick{ size, true, releasedBricks.end() };
+        stats.residentSize += size;
+        if (stats.residentSize > stats.peakResidentSize) stats.peakResidentSize = stats.residentSize;
+    }
+
+    /**
+     * Releases a brick that is not used anymore, it stays resident until it is evicted.
+     * @param brickId the id of the brick.
+     */
+    void VolumeBrickResidency::Release(unsigned int brickId)
+    {
+        auto brick = residentBricks.find(brickId);
+        if (brick == residentBricks.end() || !brick->second.pinned) return;
+        brick->second.pinned = false;
+        brick->second.lruPosition = releasedBricks.insert(releasedBricks.end(), brickId);
+    }
+
+    /**
+     * Removes a brick whose texture was deleted.
+     * @param brickId the id of the brick.
+     */
+    void VolumeBrickResidency::Remove(unsigned int brickId)
+    {
+        auto brick = residentBricks.find(brickId);
+        if (brick == residentBricks.end()) return;
+        if (!brick->second.pinned) releasedBricks.erase(brick->second.lruPosition);
+        stats.residentSize -= brick->second.size;
+        residentBricks.erase(brick);
+    }
+
+    /**
+     * Evicts the least recently used released bricks until the resident memory is within the budget.
+     * Pinned bricks are never evicted so the budget may still be exceeded afterwards.
+     * @return the ids of the evicted bricks, their textures need to be deleted.
+     */
+    std::vector<unsigned int> VolumeBrickResidency::CollectEvictions()
+    {
+        std::vector<unsigned int> evictions;
+        while (stats.residentSize > stats.budget && !releasedBricks.empty()) {
+            auto brickId = releasedBricks.front();
+            Remove(brickId);
+            evictions.push_back(brickId);
+        }
+        stats.numEvictions += static_cast<unsigned int>(evictions.size());
+        return evictions;
+    }
+
+    /**
+     * Sets the memory budget, it is applied by the next CollectEvictions().
+     * @param memoryBudget the memory budget for all resident bricks in bytes.
+     */
+    void VolumeBrickResidency::SetBudget(std::size_t memoryBudget)
+    {
+        stats.budget = memoryBudget;
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * @file   VolumeBrickResidency.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.24
+ *
+ * @brief  Defines the GPU memory residency management for volume bricks.
+ */
+
+#ifndef VOLUMEBRICKRESIDENCY_H
+#define VOLUMEBRICKRESIDENCY_H
+
+#include "main.h"
+
+namespace cgu {
+
+    /** Counters of the brick residency management. */
+    struct BrickResidencyStats
+    {
+        BrickResidencyStats() : numHits(0), numMisses(0), numEvictions(0), residentSize(0), peakResidentSize(0), budget(0) {};
+
+        /** Holds the number of requested bricks that were still resident. */
+        unsigned int numHits;
+        /** Holds the number of requested bricks that needed to be loaded. */
+        unsigned int numMisses;
+        /** Holds the number of evicted bricks. */
+        unsigned int numEvictions;
+        /** Holds the memory of all resident bricks. */
+        std::size_t residentSize;
+        /** Holds the maximum memory of all resident bricks. */
+        std::size_t peakResidentSize;
+        /** Holds the memory budget. */
+        std::size_t budget;
+    };
+
+    /**
+     * @brief  Decides which brick textures stay resident on the GPU within a memory budget.
+     * Bricks in use (rendered) are pinned. Released bricks stay resident in least recently used order and are
+     * reused on the next request until the resident memory exceeds the budget, then the least recently used
+     * released bricks are evicted. The policy does not touch OpenGL so it is deterministic and testable.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.24
+     */
+    class VolumeBrickResidency
+    {
+    public:
+        explicit VolumeBrickResidency(std::size_t memoryBudget);
+
+        bool Use(unsigned int brickId);
+        void Insert(unsigned int brickId, std::size_t size);
+        void Release(unsigned int brickId);
+        void Remove(unsigned int brickId);
+        std::vector<unsigned int> CollectEvictions();
+        void SetBudget(std::size_t memoryBudget);
+        /** Returns the counters. */
+        const BrickResidencyStats& GetStats() const { return stats; }
+
+    private:
+        /** A resident brick. */
+        struct ResidentBrick
+        {
+            /** Holds the memory of the brick. */
+            std::size_t size;
+            /** Holds whether the brick is in use. */
+            bool pinned;
+            /** Holds the position of the brick in the list of released bricks (if not pinned). */
+            std::list<unsigned int>::iterator lruPosition;
+        };
+
+        /** Holds the resident bricks. */
+        std::unordered_map<unsigned int, ResidentBrick> residentBricks;
+        /** Holds the released bricks, least recently used first. */
+        std::list<unsigned int> releasedBricks;
+        /** Holds the counters. */
+        BrickResidencyStats stats;
+    };
+}
+
+#endif // VOLUMEBRICKRESIDENCY_H
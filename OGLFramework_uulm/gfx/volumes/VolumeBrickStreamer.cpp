@@ -0,0 +1,176 @@
+/**
+ * @file   VolumeBrickStreamer.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.23
+ *
+ * @brief  Implementation of the asynchronous streaming of volume bricks.
+ */
+
+#include "VolumeBrickStreamer.h"
+#include "VolumeBrickCache.h"
+#include <cstring>
+
+namespace cgu {
+
+    /**
+     * Constructor, starts the I/O thread.
+     * @param cache the (complete) brick cache to stream from.
+     * @param sink the sink providing staging memory and uploading the bricks.
+     * @param numStagingSlots the number of staging slots (each large enough for the biggest brick).
+     */
+    VolumeBrickStreamer::VolumeBrickStreamer(std::shared_ptr<const VolumeBrickCache> cache,
+        std::unique_ptr<BrickUploadSink> sink, unsigned int numStagingSlots) :
+        brickCache(std::move(cache)),
+        uploadSink(std::move(sink)),
+        numQueued(0),
+        nextTicket(0),
+        stopIOThread(false)
+    {
+        assert(brickCache->IsComplete());
+        for (unsigned int i = numStagingSlots; i > 0; --i) freeSlots.push_back(i - 1);
+        ioThread = std::thread(&VolumeBrickStreamer::IOThreadMain, this);
+    }
+
+    /** Destructor, stops the I/O thread. */
+    VolumeBrickStreamer::~VolumeBrickStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            stopIOThread = true;
+        }
+        streamCondition.notify_all();
+        ioThread.join();
+    }
+
+    /**
+     * Requests a brick or updates the priority of an open request.
+     * A prefetch request does not change an open regular request, a regular request turns an open prefetch
+     * request into a regular one.
+     * @param brickId the id of the brick in the cache.
+     * @param priority the priority of the brick (higher is loaded first).
+     * @param prefetch whether the request is a prefetch (loaded after all regular requests).
+     */
+    void VolumeBrickStreamer::RequestBrick(unsigned int brickId, float priority, bool prefetch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            auto request = requests.find(brickId);
+            if (request != requests.end()) {
+                if (prefetch && !request->second.prefetch) return;
+                request->second.priority = priority;
+                request->second.prefetch = prefetch;
+                return;
+            }
+            requests[brickId] = BrickRequest{ priority, prefetch, RequestState::QUEUED, nextTicket++ };
+            ++numQueued;
+            ++stats.numRequested;
+        }
+        streamCondition.notify_one();
+    }
+
+    /**
+     * Cancels the request of a brick, bricks currently read are discarded afterwards.
+     * @param brickId the id of the brick in the cache.
+     */
+    void VolumeBrickStreamer::CancelBrick(unsigned int brickId)
+    {
+        std::lock_guard<std::mutex> lock(streamMutex);
+        auto request = requests.find(brickId);
+        if (request == requests.end()) return;
+        if (request->second.state == RequestState::QUEUED) --numQueued;
+        requests.erase(request);
+        ++stats.numCancelled;
+    }
+
+    /**
+     * Frees staging slots the GPU finished reading and issues the uploads of staged bricks.
+     * Needs to be called from the render thread.
+     * @param maxUploads the maximum number of uploads to issue.
+     * @return the number of uploads issued.
+     */
+    unsigned int VolumeBrickStreamer::Update(unsigned int maxUploads)
+    {
+        std::vector<unsigned int> finishedSlots;
+        for (auto it = uploadingSlots.begin(); it != uploadingSlots.end();) {
+            if (uploadSink->IsStagingSlotFree(*it)) {
+                finishedSlots.push_back(*it);
+                it = uploadingSlots.erase(it);
+            } else ++it;
+        }
+
+        std::vector<StagedBrick> uploads;
+        {
+            std::lock_guard<std::mutex> lock(streamMutex);
+            freeSlots.insert(freeSlots.end(), finishedSlots.begin(), finishedSlots.end());
+            while (!stagedBricks.empty() && uploads.size() < maxUploads) {
+                auto staged = stagedBricks.front();
+                stagedBricks.pop_front();
+                auto request = requests.find(staged.brickId);
+                if (request != requests.end() && request->second.ticket == staged.ticket) {
+                    requests.erase(request);
+                    uploads.push_back(staged);
+                } else freeSlots.push_back(staged.slot);
+            }
+            stats.numUploaded += static_cast<unsigned int>(uploads.size());
+        }
+        streamCondition.notify_one();
+
+        for (const auto& staged : uploads) {
+            uploadSink->UploadBrick(staged.brickId, staged.slot, brickCache->GetBrickDataSize(staged.brickId));
+            uploadingSlots.push_back(staged.slot);
+        }
+        return static_cast<unsigned int>(uploads.size());
+    }
+
+    /** Returns the counters of the streamer. */
+    BrickStreamingStats VolumeBrickStreamer::GetStats() const
+    {
+        std::lock_guard<std::mutex> lock(streamMutex);
+        return stats;
+    }
+
+    /**
+     * The I/O thread, reads the queued brick with the highest priority into a free staging slot.
+     * Reading from the mapped cache file is where the bricks are actually loaded from storage and decoded.
+     */
+    void VolumeBrickStreamer::IOThreadMain()
+    {
+        std::vector<uint8_t> decodeBuffer;
+        std::unique_lock<std::mutex> lock(streamMutex);
+        while (true) {
+            streamCondition.wait(lock, [this]() { return stopIOThread || (numQueued > 0 && !freeSlots.empty()); });
+            if (stopIOThread) return;
+
+            auto bestRequest = requests.end();
+            for (auto it = requests.begin(); it != requests.end(); ++it) {
+                if (it->second.state != RequestState::QUEUED) continue;
+                if (bestRequest == requests.end() || (bestRequest->second.prefetch && !it->second.prefetch)
+                    || (bestRequest->second.prefetch == it->second.prefetch && it->second.priority > bestRequest->second.priority)) {
+                    bestRequest = it;
+                }
+            }
+            assert(bestRequest != requests.end());
+
+            StagedBrick staged{ bestRequest->first, freeSlots.back(), bestRequest->second.ticket };
+            freeSlots.pop_back();
+            bestRequest->second.state = RequestState::READING;
+            --numQueued;
+
+            lock.unlock();
+            try {
+                brickCache->ReadBrick(staged.brickId, uploadSink->GetStagingMemory(staged.slot), decodeBuffer);
+            } catch (const std::exception&) {
+                LOG(WARNING) << L"Could not decode brick " << staged.brickId << L" from the brick cache.";
+                std::memset(uploadSink->GetStagingMemory(staged.slot), 0, brickCache->GetBrickDataSize(staged.brickId));
+            }
+            lock.lock();
+
+            auto request = requests.find(staged.brickId);
+            if (request != requests.end() && request->second.ticket == staged.ticket) {
+                request->second.state = RequestState::STAGED;
+                stagedBricks.push_back(staged);
+                ++stats.numStaged;
+            } else freeSlots.push_back(staged.slot);
+        }
+    }
+}
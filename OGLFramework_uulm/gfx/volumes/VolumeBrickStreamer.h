@@ -0,0 +1,152 @@
+/**
+ * @file   VolumeBrickStreamer.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.23
+ *
+ * @brief  Defines the asynchronous streaming of volume bricks.
+ */
+
+#ifndef VOLUMEBRICKSTREAMER_H
+#define VOLUMEBRICKSTREAMER_H
+
+#include "main.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace cgu {
+
+    class VolumeBrickCache;
+
+    /**
+     * @brief  Interface for the staging memory and GPU upload of streamed bricks.
+     * The OpenGL implementation uses a persistently mapped pixel buffer, tests can use plain memory.
+     */
+    class BrickUploadSink
+    {
+    public:
+        virtual ~BrickUploadSink() = default;
+
+        /**
+         * Returns the memory of a staging slot, called from the I/O thread.
+         * @param slot the staging slot.
+         */
+        virtual void* GetStagingMemory(unsigned int slot) = 0;
+        /**
+         * Issues the upload of a staged brick, called from the render thread.
+         * @param brickId the id of the brick in the cache.
+         * @param slot the staging slot holding the bricks data.
+         * @param size the size of the bricks data.
+         */
+        virtual void UploadBrick(unsigned int brickId, unsigned int slot, std::size_t size) = 0;
+        /**
+         * Returns whether the GPU finished reading a staging slot, called from the render thread.
+         * @param slot the staging slot.
+         */
+        virtual bool IsStagingSlotFree(unsigned int slot) = 0;
+    };
+
+    /** Counters of the brick streamer. */
+    struct BrickStreamingStats
+    {
+        BrickStreamingStats() : numRequested(0), numStaged(0), numUploaded(0), numCancelled(0) {};
+
+        /** Holds the number of bricks requested. */
+        unsigned int numRequested;
+        /** Holds the number of bricks read into staging memory. */
+        unsigned int numStaged;
+        /** Holds the number of bricks uploaded. */
+        unsigned int numUploaded;
+        /** Holds the number of requests cancelled before the upload. */
+        unsigned int numCancelled;
+    };
+
+    /**
+     * @brief  Streams bricks from a brick cache to the GPU without blocking the render thread.
+     * The render thread requests bricks with a priority, an I/O thread reads the requested bricks (highest
+     * priority first) into free staging slots and the render thread issues the uploads of staged bricks in
+     * Update(). A staging slot is reused once the sink reports the upload from it as finished.
+     * Prefetch requests are only read when no other requests are queued.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.23
+     */
+    class VolumeBrickStreamer
+    {
+    public:
+        VolumeBrickStreamer(std::shared_ptr<const VolumeBrickCache> cache, std::unique_ptr<BrickUploadSink> sink,
+            unsigned int numStagingSlots);
+        VolumeBrickStreamer(const VolumeBrickStreamer&) = delete;
+        VolumeBrickStreamer& operator=(const VolumeBrickStreamer&) = delete;
+        ~VolumeBrickStreamer();
+
+        void RequestBrick(unsigned int brickId, float priority, bool prefetch);
+        void CancelBrick(unsigned int brickId);
+        unsigned int Update(unsigned int maxUploads);
+        BrickStreamingStats GetStats() const;
+
+    private:
+        /** The state of a brick request. */
+        enum class RequestState
+        {
+            QUEUED,
+            READING,
+            STAGED
+        };
+
+        /** A brick request. */
+        struct BrickRequest
+        {
+            /** Holds the priority (higher is loaded first). */
+            float priority;
+            /** Holds whether the request is a prefetch. */
+            bool prefetch;
+            /** Holds the state of the request. */
+            RequestState state;
+            /** Holds the ticket identifying this request (to detect requests cancelled while reading). */
+            unsigned long long ticket;
+        };
+
+        /** A brick read into a staging slot. */
+        struct StagedBrick
+        {
+            /** Holds the id of the brick. */
+            unsigned int brickId;
+            /** Holds the staging slot. */
+            unsigned int slot;
+            /** Holds the ticket of the request. */
+            unsigned long long ticket;
+        };
+
+        void IOThreadMain();
+
+        /** Holds the brick cache. */
+        std::shared_ptr<const VolumeBrickCache> brickCache;
+        /** Holds the upload sink. */
+        std::unique_ptr<BrickUploadSink> uploadSink;
+        /** Holds the open requests. */
+        std::unordered_map<unsigned int, BrickRequest> requests;
+        /** Holds the number of queued requests. */
+        unsigned int numQueued;
+        /** Holds the bricks staged for upload. */
+        std::deque<StagedBrick> stagedBricks;
+        /** Holds the free staging slots. */
+        std::vector<unsigned int> freeSlots;
+        /** Holds the staging slots the GPU is reading from (render thread only). */
+        std::vector<unsigned int> uploadingSlots;
+        /** Holds the next request ticket. */
+        unsigned long long nextTicket;
+        /** Holds the counters. */
+        BrickStreamingStats stats;
+        /** Holds whether the I/O thread should stop. */
+        bool stopIOThread;
+        /** Holds the mutex protecting the requests, staged bricks, free slots and counters. */
+        mutable std::mutex streamMutex;
+        /** Holds the condition the I/O thread waits on. */
+        std::condition_variable streamCondition;
+        /** Holds the I/O thread. */
+        std::thread ioThread;
+    };
+}
+
+#endif // VOLUMEBRICKSTREAMER_H
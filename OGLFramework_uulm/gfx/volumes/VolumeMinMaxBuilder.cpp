@@ -0,0 +1,553 @@
+/**
+ * @file   VolumeMinMaxBuilder.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.27
+ *
+ * @brief  Implementation of the CPU builder for the min/max pyramids of volume bricks.
+ */
+
+#include "VolumeMinMaxBuilder.h"
+#include "core/parallel_helper.h"
+#include <cstring>
+#include <limits>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1) || defined(__SSE__)
+#include <xmmintrin.h>
+#define VOLUME_MINMAX_SSE
+#endif
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    namespace {
+
+        /** Holds the minimum number of texels processed by a thread. */
+        const std::size_t minTexelsPerTask = 32768;
+        /** Holds the number of texels converted at once (the conversion loops are kept simple to be vectorized). */
+        const std::size_t texelsPerBatch = 4096;
+
+        /**
+         * Converts a float to a half float (rounding to nearest even as the GPU does).
+         * @param value the float value.
+         * @return the bits of the half float.
+         */
+        uint16_t floatToHalf(float value)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+            auto absBits = bits & 0x7FFFFFFF;
+            if (absBits > 0x7F800000) return sign | 0x7E00;
+            if (absBits >= 0x47800000) return sign | 0x7C00;
+            if (absBits < 0x33000000) return sign;
+
+            uint32_t halfBits, remainder, halfway;
+            if (absBits < 0x38800000) {
+                auto shift = 126 - (absBits >> 23);
+                auto mantissa = (absBits & 0x7FFFFF) | 0x800000;
+                halfBits = mantissa >> shift;
+                remainder = mantissa & ((1u << shift) - 1);
+                halfway = 1u << (shift - 1);
+            } else {
+                halfBits = (absBits - 0x38000000) >> 13;
+                remainder = absBits & 0x1FFF;
+                halfway = 0x1000;
+            }
+            if (remainder > halfway || (remainder == halfway && (halfBits & 1))) ++halfBits;
+            return sign | static_cast<uint16_t>(halfBits);
+        }
+
+        /**
+         * Converts a half float to a float without branches (so loops converting halfs can be vectorized).
+         * The exponent and mantissa are placed in a float and rescaled by 2^112, which is exact for normal and
+         * denormal halfs, infinity and NaN are selected separately.
+         * @param value the bits of the half float.
+         * @return the float value.
+         */
+        inline float halfToFloat(uint16_t value)
+        {
+            uint32_t absBits = static_cast<uint32_t>(value & 0x7FFF) << 13;
+            float scaled;
+            std::memcpy(&scaled, &absBits, sizeof(scaled));
+            scaled *= 5.192296858534828e33f; // 2^112
+            uint32_t bits;
+            std::memcpy(&bits, &scaled, sizeof(bits));
+            bits = absBits >= (0x7C00u << 13) ? (absBits | 0x7F800000) : bits;
+            bits |= static_cast<uint32_t>(value & 0x8000) << 16;
+
+            float result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+
+        /** Texels of RGBA8 images. */
+        struct Unorm8Texel
+        {
+            typedef uint8_t Component;
+            static float ToFloat(Component c) { return static_cast<float>(c) / 255.0f; }
+            static Component FromFloat(float f) { return static_cast<Component>(glm::clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f); }
+        };
+
+        /** Texels of RGBA8_SNORM images. */
+        struct Snorm8Texel
+        {
+            typedef int8_t Component;
+            static float ToFloat(Component c) { return glm::max(static_cast<float>(c) / 127.0f, -1.0f); }
+            static Component FromFloat(float f) { return static_cast<Component>(std::floor(glm::clamp(f, -1.0f, 1.0f) * 127.0f + 0.5f)); }
+        };
+
+        /** Texels of RGBA16F images. */
+        struct HalfTexel
+        {
+            typedef uint16_t Component;
+            static float ToFloat(Component c) { return halfToFloat(c); }
+            static Component FromFloat(float f) { return floatToHalf(f); }
+        };
+
+        /** Texels of RGBA32F images. */
+        struct FloatTexel
+        {
+            typedef float Component;
+            static float ToFloat(Component c) { return c; }
+            static Component FromFloat(float f) { return f; }
+        };
+
+        /** Half float volume values (to distinguish them from unsigned shorts). */
+        struct HalfValue
+        {
+            /** Holds the bits of the half float. */
+            uint16_t bits;
+        };
+
+        /** Converts volume values as OpenGL does when uploading them to a floating point texture (normalizing integers). */
+        inline float rawToFloat(uint8_t c) { return static_cast<float>(c) / 255.0f; }
+        inline float rawToFloat(uint16_t c) { return static_cast<float>(c) / 65535.0f; }
+        inline float rawToFloat(uint32_t c) { return static_cast<float>(static_cast<double>(c) / 4294967295.0); }
+        inline float rawToFloat(int8_t c) { return glm::max(static_cast<float>(c) / 127.0f, -1.0f); }
+        inline float rawToFloat(int16_t c) { return glm::max(static_cast<float>(c) / 32767.0f, -1.0f); }
+        inline float rawToFloat(HalfValue c) { return halfToFloat(c.bits); }
+        inline float rawToFloat(float c) { return c; }
+
+        /** The r, g and b channels (avg, min, max) of a min/max image stored separately. */
+        struct MinMaxChannels
+        {
+            explicit MinMaxChannels(std::size_t numTexels) : avg(numTexels, 0.0f), minimum(numTexels, 0.0f), maximum(numTexels, 0.0f) {};
+
+            /** Holds the average values. */
+            std::vector<float> avg;
+            /** Holds the minimum values. */
+            std::vector<float> minimum;
+            /** Holds the maximum values. */
+            std::vector<float> maximum;
+        };
+
+        /**
+         * Splits slices over threads, small images are processed on the calling thread only.
+         * @param numSlices the number of slices.
+         * @param texelsPerSlice the number of texels in a slice.
+         * @param numThreads the maximum number of threads to use.
+         * @param fn the function called with the first and last (exclusive) slice of each task.
+         */
+        template<class Fn>
+        void forSlices(unsigned int numSlices, std::size_t texelsPerSlice, unsigned int numThreads, Fn fn)
+        {
+            std::size_t numTasks = (static_cast<std::size_t>(numSlices) * texelsPerSlice) / minTexelsPerTask;
+            if (numTasks > numThreads) numTasks = numThreads;
+            if (numTasks > numSlices) numTasks = numSlices;
+            if (numTasks == 0) numTasks = 1;
+            parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+                fn(static_cast<unsigned int>((task * numSlices) / numTasks), static_cast<unsigned int>(((task + 1) * numSlices) / numTasks));
+            });
+        }
+
+        /**
+         * Reads an images channels.
+         * @param data the image data.
+         * @param size the image size.
+         * @param channels the channels (output).
+         * @param numThreads the maximum number of threads to use.
+         */
+        template<class Texel>
+        void decodeImage(const uint8_t* data, const glm::uvec3& size, MinMaxChannels& channels, unsigned int numThreads)
+        {
+            auto texels = reinterpret_cast<const typename Texel::Component*>(data);
+            std::size_t sliceSize = static_cast<std::size_t>(size.x) * size.y;
+            forSlices(size.z, sliceSize, numThreads, [&](unsigned int zBegin, unsigned int zEnd) {
+                for (auto i = zBegin * sliceSize; i < zEnd * sliceSize; ++i) {
+                    channels.avg[i] = Texel::ToFloat(texels[4 * i]);
+                    channels.minimum[i] = Texel::ToFloat(texels[4 * i + 1]);
+                    channels.maximum[i] = Texel::ToFloat(texels[4 * i + 2]);
+                }
+            });
+        }
+
+        /**
+         * Reads a single channel of texels.
+         * @param data the texel data.
+         * @param numTexels the number of texels.
+         * @param channel the channel to read.
+         * @param values the values of the channel (output).
+         */
+        template<class Texel>
+        void decodeChannel(const uint8_t* data, std::size_t numTexels, unsigned int channel, float* values)
+        {
+            auto texels = reinterpret_cast<const typename Texel::Component*>(data) + channel;
+            for (std::size_t i = 0; i < numTexels; ++i) values[i] = Texel::ToFloat(texels[4 * i]);
+        }
+
+        /**
+         * Writes an images channels (a = 0) and rounds the channels to the stored values.
+         * @param channels the channels.
+         * @param size the image size.
+         * @param data the image data (output).
+         * @param numThreads the maximum number of threads to use.
+         */
+        template<class Texel>
+        void encodeImage(MinMaxChannels& channels, const glm::uvec3& size, uint8_t* data, unsigned int numThreads)
+        {
+            auto texels = reinterpret_cast<typename Texel::Component*>(data);
+            std::size_t sliceSize = static_cast<std::size_t>(size.x) * size.y;
+            forSlices(size.z, sliceSize, numThreads, [&](unsigned int zBegin, unsigned int zEnd) {
+                for (auto i = zBegin * sliceSize; i < zEnd * sliceSize; ++i) {
+                    texels[4 * i] = Texel::FromFloat(channels.avg[i]);
+                    texels[4 * i + 1] = Texel::FromFloat(channels.minimum[i]);
+                    texels[4 * i + 2] = Texel::FromFloat(channels.maximum[i]);
+                    texels[4 * i + 3] = Texel::FromFloat(0.0f);
+                    channels.avg[i] = Texel::ToFloat(texels[4 * i]);
+                    channels.minimum[i] = Texel::ToFloat(texels[4 * i + 1]);
+                    channels.maximum[i] = Texel::ToFloat(texels[4 * i + 2]);
+                }
+            });
+        }
+
+        /**
+         * Calculates the two read positions of each invocation along an axis.
+         * @param extent the number of invocations.
+         * @param ratio the ratio of the read image size to the written image size.
+         * @param shift the offset of the read positions and their lower bound.
+         * @param readSize the size of the read image (upper bound).
+         * @param positions the read positions (output, two per invocation).
+         */
+        void calculateReadPositions(unsigned int extent, float ratio, unsigned int shift, unsigned int readSize,
+            std::vector<unsigned int>& positions)
+        {
+            positions.resize(2 * static_cast<std::size_t>(extent));
+            auto lower = static_cast<int>(shift);
+            auto upper = static_cast<int>(readSize) - 1;
+            for (unsigned int i = 0; i < extent; ++i) {
+                auto base = static_cast<int>(static_cast<float>(i) * ratio) + lower;
+                // clamp(x, lo, hi) is min(max(x, lo), hi) in GLSL.
+                positions[2 * i] = static_cast<unsigned int>(glm::min(glm::max(base, lower), upper));
+                positions[2 * i + 1] = static_cast<unsigned int>(glm::min(glm::max(base + 1, lower), upper));
+            }
+        }
+
+#ifdef VOLUME_MINMAX_SSE
+        /**
+         * Loads eight consecutive values and splits them into the values at even and odd positions.
+         * @param values the values (do not need to be aligned).
+         * @param even the values 0, 2, 4 and 6 (output).
+         * @param odd the values 1, 3, 5 and 7 (output).
+         */
+        inline void loadValuePairs(const float* values, __m128& even, __m128& odd)
+        {
+            auto lower = _mm_loadu_ps(values);
+            auto upper = _mm_loadu_ps(values + 4);
+            even = _mm_shuffle_ps(lower, upper, _MM_SHUFFLE(2, 0, 2, 0));
+            odd = _mm_shuffle_ps(lower, upper, _MM_SHUFFLE(3, 1, 3, 1));
+        }
+#endif
+
+        /**
+         * Reduces 2x2x2 blocks of an image as the compute shaders do: each invocation reads at its position scaled by
+         * the size ratio plus the shift and writes the average of r, the minimum of g and the maximum of b.
+         * Minimum and maximum start at infinity (the shaders start at 1 and 0 which only works for unsigned data).
+         * Invocations reading two neighbouring texels at consecutive even offsets along x (all mip map levels of
+         * power of two sizes) are reduced four at a time with SSE, summing in the same order as the scalar loop.
+         * @param src the channels of the read image.
+         * @param srcSize the size of the read image.
+         * @param shift the offset of the read positions and their lower bound.
+         * @param ratio the ratio used to scale the invocation positions.
+         * @param dst the channels of the written image.
+         * @param dstSize the size of the written image.
+         * @param dstOffset the position written by the first invocation.
+         * @param extent the number of invocations (per axis).
+         * @param numThreads the maximum number of threads to use.
+         */
+        void reduceImage(const MinMaxChannels& src, const glm::uvec3& srcSize, const glm::uvec3& shift, const glm::vec3& ratio,
+            MinMaxChannels& dst, const glm::uvec3& dstSize, const glm::uvec3& dstOffset, const glm::uvec3& extent,
+            unsigned int numThreads)
+        {
+            std::vector<unsigned int> readX, readY, readZ;
+            calculateReadPositions(extent.x, ratio.x, shift.x, srcSize.x, readX);
+            calculateReadPositions(extent.y, ratio.y, shift.y, srcSize.y, readY);
+            calculateReadPositions(extent.z, ratio.z, shift.z, srcSize.z, readZ);
+
+            unsigned int numContiguous = 0;
+            while (numContiguous < extent.x && readX[2 * numContiguous] == readX[0] + 2 * numContiguous
+                && readX[2 * numContiguous + 1] == readX[2 * numContiguous] + 1) ++numContiguous;
+
+            std::size_t srcLine = srcSize.x;
+            std::size_t srcSlice = srcLine * srcSize.y;
+            forSlices(extent.z, static_cast<std::size_t>(extent.x) * extent.y, numThreads, [&](unsigned int zBegin, unsigned int zEnd) {
+                for (auto z = zBegin; z < zEnd; ++z) {
+                    for (unsigned int y = 0; y < extent.y; ++y) {
+                        // rows in the order the shaders read them: (y0, z0), (y0, z1), (y1, z0), (y1, z1).
+                        std::size_t rows[4] = { readZ[2 * z] * srcSlice + readY[2 * y] * srcLine,
+                            readZ[2 * z + 1] * srcSlice + readY[2 * y] * srcLine,
+                            readZ[2 * z] * srcSlice + readY[2 * y + 1] * srcLine,
+                            readZ[2 * z + 1] * srcSlice + readY[2 * y + 1] * srcLine };
+                        auto dstStart = (static_cast<std::size_t>(dstOffset.z + z) * dstSize.y + dstOffset.y + y) * dstSize.x + dstOffset.x;
+                        auto dstAvg = &dst.avg[dstStart];
+                        auto dstMin = &dst.minimum[dstStart];
+                        auto dstMax = &dst.maximum[dstStart];
+                        unsigned int x = 0;
+#ifdef VOLUME_MINMAX_SSE
+                        for (; x + 4 <= numContiguous; x += 4) {
+                            // pairs 0-3 are the reads at x0 of the four rows, pairs 4-7 the reads at x1.
+                            __m128 avgPairs[8], minPairs[8], maxPairs[8];
+                            for (unsigned int row = 0; row < 4; ++row) {
+                                auto read = rows[row] + readX[2 * x];
+                                loadValuePairs(&src.avg[read], avgPairs[row], avgPairs[row + 4]);
+                                loadValuePairs(&src.minimum[read], minPairs[row], minPairs[row + 4]);
+                                loadValuePairs(&src.maximum[read], maxPairs[row], maxPairs[row + 4]);
+                            }
+                            auto avg = _mm_setzero_ps();
+                            auto minimum = _mm_set1_ps(std::numeric_limits<float>::infinity());
+                            auto maximum = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+                            for (unsigned int i = 0; i < 8; ++i) {
+                                avg = _mm_add_ps(avg, avgPairs[i]);
+                                minimum = _mm_min_ps(minPairs[i], minimum);
+                                maximum = _mm_max_ps(maxPairs[i], maximum);
+                            }
+                            _mm_storeu_ps(dstAvg + x, _mm_div_ps(avg, _mm_set1_ps(8.0f)));
+                            _mm_storeu_ps(dstMin + x, minimum);
+                            _mm_storeu_ps(dstMax + x, maximum);
+                        }
+#endif
+                        for (; x < extent.x; ++x) {
+                            std::size_t reads[8] = { rows[0] + readX[2 * x], rows[1] + readX[2 * x], rows[2] + readX[2 * x],
+                                rows[3] + readX[2 * x], rows[0] + readX[2 * x + 1], rows[1] + readX[2 * x + 1],
+                                rows[2] + readX[2 * x + 1], rows[3] + readX[2 * x + 1] };
+                            auto avg = 0.0f;
+                            auto minimum = std::numeric_limits<float>::infinity();
+                            auto maximum = -std::numeric_limits<float>::infinity();
+                            for (auto read : reads) {
+                                avg += src.avg[read];
+                                minimum = glm::min(minimum, src.minimum[read]);
+                                maximum = glm::max(maximum, src.maximum[read]);
+                            }
+                            dstAvg[x] = avg / 8.0f;
+                            dstMin[x] = minimum;
+                            dstMax[x] = maximum;
+                        }
+                    }
+                }
+            });
+        }
+
+        /**
+         * Creates the min/max image of raw volume data (as the former genMinMaxTexture*.cp) from the first channel of
+         * the volume.
+         * The values are converted to float in batches first so the conversion is vectorized.
+         * @param rawData the raw volume data.
+         * @param numChannels the number of channels of the volume.
+         * @param size the image size.
+         * @param data the image data (output).
+         * @param numThreads the maximum number of threads to use.
+         */
+        template<class Raw, class Texel>
+        void createMinMaxImage(const std::vector<uint8_t>& rawData, unsigned int numChannels, const glm::uvec3& size,
+            uint8_t* data, unsigned int numThreads)
+        {
+            auto raw = reinterpret_cast<const Raw*>(rawData.data());
+            auto texels = reinterpret_cast<typename Texel::Component*>(data);
+            auto zero = Texel::FromFloat(0.0f);
+            std::size_t sliceSize = static_cast<std::size_t>(size.x) * size.y;
+            forSlices(size.z, sliceSize, numThreads, [&](unsigned int zBegin, unsigned int zEnd) {
+                float values[texelsPerBatch];
+                for (auto batch = zBegin * sliceSize; batch < zEnd * sliceSize; batch += texelsPerBatch) {
+                    auto batchSize = glm::min(texelsPerBatch, zEnd * sliceSize - batch);
+                    auto batchRaw = raw + batch * numChannels;
+                    if (numChannels == 1) for (std::size_t i = 0; i < batchSize; ++i) values[i] = rawToFloat(batchRaw[i]);
+                    else for (std::size_t i = 0; i < batchSize; ++i) values[i] = rawToFloat(batchRaw[i * numChannels]);
+
+                    auto batchTexels = texels + 4 * batch;
+                    for (std::size_t i = 0; i < batchSize; ++i) {
+                        auto value = Texel::FromFloat(values[i]);
+                        batchTexels[4 * i] = value;
+                        batchTexels[4 * i + 1] = value;
+                        batchTexels[4 * i + 2] = value;
+                        batchTexels[4 * i + 3] = zero;
+                    }
+                }
+            });
+        }
+
+        /** Combines the level 0 images of child bricks (as the former combineChildTextures*.cp). */
+        template<class Texel>
+        void combineChildImages(const std::vector<MinMaxChildBrick>& childBricks, const glm::uvec3& size, uint8_t* data,
+            unsigned int numThreads)
+        {
+            MinMaxChannels combined(static_cast<std::size_t>(size.x) * size.y * size.z);
+            for (const auto& child : childBricks) {
+                // the shader is dispatched over the child size in groups of 8 and writes at the child size times the shift.
+                auto dstOffset = child.texSize * child.shift;
+                if (dstOffset.x >= size.x || dstOffset.y >= size.y || dstOffset.z >= size.z) continue;
+                auto numInvocations = ((child.texSize + glm::uvec3(7)) / 8u) * 8u;
+                auto extent = glm::min(numInvocations, size - dstOffset);
+
+                MinMaxChannels childChannels(static_cast<std::size_t>(child.texSize.x) * child.texSize.y * child.texSize.z);
+                decodeImage<Texel>(child.data, child.texSize, childChannels, numThreads);
+                reduceImage(childChannels, child.texSize, child.shift, glm::vec3(child.texSize) / glm::vec3(size), combined,
+                    size, dstOffset, extent, numThreads);
+            }
+            encodeImage<Texel>(combined, size, data, numThreads);
+        }
+
+        /** Generates the mip map levels from level 0 (as the former genMinMaxMipMaps*.cp). */
+        template<class Texel>
+        void generateMinMaxLevels(const glm::uvec3& size, uint8_t* data, unsigned int numThreads)
+        {
+            auto srcSize = size;
+            MinMaxChannels src(static_cast<std::size_t>(srcSize.x) * srcSize.y * srcSize.z);
+            decodeImage<Texel>(data, srcSize, src, numThreads);
+            auto numLevels = VolumeMinMaxBuilder::CalculateNumMipLevels(size);
+            for (unsigned int level = 1; level < numLevels; ++level) {
+                data += static_cast<std::size_t>(srcSize.x) * srcSize.y * srcSize.z * 4 * sizeof(typename Texel::Component);
+                auto dstSize = VolumeMinMaxBuilder::CalculateMipSize(size, level);
+                MinMaxChannels dst(static_cast<std::size_t>(dstSize.x) * dstSize.y * dstSize.z);
+                reduceImage(src, srcSize, glm::uvec3(0), glm::vec3(srcSize) / glm::vec3(dstSize), dst, dstSize,
+                    glm::uvec3(0), dstSize, numThreads);
+                encodeImage<Texel>(dst, dstSize, data, numThreads);
+                src = std::move(dst);
+                srcSize = dstSize;
+            }
+        }
+    }
+
+    /**
+     * Constructor.
+     * Bricks of 8 bit volumes are stored in RGBA8 (RGBA8_SNORM if signed), of 16 bit volumes in RGBA16F and of 32 bit
+     * volumes in RGBA32F. For volumes with multiple channels the min/max data describe the first channel.
+     * @param volumeDesc the texture descriptor of the volume.
+     * @param numThreads the maximum number of threads to use.
+     */
+    VolumeMinMaxBuilder::VolumeMinMaxBuilder(const TextureDescriptor& volumeDesc, unsigned int numThreads) :
+        volumeType(volumeDesc.type),
+        volumeChannels(1),
+        brickDesc(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE),
+        numThreads(numThreads)
+    {
+        if (volumeType == GL_UNSIGNED_BYTE) brickDesc = TextureDescriptor(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE);
+        else if (volumeType == GL_BYTE) brickDesc = TextureDescriptor(4, GL_RGBA8_SNORM, GL_RGBA, GL_BYTE);
+        else if (volumeType == GL_UNSIGNED_SHORT || volumeType == GL_SHORT || volumeType == GL_HALF_FLOAT)
+            brickDesc = TextureDescriptor(8, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT);
+        else if (volumeType == GL_UNSIGNED_INT || volumeType == GL_FLOAT)
+            brickDesc = TextureDescriptor(16, GL_RGBA32F, GL_RGBA, GL_FLOAT);
+        else throw std::runtime_error("Pixel-type not supported.");
+
+        if (volumeDesc.format == GL_RG) volumeChannels = 2;
+        else if (volumeDesc.format == GL_RGB) volumeChannels = 3;
+        else if (volumeDesc.format == GL_RGBA) volumeChannels = 4;
+    }
+
+    /**
+     * Creates a builder for the same volume with a different number of threads (for work running in parallel).
+     * @param rhs the builder to copy.
+     * @param numThreads the number of threads to use.
+     */
+    VolumeMinMaxBuilder::VolumeMinMaxBuilder(const VolumeMinMaxBuilder& rhs, unsigned int numThreads) :
+        volumeType(rhs.volumeType),
+        volumeChannels(rhs.volumeChannels),
+        brickDesc(rhs.brickDesc),
+        numThreads(numThreads)
+    {
+    }
+
+    /**
+     * Creates the min/max data (level 0) of a leaf brick.
+     * @param rawData the raw volume data of the brick.
+     * @param texSize the size of the brick.
+     * @param brick the bricks min/max data (output).
+     */
+    void VolumeMinMaxBuilder::CreateMinMaxBrick(const std::vector<uint8_t>& rawData, const glm::uvec3& texSize,
+        std::vector<uint8_t>& brick) const
+    {
+        brick.resize(static_cast<std::size_t>(texSize.x) * texSize.y * texSize.z * brickDesc.bytesPP);
+        auto data = brick.data();
+        if (volumeType == GL_UNSIGNED_BYTE) createMinMaxImage<uint8_t, Unorm8Texel>(rawData, volumeChannels, texSize, data, numThreads);
+        else if (volumeType == GL_BYTE) createMinMaxImage<int8_t, Snorm8Texel>(rawData, volumeChannels, texSize, data, numThreads);
+        else if (volumeType == GL_UNSIGNED_SHORT) createMinMaxImage<uint16_t, HalfTexel>(rawData, volumeChannels, texSize, data, numThreads);
+        else if (volumeType == GL_SHORT) createMinMaxImage<int16_t, HalfTexel>(rawData, volumeChannels, texSize, data, numThreads);
+        else if (volumeType == GL_HALF_FLOAT) createMinMaxImage<HalfValue, HalfTexel>(rawData, volumeChannels, texSize, data, numThreads);
+        else if (volumeType == GL_UNSIGNED_INT) createMinMaxImage<uint32_t, FloatTexel>(rawData, volumeChannels, texSize, data, numThreads);
+        else createMinMaxImage<float, FloatTexel>(rawData, volumeChannels, texSize, data, numThreads);
+    }
+
+    /**
+     * Combines the min/max data of child bricks to the min/max data (level 0) of their parent.
+     * @param childBricks the child bricks with data in the order they are combined.
+     * @param texSize the size of the parents brick.
+     * @param brick the parents min/max data (output).
+     */
+    void VolumeMinMaxBuilder::CombineChildBricks(const std::vector<MinMaxChildBrick>& childBricks, const glm::uvec3& texSize,
+        std::vector<uint8_t>& brick) const
+    {
+        brick.resize(static_cast<std::size_t>(texSize.x) * texSize.y * texSize.z * brickDesc.bytesPP);
+        if (brickDesc.type == GL_UNSIGNED_BYTE) combineChildImages<Unorm8Texel>(childBricks, texSize, brick.data(), numThreads);
+        else if (brickDesc.type == GL_BYTE) combineChildImages<Snorm8Texel>(childBricks, texSize, brick.data(), numThreads);
+        else if (brickDesc.type == GL_HALF_FLOAT) combineChildImages<HalfTexel>(childBricks, texSize, brick.data(), numThreads);
+        else combineChildImages<FloatTexel>(childBricks, texSize, brick.data(), numThreads);
+    }
+
+    /**
+     * Appends the min/max mip map levels to the min/max data (level 0) of a brick.
+     * @param texSize the size of the brick.
+     * @param brick the bricks min/max data, the mip map levels are stored after level 0.
+     */
+    void VolumeMinMaxBuilder::GenerateMinMaxMaps(const glm::uvec3& texSize, std::vector<uint8_t>& brick) const
+    {
+        std::size_t pyramidSize = 0;
+        auto numLevels = CalculateNumMipLevels(texSize);
+        for (unsigned int level = 0; level < numLevels; ++level) {
+            auto levelSize = CalculateMipSize(texSize, level);
+            pyramidSize += static_cast<std::size_t>(levelSize.x) * levelSize.y * levelSize.z * brickDesc.bytesPP;
+        }
+        brick.resize(pyramidSize);
+        if (brickDesc.type == GL_UNSIGNED_BYTE) generateMinMaxLevels<Unorm8Texel>(texSize, brick.data(), numThreads);
+        else if (brickDesc.type == GL_BYTE) generateMinMaxLevels<Snorm8Texel>(texSize, brick.data(), numThreads);
+        else if (brickDesc.type == GL_HALF_FLOAT) generateMinMaxLevels<HalfTexel>(texSize, brick.data(), numThreads);
+        else generateMinMaxLevels<FloatTexel>(texSize, brick.data(), numThreads);
+    }
+
+    /**
+     * Reads a single channel (r: avg, g: min, b: max) of min/max texels as float values.
+     * @param brickDesc the texture descriptor of the min/max bricks.
+     * @param data the texel data.
+     * @param numTexels the number of texels.
+     * @param channel the channel to read.
+     * @param values the values of the channel (output).
+     */
+    void VolumeMinMaxBuilder::DecodeChannel(const TextureDescriptor& brickDesc, const uint8_t* data, std::size_t numTexels,
+        unsigned int channel, float* values)
+    {
+        if (brickDesc.type == GL_UNSIGNED_BYTE) decodeChannel<Unorm8Texel>(data, numTexels, channel, values);
+        else if (brickDesc.type == GL_BYTE) decodeChannel<Snorm8Texel>(data, numTexels, channel, values);
+        else if (brickDesc.type == GL_HALF_FLOAT) decodeChannel<HalfTexel>(data, numTexels, channel, values);
+        else decodeChannel<FloatTexel>(data, numTexels, channel, values);
+    }
+
+    /**
+     * Returns the number of mip map levels down to a single texel.
+     * @param texSize the size of level 0.
+     */
+    unsigned int VolumeMinMaxBuilder::CalculateNumMipLevels(const glm::uvec3& texSize)
+    {
+        unsigned int numLevels = 1;
+        while (CalculateMipSize(texSize, numLevels - 1) != glm::uvec3(1)) ++numLevels;
+        return numLevels;
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file   VolumeMinMaxBuilder.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.27
+ *
+ * @brief  Defines the CPU builder for the min/max pyramids of volume bricks.
+ */
+
+#ifndef VOLUMEMINMAXBUILDER_H
+#define VOLUMEMINMAXBUILDER_H
+
+#include "main.h"
+#include "gfx/glrenderer/GLTexture.h"
+
+namespace cgu {
+
+    /** Describes a child brick combined into its parents brick. */
+    struct MinMaxChildBrick
+    {
+        /** Holds the childs min/max data (level 0 first). */
+        const uint8_t* data;
+        /** Holds the childs texture size. */
+        glm::uvec3 texSize;
+        /** Holds the childs position in its parent (0 or 1 per axis). */
+        glm::uvec3 shift;
+    };
+
+    /**
+     * @brief  Builds min/max pyramids of volume bricks on the CPU.
+     * Each texel holds the average, minimum and maximum of the volume values it covers (r: avg, g: min, b: max).
+     * The values are computed per texel exactly as the former genMinMaxTexture*, combineChildTextures* and
+     * genMinMaxMipMaps* compute shaders did and are stored in the same format as their images (RGBA8, RGBA16F or
+     * RGBA32F), so the results can be cached and uploaded without any work on the GPU. The work is split in slices
+     * over threads.
+     * Signed, half and float volumes (which the shaders do not support) are handled the same way, signed 8 bit volumes
+     * are stored in RGBA8_SNORM. Multi-channel volumes use their first channel like the renderer does.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.27
+     */
+    class VolumeMinMaxBuilder
+    {
+    public:
+        VolumeMinMaxBuilder(const TextureDescriptor& volumeDesc, unsigned int numThreads);
+        VolumeMinMaxBuilder(const VolumeMinMaxBuilder& rhs, unsigned int numThreads);
+
+        /** Returns the texture descriptor of the min/max bricks. */
+        const TextureDescriptor& GetBrickTextureDescriptor() const { return brickDesc; }
+        /** Returns the number of threads the builder uses. */
+        unsigned int GetNumThreads() const { return numThreads; }
+        void CreateMinMaxBrick(const std::vector<uint8_t>& rawData, const glm::uvec3& texSize, std::vector<uint8_t>& brick) const;
+        void CombineChildBricks(const std::vector<MinMaxChildBrick>& childBricks, const glm::uvec3& texSize,
+            std::vector<uint8_t>& brick) const;
+        void GenerateMinMaxMaps(const glm::uvec3& texSize, std::vector<uint8_t>& brick) const;
+
+        static void DecodeChannel(const TextureDescriptor& brickDesc, const uint8_t* data, std::size_t numTexels,
+            unsigned int channel, float* values);
+        static unsigned int CalculateNumMipLevels(const glm::uvec3& texSize);
+        /** Returns the size of a mip map level. */
+        static glm::uvec3 CalculateMipSize(const glm::uvec3& texSize, unsigned int level) { return glm::max(glm::uvec3(1), texSize >> level); }
+
+    private:
+        /** Holds the type of the volume data. */
+        GLenum volumeType;
+        /** Holds the number of channels of the volume data. */
+        unsigned int volumeChannels;
+        /** Holds the texture descriptor of the min/max bricks. */
+        TextureDescriptor brickDesc;
+        /** Holds the number of threads to use. */
+        unsigned int numThreads;
+    };
+}
+
+#endif // VOLUMEMINMAXBUILDER_H
@@ -0,0 +1,183 @@
+/**
+ * @file   VolumeRawSlabReader.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.28
+ *
+ * @brief  Implementation of the reader for raw volume files that maps only a slab of the file at a time.
+ */
+
+#include "VolumeRawSlabReader.h"
+#include "core/binary_helper.h"
+#include <codecvt>
+#include <cstring>
+#include <boost/filesystem.hpp>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VOLUME_RAW_SSE2
+#endif
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    namespace bip = boost::interprocess;
+
+    /**
+     * Constructor, opens the raw file (nothing is mapped yet).
+     * @param rawFileName the name of the raw file.
+     * @param slabBudget the maximum size of the mapped slab in bytes.
+     */
+    VolumeRawSlabReader::VolumeRawSlabReader(const std::string& rawFileName, std::size_t slabBudget) :
+        rawFileName(rawFileName),
+        slabOffset(0),
+        fileSize(0),
+        lastWriteTime(0),
+        slabBudget(std::max(slabBudget, static_cast<std::size_t>(1 << 20)) & ~static_cast<std::size_t>(7)),
+        numSlabReaders(0)
+    {
+        try {
+            fileSize = static_cast<std::size_t>(boost::filesystem::file_size(rawFileName));
+            lastWriteTime = static_cast<std::int64_t>(boost::filesystem::last_write_time(rawFileName));
+            if (fileSize == 0) return;
+            bip::file_mapping file(rawFileName.c_str(), bip::read_only);
+            rawFile.swap(file);
+        } catch (const std::exception&) {
+            std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+            LOG(ERROR) << "Could not open file '" << converter.from_bytes(rawFileName) << "'.";
+            throw std::runtime_error("Could not open file '" + rawFileName + "'.");
+        }
+    }
+
+    /**
+     * Calculates the hash of the whole raw file slab by slab (equal to binary_help::hashBytes over the file).
+     * @return the hash value.
+     */
+    std::uint64_t VolumeRawSlabReader::CalculateHash()
+    {
+        binary_help::ByteHasher hasher(fileSize);
+        for (std::size_t offset = 0; offset < fileSize; offset += slabBudget) {
+            auto end = std::min(offset + slabBudget, fileSize);
+            hasher.Update(reinterpret_cast<const char*>(AcquireSlab(offset, end) + (offset - slabOffset)), end - offset);
+            ReleaseSlab();
+        }
+        return hasher.Finish();
+    }
+
+    /**
+     * Copies a sub volume out of the raw file, can be called from multiple threads.
+     * Scanlines are copied with strides directly from the mapped slab, parts beyond the end of the file stay zero.
+     * The slab is used until a slice is not contained in it anymore.
+     * @param data the data to fill.
+     * @param volumeSize the size of the whole volume.
+     * @param bytesPerVoxel the size of a voxel in bytes.
+     * @param pos the position of the sub volume.
+     * @param dataSize the size of the sub volume.
+     * @param texSize the size of the data (at least the size of the sub volume).
+     * @param ushortScale the factor the values are multiplied with if they are 16 bit values (1 to copy unchanged).
+     */
+    void VolumeRawSlabReader::ReadSubVolume(std::vector<uint8_t>& data, const glm::uvec3& volumeSize,
+        unsigned int bytesPerVoxel, const glm::uvec3& pos, const glm::uvec3& dataSize, const glm::uvec3& texSize,
+        std::uint16_t ushortScale)
+    {
+        data.assign(static_cast<std::size_t>(texSize.x) * texSize.y * texSize.z * bytesPerVoxel, 0);
+        if (dataSize.x == 0 || dataSize.y == 0) return;
+
+        std::size_t lineSize = static_cast<std::size_t>(volumeSize.x) * bytesPerVoxel;
+        std::size_t sliceSize = lineSize * volumeSize.y;
+        std::size_t copySize = static_cast<std::size_t>(dataSize.x) * bytesPerVoxel;
+        std::size_t texLineSize = static_cast<std::size_t>(texSize.x) * bytesPerVoxel;
+
+        const uint8_t* slabData = nullptr;
+        for (unsigned int z = 0; z < dataSize.z; ++z) {
+            auto sliceStart = (pos.z + z) * sliceSize + pos.y * lineSize + pos.x * bytesPerVoxel;
+            if (sliceStart >= fileSize) break;
+            auto sliceEnd = std::min(sliceStart + (dataSize.y - 1) * lineSize + copySize, fileSize);
+            // the slab is not replaced while it is acquired, it can be checked without locking.
+            if (!slabData || !SlabContains(sliceStart, sliceEnd)) {
+                if (slabData) ReleaseSlab();
+                slabData = AcquireSlab(sliceStart, sliceEnd);
+            }
+
+            auto dataPtr = data.data() + static_cast<std::size_t>(z) * texSize.y * texLineSize;
+            for (unsigned int y = 0; y < dataSize.y; ++y) {
+                auto lineStart = sliceStart + y * lineSize;
+                if (lineStart >= fileSize) break;
+                auto lineData = slabData + (lineStart - slabOffset);
+                auto lineCopySize = std::min(copySize, fileSize - lineStart);
+                if (ushortScale == 1) std::memcpy(dataPtr, lineData, lineCopySize);
+                else CopyScaledUShorts(lineData, dataPtr, lineCopySize / sizeof(std::uint16_t), ushortScale);
+                dataPtr += texLineSize;
+            }
+        }
+        if (slabData) ReleaseSlab();
+    }
+
+    /**
+     * Copies 16 bit values and multiplies them with a scale factor (modulo 2^16 like the scalar multiplication).
+     * Sixteen values (two SSE2 registers) are scaled per iteration where SSE2 is available, the rest with a scalar loop.
+     * The values do not need to be aligned.
+     * @param src the values to copy.
+     * @param dst the memory to copy the scaled values to (can be equal to src).
+     * @param count the number of values.
+     * @param scale the scale factor.
+     */
+    void VolumeRawSlabReader::CopyScaledUShorts(const uint8_t* src, uint8_t* dst, std::size_t count, std::uint16_t scale)
+    {
+        std::size_t i = 0;
+#ifdef VOLUME_RAW_SSE2
+        auto scaleVec = _mm_set1_epi16(static_cast<short>(scale));
+        for (; i + 16 <= count; i += 16) {
+            auto v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+            auto v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_mullo_epi16(v0, scaleVec));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 16), _mm_mullo_epi16(v1, scaleVec));
+        }
+#endif
+        for (; i < count; ++i) {
+            std::uint16_t value;
+            std::memcpy(&value, src + 2 * i, sizeof(value));
+            value = static_cast<std::uint16_t>(value * scale);
+            std::memcpy(dst + 2 * i, &value, sizeof(value));
+        }
+    }
+
+    /**
+     * Makes sure a range of the file is mapped and registers the calling thread as reader of the slab.
+     * If the current slab does not contain the range, a new slab replaces it as soon as no other thread reads from it.
+     * @param begin the start of the range.
+     * @param end the end of the range.
+     * @return the address of the mapped slab (corresponding to slabOffset in the file).
+     */
+    const uint8_t* VolumeRawSlabReader::AcquireSlab(std::size_t begin, std::size_t end)
+    {
+        std::unique_lock<std::mutex> lock(slabMutex);
+        slabReleased.wait(lock, [this, begin, end]() { return numSlabReaders == 0 || SlabContains(begin, end); });
+        if (!SlabContains(begin, end)) {
+            auto slabEnd = std::min(begin + std::max(slabBudget, end - begin), fileSize);
+            try {
+                // release the old slab first so at most one slab is mapped.
+                bip::mapped_region().swap(slab);
+                bip::mapped_region region(rawFile, bip::read_only, begin, slabEnd - begin);
+                slab.swap(region);
+                slabOffset = begin;
+            } catch (const std::exception&) {
+                std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+                LOG(ERROR) << "Could not map file '" << converter.from_bytes(rawFileName) << "'.";
+                throw std::runtime_error("Could not map file '" + rawFileName + "'.");
+            }
+        }
+        ++numSlabReaders;
+        return static_cast<const uint8_t*>(slab.get_address());
+    }
+
+    /**
+     * Unregisters the calling thread as reader of the slab (after AcquireSlab).
+     */
+    void VolumeRawSlabReader::ReleaseSlab()
+    {
+        std::lock_guard<std::mutex> lock(slabMutex);
+        if (--numSlabReaders == 0) slabReleased.notify_all();
+    }
+}
@@ -0,0 +1,75 @@
+/**
+ * @file   VolumeRawSlabReader.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.28
+ *
+ * @brief  Defines the reader for raw volume files that maps only a slab of the file at a time.
+ */
+
+#ifndef VOLUMERAWSLABREADER_H
+#define VOLUMERAWSLABREADER_H
+
+#include "main.h"
+#include <condition_variable>
+#include <mutex>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace cgu {
+
+    /**
+     * @brief  Reads sub volumes out of a raw volume file through a sliding memory mapped window (slab).
+     * Only one slab of at most the memory budget (or a single sub volume if that is larger) is mapped at a time, so
+     * volumes larger than the system memory can be bricked. As the octree is built depth first, sub volumes are
+     * requested in an order that keeps consecutive reads mostly within the same slab. Sub volumes can be read from
+     * multiple threads: only looking up the slab is serialized, readers copy from it concurrently and a new slab is
+     * mapped once no reader uses the current one.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.28
+     */
+    class VolumeRawSlabReader
+    {
+    public:
+        VolumeRawSlabReader(const std::string& rawFileName, std::size_t slabBudget);
+
+        /** Returns the size of the raw file. */
+        std::size_t GetFileSize() const { return fileSize; }
+        /** Returns the last write time of the raw file. */
+        std::int64_t GetLastWriteTime() const { return lastWriteTime; }
+        std::uint64_t CalculateHash();
+        void ReadSubVolume(std::vector<uint8_t>& data, const glm::uvec3& volumeSize, unsigned int bytesPerVoxel,
+            const glm::uvec3& pos, const glm::uvec3& dataSize, const glm::uvec3& texSize, std::uint16_t ushortScale);
+
+        static void CopyScaledUShorts(const uint8_t* src, uint8_t* dst, std::size_t count, std::uint16_t scale);
+
+    private:
+        const uint8_t* AcquireSlab(std::size_t begin, std::size_t end);
+        void ReleaseSlab();
+        /** Returns whether the mapped slab contains a range of the file. */
+        bool SlabContains(std::size_t begin, std::size_t end) const { return slab.get_size() != 0 && begin >= slabOffset && end <= slabOffset + slab.get_size(); }
+
+        /** Holds the name of the raw file. */
+        std::string rawFileName;
+        /** Holds the file mapping of the raw file. */
+        boost::interprocess::file_mapping rawFile;
+        /** Holds the currently mapped slab. */
+        boost::interprocess::mapped_region slab;
+        /** Holds the offset of the mapped slab in the file. */
+        std::size_t slabOffset;
+        /** Holds the size of the raw file. */
+        std::size_t fileSize;
+        /** Holds the last write time of the raw file. */
+        std::int64_t lastWriteTime;
+        /** Holds the maximum size of a slab (if the data requested at once fits). */
+        std::size_t slabBudget;
+        /** Holds the number of threads copying from the mapped slab. */
+        unsigned int numSlabReaders;
+        /** Holds the mutex for looking up the slab from multiple threads. */
+        std::mutex slabMutex;
+        /** Holds the condition signaled when the last reader released the slab. */
+        std::condition_variable slabReleased;
+    };
+}
+
+#endif // VOLUMERAWSLABREADER_H
@@ -0,0 +1,377 @@
+/**
+ * @file   VolumeRayCaster.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.30
+ *
+ * @brief  Implementation of the CPU reference ray caster for bricked volumes.
+ */
+
+#include "VolumeRayCaster.h"
+#include "VolumeBrickCache.h"
+#include "VolumeMinMaxBuilder.h"
+#include "core/parallel_helper.h"
+#include "volumeScene/TransferFunction.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <limits>
+
+#undef min
+#undef max
+
+namespace cgu {
+
+    /**
+     * Constructor, reads the values of the bricks from the brick cache.
+     * The transfer function is a ramp (white with opacity equal to the value) until one is set.
+     * Of the min/max levels only those are kept that halve the previous level exactly, coarser levels do not cover
+     * all texels of the brick. Bricks without volume (the octree creates flat ones at the border) are left out as
+     * nothing is rasterized for them.
+     * @param brickCache the (complete) brick cache holding the data of the bricks.
+     * @param volumeBricks the bricks to ray cast (e.g. the bricks of a tree level of a VolumeBrickLayout).
+     * @param numThreads the maximum number of threads to use.
+     */
+    VolumeRayCaster::VolumeRayCaster(const VolumeBrickCache& brickCache, const std::vector<RayCastBrick>& volumeBricks,
+        unsigned int numThreads) :
+        preIntegrationResolution(0),
+        preIntegrationStepSize(1.0f / 512.0f),
+        maxSkipLevel(DEFAULT_MAX_SKIP_LEVEL),
+        numThreads(glm::max(1u, numThreads))
+    {
+        std::vector<const RayCastBrick*> solidBricks;
+        for (const auto& volumeBrick : volumeBricks) {
+            if (glm::determinant(glm::mat3(volumeBrick.localWorld)) != 0.0f) solidBricks.push_back(&volumeBrick);
+        }
+
+        bricks.resize(solidBricks.size());
+        std::atomic<std::size_t> nextBrick(0);
+        parallel_help::parallelFor(std::min(static_cast<std::size_t>(this->numThreads), bricks.size()), [&](std::size_t) {
+            std::vector<uint8_t> data, decodeBuffer;
+            for (auto i = nextBrick++; i < solidBricks.size(); i = nextBrick++) {
+                const auto& volumeBrick = *solidBricks[i];
+                auto& brick = bricks[i];
+                brick.texSize = volumeBrick.texSize;
+                brick.minTexValue = volumeBrick.minTexValue;
+                brick.texExtent = volumeBrick.maxTexValue - volumeBrick.minTexValue;
+                brick.worldToLocal = glm::inverse(volumeBrick.localWorld);
+
+                data.resize(brickCache.GetBrickDataSize(volumeBrick.brickId));
+                brickCache.ReadBrick(volumeBrick.brickId, data.data(), decodeBuffer);
+                brick.values.resize(static_cast<std::size_t>(brick.texSize.x) * brick.texSize.y * brick.texSize.z);
+                VolumeMinMaxBuilder::DecodeChannel(volumeBrick.desc, data.data(), brick.values.size(), 0, brick.values.data());
+
+                auto levelOffset = brick.values.size() * volumeBrick.desc.bytesPP;
+                auto numLevels = VolumeMinMaxBuilder::CalculateNumMipLevels(brick.texSize);
+                std::vector<float> minValues, maxValues;
+                for (unsigned int level = 1; level < numLevels; ++level) {
+                    auto prevSize = VolumeMinMaxBuilder::CalculateMipSize(brick.texSize, level - 1);
+                    if ((prevSize.x % 2 != 0 && prevSize.x != 1) || (prevSize.y % 2 != 0 && prevSize.y != 1)
+                        || (prevSize.z % 2 != 0 && prevSize.z != 1)) break;
+                    auto levelSize = VolumeMinMaxBuilder::CalculateMipSize(brick.texSize, level);
+                    auto numTexels = static_cast<std::size_t>(levelSize.x) * levelSize.y * levelSize.z;
+                    minValues.resize(numTexels);
+                    maxValues.resize(numTexels);
+                    VolumeMinMaxBuilder::DecodeChannel(volumeBrick.desc, data.data() + levelOffset, numTexels, 1, minValues.data());
+                    VolumeMinMaxBuilder::DecodeChannel(volumeBrick.desc, data.data() + levelOffset, numTexels, 2, maxValues.data());
+                    brick.minMaxLevels.emplace_back(numTexels);
+                    for (std::size_t j = 0; j < numTexels; ++j) brick.minMaxLevels.back()[j] = glm::vec2(minValues[j], maxValues[j]);
+                    levelOffset += numTexels * volumeBrick.desc.bytesPP;
+                }
+            }
+        });
+
+        tf::TransferFunction ramp;
+        ramp.InsertControlPoint(tf::ControlPoint{ 0.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) });
+        ramp.InsertControlPoint(tf::ControlPoint{ 1.0f, glm::vec4(1.0f) });
+        SetTransferFunction(ramp, 256);
+    }
+
+    /**
+     * Sets the transfer function from the same data as the transferFunc and transferFuncEmpty textures.
+     * The values are rounded to 8 bit as they are by the RGBA8 transfer function texture. For empty space skipping
+     * each texel stores the index of the next texel with opacity (see tf::TransferFunction::CreateEmptySpaceData).
+     * @param transferFunc the transfer function.
+     * @param resolution the number of texels.
+     */
+    void VolumeRayCaster::SetTransferFunction(const tf::TransferFunction& transferFunc, unsigned int resolution)
+    {
+        assert(resolution > 1);
+        transferFunction.resize(resolution);
+        transferFunc.CreateTextureData(transferFunction.data(), static_cast<int>(resolution));
+        for (auto& texel : transferFunction) {
+            texel = glm::floor(glm::clamp(texel, glm::vec4(0.0f), glm::vec4(1.0f)) * 255.0f + 0.5f) / 255.0f;
+        }
+        std::vector<float> emptySpaceData(resolution);
+        transferFunc.CreateEmptySpaceData(emptySpaceData.data(), static_cast<int>(resolution));
+        emptySpaceTable.assign(emptySpaceData.begin(), emptySpaceData.end());
+    }
+
+    /**
+     * Sets the pre-integration table used instead of the transfer function.
+     * The table is created for steps of one size (with a step length of 100 times the step size, as the opacity of the
+     * transfer function is scaled), the opacity is corrected for the step size rendered with.
+     * @param data the table (as created by tf::TransferFunction::CreatePreIntegratedData, nullptr to not use one).
+     * @param resolution the number of texels per side.
+     * @param stepSize the step size the table is created for (the preIntStepSize uniform of renderVolume.fp).
+     */
+    void VolumeRayCaster::SetPreIntegrationTable(const glm::vec4* data, unsigned int resolution, float stepSize)
+    {
+        assert(data == nullptr || stepSize > 0.0f);
+        if (data == nullptr) resolution = 0;
+        preIntegrationTable.assign(data, data + static_cast<std::size_t>(resolution) * resolution);
+        preIntegrationResolution = resolution;
+        preIntegrationStepSize = stepSize;
+    }
+
+    /**
+     * Ray casts an image of the volume.
+     * Rays start at the near plane through the pixel centers, the first row is the bottom row (as in OpenGL).
+     * @param view the view matrix.
+     * @param projection the projection matrix.
+     * @param imageSize the size of the image.
+     * @param lod the level of detail of the step size (the lod uniform of renderVolume.fp).
+     * @param image the image, accumulated color and opacity per pixel (output).
+     * @return the counters of the pass.
+     */
+    RayCastStats VolumeRayCaster::Render(const glm::mat4& view, const glm::mat4& projection, const glm::uvec2& imageSize,
+        float lod, std::vector<glm::vec4>& image) const
+    {
+        auto startTime = std::chrono::steady_clock::now();
+        image.assign(static_cast<std::size_t>(imageSize.x) * imageSize.y, glm::vec4(0.0f));
+        auto invViewProj = glm::inverse(projection * view);
+        auto stepSize = glm::pow(2.0f, lod) / 512.0f;
+
+        auto numTasks = std::min(numThreads, imageSize.y);
+        std::vector<RayCastStats> taskStats(numTasks);
+        std::atomic<unsigned int> nextRow(0);
+        parallel_help::parallelFor(numTasks, [&](std::size_t task) {
+            RayCastStats stats;
+            std::vector<BrickHit> hits;
+            for (auto y = nextRow++; y < imageSize.y; y = nextRow++) {
+                for (unsigned int x = 0; x < imageSize.x; ++x) {
+                    auto ndc = (glm::vec2(x, y) + 0.5f) / glm::vec2(imageSize) * 2.0f - 1.0f;
+                    auto nearPos = invViewProj * glm::vec4(ndc, -1.0f, 1.0f);
+                    auto farPos = invViewProj * glm::vec4(ndc, 1.0f, 1.0f);
+                    auto origin = glm::vec3(nearPos) / nearPos.w;
+                    auto direction = glm::vec3(farPos) / farPos.w - origin;
+                    image[static_cast<std::size_t>(y) * imageSize.x + x] = CastRay(origin, direction, stepSize, hits, stats);
+                }
+            }
+            taskStats[task] = stats;
+        });
+
+        RayCastStats result;
+        result.numRays = static_cast<std::uint64_t>(imageSize.x) * imageSize.y;
+        for (const auto& stats : taskStats) {
+            result.numSamples += stats.numSamples;
+            result.numSegments += stats.numSegments;
+            result.numSkips += stats.numSkips;
+            result.numSkippedSamples += stats.numSkippedSamples;
+        }
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+        return result;
+    }
+
+    /**
+     * Integrates a ray through all bricks it hits front to back.
+     * @param origin the origin of the ray (world space).
+     * @param direction the direction of the ray (world space), the ray ends at origin + direction.
+     * @param stepSize the step size in the texture space of the bricks.
+     * @param hits memory for the bricks hit.
+     * @param stats the counters to add the samples to.
+     * @return the accumulated color and opacity.
+     */
+    glm::vec4 VolumeRayCaster::CastRay(const glm::vec3& origin, const glm::vec3& direction, float stepSize,
+        std::vector<BrickHit>& hits, RayCastStats& stats) const
+    {
+        hits.clear();
+        for (unsigned int i = 0; i < bricks.size(); ++i) {
+            auto localOrigin = glm::vec3(bricks[i].worldToLocal * glm::vec4(origin, 1.0f));
+            auto localDirection = glm::vec3(bricks[i].worldToLocal * glm::vec4(direction, 0.0f));
+            auto tEnter = 0.0f, tExit = 1.0f;
+            for (int axis = 0; axis < 3 && tEnter < tExit; ++axis) {
+                if (localDirection[axis] == 0.0f) {
+                    if (localOrigin[axis] < 0.0f || localOrigin[axis] > 1.0f) tExit = tEnter;
+                    continue;
+                }
+                auto t0 = -localOrigin[axis] / localDirection[axis];
+                auto t1 = (1.0f - localOrigin[axis]) / localDirection[axis];
+                tEnter = std::max(tEnter, std::min(t0, t1));
+                tExit = std::min(tExit, std::max(t0, t1));
+            }
+            if (tEnter < tExit) hits.push_back(BrickHit{ tEnter, tExit, i });
+        }
+        std::sort(hits.begin(), hits.end(), [](const BrickHit& a, const BrickHit& b) { return a.tEnter < b.tEnter; });
+
+        glm::vec3 color(0.0f);
+        auto alpha = 0.0f;
+        auto overShoot = 0.0f;
+        std::uint64_t numSamples = 0, numSkips = 0, numSkippedSamples = 0;
+        for (const auto& hit : hits) {
+            if (alpha >= 1.0f) break;
+            const auto& brick = bricks[hit.brick];
+            auto localOrigin = glm::vec3(brick.worldToLocal * glm::vec4(origin, 1.0f));
+            auto localDirection = glm::vec3(brick.worldToLocal * glm::vec4(direction, 0.0f));
+            auto rayStart = brick.minTexValue + glm::clamp(localOrigin + localDirection * hit.tEnter, 0.0f, 1.0f) * brick.texExtent;
+            auto rayEnd = brick.minTexValue + glm::clamp(localOrigin + localDirection * hit.tExit, 0.0f, 1.0f) * brick.texExtent;
+
+            auto rayDir = rayEnd - rayStart;
+            auto t1 = glm::min(glm::length(rayDir), glm::length(glm::vec3(1.0f)));
+            if (t1 > 0.0f) rayDir /= t1;
+
+            auto skipLevels = glm::min(maxSkipLevel, static_cast<unsigned int>(brick.minMaxLevels.size()));
+            auto volSize = glm::vec3(brick.texSize);
+            auto halfTexel = 0.5f / volSize;
+            auto level = skipLevels;
+            // the last level 1 cell that was not empty.
+            glm::ivec3 occupiedCell(-1);
+            // the previous value for pre-integration (none at the start and after skipping).
+            auto prevValue = 0.0f;
+            auto hasPrevValue = false;
+
+            auto t = overShoot;
+            while (t < t1 && alpha < 1.0f) {
+                auto pos = rayStart + rayDir * t;
+
+                // hierarchical DDA over the min/max levels: skip empty cells and go up a level, else go down.
+                auto texel = glm::clamp(glm::ivec3(pos * volSize), glm::ivec3(0), glm::ivec3(brick.texSize) - 1);
+                if (level == 0 && skipLevels > 0 && glm::ivec3(glm::uvec3(texel) >> 1u) != occupiedCell) level = 1;
+                if (level > 0) {
+                    auto levelSize = VolumeMinMaxBuilder::CalculateMipSize(brick.texSize, level);
+                    auto cell = glm::min(glm::uvec3(texel) >> level, levelSize - 1u);
+                    auto cellMin = glm::vec3(cell << level) / volSize;
+                    auto cellMax = glm::vec3(glm::min((cell + 1u) << level, brick.texSize)) / volSize;
+                    auto cellIndex = (static_cast<std::size_t>(cell.z) * levelSize.y + cell.y) * levelSize.x + cell.x;
+                    if (IsTransparent(brick.minMaxLevels[level - 1][cellIndex])) {
+                        // samples within half a texel of the cell border are filtered with texels of the neighboring cells.
+                        auto boxMin = cellMin + halfTexel;
+                        auto boxMax = cellMax - halfTexel;
+                        auto inside = true;
+                        auto tSkip = std::numeric_limits<float>::max();
+                        for (int axis = 0; axis < 3; ++axis) {
+                            inside = inside && pos[axis] >= boxMin[axis] && pos[axis] <= boxMax[axis];
+                            auto dist = rayDir[axis] > 0.0f ? boxMax[axis] - pos[axis] : pos[axis] - boxMin[axis];
+                            tSkip = glm::min(tSkip, dist / glm::max(std::abs(rayDir[axis]), 1e-20f));
+                        }
+                        if (inside && tSkip > 0.0f) {
+                            // cells reach into the overlap, skipping ends with the segment to keep the over shoot.
+                            auto numStepsSkipped = std::ceil(glm::min(tSkip, t1 - t) / stepSize);
+                            numSkippedSamples += static_cast<std::uint64_t>(numStepsSkipped);
+                            ++numSkips;
+                            t += numStepsSkipped * stepSize;
+                            level = glm::min(level + 1, skipLevels);
+                            hasPrevValue = false;
+                            continue;
+                        }
+                        // in the border of an empty cell the sample is taken without going down a level.
+                    } else {
+                        if (level == 1) occupiedCell = glm::ivec3(cell);
+                        --level;
+                        continue;
+                    }
+                }
+
+                auto value = SampleBrick(brick, pos);
+                if (preIntegrationResolution > 0) {
+                    auto sample = SamplePreIntegrationTable(hasPrevValue ? prevValue : value, value);
+                    auto stepAlpha = 1.0f - glm::pow(glm::max(1.0f - sample.a, 0.0f), stepSize / preIntegrationStepSize);
+                    prevValue = value;
+                    hasPrevValue = true;
+                    if (sample.a > 0.0f) color += (1.0f - alpha) * glm::vec3(sample) * (stepAlpha / sample.a);
+                    alpha += (1.0f - alpha) * stepAlpha;
+                } else {
+                    auto sample = SampleTransferFunction(value);
+                    sample.a *= stepSize * 100.0f;
+                    color += (1.0f - alpha) * sample.a * glm::vec3(sample);
+                    alpha += (1.0f - alpha) * sample.a;
+                }
+                ++numSamples;
+                t += stepSize;
+            }
+            overShoot = t - t1;
+            ++stats.numSegments;
+        }
+        stats.numSamples += numSamples;
+        stats.numSkips += numSkips;
+        stats.numSkippedSamples += numSkippedSamples;
+        return glm::vec4(color, alpha);
+    }
+
+    /**
+     * Samples the values of a brick with linear filtering and clamping to the edge.
+     * @param brick the brick.
+     * @param pos the position in texture space.
+     * @return the value.
+     */
+    float VolumeRayCaster::SampleBrick(const Brick& brick, const glm::vec3& pos) const
+    {
+        auto coords = pos * glm::vec3(brick.texSize) - 0.5f;
+        auto base = glm::floor(coords);
+        auto f = coords - base;
+        auto maxIndex = glm::ivec3(brick.texSize) - 1;
+        auto i0 = glm::clamp(glm::ivec3(base), glm::ivec3(0), maxIndex);
+        auto i1 = glm::clamp(glm::ivec3(base) + 1, glm::ivec3(0), maxIndex);
+
+        std::size_t lineSize = brick.texSize.x;
+        std::size_t sliceSize = lineSize * brick.texSize.y;
+        auto row00 = brick.values.data() + i0.z * sliceSize + i0.y * lineSize;
+        auto row10 = brick.values.data() + i0.z * sliceSize + i1.y * lineSize;
+        auto row01 = brick.values.data() + i1.z * sliceSize + i0.y * lineSize;
+        auto row11 = brick.values.data() + i1.z * sliceSize + i1.y * lineSize;
+        auto v00 = glm::mix(row00[i0.x], row00[i1.x], f.x);
+        auto v10 = glm::mix(row10[i0.x], row10[i1.x], f.x);
+        auto v01 = glm::mix(row01[i0.x], row01[i1.x], f.x);
+        auto v11 = glm::mix(row11[i0.x], row11[i1.x], f.x);
+        return glm::mix(glm::mix(v00, v10, f.y), glm::mix(v01, v11, f.y), f.z);
+    }
+
+    /**
+     * Returns whether the transfer function is transparent for all values in a range.
+     * The range of texels checked includes one more texel on each side for the filtering and rounding of sampled values.
+     * @param minMax the minimum and maximum of the range.
+     */
+    bool VolumeRayCaster::IsTransparent(const glm::vec2& minMax) const
+    {
+        auto resolution = static_cast<int>(transferFunction.size());
+        auto texelRange = glm::clamp(minMax * static_cast<float>(resolution) - 0.5f, -2.0f, static_cast<float>(resolution + 1));
+        auto lo = glm::clamp(static_cast<int>(std::floor(texelRange.x)) - 1, 0, resolution - 1);
+        auto hi = glm::clamp(static_cast<int>(std::floor(texelRange.y)) + 2, 0, resolution - 1);
+        return emptySpaceTable[lo] > static_cast<unsigned int>(hi);
+    }
+
+    /**
+     * Samples the transfer function texture with linear filtering and clamping to the edge.
+     * @param value the volume value.
+     * @return the color and opacity.
+     */
+    glm::vec4 VolumeRayCaster::SampleTransferFunction(float value) const
+    {
+        auto resolution = static_cast<float>(transferFunction.size());
+        auto coord = glm::clamp(value * resolution - 0.5f, -1.0f, resolution);
+        auto base = std::floor(coord);
+        auto maxIndex = static_cast<int>(transferFunction.size()) - 1;
+        auto i0 = glm::clamp(static_cast<int>(base), 0, maxIndex);
+        auto i1 = glm::clamp(static_cast<int>(base) + 1, 0, maxIndex);
+        return glm::mix(transferFunction[i0], transferFunction[i1], coord - base);
+    }
+
+    /**
+     * Samples the pre-integration table with bilinear filtering and clamping to the edge.
+     * @param front the volume value at the front of the step.
+     * @param back the volume value at the back of the step.
+     * @return the opacity weighted color and opacity.
+     */
+    glm::vec4 VolumeRayCaster::SamplePreIntegrationTable(float front, float back) const
+    {
+        auto resolution = static_cast<float>(preIntegrationResolution);
+        auto coords = glm::clamp(glm::vec2(front, back) * resolution - 0.5f, -1.0f, resolution);
+        auto base = glm::floor(coords);
+        auto f = coords - base;
+        auto maxIndex = static_cast<int>(preIntegrationResolution) - 1;
+        auto x0 = glm::clamp(static_cast<int>(base.x), 0, maxIndex), x1 = glm::clamp(static_cast<int>(base.x) + 1, 0, maxIndex);
+        auto y0 = glm::clamp(static_cast<int>(base.y), 0, maxIndex), y1 = glm::clamp(static_cast<int>(base.y) + 1, 0, maxIndex);
+        const auto* row0 = &preIntegrationTable[static_cast<std::size_t>(y0) * preIntegrationResolution];
+        const auto* row1 = &preIntegrationTable[static_cast<std::size_t>(y1) * preIntegrationResolution];
+        return glm::mix(glm::mix(row0[x0], row0[x1], f.x), glm::mix(row1[x0], row1[x1], f.x), f.y);
+    }
+}
@@ -0,0 +1,156 @@
+/**
+ * @file   VolumeRayCaster.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.09.30
+ *
+ * @brief  Defines the CPU reference ray caster for bricked volumes.
+ */
+
+#ifndef VOLUMERAYCASTER_H
+#define VOLUMERAYCASTER_H
+
+#include "main.h"
+#include "gfx/glrenderer/GLTexture.h"
+
+namespace cgu {
+
+    class VolumeBrickCache;
+
+    namespace tf {
+        class TransferFunction;
+    }
+
+    /** Describes a brick of a VolumeBrickLayout or VolumeBrickOctree for ray casting on the CPU. */
+    struct RayCastBrick
+    {
+        /** Holds the id of the brick in the brick cache. */
+        unsigned int brickId;
+        /** Holds the texture size of the brick. */
+        glm::uvec3 texSize;
+        /** Holds the minimum value in texture space (excluding overlap). */
+        glm::vec3 minTexValue;
+        /** Holds the maximum value in texture space (excluding overlap). */
+        glm::vec3 maxTexValue;
+        /** Holds the matrix mapping the unit cube to the brick (excluding overlap) in world space. */
+        glm::mat4 localWorld;
+        /** Holds the texture descriptor of the brick. */
+        TextureDescriptor desc;
+    };
+
+    /** Counters of a ray casting pass. */
+    struct RayCastStats
+    {
+        RayCastStats() : numRays(0), numSamples(0), numSegments(0), numSkips(0), numSkippedSamples(0), seconds(0.0) {};
+
+        /** Returns the number of rays per second. */
+        double GetRaysPerSecond() const { return seconds > 0.0 ? static_cast<double>(numRays) / seconds : 0.0; }
+        /** Returns the number of samples per second. */
+        double GetSamplesPerSecond() const { return seconds > 0.0 ? static_cast<double>(numSamples) / seconds : 0.0; }
+
+        /** Holds the number of rays cast. */
+        std::uint64_t numRays;
+        /** Holds the number of volume samples taken. */
+        std::uint64_t numSamples;
+        /** Holds the number of ray segments through bricks. */
+        std::uint64_t numSegments;
+        /** Holds the number of empty cells skipped. */
+        std::uint64_t numSkips;
+        /** Holds the number of samples skipped in empty cells. */
+        std::uint64_t numSkippedSamples;
+        /** Holds the time the pass took in seconds. */
+        double seconds;
+    };
+
+    /**
+     * @brief  Ray casts the bricks of a bricked volume on the CPU without OpenGL.
+     * The bricks of one tree level (see VolumeBrickLayout::GetBricksAtLevel) are read from the brick cache, so no
+     * OpenGL context is needed to create the bricks or to ray cast them. Every ray is integrated through the bricks it
+     * hits front to back with the rules of renderVolume.fp: steps of 2^lod / 512 in the texture space of each brick,
+     * linear sampling of the value (r) channel with clamp to edge, a linear transfer function lookup, opacity scaled
+     * by 100 times the step size, front to back compositing until the opacity reaches 1 and the overshoot of the last
+     * step carried to the next brick. Entry and exit points map the unit cube of a brick to the texture space without
+     * overlap. The result is meant as a reference image and to measure the ray casting throughput.
+     * Empty space is skipped like renderVolume.fp does (by default over all min/max levels): a hierarchical DDA over
+     * the min/max levels of the bricks skips cells for which the empty space table of the transfer function (see
+     * tf::TransferFunction::CreateEmptySpaceData) is transparent over their [min, max] range, in whole steps so the
+     * remaining samples stay at their positions. With a pre-integration table the opacity weighted color and the
+     * opacity of each step are looked up for the values of the previous and the current sample instead and corrected
+     * from the step size of the table to the one rendered with (as with the preIntegrated uniform). Rows of the image are distributed dynamically over the threads.
+     *
+     * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+     * @date   2015.09.30
+     */
+    class VolumeRayCaster
+    {
+    public:
+        /** Holds the default coarsest min/max level used for empty space skipping (all levels of the bricks). */
+        static const unsigned int DEFAULT_MAX_SKIP_LEVEL = 16;
+
+        VolumeRayCaster(const VolumeBrickCache& brickCache, const std::vector<RayCastBrick>& volumeBricks,
+            unsigned int numThreads);
+
+        void SetTransferFunction(const tf::TransferFunction& transferFunc, unsigned int resolution);
+        void SetPreIntegrationTable(const glm::vec4* data, unsigned int resolution, float stepSize);
+        /** Sets the coarsest min/max level used for empty space skipping (0 disables it). */
+        void SetMaxSkipLevel(unsigned int level) { maxSkipLevel = level; }
+        RayCastStats Render(const glm::mat4& view, const glm::mat4& projection, const glm::uvec2& imageSize, float lod,
+            std::vector<glm::vec4>& image) const;
+        /** Returns the number of bricks ray cast. */
+        std::size_t GetNumberOfBricks() const { return bricks.size(); }
+
+    private:
+        /** A brick with its values. */
+        struct Brick
+        {
+            /** Holds the texture size of the brick. */
+            glm::uvec3 texSize;
+            /** Holds the minimum value in texture space (excluding overlap). */
+            glm::vec3 minTexValue;
+            /** Holds the extent of the brick in texture space (excluding overlap). */
+            glm::vec3 texExtent;
+            /** Holds the matrix mapping world space to the unit cube of the brick. */
+            glm::mat4 worldToLocal;
+            /** Holds the values (level 0). */
+            std::vector<float> values;
+            /** Holds the min/max values of the levels that halve the previous level exactly (level 1 first). */
+            std::vector<std::vector<glm::vec2>> minMaxLevels;
+        };
+
+        /** A brick hit by a ray. */
+        struct BrickHit
+        {
+            /** Holds the ray parameter the ray enters the brick. */
+            float tEnter;
+            /** Holds the ray parameter the ray exits the brick. */
+            float tExit;
+            /** Holds the index of the brick. */
+            unsigned int brick;
+        };
+
+        glm::vec4 CastRay(const glm::vec3& origin, const glm::vec3& direction, float stepSize,
+            std::vector<BrickHit>& hits, RayCastStats& stats) const;
+        float SampleBrick(const Brick& brick, const glm::vec3& pos) const;
+        glm::vec4 SampleTransferFunction(float value) const;
+        glm::vec4 SamplePreIntegrationTable(float front, float back) const;
+        bool IsTransparent(const glm::vec2& minMax) const;
+
+        /** Holds the bricks. */
+        std::vector<Brick> bricks;
+        /** Holds the transfer function texture (RGBA8 values). */
+        std::vector<glm::vec4> transferFunction;
+        /** Holds the index of the next transfer function texel with opacity for each texel. */
+        std::vector<unsigned int> emptySpaceTable;
+        /** Holds the pre-integration table (empty if not used). */
+        std::vector<glm::vec4> preIntegrationTable;
+        /** Holds the resolution of the pre-integration table. */
+        unsigned int preIntegrationResolution;
+        /** Holds the step size the pre-integration table is created for. */
+        float preIntegrationStepSize;
+        /** Holds the coarsest min/max level used for empty space skipping. */
+        unsigned int maxSkipLevel;
+        /** Holds the number of threads to use. */
+        unsigned int numThreads;
+    };
+}
+
+#endif // VOLUMERAYCASTER_H
@@ -2,11 +2,20 @@
 
 uniform sampler3D volume;
 uniform sampler1D transferFunc;
+// index of the next texel with opacity for each texel of transferFunc (TransferFunction::CreateEmptySpaceData).
+uniform sampler1D transferFuncEmpty;
+// opacity weighted color and opacity of a step of preIntStepSize between a front (x) and a back (y) value.
+uniform sampler2D transferFuncPreInt;
+uniform float preIntStepSize = 1.0f / 512.0f;
 // uniform sampler2D back;
 layout(rgba32f) uniform image2D back;
 layout(rgba32f) uniform image2D colorAcc;
 layout(r32f) uniform image2D overShootAdj;
 uniform float lod = 0.0f;
+// coarsest min/max level used for empty space skipping (0 disables it, by default all levels are used).
+uniform int maxSkipLevel = 16;
+// integrate the transfer function between samples with transferFuncPreInt.
+uniform bool preIntegrated = false;
 
 in vec4 gl_FragCoord;
 // layout(origin_upper_left) in vec4 gl_FragCoord;
@@ -17,6 +26,17 @@ in vec3 vVolPosition;
 
 layout(location = 0) out vec4 outputColor;
 
+// Returns whether the transfer function is transparent for all values in [minMax.x, minMax.y].
+bool isTransparent(vec2 minMax)
+{
+    int tfRes = textureSize(transferFunc, 0);
+    // one more texel on each side for the filtering and rounding of sampled values.
+    vec2 texelRange = clamp(minMax * float(tfRes) - 0.5f, -2.0f, float(tfRes + 1));
+    int lo = clamp(int(floor(texelRange.x)) - 1, 0, tfRes - 1);
+    int hi = clamp(int(floor(texelRange.y)) + 2, 0, tfRes - 1);
+    return texelFetch(transferFuncEmpty, lo, 0).x > float(hi);
+}
+
 void main()
 {
     ivec2 imgCoords = ivec2(gl_FragCoord.xy);
@@ -48,26 +68,83 @@ void main()
     // vec3 C = vec3(0.0f);
     // float A = 0.0f;
 
+    // Empty space skipping: min/max levels are only used while each level halves the previous one exactly.
+    ivec3 volSize = textureSize(volume, 0);
+    int skipLevels = 0;
+    ivec3 levelSize = volSize;
+    while (skipLevels < min(maxSkipLevel, textureQueryLevels(volume) - 1)
+        && all(equal((levelSize & 1) * (levelSize - 1), ivec3(0)))) {
+        levelSize = max(levelSize >> 1, ivec3(1));
+        ++skipLevels;
+    }
+    vec3 halfTexel = 0.5f / vec3(volSize);
+    int level = skipLevels;
+    // the last level 1 cell that was not empty.
+    ivec3 occupiedCell = ivec3(-1);
+
+    // the previous sample for pre-integration (none at the start and after skipping).
+    float sPrev = 0.0f;
+    bool hasPrevSample = false;
+
     float t = overShoot;
     unsigned int numSteps = 0;
     while (t < t1 && A < 1.0) {
         // World Space Position
         vec3 p = rayStart + rayDir * t;
 
+        // Hierarchical DDA over the min/max levels: skip empty cells and go up a level, else go down.
+        ivec3 texel = clamp(ivec3(p * vec3(volSize)), ivec3(0), volSize - 1);
+        if (level == 0 && skipLevels > 0 && any(notEqual(texel >> 1, occupiedCell))) level = 1;
+        if (level > 0) {
+            ivec3 cell = min(texel >> level, textureSize(volume, level) - 1);
+            vec3 cellMin = vec3(cell << level) / vec3(volSize);
+            vec3 cellMax = vec3(min((cell + 1) << level, volSize)) / vec3(volSize);
+            if (isTransparent(texelFetch(volume, cell, level).yz)) {
+                // samples within half a texel of the cell border are filtered with texels of the neighboring cells.
+                vec3 boxMin = cellMin + halfTexel;
+                vec3 boxMax = cellMax - halfTexel;
+                vec3 dist = mix(p - boxMin, boxMax - p, greaterThan(rayDir, vec3(0.0f))) / max(abs(rayDir), vec3(1e-20f));
+                float tSkip = min(dist.x, min(dist.y, dist.z));
+                if (all(greaterThanEqual(p, boxMin)) && all(lessThanEqual(p, boxMax)) && tSkip > 0.0f) {
+                    // cells reach into the overlap, skipping ends with the segment to keep the over shoot.
+                    t += ceil(min(tSkip, t1 - t) / stepSize) * stepSize;
+                    level = min(level + 1, skipLevels);
+                    hasPrevSample = false;
+                    continue;
+                }
+                // in the border of an empty cell the sample is taken without going down a level.
+            } else {
+                if (level == 1) occupiedCell = cell;
+                --level;
+                continue;
+            }
+        }
+
         // Intensity value of volume data
         // float s = textureLod(volume, p, lod).r;
-        float s = texture(volume, p).r;
+        float s = textureLod(volume, p, 0.0f).r;
 
         /*vec4 color;
         if (s > 0.2f) color = vec4(s, s, s, 1.0f);
         else color = vec4(0.0f);*/
 
-        // Transfer function lookup
-        vec4 color = texture(transferFunc, s);
-        color.a *= stepSize * 100;
-
-        C += (1 - A) * color.a * color.rgb;
-        A += (1 - A) * color.a;
+        if (preIntegrated) {
+            // Pre-integrated transfer function lookup (already opacity weighted), corrected for the step size
+            vec4 color = texture(transferFuncPreInt, vec2(hasPrevSample ? sPrev : s, s));
+            float alpha = 1 - pow(max(1 - color.a, 0.0f), stepSize / preIntStepSize);
+            sPrev = s;
+            hasPrevSample = true;
+
+            C += (1 - A) * (color.a > 0.0f ? color.rgb * (alpha / color.a) : vec3(0.0f));
+            A += (1 - A) * alpha;
+        } else {
+            // Transfer function lookup
+            vec4 color = texture(transferFunc, s);
+            color.a *= stepSize * 100;
+
+            C += (1 - A) * color.a * color.rgb;
+            A += (1 - A) * color.a;
+        }
 
         t += stepSize;
         ++numSteps;
@@ -8,6 +8,8 @@
 
 #include "TransferFunction.h"
 #include <algorithm>
+#include <cassert>
+#include <cmath>
 
 namespace cgu {
     namespace tf {
@@ -19,29 +21,56 @@ namespace cgu {
             }
         } PointLess; // Note the pun! Hilarious!
 
+        // Creates a transfer function without control points and its opacity summary
+        TransferFunction::TransferFunction(int summaryResolution) :
+            summaryResolution_(summaryResolution),
+            opaqueCells_(summaryResolution + 1, 0),
+            rangeLevel_(summaryResolution + 1, 0)
+        {
+            assert(summaryResolution > 0);
+
+            for (auto len = 1; len <= summaryResolution_; len *= 2)
+                maxOpacity_.emplace_back(summaryResolution_ - len + 1, 0.0f);
+            for (auto n = 2; n <= summaryResolution_; ++n)
+                rangeLevel_[n] = rangeLevel_[n / 2] + 1;
+
+            UpdateOpacitySummary(0.0f, 1.0f);
+        }
+
         // Inserts a new Control Point
         void TransferFunction::InsertControlPoint(const ControlPoint& p)
         {
             points_.push_back(p);
             std::sort(points_.begin(), points_.end(), PointLess);
+
+            auto range = AffectedRange(p.val);
+            UpdateOpacitySummary(range.x, range.y);
         }
 
         // Removes an existing Control Point at index i
         void TransferFunction::RemoveControlPoint(int i)
         {
             assert(i < points_.size());
+            auto val = points_[i].val;
             points_.erase(points_.begin() + i);
+
+            auto range = AffectedRange(val);
+            UpdateOpacitySummary(range.x, range.y);
         }
 
         // Sets the position for a point with a particular index
         // Returns the new index for the point after sorting
         int TransferFunction::SetPosition(int i, const glm::vec2& pos)
         {
+            auto oldRange = AffectedRange(points_[i].val);
             points_[i].SetPos(pos);
             auto p = points_[i];
 
             std::sort(points_.begin(), points_.end(), PointLess);
 
+            auto newRange = AffectedRange(p.val);
+            UpdateOpacitySummary(std::min(oldRange.x, newRange.x), std::max(oldRange.y, newRange.y));
+
             for (auto u = 0; u < static_cast<int>(points_.size()); ++u)
                 if (points_[u] == p)
                     return u;
@@ -52,6 +81,9 @@ namespace cgu {
         void TransferFunction::SetColor(int i, const glm::vec4& color)
         {
             points_[i].rgba = color;
+
+            auto range = AffectedRange(points_[i].val);
+            UpdateOpacitySummary(range.x, range.y);
         }
 
         // Returns the interpolated value for the transfer function
@@ -72,9 +104,7 @@ namespace cgu {
                 return points_.back().rgba;
 
             // Find the corresponding index
-            size_t i = 0;
-            while (val > points_[i].val)
-                ++i;
+            auto i = FindSegment(val);
 
             // Prev and Next points
             const auto p = points_[i - 1];
@@ -87,16 +117,212 @@ namespace cgu {
             return glm::mix(p.rgba, n.rgba, t);
         }
 
+        // Returns the interpolated values for an array of values
+        // The results are the same as of RGBA(float). Values in the same or the next interval between control points
+        // as the previous one (like ascending texture coordinates) do not need a search.
+        void TransferFunction::RGBA(const float* vals, glm::vec4* rgba, std::size_t count) const
+        {
+            assert(count == 0 || (vals && rgba));
+
+            if (points_.size() == 0) {
+                for (std::size_t j = 0; j < count; ++j) rgba[j] = RGBA(vals[j]);
+                return;
+            }
+
+            const auto& front = points_.front();
+            const auto& back = points_.back();
+            std::size_t i = 1;
+            for (std::size_t j = 0; j < count; ++j) {
+                auto val = glm::clamp(vals[j], 0.f, 1.f);
+                if (val <= front.val) {
+                    rgba[j] = front.rgba;
+                    continue;
+                }
+                if (val >= back.val) {
+                    rgba[j] = back.rgba;
+                    continue;
+                }
+
+                // points_[i - 1].val < val <= points_[i].val
+                if (val <= points_[i - 1].val || val > points_[i].val) {
+                    if (val > points_[i].val && val <= points_[i + 1].val) ++i;
+                    else i = FindSegment(val);
+                }
+
+                const auto& p = points_[i - 1];
+                const auto& n = points_[i];
+                auto t = (val - p.val) / (n.val - p.val);
+                rgba[j] = glm::mix(p.rgba, n.rgba, t);
+            }
+        }
+
         // Generates interpolated texture data with a specified resolution
         void TransferFunction::CreateTextureData(glm::vec4* data, int resolution) const
         {
             assert(resolution > 0);
             assert(data);
 
-            for (auto i = 0; i < resolution; ++i) {
-                auto x = static_cast<float>(i) / static_cast<float>(resolution - 1);
-                data[i] = RGBA(x);
+            std::vector<float> x(resolution);
+            for (auto i = 0; i < resolution; ++i) x[i] = static_cast<float>(i) / static_cast<float>(resolution - 1);
+            RGBA(x.data(), data, resolution);
+        }
+
+        // Generates the empty space table for the texture data with a specified resolution
+        // Each texel holds the index of the next texel (itself included) with an opacity above 0 or the resolution if
+        // there is none, so a range of texels [lo, hi] is transparent if data[lo] > hi. A texel has opacity if the
+        // opacity summary has some between its neighbors (the values filtered with it), so the texels [lo, hi] are
+        // transparent exactly if IsTransparent is for the values of texels lo - 1 to hi + 1.
+        void TransferFunction::CreateEmptySpaceData(float* data, int resolution) const
+        {
+            assert(resolution > 1);
+            assert(data);
+
+            auto texelValue = [resolution](int i) { return static_cast<float>(i) / static_cast<float>(resolution - 1); };
+            auto nextOpaque = static_cast<float>(resolution);
+            auto nextSegmentOpaque = false;
+            for (auto i = resolution - 1; i >= 0; --i) {
+                auto segmentOpaque = !IsTransparent(texelValue(std::max(i - 1, 0)), texelValue(i));
+                if (segmentOpaque || nextSegmentOpaque) nextOpaque = static_cast<float>(i);
+                data[i] = nextOpaque;
+                nextSegmentOpaque = segmentOpaque;
             }
         }
+
+        // Generates the pre-integration table for steps of a length with a specified resolution
+        // Texel (f, b) at data[b * resolution + f] holds the opacity weighted color (rgb) and the opacity (a) of a step
+        // of stepLength between texel f (front) and texel b (back) of the linearly interpolated texture data. The opacity
+        // of the transfer function is the extinction over a step of length 1, so with T the integral of the opacity the
+        // step has the opacity 1 - exp(-stepLength / (b - f) * (T(b) - T(f))). Its color is the opacity weighted average
+        // color (K(b) - K(f)) / (T(b) - T(f)), K the integral of the opacity weighted color, times this opacity. The
+        // integrals are prefix sums over the segments between neighboring texels, so generating the table takes
+        // O(resolution^2). For steps of another length d the opacity becomes 1 - (1 - a)^(d / stepLength) and the color
+        // is scaled with it.
+        void TransferFunction::CreatePreIntegratedData(glm::vec4* data, int resolution, float stepLength) const
+        {
+            assert(resolution > 1);
+            assert(data);
+            assert(stepLength > 0.0f);
+
+            std::vector<glm::vec4> texData(resolution);
+            CreateTextureData(texData.data(), resolution);
+
+            // the product of the linearly interpolated opacity and color is integrated exactly.
+            std::vector<glm::dvec4> integral(resolution);
+            for (auto i = 1; i < resolution; ++i) {
+                glm::dvec4 p(texData[i - 1]), n(texData[i]);
+                glm::dvec4 segment(glm::dvec3(p.a * p + n.a * n) / 3.0 + glm::dvec3(p.a * n + n.a * p) / 6.0,
+                    0.5 * (p.a + n.a));
+                integral[i] = integral[i - 1] + segment;
+            }
+
+            for (auto b = 0; b < resolution; ++b) {
+                for (auto f = 0; f < resolution; ++f) {
+                    glm::dvec4 average(glm::dvec3(texData[f]) * static_cast<double>(texData[f].a), texData[f].a);
+                    if (f != b) average = (integral[b] - integral[f]) / static_cast<double>(b - f);
+                    auto alpha = 1.0 - std::exp(-static_cast<double>(stepLength) * average.a);
+                    auto color = average.a > 0.0 ? glm::dvec3(average) * (alpha / average.a) : glm::dvec3(0.0);
+                    data[static_cast<std::size_t>(b) * resolution + f] = glm::vec4(glm::dvec4(color, alpha));
+                }
+            }
+        }
+
+        // Generates the pre-integration table on a worker thread
+        // The worker uses a copy of the transfer function, so it may be changed while the table is generated.
+        std::future<std::vector<glm::vec4>> TransferFunction::CreatePreIntegratedDataAsync(int resolution,
+            float stepLength) const
+        {
+            auto tf = *this;
+            return std::async(std::launch::async, [tf, resolution, stepLength]() {
+                std::vector<glm::vec4> data(static_cast<std::size_t>(resolution) * resolution);
+                tf.CreatePreIntegratedData(data.data(), resolution, stepLength);
+                return data;
+            });
+        }
+
+        // Returns whether the transfer function is transparent for all values in [a, b]
+        bool TransferFunction::IsTransparent(float a, float b) const
+        {
+            assert(a <= b);
+            return opaqueCells_[CellIndex(b) + 1] == opaqueCells_[CellIndex(a)];
+        }
+
+        // Returns the maximum opacity for values in [a, b]
+        // The maximum is taken over the summary cells overlapping the range, so it is exact up to the cell size
+        float TransferFunction::MaxOpacity(float a, float b) const
+        {
+            assert(a <= b);
+            auto first = CellIndex(a);
+            auto last = CellIndex(b);
+            auto level = rangeLevel_[last - first + 1];
+            return std::max(maxOpacity_[level][first], maxOpacity_[level][last - (1 << level) + 1]);
+        }
+
+        // Updates the opacity summary for the values in [lo, hi]
+        // The maximum of a cell is taken from the opacity at its borders and of the control points inside, this
+        // is exact for the linear interpolation between control points.
+        void TransferFunction::UpdateOpacitySummary(float lo, float hi)
+        {
+            // one more cell on each side for values on cell borders.
+            auto first = std::max(CellIndex(lo) - 1, 0);
+            auto last = std::min(CellIndex(hi) + 1, summaryResolution_ - 1);
+            auto res = static_cast<float>(summaryResolution_);
+
+            std::vector<float> borders(last - first + 2);
+            std::vector<glm::vec4> borderRGBA(borders.size());
+            for (auto j = first; j <= last + 1; ++j) borders[j - first] = static_cast<float>(j) / res;
+            RGBA(borders.data(), borderRGBA.data(), borders.size());
+
+            auto& cells = maxOpacity_[0];
+            for (auto j = first; j <= last; ++j)
+                cells[j] = std::max(borderRGBA[j - first].a, borderRGBA[j - first + 1].a);
+            for (const auto& p : points_) {
+                if (p.val < 0.0f || p.val > 1.0f) continue;
+                auto j = CellIndex(p.val);
+                if (j >= first && j <= last) cells[j] = std::max(cells[j], p.rgba.a);
+            }
+
+            for (auto j = first; j < summaryResolution_; ++j)
+                opaqueCells_[j + 1] = opaqueCells_[j] + (cells[j] > 0.0f ? 1 : 0);
+
+            for (auto k = 1; k < static_cast<int>(maxOpacity_.size()); ++k) {
+                auto half = 1 << (k - 1);
+                auto& level = maxOpacity_[k];
+                const auto& prevLevel = maxOpacity_[k - 1];
+                auto end = std::min(last, static_cast<int>(level.size()) - 1);
+                for (auto j = std::max(first - 2 * half + 1, 0); j <= end; ++j)
+                    level[j] = std::max(prevLevel[j], prevLevel[j + half]);
+            }
+        }
+
+        // Returns the index of the first control point with a value not less than val
+        std::size_t TransferFunction::FindSegment(float val) const
+        {
+            // binary search without branches on the comparisons (random values are not predictable).
+            const auto* base = points_.data();
+            auto n = points_.size();
+            while (n > 1) {
+                auto half = n / 2;
+                base = base[half].val < val ? base + half : base;
+                n -= half;
+            }
+            return static_cast<std::size_t>(base - points_.data()) + (base->val < val ? 1 : 0);
+        }
+
+        // Returns the range of values in which the transfer function depends on a control point at val
+        glm::vec2 TransferFunction::AffectedRange(float val) const
+        {
+            glm::vec2 range(0.0f, 1.0f);
+            for (const auto& p : points_) {
+                if (p.val < val) range.x = std::max(range.x, p.val);
+                if (p.val > val) range.y = std::min(range.y, p.val);
+            }
+            return range;
+        }
+
+        // Returns the index of the summary cell containing a value
+        int TransferFunction::CellIndex(float val) const
+        {
+            return glm::clamp(static_cast<int>(val * static_cast<float>(summaryResolution_)), 0, summaryResolution_ - 1);
+        }
     }
 }
\ No newline at end of file
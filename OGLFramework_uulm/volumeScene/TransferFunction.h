@@ -9,6 +9,7 @@
 #ifndef TRANSFERFUNCTION_H
 #define TRANSFERFUNCTION_H
 
+#include <future>
 #include <vector>
 #include <glm/glm.hpp>
 
@@ -42,26 +43,60 @@ namespace cgu {
             }
         };
 
+        // The transfer function keeps a summary of its opacity: the maximum opacity of each of summaryResolution
+        // cells of the value range, a prefix count of the cells with opacity and a table of the maxima of all
+        // power of two cell ranges. It answers range queries in constant time and is updated for the values
+        // affected when control points change.
         class TransferFunction
         {
         public:
+            explicit TransferFunction(int summaryResolution = 512);
+
             void InsertControlPoint(const ControlPoint& p);
             void RemoveControlPoint(int index);
-            void Clear() { points_.clear(); }
+            void Clear() { points_.clear(); UpdateOpacitySummary(0.0f, 1.0f); }
 
             int SetPosition(int point_idx, const glm::vec2& pos);
             void SetColor(int point_idx, const glm::vec4& color);
 
             // Returns the interpolated value for the transfer function
             glm::vec4 RGBA(float val) const;
+            // Returns the interpolated values for an array of values
+            void RGBA(const float* vals, glm::vec4* rgba, std::size_t count) const;
 
             // Generates interpolated texture data with a specified resolution
             void CreateTextureData(glm::vec4* data, int resolution) const;
+            // Generates the empty space table for the texture data with a specified resolution (from the opacity summary)
+            void CreateEmptySpaceData(float* data, int resolution) const;
+            // Generates the pre-integration table for steps of a length with a specified resolution
+            void CreatePreIntegratedData(glm::vec4* data, int resolution, float stepLength) const;
+            // Generates the pre-integration table on a worker thread
+            std::future<std::vector<glm::vec4>> CreatePreIntegratedDataAsync(int resolution, float stepLength) const;
+
+            // Returns whether the transfer function is transparent for all values in [a, b]
+            bool IsTransparent(float a, float b) const;
+            // Returns the maximum opacity for values in [a, b] (of the summary cells overlapping the range)
+            float MaxOpacity(float a, float b) const;
+            // Updates the opacity summary for the values in [lo, hi]
+            void UpdateOpacitySummary(float lo, float hi);
 
+            // Opacity changes through points() need a call to UpdateOpacitySummary
             std::vector<ControlPoint>& points() { return points_; }
             const std::vector<ControlPoint>& points() const { return points_; }
         private:
+            std::size_t FindSegment(float val) const;
+            glm::vec2 AffectedRange(float val) const;
+            int CellIndex(float val) const;
+
             std::vector<ControlPoint> points_;
+            // Number of cells of the opacity summary
+            int summaryResolution_;
+            // Number of cells with opacity before each cell (summaryResolution_ + 1 entries)
+            std::vector<int> opaqueCells_;
+            // Maximum opacity of 2^k cells starting at each cell for each k (k = 0 are the single cells)
+            std::vector<std::vector<float>> maxOpacity_;
+            // Largest k with 2^k <= n for each range length n
+            std::vector<int> rangeLevel_;
         };
     }
 }
@@ -23,13 +23,15 @@ namespace cgu {
         quad(nullptr),
         quadTex(nullptr),
         tfTex(nullptr),
+        preIntOutdated(false),
         selection(-1),
         draggingSelection(false),
         lastButtonAction(0),
         tfProgram(nullptr),
         orthoUBO(new GLUniformBuffer("tfOrthoProjection", sizeof(OrthoProjectionBuffer), app->GetUBOBindingPoints())),
         tfVBO(0),
-        colorPicker()
+        colorPicker(),
+        tf_(TEX_RES)
     {
         screenAlignedProg = app->GetGPUProgramManager()->GetResource("tfRenderGUI.vp|tfRenderGUI.fp");
         screenAlignedTextureUniform = screenAlignedProg->GetUniformLocation("guiTex");
@@ -75,6 +77,8 @@ namespace cgu {
 
         // Create texture and update it
         tfTex.reset(new GLTexture(TEX_RES, TextureDescriptor(32, GL_RGBA8, GL_RGBA, GL_FLOAT)));
+        tfEmptyTex.reset(new GLTexture(TEX_RES, TextureDescriptor(4, GL_R32F, GL_RED, GL_FLOAT)));
+        tfPreIntTex.reset(new GLTexture(PREINT_RES, PREINT_RES, TextureDescriptor(16, GL_RGBA32F, GL_RGBA, GL_FLOAT), nullptr));
         UpdateTexture();
 
         // Create BG texture
@@ -104,6 +108,11 @@ namespace cgu {
 
     void TransferFunctionGUI::Draw()
     {
+        if (preIntData.valid() && preIntData.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            tfPreIntTex->SetData(preIntData.get().data());
+            if (preIntOutdated) UpdatePreIntegration();
+        }
+
         glDisable(GL_DEPTH_TEST);
         glDepthMask(GL_FALSE);
         orthoUBO->BindBuffer();
@@ -280,6 +289,7 @@ namespace cgu {
             attribBind->UpdateVertexAttributes();
         }
         UpdateTexture();
+        UpdatePreIntegration();
     }
 
     void TransferFunctionGUI::UpdateTexture() const
@@ -287,6 +297,22 @@ namespace cgu {
         std::array<glm::vec4, TEX_RES> texData;
         tf_.CreateTextureData(texData.data(), TEX_RES);
         tfTex->SetData(texData.data());
+        std::array<float, TEX_RES> emptySpaceData;
+        tf_.CreateEmptySpaceData(emptySpaceData.data(), TEX_RES);
+        tfEmptyTex->SetData(emptySpaceData.data());
+    }
+
+    // Starts generating the pre-integration table on a worker thread, Draw uploads it when it is ready
+    // Only one table is generated at a time, changes in the meantime start the next one when it is done.
+    void TransferFunctionGUI::UpdatePreIntegration()
+    {
+        if (preIntData.valid()) {
+            preIntOutdated = true;
+            return;
+        }
+        preIntOutdated = false;
+        // the volume renderer scales the opacity of the transfer function with 100 times the step size.
+        preIntData = tf_.CreatePreIntegratedDataAsync(PREINT_RES, GetPreIntegrationStepSize() * 100.0f);
     }
 
     // Gets an index to a control point if found within radii of mouse_pos
@@ -34,6 +34,10 @@ namespace cgu {
         void SetSelectionColor(const glm::vec3* color);
         glm::vec3 GetSelectionColor() const;
         const GLTexture* GetTexture() const { return tfTex.get(); };
+        const GLTexture* GetEmptySpaceTexture() const { return tfEmptyTex.get(); };
+        const GLTexture* GetPreIntegrationTexture() const { return tfPreIntTex.get(); };
+        /** Returns the step size the pre-integration table is created for (the preIntStepSize uniform of renderVolume.fp). */
+        static float GetPreIntegrationStepSize() { return 1.0f / 512.0f; }
 
         static void TW_CALL SetColorCallback(const void *value, void *clientData);
         static void TW_CALL GetColorCallback(void *value, void *clientData);
@@ -43,6 +47,7 @@ namespace cgu {
         static const int CP_GUI_WIDTH = 128;
         static const int CP_GUI_HEIGHT = 128;
         static const int TEX_RES = 512;
+        static const int PREINT_RES = 256;
         const float pickRadius = 10.0f;
 
         bool SelectPoint(const glm::vec2& position, const glm::vec2& pickSize);
@@ -68,6 +73,14 @@ namespace cgu {
         std::unique_ptr<GLTexture> quadTex;
         /** The texture that is the result of the transfer function. */
         std::unique_ptr<GLTexture> tfTex;
+        /** The empty space table of the transfer function texture (next texel with opacity per texel). */
+        std::unique_ptr<GLTexture> tfEmptyTex;
+        /** The pre-integration table of the transfer function. */
+        std::unique_ptr<GLTexture> tfPreIntTex;
+        /** Holds the pre-integration table generated on a worker thread. */
+        std::future<std::vector<glm::vec4>> preIntData;
+        /** Holds whether the transfer function changed while the pre-integration table was generated. */
+        bool preIntOutdated;
         /** holds the GPU program for rendering screen aligned things. */
         GPUProgram* screenAlignedProg;
         /** holds the uniform binding point for textures on screen aligned things. */
@@ -92,6 +105,7 @@ namespace cgu {
         TwBar* colorPicker;
 
         void UpdateTexture() const;
+        void UpdatePreIntegration();
         int GetControlPoint(const glm::vec2& p);
         tf::TransferFunction tf_;
     };
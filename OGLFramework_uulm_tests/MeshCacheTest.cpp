@@ -0,0 +1,324 @@
+/**
+ * @file   MeshCacheTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests writing and reading meshes in binary form, validating the binary data and when the mesh cache
+ *         hashes the source file.
+ */
+
+#include "gfx/Mesh.h"
+#include "gfx/MeshCache.h"
+#include "gfx/ObjParser.h"
+
+#include <functional>
+#include <fstream>
+#include <sstream>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Holds the hash of the test source file. */
+    const std::uint64_t testSourceHash = 0xfedcba9876543210ull;
+
+    /** Stands in for the materials of the tests, only their addresses are used. */
+    const std::array<char, 2> materialTags{ { 0, 1 } };
+
+    /** Gives the tests access to creating the geometry information of meshes and searching triangles. */
+    class CacheTestMesh : public cgu::Mesh
+    {
+    public:
+        using Mesh::CreateGeomertyInfo;
+        using Mesh::FindContainingTriangleAll;
+    };
+
+    /**
+     * Creates a mesh of two objects with materials, points and lines: a grid of quads (split into triangles) in
+     * each object with a texture seam in the middle and two triangles sharing a grid edge (non-manifold).
+     */
+    void createMesh(CacheTestMesh& mesh)
+    {
+        std::string text = "mtllib test.mtl\n";
+        const unsigned int size = 12;
+        for (unsigned int y = 0; y < size; ++y) {
+            for (unsigned int x = 0; x < size; ++x) {
+                text += "v " + std::to_string(x) + " " + std::to_string(y) + " " + std::to_string((x * y) % 5) + "\n";
+            }
+        }
+        text += "vt 0 0\nvt 1 0\nvt 0 1\nvt 1 1\n";
+        for (unsigned int object = 0; object < 2; ++object) {
+            text += "o object" + std::to_string(object) + "\nusemtl m" + std::to_string(object) + "\n";
+            for (unsigned int y = object * (size / 2); y + 1 < (object + 1) * (size / 2); ++y) {
+                for (unsigned int x = 0; x + 1 < size; ++x) {
+                    auto i = y * size + x + 1;
+                    auto t = x < size / 2 ? "/1" : "/2";
+                    text += "f " + std::to_string(i) + t + " " + std::to_string(i + 1) + t + " "
+                        + std::to_string(i + size + 1) + t + " " + std::to_string(i + size) + t + "\n";
+                }
+            }
+            text += "usemtl unknown\nf 1 2 " + std::to_string(size * size) + "\nf 1 2 " + std::to_string(size * size - 1)
+                + "\nl 1 5 9\np 3 4\n";
+        }
+
+        cgu::ObjParser parser([](const std::vector<std::string>&) {}, [](const std::string& name) {
+            return name == "m0" || name == "m1" ? reinterpret_cast<const cgu::Material*>(&materialTags[name[1] - '0'])
+                : nullptr;
+        });
+        parser.Parse(text.data(), text.data() + text.size(), 1, mesh);
+        mesh.CreateGeomertyInfo(1);
+    }
+
+    /** Returns the materials table of the test meshes. */
+    std::vector<const cgu::Material*> getMaterials()
+    {
+        return std::vector<const cgu::Material*>{ reinterpret_cast<const cgu::Material*>(&materialTags[0]),
+            reinterpret_cast<const cgu::Material*>(&materialTags[1]) };
+    }
+
+    /** Expects two sub-meshes to be equal. */
+    void expectSubMeshesEqual(const cgu::SubMesh& expected, const cgu::SubMesh& actual)
+    {
+        EXPECT_EQ(expected.objectName, actual.objectName);
+        EXPECT_EQ(expected.lineHasTexture, actual.lineHasTexture);
+        EXPECT_EQ(expected.faceHasTexture, actual.faceHasTexture);
+        EXPECT_EQ(expected.faceHasNormal, actual.faceHasNormal);
+        EXPECT_TRUE(expected.pointIndices == actual.pointIndices);
+        EXPECT_TRUE(expected.lineIndices == actual.lineIndices);
+        EXPECT_TRUE(expected.faceIndices == actual.faceIndices);
+        EXPECT_EQ(expected.firstTriIndex, actual.firstTriIndex);
+        EXPECT_EQ(expected.numTriangles, actual.numTriangles);
+        EXPECT_EQ(expected.trianglePtsIndices.size(), actual.trianglePtsIndices.size());
+        EXPECT_TRUE(expected.aabb.minmax[0] == actual.aabb.minmax[0] && expected.aabb.minmax[1] == actual.aabb.minmax[1]);
+        ASSERT_EQ(expected.mtlChunks.size(), actual.mtlChunks.size());
+        for (std::size_t i = 0; i < expected.mtlChunks.size(); ++i) {
+            const auto& e = expected.mtlChunks[i];
+            const auto& a = actual.mtlChunks[i];
+            EXPECT_EQ(e.material, a.material);
+            EXPECT_TRUE(e.point_seq_begin == a.point_seq_begin && e.point_seq_num == a.point_seq_num);
+            EXPECT_TRUE(e.line_seq_begin == a.line_seq_begin && e.line_seq_num == a.line_seq_num);
+            EXPECT_TRUE(e.face_seq_begin == a.face_seq_begin && e.face_seq_num == a.face_seq_num);
+        }
+    }
+
+    /** Expects two meshes to be equal (the search trees are not compared). */
+    void expectMeshesEqual(const cgu::Mesh& expected, const cgu::Mesh& actual)
+    {
+        EXPECT_TRUE(expected.vertices == actual.vertices);
+        EXPECT_TRUE(expected.texCoords == actual.texCoords);
+        EXPECT_TRUE(expected.normals == actual.normals);
+        EXPECT_TRUE(expected.lineVertices == actual.lineVertices);
+        EXPECT_TRUE(expected.faceVertices == actual.faceVertices);
+        EXPECT_TRUE(expected.vertexTriangleOffsets == actual.vertexTriangleOffsets);
+        EXPECT_TRUE(expected.vertexTriangles == actual.vertexTriangles);
+        EXPECT_TRUE(expected.nonManifoldEdges == actual.nonManifoldEdges);
+        ASSERT_EQ(expected.triangleConnect.size(), actual.triangleConnect.size());
+        for (std::size_t i = 0; i < expected.triangleConnect.size(); ++i) {
+            EXPECT_TRUE(expected.triangleConnect[i].vertex == actual.triangleConnect[i].vertex);
+            EXPECT_TRUE(expected.triangleConnect[i].faceVertex == actual.triangleConnect[i].faceVertex);
+            EXPECT_TRUE(expected.triangleConnect[i].neighbors == actual.triangleConnect[i].neighbors);
+        }
+
+        expectSubMeshesEqual(expected, actual);
+        ASSERT_EQ(expected.subMeshes.size(), actual.subMeshes.size());
+        for (std::size_t i = 0; i < expected.subMeshes.size(); ++i) {
+            expectSubMeshesEqual(*expected.subMeshes[i], *actual.subMeshes[i]);
+        }
+    }
+
+    /**
+     * Writes a mesh in binary form after changing it and reads it back.
+     * @param change the function changing the written mesh.
+     */
+    void readChangedMesh(const std::function<void(CacheTestMesh&)>& change)
+    {
+        CacheTestMesh mesh;
+        createMesh(mesh);
+        change(mesh);
+        std::ostringstream out;
+        mesh.WriteBinary(out, getMaterials());
+        auto binary = out.str();
+        const char* data = binary.data();
+        cgu::Mesh readMesh;
+        readMesh.ReadBinary(data, binary.data() + binary.size(), getMaterials());
+    }
+
+    /** Creates the cache file name in the temporary directory and removes the file afterwards. */
+    class MeshCacheTest : public ::testing::Test
+    {
+    protected:
+        MeshCacheTest() :
+            cacheFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.meshcache")).string()),
+            numHashes(0)
+        {
+            createMesh(mesh);
+        }
+
+        ~MeshCacheTest()
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(cacheFilename, ec);
+        }
+
+        /** Opens the cache for a source file and counts the hashes of the source file. */
+        cgu::MeshCache OpenCache(std::uint64_t sourceSize, std::int64_t sourceWriteTime, std::uint64_t sourceHash)
+        {
+            cgu::MeshCacheKey key;
+            key.sourceSize = sourceSize;
+            key.sourceWriteTime = sourceWriteTime;
+            key.sourceHash = 0;
+            return cgu::MeshCache(cacheFilename, key, [this, sourceHash]() { ++numHashes; return sourceHash; });
+        }
+
+        /** Writes the test mesh to a cache. */
+        bool WriteMesh(cgu::MeshCache& cache)
+        {
+            return cache.Write([this](std::ostream& out) { mesh.WriteBinary(out, getMaterials()); });
+        }
+
+        /** Reads a mesh from a cache. */
+        bool ReadMesh(cgu::MeshCache& cache, cgu::Mesh& readMesh)
+        {
+            return cache.Read([&readMesh](const char*& data, const char* dataEnd) {
+                readMesh.ReadBinary(data, dataEnd, getMaterials());
+            });
+        }
+
+        /** Holds the name of the cache file. */
+        std::string cacheFilename;
+        /** Holds the mesh written to the cache. */
+        CacheTestMesh mesh;
+        /** Holds the number of times the source file was hashed. */
+        unsigned int numHashes;
+    };
+}
+
+TEST_F(MeshCacheTest, RoundTrip)
+{
+    ASSERT_EQ(2u, mesh.subMeshes.size());
+    ASSERT_FALSE(mesh.nonManifoldEdges.empty());
+    auto cache = OpenCache(100, 1000, testSourceHash);
+    ASSERT_TRUE(WriteMesh(cache));
+
+    CacheTestMesh readMesh;
+    ASSERT_TRUE(ReadMesh(cache, readMesh));
+    expectMeshesEqual(mesh, readMesh);
+    EXPECT_EQ(mesh.GetNumberOfTriangles(), readMesh.GetNumberOfTriangles());
+    for (const auto& tri : mesh.triangleConnect) {
+        auto center = (mesh.vertices[tri.vertex[0]].xyz() + mesh.vertices[tri.vertex[1]].xyz()
+            + mesh.vertices[tri.vertex[2]].xyz()) / 3.0f;
+        EXPECT_EQ(mesh.FindContainingTriangleAll(center), readMesh.FindContainingTriangleAll(center));
+    }
+}
+
+TEST_F(MeshCacheTest, HashesSourceFileOnlyIfChanged)
+{
+    {
+        auto cache = OpenCache(100, 1000, testSourceHash);
+        cgu::Mesh readMesh;
+        EXPECT_FALSE(ReadMesh(cache, readMesh));
+        ASSERT_TRUE(WriteMesh(cache));
+        EXPECT_EQ(1u, numHashes);
+    }
+
+    // warm start: same size and write time, the stored hash is used.
+    numHashes = 0;
+    {
+        auto cache = OpenCache(100, 1000, testSourceHash);
+        cgu::Mesh readMesh;
+        EXPECT_TRUE(ReadMesh(cache, readMesh));
+        EXPECT_EQ(0u, numHashes);
+    }
+
+    // touched but unchanged file: hashed once, then the new write time is stored.
+    {
+        auto cache = OpenCache(100, 2000, testSourceHash);
+        cgu::Mesh readMesh;
+        EXPECT_TRUE(ReadMesh(cache, readMesh));
+        EXPECT_EQ(1u, numHashes);
+    }
+    numHashes = 0;
+    {
+        auto cache = OpenCache(100, 2000, testSourceHash);
+        cgu::Mesh readMesh;
+        EXPECT_TRUE(ReadMesh(cache, readMesh));
+        EXPECT_EQ(0u, numHashes);
+    }
+
+    // changed size: outdated without hashing.
+    {
+        auto cache = OpenCache(101, 2000, testSourceHash);
+        cgu::Mesh readMesh;
+        EXPECT_FALSE(ReadMesh(cache, readMesh));
+        EXPECT_EQ(0u, numHashes);
+    }
+
+    // changed content of the same size: the hash differs.
+    {
+        auto cache = OpenCache(100, 3000, testSourceHash + 1);
+        cgu::Mesh readMesh;
+        EXPECT_FALSE(ReadMesh(cache, readMesh));
+        EXPECT_EQ(1u, numHashes);
+    }
+}
+
+TEST_F(MeshCacheTest, TruncatedCacheIsNotUsed)
+{
+    {
+        auto cache = OpenCache(100, 1000, testSourceHash);
+        ASSERT_TRUE(WriteMesh(cache));
+    }
+    auto size = boost::filesystem::file_size(cacheFilename);
+    boost::filesystem::resize_file(cacheFilename, size - 5);
+
+    auto cache = OpenCache(100, 1000, testSourceHash);
+    cgu::Mesh readMesh;
+    EXPECT_FALSE(ReadMesh(cache, readMesh));
+}
+
+TEST(MeshBinary, RejectsIndicesOutOfBounds)
+{
+    EXPECT_NO_THROW(readChangedMesh([](CacheTestMesh&) {}));
+
+    auto faceVertexEnd = [](const CacheTestMesh& mesh) { return static_cast<unsigned int>(mesh.faceVertices.size()); };
+    EXPECT_THROW(readChangedMesh([&](CacheTestMesh& mesh) { mesh.subMeshes[0]->faceIndices.back() = faceVertexEnd(mesh); }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.subMeshes[1]->lineIndices[0] = static_cast<unsigned int>(mesh.lineVertices.size());
+    }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.subMeshes[0]->pointIndices[1] = static_cast<unsigned int>(mesh.vertices.size());
+    }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.triangleConnect[3].vertex[1] = static_cast<unsigned int>(mesh.vertices.size());
+    }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([&](CacheTestMesh& mesh) { mesh.triangleConnect[3].faceVertex[2] = faceVertexEnd(mesh); }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.triangleConnect[5].neighbors[0] = static_cast<int>(mesh.triangleConnect.size());
+    }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) { mesh.triangleConnect[5].neighbors[0] = -2; }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.vertexTriangles[7] = static_cast<unsigned int>(mesh.triangleConnect.size());
+    }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) { std::swap(mesh.vertexTriangleOffsets[3], mesh.vertexTriangleOffsets[30]); }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.nonManifoldEdges[0][1] = static_cast<unsigned int>(mesh.vertices.size());
+    }), std::out_of_range);
+
+    // sub-mesh and material ranges, also ranges whose end overflows.
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) { mesh.subMeshes[1]->numTriangles += 1; }), std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) { mesh.subMeshes[0]->firstTriIndex = 0xFFFFFFFFu; }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) { mesh.subMeshes[0]->mtlChunks.back().face_seq_num += 1; }),
+        std::out_of_range);
+    EXPECT_THROW(readChangedMesh([](CacheTestMesh& mesh) {
+        mesh.subMeshes[1]->mtlChunks[1].line_seq_begin = 0xFFFFFFF0u;
+    }), std::out_of_range);
+}
@@ -0,0 +1,132 @@
+/**
+ * @file   MeshConnectivityTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the triangle connectivity of meshes against the former serial algorithm.
+ */
+
+#include "gfx/Mesh.h"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Gives the tests access to creating the geometry information of meshes. */
+    class ConnectivityTestMesh : public cgu::Mesh
+    {
+    public:
+        using Mesh::CreateGeomertyInfo;
+    };
+
+    /**
+     * Creates a jittered grid mesh split into horizontal bands: the first band belongs to the mesh itself, the
+     * others to sub meshes, so neighbors are found across sub meshes. Fins (triangles with an additional vertex) are
+     * added to random grid edges in other sub meshes than the edges triangles, making these edges non-manifold.
+     * The triangle order within each band is shuffled.
+     */
+    void createBandedMesh(ConnectivityTestMesh& mesh, unsigned int size, unsigned int numBands)
+    {
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> jitter(-0.4f, 0.4f);
+        for (unsigned int y = 0; y < size; ++y) {
+            for (unsigned int x = 0; x < size; ++x) {
+                mesh.vertices.push_back(glm::vec4(static_cast<float>(x) + jitter(rng),
+                    static_cast<float>(y) + jitter(rng), jitter(rng), 1.0f));
+            }
+        }
+
+        std::vector<cgu::SubMesh*> bands{ &mesh };
+        for (unsigned int b = 1; b < numBands; ++b) bands.push_back(mesh.createSubMesh("band" + std::to_string(b)));
+        auto addTriangle = [](cgu::SubMesh* submesh, unsigned int v0, unsigned int v1, unsigned int v2) {
+            submesh->trianglePtsIndices.push_back(cgu::MeshConnectTriangle(std::array<unsigned int, 3>{ { v0, v1, v2 } }));
+        };
+        for (unsigned int y = 0; y + 1 < size; ++y) {
+            auto band = bands[(y * numBands) / (size - 1)];
+            for (unsigned int x = 0; x + 1 < size; ++x) {
+                auto i = y * size + x;
+                addTriangle(band, i, i + 1, i + size);
+                addTriangle(band, i + 1, i + size + 1, i + size);
+            }
+        }
+
+        std::uniform_int_distribution<unsigned int> gridPos(0, size - 2);
+        std::uniform_int_distribution<unsigned int> bandIdx(0, numBands - 1);
+        for (unsigned int f = 0; f < size; ++f) {
+            auto i = gridPos(rng) * size + gridPos(rng);
+            auto finVertex = static_cast<unsigned int>(mesh.vertices.size());
+            mesh.vertices.push_back(mesh.vertices[i] + glm::vec4(0.5f, 0.5f, 1.0f, 0.0f));
+            addTriangle(bands[bandIdx(rng)], i, finVertex, f % 2 == 0 ? i + 1 : i + size);
+        }
+
+        for (auto band : bands) std::shuffle(band->trianglePtsIndices.begin(), band->trianglePtsIndices.end(), rng);
+    }
+
+    /**
+     * The former serial connectivity algorithm (reference): the neighbor over an edge is the other triangle in the
+     * intersection of the edge vertices triangle lists. Unlike the former code the lists hold the triangles of all
+     * sub meshes before searching and edges with more than two triangles get no neighbors (the former code asserted).
+     * @param mesh the mesh to calculate the reference for (its triangles must not be degenerated).
+     * @param neighbors the neighbors of all triangles.
+     * @param nonManifoldEdges the (sorted) edges with more than two triangles.
+     */
+    void createConnectivityReference(const ConnectivityTestMesh& mesh, std::vector<std::array<int, 3>>& neighbors,
+        std::set<std::array<unsigned int, 2>>& nonManifoldEdges)
+    {
+        std::vector<std::vector<unsigned int>> vertexTriangles(mesh.vertices.size());
+        for (unsigned int i = 0; i < mesh.triangleConnect.size(); ++i) {
+            for (auto vi : mesh.triangleConnect[i].vertex) vertexTriangles[vi].push_back(i);
+        }
+
+        neighbors.resize(mesh.triangleConnect.size());
+        for (unsigned int i = 0; i < mesh.triangleConnect.size(); ++i) {
+            const auto& tri = mesh.triangleConnect[i];
+            for (unsigned int ni = 0; ni < 3; ++ni) {
+                auto vi0 = tri.vertex[(ni + 1) % 3];
+                auto vi1 = tri.vertex[(ni + 2) % 3];
+                std::vector<unsigned int> isect;
+                std::set_intersection(vertexTriangles[vi0].begin(), vertexTriangles[vi0].end(),
+                    vertexTriangles[vi1].begin(), vertexTriangles[vi1].end(), std::back_inserter(isect));
+                if (isect.size() == 2) neighbors[i][ni] = isect[0] == i ? isect[1] : isect[0];
+                else neighbors[i][ni] = -1;
+                if (isect.size() > 2) nonManifoldEdges.insert({ { std::min(vi0, vi1), std::max(vi0, vi1) } });
+            }
+        }
+    }
+}
+
+TEST(MeshConnectivity, MatchesSerialReference)
+{
+    ConnectivityTestMesh mesh;
+    createBandedMesh(mesh, 400, 4);
+
+    unsigned int threadCounts[] = { 1, 4, 7 };
+    for (auto numThreads : threadCounts) {
+        mesh.CreateGeomertyInfo(numThreads);
+        std::vector<std::array<int, 3>> neighbors;
+        std::set<std::array<unsigned int, 2>> nonManifoldEdges;
+        createConnectivityReference(mesh, neighbors, nonManifoldEdges);
+        ASSERT_FALSE(nonManifoldEdges.empty());
+
+        auto numCrossNeighbors = 0U;
+        auto numMismatches = 0U;
+        auto firstSubMeshTri = static_cast<int>(mesh.subMeshes[0]->firstTriIndex);
+        for (unsigned int i = 0; i < mesh.triangleConnect.size(); ++i) {
+            if (mesh.triangleConnect[i].neighbors != neighbors[i]) ++numMismatches;
+            for (auto n : neighbors[i]) {
+                if (n != -1 && (n < firstSubMeshTri) != (static_cast<int>(i) < firstSubMeshTri)) ++numCrossNeighbors;
+            }
+        }
+        EXPECT_EQ(0U, numMismatches) << numThreads << " threads";
+        EXPECT_LT(0U, numCrossNeighbors);
+        std::vector<std::array<unsigned int, 2>> expectedEdges(nonManifoldEdges.begin(), nonManifoldEdges.end());
+        EXPECT_TRUE(expectedEdges == mesh.nonManifoldEdges) << numThreads << " threads";
+    }
+}
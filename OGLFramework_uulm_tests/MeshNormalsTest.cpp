@@ -0,0 +1,154 @@
+/**
+ * @file   MeshNormalsTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests and benchmarks the parallel normal calculation of meshes against the former serial loop.
+ */
+
+#include "test_helper.h"
+#include "gfx/Mesh.h"
+#include "core/parallel_helper.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Allowed difference to the serial reference in units in the last place (the order of sums is the same). */
+    const unsigned int normalToleranceULPs = 0;
+
+    /** Gives the tests access to the normal calculation of meshes. */
+    class NormalsTestMesh : public cgu::Mesh
+    {
+    public:
+        using Mesh::CalculateNormals;
+        using Mesh::CreateVertexConnectivity;
+    };
+
+    /**
+     * Creates a jittered grid mesh. Every fourth position gets a second face vertex (used by the triangles of odd
+     * rows) as at texture seams and some degenerated triangles are added.
+     */
+    void createGridMesh(NormalsTestMesh& mesh, unsigned int size)
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<float> jitter(-0.4f, 0.4f);
+        std::vector<unsigned int> faceVertex(size * size), seamFaceVertex(size * size);
+        for (unsigned int y = 0; y < size; ++y) {
+            for (unsigned int x = 0; x < size; ++x) {
+                auto i = y * size + x;
+                mesh.vertices.push_back(glm::vec4(static_cast<float>(x) + jitter(rng),
+                    static_cast<float>(y) + jitter(rng), 10.0f * jitter(rng), 1.0f));
+                faceVertex[i] = seamFaceVertex[i] = static_cast<unsigned int>(mesh.faceVertices.size());
+                mesh.faceVertices.push_back(cgu::FaceVertex());
+                if (i % 4 == 0) {
+                    seamFaceVertex[i] = static_cast<unsigned int>(mesh.faceVertices.size());
+                    mesh.faceVertices.push_back(cgu::FaceVertex());
+                }
+            }
+        }
+
+        auto addTriangle = [&](unsigned int v0, unsigned int v1, unsigned int v2, unsigned int row) {
+            cgu::MeshConnectTriangle tri(std::array<unsigned int, 3>{ { v0, v1, v2 } });
+            for (unsigned int i = 0; i < 3; ++i) {
+                tri.faceVertex[i] = row % 2 == 1 ? seamFaceVertex[tri.vertex[i]] : faceVertex[tri.vertex[i]];
+            }
+            mesh.triangleConnect.push_back(tri);
+        };
+        for (unsigned int y = 0; y + 1 < size; ++y) {
+            for (unsigned int x = 0; x + 1 < size; ++x) {
+                auto i = y * size + x;
+                addTriangle(i, i + 1, i + size, y);
+                addTriangle(i + 1, i + size + 1, i + size, y);
+                if (x % 97 == 0) addTriangle(i, i, i + 1, y);
+            }
+        }
+        mesh.CreateVertexConnectivity();
+    }
+
+    /** The former serial normal calculation (reference). */
+    std::vector<glm::vec3> calculateNormalsReference(const NormalsTestMesh& mesh)
+    {
+        std::vector<glm::vec3> normals(mesh.faceVertices.size(), glm::vec3(0.0f));
+        for (const auto& tc : mesh.triangleConnect) {
+            for (unsigned int vi0 = 0; vi0 < 3; ++vi0) {
+                auto vi1 = (vi0 + 1) % 3;
+                auto vi2 = (vi0 + 2) % 3;
+                auto v0 = glm::vec3(mesh.vertices[tc.vertex[vi1]]) - glm::vec3(mesh.vertices[tc.vertex[vi0]]);
+                auto v1 = glm::vec3(mesh.vertices[tc.vertex[vi2]]) - glm::vec3(mesh.vertices[tc.vertex[vi0]]);
+                normals[tc.faceVertex[vi0]] += glm::cross(v0, v1);
+            }
+        }
+
+        for (auto& n : normals) n = glm::normalize(n);
+        return normals;
+    }
+
+    /** Returns the distance of two floats in units in the last place. */
+    unsigned int floatULPs(float a, float b)
+    {
+        if (a == b) return 0;
+        std::int32_t ia, ib;
+        std::memcpy(&ia, &a, sizeof(float));
+        std::memcpy(&ib, &b, sizeof(float));
+        if (ia < 0) ia = std::numeric_limits<std::int32_t>::min() - ia;
+        if (ib < 0) ib = std::numeric_limits<std::int32_t>::min() - ib;
+        auto diff = static_cast<std::int64_t>(ia) - static_cast<std::int64_t>(ib);
+        return static_cast<unsigned int>(diff < 0 ? -diff : diff);
+    }
+
+    /** Returns the largest difference of the meshes normals to the reference in units in the last place. */
+    unsigned int maxNormalULPs(const NormalsTestMesh& mesh, const std::vector<glm::vec3>& reference)
+    {
+        auto maxULPs = 0u;
+        for (std::size_t i = 0; i < reference.size(); ++i) {
+            for (int c = 0; c < 3; ++c) {
+                auto ulps = floatULPs(mesh.faceVertices[i].normal[c], reference[i][c]);
+                if (ulps > maxULPs) maxULPs = ulps;
+            }
+        }
+        return maxULPs;
+    }
+}
+
+TEST(MeshNormals, MatchesSerialReference)
+{
+    NormalsTestMesh mesh;
+    createGridMesh(mesh, 400);
+    auto reference = calculateNormalsReference(mesh);
+
+    unsigned int threadCounts[] = { 1, 4, 7 };
+    for (auto numThreads : threadCounts) {
+        mesh.CalculateNormals(numThreads);
+        EXPECT_LE(maxNormalULPs(mesh, reference), normalToleranceULPs) << numThreads << " threads";
+    }
+
+    // calculating again must not add to the previous normals.
+    mesh.CalculateNormals(4);
+    EXPECT_LE(maxNormalULPs(mesh, reference), normalToleranceULPs);
+}
+
+TEST(MeshNormals, DISABLED_Benchmark)
+{
+    NormalsTestMesh mesh;
+    createGridMesh(mesh, 1000);
+    auto numThreads = parallel_help::numThreads(0);
+
+    std::vector<glm::vec3> reference;
+    auto referenceMS = test_help::measureMS(5, [&]() { reference = calculateNormalsReference(mesh); });
+    auto serialMS = test_help::measureMS(5, [&]() { mesh.CalculateNormals(1); });
+    auto parallelMS = test_help::measureMS(5, [&]() { mesh.CalculateNormals(numThreads); });
+    EXPECT_LE(maxNormalULPs(mesh, reference), normalToleranceULPs);
+
+    std::cout << mesh.triangleConnect.size() << " triangles: reference " << referenceMS << " ms, 1 thread "
+        << serialMS << " ms, " << numThreads << " threads " << parallelMS << " ms." << std::endl;
+}
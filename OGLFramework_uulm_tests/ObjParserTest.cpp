@@ -0,0 +1,310 @@
+/**
+ * @file   ObjParserTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests and benchmarks parsing .obj files with different numbers of threads.
+ */
+
+#include "test_helper.h"
+#include "gfx/Mesh.h"
+#include "gfx/ObjParser.h"
+#include "core/parallel_helper.h"
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Stands in for the materials of the tests, only their addresses are used. */
+    const std::array<char, 4> materialTags{ { 0, 1, 2, 3 } };
+
+    /** Creates a parser returning one of the material tags for the materials "m0" to "m3". */
+    cgu::ObjParser createParser(std::size_t minChunkSize, std::vector<std::string>* mtlLibs = nullptr)
+    {
+        return cgu::ObjParser([mtlLibs](const std::vector<std::string>& names) {
+            if (mtlLibs != nullptr) mtlLibs->insert(mtlLibs->end(), names.begin(), names.end());
+        }, [](const std::string& name) -> const cgu::Material* {
+            if (name.size() != 2 || name[0] != 'm' || name[1] < '0' || name[1] > '3') return nullptr;
+            return reinterpret_cast<const cgu::Material*>(&materialTags[name[1] - '0']);
+        }, minChunkSize);
+    }
+
+    /**
+     * Creates the text of an .obj file with rows of positions and faces between the last two rows.
+     * Faces use all index forms with absolute and relative indices and 3 to 5 vertices, objects (also repeated
+     * ones), materials, lines, points, comments and malformed lines are mixed in.
+     */
+    std::string createObjText(unsigned int numRows, unsigned int rowSize, std::mt19937& rng)
+    {
+        std::string text = "# test file\nmtllib a.mtl b.mtl\n";
+        std::uniform_real_distribution<float> coord(-10.0f, 10.0f);
+        auto appendFloats = [&text, &coord, &rng](const char* key, unsigned int count) {
+            text += key;
+            for (unsigned int i = 0; i < count; ++i) text += " " + std::to_string(coord(rng));
+            text += "\n";
+        };
+
+        unsigned int numVertices = 0, numTexCoords = 0, numNormals = 0;
+        auto appendIndex = [&](unsigned int vertex, int form) {
+            auto relative = rng() % 3 == 0;
+            auto idx = [relative](unsigned int i, unsigned int count) {
+                return relative ? std::to_string(static_cast<int>(i) - static_cast<int>(count)) : std::to_string(i + 1);
+            };
+            auto tex = vertex % numTexCoords;
+            auto normal = (vertex / 2) % numNormals;
+            text += " " + idx(vertex, numVertices);
+            switch (form) {
+            case 1: text += "/" + idx(tex, numTexCoords); break;
+            case 2: text += "//" + idx(normal, numNormals); break;
+            case 3: text += "/" + idx(tex, numTexCoords) + "/" + idx(normal, numNormals); break;
+            default: break;
+            }
+        };
+
+        for (unsigned int row = 0; row < numRows; ++row) {
+            for (unsigned int i = 0; i < rowSize; ++i) appendFloats("v", i % 7 == 0 ? 4 : 3);
+            numVertices += rowSize;
+            for (unsigned int i = 0; i < rowSize / 2; ++i) appendFloats("vt", 2);
+            numTexCoords += rowSize / 2;
+            for (unsigned int i = 0; i < rowSize / 3; ++i) appendFloats("vn", 3);
+            numNormals += rowSize / 3;
+            if (row % 5 == 2) appendFloats("vp", 2);
+            if (row == 0) continue;
+
+            if (row % 4 == 1) text += "o object" + std::to_string(rng() % 3) + "\n";
+            if (row % 3 == 0) text += "usemtl m" + std::to_string(rng() % 5) + "\n";
+            auto form = static_cast<int>(rng() % 4);
+            auto rowStart = numVertices - 2 * rowSize;
+            for (unsigned int i = 0; i + 2 < rowSize; i += 2) {
+                auto v = rowStart + i;
+                text += "f";
+                appendIndex(v, form);
+                appendIndex(v + 1, form);
+                appendIndex(v + rowSize + 1, form);
+                if (rng() % 2 == 0) appendIndex(v + rowSize, form);
+                if (rng() % 4 == 0) appendIndex(v + 2, form);
+                text += "\n";
+                if (rng() % 8 == 0) form = static_cast<int>(rng() % 4);
+            }
+            if (row % 6 == 3) {
+                text += "l";
+                for (unsigned int i = 0; i < 4; ++i) appendIndex(rowStart + rng() % rowSize, rng() % 2 == 0 ? 0 : 1);
+                text += "\n";
+            }
+            if (row % 7 == 4) {
+                text += "p";
+                appendIndex(rowStart + rng() % rowSize, 0);
+                text += "\n";
+            }
+            if (row % 9 == 5) text += "f 1 2\n  \n# comment\nf 1 x 3\n";
+        }
+        return text;
+    }
+
+    /**
+     * Creates the text of an .obj file of a scanned surface: a grid of positions with a texture coordinate and
+     * normal each and two triangles per grid cell (each face vertex is used by up to six triangles).
+     */
+    std::string createGridObjText(unsigned int size, std::mt19937& rng)
+    {
+        std::string text;
+        std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+        for (unsigned int y = 0; y < size; ++y) {
+            for (unsigned int x = 0; x < size; ++x) {
+                text += "v " + std::to_string(x) + " " + std::to_string(y) + " " + std::to_string(height(rng)) + "\n";
+            }
+        }
+        for (unsigned int i = 0; i < size * size; ++i) {
+            text += "vt " + std::to_string(static_cast<float>(i % size) / static_cast<float>(size)) + " "
+                + std::to_string(static_cast<float>(i / size) / static_cast<float>(size)) + "\n";
+        }
+        for (unsigned int i = 0; i < size * size; ++i) text += "vn 0 " + std::to_string(height(rng)) + " 1\n";
+
+        auto vertex = [](unsigned int i) { auto s = std::to_string(i + 1); return s + "/" + s + "/" + s; };
+        for (unsigned int y = 0; y + 1 < size; ++y) {
+            for (unsigned int x = 0; x + 1 < size; ++x) {
+                auto i = y * size + x;
+                text += "f " + vertex(i) + " " + vertex(i + 1) + " " + vertex(i + size) + "\n";
+                text += "f " + vertex(i + 1) + " " + vertex(i + size + 1) + " " + vertex(i + size) + "\n";
+            }
+        }
+        return text;
+    }
+
+    /** Expects two sub-meshes to be equal. */
+    void expectSubMeshesEqual(const cgu::SubMesh& expected, const cgu::SubMesh& actual)
+    {
+        EXPECT_EQ(expected.objectName, actual.objectName);
+        EXPECT_EQ(expected.lineHasTexture, actual.lineHasTexture);
+        EXPECT_EQ(expected.faceHasTexture, actual.faceHasTexture);
+        EXPECT_EQ(expected.faceHasNormal, actual.faceHasNormal);
+        EXPECT_TRUE(expected.pointIndices == actual.pointIndices);
+        EXPECT_TRUE(expected.lineIndices == actual.lineIndices);
+        EXPECT_TRUE(expected.faceIndices == actual.faceIndices);
+        ASSERT_EQ(expected.trianglePtsIndices.size(), actual.trianglePtsIndices.size());
+        for (std::size_t i = 0; i < expected.trianglePtsIndices.size(); ++i) {
+            EXPECT_TRUE(expected.trianglePtsIndices[i].vertex == actual.trianglePtsIndices[i].vertex);
+            EXPECT_TRUE(expected.trianglePtsIndices[i].faceVertex == actual.trianglePtsIndices[i].faceVertex);
+        }
+        ASSERT_EQ(expected.mtlChunks.size(), actual.mtlChunks.size());
+        for (std::size_t i = 0; i < expected.mtlChunks.size(); ++i) {
+            const auto& e = expected.mtlChunks[i];
+            const auto& a = actual.mtlChunks[i];
+            EXPECT_EQ(e.material, a.material);
+            EXPECT_EQ(e.point_seq_begin, a.point_seq_begin);
+            EXPECT_EQ(e.point_seq_num, a.point_seq_num);
+            EXPECT_EQ(e.line_seq_begin, a.line_seq_begin);
+            EXPECT_EQ(e.line_seq_num, a.line_seq_num);
+            EXPECT_EQ(e.face_seq_begin, a.face_seq_begin);
+            EXPECT_EQ(e.face_seq_num, a.face_seq_num);
+        }
+    }
+
+    /** Expects two meshes to be equal (including the order of all their data). */
+    void expectMeshesEqual(const cgu::Mesh& expected, const cgu::Mesh& actual)
+    {
+        EXPECT_TRUE(expected.vertices == actual.vertices);
+        EXPECT_TRUE(expected.texCoords == actual.texCoords);
+        EXPECT_TRUE(expected.normals == actual.normals);
+        EXPECT_TRUE(expected.paramVertices == actual.paramVertices);
+        EXPECT_TRUE(expected.lineVertices == actual.lineVertices);
+        EXPECT_TRUE(expected.faceVertices == actual.faceVertices);
+        expectSubMeshesEqual(expected, actual);
+        ASSERT_EQ(expected.subMeshes.size(), actual.subMeshes.size());
+        for (std::size_t i = 0; i < expected.subMeshes.size(); ++i) {
+            SCOPED_TRACE("sub-mesh " + expected.subMeshes[i]->objectName);
+            expectSubMeshesEqual(*expected.subMeshes[i], *actual.subMeshes[i]);
+        }
+    }
+}
+
+TEST(ObjParser, ParsesStatements)
+{
+    std::string text = "mtllib a.mtl  b.mtl\n"
+        "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+        "vt 0 0\nvt 1 1\nvn 0 0 2\n"
+        "usemtl m1\n"
+        "f 1/1/1 2/2/1 3/2/1 4/1/1\n"
+        "o second\n"
+        "f -4 -2 -1\n"
+        "l 1/1 2/2 -2/1\n"
+        "p 1 2\n"
+        "usemtl unknown\n"
+        "f 1/1/1 3/2/1 4/1/1\n";
+    std::vector<std::string> mtlLibs;
+    cgu::Mesh mesh;
+    createParser(cgu::ObjParser::DEFAULT_MIN_CHUNK_SIZE, &mtlLibs).Parse(text.data(), text.data() + text.size(), 1, mesh);
+
+    ASSERT_EQ(2u, mtlLibs.size());
+    EXPECT_EQ("a.mtl", mtlLibs[0]);
+    EXPECT_EQ("b.mtl", mtlLibs[1]);
+    ASSERT_EQ(4u, mesh.vertices.size());
+    EXPECT_TRUE(glm::vec3(0.0f, 0.0f, 1.0f) == mesh.normals[0]);
+
+    // the vertices 1/1/1, 3/2/1 and 4/1/1 are shared by the quad and the last triangle.
+    ASSERT_EQ(7u, mesh.faceVertices.size());
+    EXPECT_TRUE(glm::vec2(1.0f, 1.0f) == mesh.faceVertices[2].tex);
+    EXPECT_TRUE(glm::vec3(0.0f) == mesh.faceVertices[5].normal);
+    EXPECT_TRUE((std::vector<unsigned int>{ 0, 1, 2, 0, 2, 3 }) == mesh.faceIndices);
+    EXPECT_TRUE(mesh.faceHasTexture && mesh.faceHasNormal);
+    ASSERT_EQ(1u, mesh.mtlChunks.size());
+    EXPECT_EQ(reinterpret_cast<const cgu::Material*>(&materialTags[1]), mesh.mtlChunks[0].material);
+
+    ASSERT_EQ(1u, mesh.subMeshes.size());
+    const auto& second = *mesh.subMeshes[0];
+    EXPECT_EQ("second", second.objectName);
+    EXPECT_TRUE((std::vector<unsigned int>{ 4, 5, 6, 0, 2, 3 }) == second.faceIndices);
+    ASSERT_EQ(2u, second.trianglePtsIndices.size());
+    EXPECT_TRUE((std::array<unsigned int, 3>{ { 0, 2, 3 } }) == second.trianglePtsIndices[0].vertex);
+    EXPECT_TRUE((std::vector<unsigned int>{ 0, 1, 1, 2 }) == second.lineIndices);
+    EXPECT_EQ(3u, mesh.lineVertices.size());
+    EXPECT_TRUE(second.lineHasTexture);
+    EXPECT_TRUE((std::vector<unsigned int>{ 0, 1 }) == second.pointIndices);
+    ASSERT_EQ(2u, second.mtlChunks.size());
+    EXPECT_EQ(reinterpret_cast<const cgu::Material*>(&materialTags[1]), second.mtlChunks[0].material);
+    EXPECT_EQ(3u, second.mtlChunks[0].face_seq_num);
+    EXPECT_EQ(nullptr, second.mtlChunks[1].material);
+    EXPECT_EQ(3u, second.mtlChunks[1].face_seq_begin);
+}
+
+TEST(ObjParser, SkipsStatementsWithUndefinedIndices)
+{
+    std::string text = "v 0 0 0\nv 1 0 0\nv 1 1 0\n"
+        "vt 0 0\nvn 0 0 1\n"
+        "f -4 1 2\n"           // relative index before the first position.
+        "f 1 2 3\n"
+        "f 1 2 5\n"            // index behind the last position.
+        "f 1/2 2/1 3/1\n"      // undefined texture coordinate.
+        "f 1//-2 2//1 3//1\n"  // relative normal index before the first normal.
+        "l 1 7\np -9\n"
+        "v 0 1 0\n"
+        "f 2/1/1 3/1/1 4/1/1\n"
+        "f -1 -2 -5\n"
+        "l 1 -1\np 4\n";
+    cgu::Mesh reference;
+    createParser(cgu::ObjParser::DEFAULT_MIN_CHUNK_SIZE).Parse(text.data(), text.data() + text.size(), 1, reference);
+
+    ASSERT_EQ(4u, reference.vertices.size());
+    ASSERT_EQ(6u, reference.faceVertices.size());
+    EXPECT_TRUE((std::vector<unsigned int>{ 0, 1, 2, 3, 4, 5 }) == reference.faceIndices);
+    EXPECT_TRUE(glm::vec3(0.0f, 1.0f, 0.0f) == reference.faceVertices[5].pos);
+    EXPECT_TRUE((std::vector<unsigned int>{ 0, 1 }) == reference.lineIndices);
+    EXPECT_TRUE((std::vector<unsigned int>{ 3 }) == reference.pointIndices);
+
+    unsigned int threadCounts[] = { 2, 5 };
+    for (auto numThreads : threadCounts) {
+        SCOPED_TRACE(std::to_string(numThreads) + " threads");
+        cgu::Mesh mesh;
+        createParser(1).Parse(text.data(), text.data() + text.size(), numThreads, mesh);
+        expectMeshesEqual(reference, mesh);
+    }
+}
+
+TEST(ObjParser, SameResultForAnyNumberOfThreads)
+{
+    std::mt19937 rng(13);
+    auto text = createObjText(60, 40, rng);
+    cgu::Mesh reference;
+    createParser(cgu::ObjParser::DEFAULT_MIN_CHUNK_SIZE).Parse(text.data(), text.data() + text.size(), 1, reference);
+    ASSERT_GT(reference.faceVertices.size(), 1000u);
+    ASSERT_EQ(3u, reference.subMeshes.size());
+
+    // small chunks put chunk borders everywhere (relative indices, objects and materials span them).
+    std::size_t minChunkSizes[] = { 1, 97, 4096 };
+    unsigned int threadCounts[] = { 2, 3, 8, 64 };
+    for (auto minChunkSize : minChunkSizes) {
+        for (auto numThreads : threadCounts) {
+            SCOPED_TRACE(std::to_string(numThreads) + " threads, minimum chunk size " + std::to_string(minChunkSize));
+            cgu::Mesh mesh;
+            createParser(minChunkSize).Parse(text.data(), text.data() + text.size(), numThreads, mesh);
+            expectMeshesEqual(reference, mesh);
+        }
+    }
+}
+
+TEST(ObjParser, DISABLED_Benchmark)
+{
+    std::mt19937 rng(3);
+    auto text = createGridObjText(1000, rng);
+    auto textMB = static_cast<double>(text.size()) / (1024.0 * 1024.0);
+
+    std::cout << std::fixed << std::setprecision(1) << textMB << " MB .obj text:" << std::endl;
+    double serialMS = 0.0;
+    for (unsigned int numThreads = 1; numThreads <= parallel_help::numThreads(0); numThreads *= 2) {
+        auto parser = createParser(cgu::ObjParser::DEFAULT_MIN_CHUNK_SIZE);
+        auto ms = test_help::measureMS(3, [&]() {
+            cgu::Mesh mesh;
+            parser.Parse(text.data(), text.data() + text.size(), numThreads, mesh);
+        });
+        if (numThreads == 1) serialMS = ms;
+        std::cout << std::setw(4) << numThreads << " threads: " << std::setw(8) << ms << " ms, " << std::setw(7)
+            << 1000.0 * textMB / ms << " MB/s, speedup " << std::setprecision(2) << serialMS / ms
+            << std::setprecision(1) << std::endl;
+    }
+}
@@ -0,0 +1,129 @@
+/**
+ * @file   ParseHelperTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the locale independent number parsing used by the OBJ loader.
+ */
+
+#include "core/parse_helper.h"
+
+#include <gtest/gtest.h>
+
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace {
+
+    /** Parses a whole string with parse_help::parseFloat, returns false if not all of it was used. */
+    bool parseFloatString(const std::string& text, float& result)
+    {
+        auto p = text.c_str();
+        auto end = p + text.size();
+        return parse_help::parseFloat(p, end, result) && p == end;
+    }
+
+    /** Compares parse_help::parseFloat bitwise with strtof (the C locale must be active). */
+    bool parsesLikeStrtof(const std::string& text)
+    {
+        auto expected = std::strtof(text.c_str(), nullptr);
+        auto value = 0.0f;
+        if (!parseFloatString(text, value)) return false;
+        return std::memcmp(&value, &expected, sizeof(float)) == 0;
+    }
+
+    /** Counts a mismatch between parse_help::parseFloat and strtof and remembers the first one. */
+    void checkMismatch(const std::string& text, int& numMismatches, std::string& firstMismatch)
+    {
+        if (parsesLikeStrtof(text)) return;
+        if (numMismatches++ == 0) firstMismatch = text;
+    }
+
+    /** Formats a value with printf. */
+    std::string format(const char* fmt, double value)
+    {
+        char buffer[64];
+        std::sprintf(buffer, fmt, value);
+        return buffer;
+    }
+}
+
+TEST(ParseHelper, ParseIntRange)
+{
+    const char* valid[] = { "0", "-0", "+17", "2147483647", "-2147483648", "000000000000000000042" };
+    const int expected[] = { 0, 0, 17, 2147483647, -2147483647 - 1, 42 };
+    for (auto i = 0; i < 6; ++i) {
+        auto p = valid[i];
+        auto value = -1;
+        EXPECT_TRUE(parse_help::parseInt(p, valid[i] + std::strlen(valid[i]), value)) << valid[i];
+        EXPECT_EQ(expected[i], value);
+        EXPECT_EQ(valid[i] + std::strlen(valid[i]), p);
+    }
+
+    const char* overflow[] = { "2147483648", "-2147483649", "99999999999999999999", "4294967296" };
+    for (auto text : overflow) {
+        auto p = text;
+        auto value = 0;
+        EXPECT_FALSE(parse_help::parseInt(p, text + std::strlen(text), value)) << text;
+        EXPECT_EQ(text, p);
+    }
+}
+
+TEST(ParseHelper, ParseFloatMatchesStrtof)
+{
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> exponentDist(-12.0f, 12.0f);
+    std::uniform_real_distribution<float> mantissaDist(-1.0f, 1.0f);
+    const char* formats[] = { "%.1g", "%.3g", "%.6g", "%.7g", "%.8g", "%.9g", "%.12g", "%.16g", "%.17g",
+        "%.3f", "%.6f", "%.3e", "%.8e", "%.15e" };
+
+    auto numMismatches = 0;
+    std::string firstMismatch;
+    for (auto i = 0; i < 50000; ++i) {
+        auto value = mantissaDist(rng) * std::pow(10.0f, exponentDist(rng));
+        for (auto fmt : formats) {
+            checkMismatch(format(fmt, value), numMismatches, firstMismatch);
+        }
+
+        // decimal values close to the midpoint between two floats are the ones double rounding gets wrong.
+        auto next = std::nextafter(value, 2.0f * value);
+        auto midpoint = (static_cast<double>(value) + static_cast<double>(next)) / 2.0;
+        checkMismatch(format("%.15g", midpoint), numMismatches, firstMismatch);
+        checkMismatch(format("%.16g", midpoint), numMismatches, firstMismatch);
+        checkMismatch(format("%.17g", midpoint), numMismatches, firstMismatch);
+        checkMismatch(format("%.25g", midpoint), numMismatches, firstMismatch);
+    }
+    EXPECT_EQ(0, numMismatches) << "first mismatch: " << firstMismatch;
+
+    // exact midpoints round to even, values just above them round up.
+    const char* special[] = { "16777217", "16777217.000001", "16777219", "1.000000059604644775390625",
+        "1.000000059604644775390626", "0.1", "1e-22", "3.4028234e38", "-7.5e-5", "123456789012345678901",
+        "0.000000000000000000000000000001", "1e-40", "1E+10", ".5", "5." };
+    for (auto text : special) EXPECT_TRUE(parsesLikeStrtof(text)) << text;
+}
+
+TEST(ParseHelper, ParseFloatIgnoresLocale)
+{
+    const char* commaLocales[] = { "de_DE.UTF-8", "de_DE.utf8", "de_DE", "German_Germany.1252", "deu" };
+    auto localeSet = false;
+    for (auto name : commaLocales) {
+        if (std::setlocale(LC_NUMERIC, name) != nullptr) {
+            localeSet = true;
+            break;
+        }
+    }
+    if (!localeSet) return;
+
+    // both the fast path and the strtof fall back must accept the '.' separator.
+    const char* texts[] = { "0.25", "16777217", "0.1000000000000000000000001", "2.5e-30" };
+    const float expected[] = { 0.25f, 16777216.0f, 0.1f, 2.5e-30f };
+    for (auto i = 0; i < 4; ++i) {
+        auto value = 0.0f;
+        EXPECT_TRUE(parseFloatString(texts[i], value)) << texts[i];
+        EXPECT_EQ(expected[i], value);
+    }
+    std::setlocale(LC_NUMERIC, "C");
+}
@@ -0,0 +1,252 @@
+/**
+ * @file   TransferFunctionTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests and benchmarks the evaluation of the transfer function against the former linear scan and the
+ *         generation of the pre-integration table.
+ */
+
+#include "test_helper.h"
+#include "volumeScene/TransferFunction.h"
+
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** The former evaluation of the transfer function with a linear scan over the control points (reference). */
+    glm::vec4 rgbaLinearScan(const std::vector<cgu::tf::ControlPoint>& points, float val)
+    {
+        val = glm::clamp(val, 0.f, 1.f);
+        if (points.size() == 0) return glm::vec4(1.f, 1.f, 1.f, val);
+        if (val <= points.front().val) return points.front().rgba;
+        if (val >= points.back().val) return points.back().rgba;
+
+        std::size_t i = 0;
+        while (val > points[i].val) ++i;
+        const auto p = points[i - 1];
+        const auto n = points[i];
+        auto t = (val - p.val) / (n.val - p.val);
+        return glm::mix(p.rgba, n.rgba, t);
+    }
+
+    /** Returns whether two colors are identical in all bits. */
+    bool bitEqual(const glm::vec4& a, const glm::vec4& b)
+    {
+        return std::memcmp(&a, &b, sizeof(glm::vec4)) == 0;
+    }
+
+    /** Creates a transfer function with evenly spaced control points of random colors. */
+    cgu::tf::TransferFunction createEvenTransferFunction(unsigned int numPoints, std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> color(0.0f, 1.0f);
+        cgu::tf::TransferFunction tf(64);
+        for (unsigned int i = 0; i < numPoints; ++i) {
+            cgu::tf::ControlPoint p;
+            p.val = (static_cast<float>(i) + 0.5f) / static_cast<float>(numPoints);
+            p.rgba = glm::vec4(color(rng), color(rng), color(rng), color(rng));
+            tf.InsertControlPoint(p);
+        }
+        return tf;
+    }
+}
+
+TEST(TransferFunction, RGBAMatchesLinearScan)
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> value(-0.1f, 1.1f);
+    for (unsigned int i = 0; i < 300; ++i) {
+        // duplicate and out of range control points included.
+        cgu::tf::TransferFunction tf(64);
+        auto numPoints = rng() % 40;
+        for (unsigned int k = 0; k < numPoints; ++k) {
+            cgu::tf::ControlPoint p;
+            p.val = rng() % 4 == 0 ? static_cast<float>(rng() % 10) / 9.0f : value(rng);
+            p.rgba = glm::vec4(value(rng), value(rng), value(rng), value(rng));
+            tf.InsertControlPoint(p);
+        }
+
+        // ascending (as for the texture) or random values, some on the control points.
+        std::vector<float> vals(2000);
+        for (std::size_t j = 0; j < vals.size(); ++j)
+            vals[j] = i % 2 == 0 ? static_cast<float>(j) / static_cast<float>(vals.size() - 1) : value(rng);
+        if (i % 3 == 0) {
+            for (unsigned int k = 0; k < 50; ++k) vals[rng() % vals.size()] = static_cast<float>(rng() % 10) / 9.0f;
+        }
+
+        std::vector<glm::vec4> batch(vals.size());
+        tf.RGBA(vals.data(), batch.data(), vals.size());
+        for (std::size_t j = 0; j < vals.size(); ++j) {
+            auto reference = rgbaLinearScan(tf.points(), vals[j]);
+            ASSERT_TRUE(bitEqual(reference, tf.RGBA(vals[j]))) << "function " << i << ", value " << vals[j];
+            ASSERT_TRUE(bitEqual(reference, batch[j])) << "function " << i << ", batch value " << vals[j];
+        }
+    }
+}
+
+TEST(TransferFunction, TextureDataMatchesLinearScan)
+{
+    std::mt19937 rng(11);
+    unsigned int numPoints[] = { 1, 2, 8, 1024 };
+    for (auto n : numPoints) {
+        auto tf = createEvenTransferFunction(n, rng);
+        std::vector<glm::vec4> texData(4096);
+        tf.CreateTextureData(texData.data(), static_cast<int>(texData.size()));
+        for (std::size_t i = 0; i < texData.size(); ++i) {
+            auto x = static_cast<float>(i) / static_cast<float>(texData.size() - 1);
+            ASSERT_TRUE(bitEqual(rgbaLinearScan(tf.points(), x), texData[i])) << n << " points, texel " << i;
+        }
+    }
+}
+
+TEST(TransferFunction, EmptySpaceDataMatchesIsTransparent)
+{
+    // transparent stretches between the control points, so texel ranges and summary cells are partly transparent.
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> value(0.0f, 1.0f);
+    const int resolution = 100;
+    for (auto run = 0; run < 20; ++run) {
+        cgu::tf::TransferFunction tf(64);
+        for (auto i = 0; i < 6; ++i) {
+            cgu::tf::ControlPoint p;
+            p.val = value(rng);
+            p.rgba = glm::vec4(value(rng), value(rng), value(rng), i % 2 == 0 ? 0.0f : value(rng));
+            tf.InsertControlPoint(p);
+        }
+        std::vector<float> emptySpaceData(resolution);
+        tf.CreateEmptySpaceData(emptySpaceData.data(), resolution);
+
+        auto texelValue = [](int i) { return static_cast<float>(i) / static_cast<float>(resolution - 1); };
+        auto numTransparent = 0;
+        for (auto lo = 0; lo < resolution; ++lo) {
+            for (auto hi = lo; hi < resolution; ++hi) {
+                auto transparent = emptySpaceData[lo] > static_cast<float>(hi);
+                if (transparent) ++numTransparent;
+                ASSERT_EQ(tf.IsTransparent(texelValue(std::max(lo - 1, 0)), texelValue(std::min(hi + 1, resolution - 1))),
+                    transparent) << "run " << run << ", texels " << lo << " to " << hi;
+            }
+        }
+        EXPECT_LT(0, numTransparent) << "run " << run;
+    }
+}
+
+TEST(TransferFunction, PreIntegratedDataMatchesNumericalIntegration)
+{
+    std::mt19937 rng(5);
+    const int resolution = 64;
+    const float stepLength = 0.8f;
+    auto tf = createEvenTransferFunction(12, rng);
+    std::vector<glm::vec4> texData(resolution), table(resolution * resolution);
+    tf.CreateTextureData(texData.data(), resolution);
+    tf.CreatePreIntegratedData(table.data(), resolution, stepLength);
+
+    // midpoint rule over the linearly interpolated texels between front and back.
+    const int numSamples = 4096;
+    for (auto b = 0; b < resolution; b += 3) {
+        for (auto f = 0; f < resolution; f += 5) {
+            glm::dvec4 average(0.0);
+            if (f == b) {
+                glm::dvec4 c(texData[f]);
+                average = glm::dvec4(glm::dvec3(c) * c.a, c.a);
+            } else {
+                for (auto i = 0; i < numSamples; ++i) {
+                    auto x = f + (b - f) * (i + 0.5) / numSamples;
+                    auto i0 = glm::min(static_cast<int>(x), resolution - 2);
+                    auto c = glm::mix(glm::dvec4(texData[i0]), glm::dvec4(texData[i0 + 1]), x - i0);
+                    average += glm::dvec4(glm::dvec3(c) * c.a, c.a) / static_cast<double>(numSamples);
+                }
+            }
+            auto alpha = 1.0 - std::exp(-stepLength * average.a);
+            glm::dvec4 expected(average.a > 0.0 ? glm::dvec3(average) * (alpha / average.a) : glm::dvec3(0.0), alpha);
+            const auto& texel = table[b * resolution + f];
+            for (auto k = 0; k < 4; ++k) EXPECT_NEAR(expected[k], texel[k], 1e-6) << "front " << f << ", back " << b;
+        }
+    }
+
+    auto asyncTable = tf.CreatePreIntegratedDataAsync(resolution, stepLength).get();
+    ASSERT_EQ(table.size(), asyncTable.size());
+    EXPECT_EQ(0, std::memcmp(table.data(), asyncTable.data(), table.size() * sizeof(glm::vec4)));
+}
+
+TEST(TransferFunction, PreIntegratedDataComposesSteps)
+{
+    // for a constant value two steps of a length are one step of twice the length.
+    std::mt19937 rng(6);
+    const int resolution = 32;
+    auto tf = createEvenTransferFunction(8, rng);
+    std::vector<glm::vec4> table(resolution * resolution), doubleTable(resolution * resolution);
+    tf.CreatePreIntegratedData(table.data(), resolution, 0.5f);
+    tf.CreatePreIntegratedData(doubleTable.data(), resolution, 1.0f);
+    for (auto i = 0; i < resolution; ++i) {
+        const auto& step = table[i * resolution + i];
+        auto twoSteps = step + (1.0f - step.a) * step;
+        const auto& doubleStep = doubleTable[i * resolution + i];
+        for (auto k = 0; k < 4; ++k) EXPECT_NEAR(twoSteps[k], doubleStep[k], 1e-6f) << "texel " << i;
+    }
+}
+
+TEST(TransferFunction, DISABLED_BenchmarkRGBA)
+{
+    std::mt19937 rng(3);
+    const std::size_t numValues = 1 << 16;
+    std::uniform_real_distribution<float> value(0.0f, 1.0f);
+    std::vector<float> ascending(numValues), random(numValues);
+    for (std::size_t i = 0; i < numValues; ++i) {
+        ascending[i] = static_cast<float>(i) / static_cast<float>(numValues - 1);
+        random[i] = value(rng);
+    }
+    std::vector<glm::vec4> result(numValues);
+    volatile float sink = 0.0f;
+
+    auto toNS = [numValues](double ms) { return 1.0e6 * ms / static_cast<double>(numValues); };
+    std::cout << "ns per value, evenly spaced control points:" << std::endl;
+    std::cout << std::setw(8) << "points" << std::setw(14) << "linear scan" << std::setw(14) << "RGBA"
+        << std::setw(14) << "batch asc" << std::setw(14) << "batch random" << std::endl;
+    unsigned int numPoints[] = { 8, 32, 128, 512, 1024 };
+    for (auto n : numPoints) {
+        auto tf = createEvenTransferFunction(n, rng);
+        auto scanMS = test_help::measureMS(5, [&]() {
+            for (std::size_t i = 0; i < numValues; ++i) result[i] = rgbaLinearScan(tf.points(), random[i]);
+            sink = result[numValues / 2].x;
+        });
+        auto singleMS = test_help::measureMS(5, [&]() {
+            for (std::size_t i = 0; i < numValues; ++i) result[i] = tf.RGBA(random[i]);
+            sink = result[numValues / 2].x;
+        });
+        auto ascendingMS = test_help::measureMS(5, [&]() {
+            tf.RGBA(ascending.data(), result.data(), numValues);
+            sink = result[numValues / 2].x;
+        });
+        auto randomMS = test_help::measureMS(5, [&]() {
+            tf.RGBA(random.data(), result.data(), numValues);
+            sink = result[numValues / 2].x;
+        });
+        std::cout << std::fixed << std::setprecision(1) << std::setw(8) << n << std::setw(14) << toNS(scanMS)
+            << std::setw(14) << toNS(singleMS) << std::setw(14) << toNS(ascendingMS) << std::setw(14) << toNS(randomMS)
+            << std::endl;
+    }
+}
+
+TEST(TransferFunction, DISABLED_BenchmarkPreIntegratedData)
+{
+    std::mt19937 rng(3);
+    auto tf = createEvenTransferFunction(32, rng);
+    int resolutions[] = { 256, 4096 };
+    for (auto resolution : resolutions) {
+        std::vector<glm::vec4> table(static_cast<std::size_t>(resolution) * resolution);
+        auto ms = test_help::measureMS(resolution > 1024 ? 3 : 20, [&]() {
+            tf.CreatePreIntegratedData(table.data(), resolution, 1.0f);
+        });
+        auto tableMB = table.size() * sizeof(glm::vec4) / (1024 * 1024);
+        std::cout << "pre-integration table " << resolution << "^2 (" << tableMB << " MB): " << std::fixed
+            << std::setprecision(2) << ms << " ms" << std::endl;
+    }
+}
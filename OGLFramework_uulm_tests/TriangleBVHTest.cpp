@@ -0,0 +1,313 @@
+/**
+ * @file   TriangleBVHTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the triangle BVH and batched point location and benchmarks the BVH against the former
+ *         boost::geometry rtree.
+ */
+
+#include "test_helper.h"
+#include "gfx/TriangleBVH.h"
+#include "gfx/Mesh.h"
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Holds the number of bytes currently allocated by CountingAllocator. */
+    std::size_t countedBytes = 0;
+
+    /** Allocator counting the allocated bytes, used to measure the memory of the rtree. */
+    template<typename T> struct CountingAllocator
+    {
+        typedef T value_type;
+        typedef T* pointer;
+        typedef const T* const_pointer;
+        typedef T& reference;
+        typedef const T& const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+        template<typename U> struct rebind { typedef CountingAllocator<U> other; };
+
+        CountingAllocator() {}
+        template<typename U> CountingAllocator(const CountingAllocator<U>&) {}
+
+        T* allocate(std::size_t n)
+        {
+            countedBytes += n * sizeof(T);
+            return std::allocator<T>().allocate(n);
+        }
+
+        void deallocate(T* p, std::size_t n)
+        {
+            countedBytes -= n * sizeof(T);
+            std::allocator<T>().deallocate(p, n);
+        }
+
+        template<typename U> bool operator==(const CountingAllocator<U>&) const { return true; }
+        template<typename U> bool operator!=(const CountingAllocator<U>&) const { return false; }
+    };
+
+    namespace bg = boost::geometry;
+    typedef bg::model::point<float, 3, bg::cs::cartesian> point;
+    typedef bg::model::box<point> box;
+    typedef std::pair<box, unsigned> polyIdxBox;
+    /** The rtree sub-meshes used before the BVH (with the same parameters). */
+    typedef bg::index::rtree<polyIdxBox, bg::index::quadratic<16>, bg::index::indexable<polyIdxBox>,
+        bg::index::equal_to<polyIdxBox>, CountingAllocator<polyIdxBox>> RTreeType;
+
+    /**
+     * Returns a point on the tilted plane the test triangles lie in (the plane is not axis aligned as the rtree
+     * does not find points on the faces of flat boxes).
+     */
+    glm::vec3 planePoint(float x, float z, float offset)
+    {
+        return glm::vec3(x, 0.25f * x + 0.125f * z + offset, z);
+    }
+
+    /** Creates a jittered grid of triangles covering [0, size]^2 in x and z plus some overlapping ones. */
+    std::vector<cguMath::Tri3<float>> createTriangles(unsigned int size)
+    {
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+        std::vector<glm::vec3> grid;
+        for (unsigned int z = 0; z <= size; ++z) {
+            for (unsigned int x = 0; x <= size; ++x) {
+                auto border = x == 0 || z == 0 || x == size || z == size;
+                grid.push_back(planePoint(static_cast<float>(x) + (border ? 0.0f : jitter(rng)),
+                    static_cast<float>(z) + (border ? 0.0f : jitter(rng)), 0.0f));
+            }
+        }
+
+        std::vector<cguMath::Tri3<float>> tris;
+        for (unsigned int z = 0; z < size; ++z) {
+            for (unsigned int x = 0; x < size; ++x) {
+                auto i = z * (size + 1) + x;
+                tris.push_back(cguMath::Tri3<float>{ { grid[i], grid[i + 1], grid[i + size + 2] } });
+                tris.push_back(cguMath::Tri3<float>{ { grid[i], grid[i + size + 2], grid[i + size + 1] } });
+            }
+        }
+
+        // large triangles overlapping the grid above it.
+        std::uniform_real_distribution<float> pos(0.0f, static_cast<float>(size));
+        for (unsigned int i = 0; i < size; ++i) {
+            auto x = pos(rng), z = pos(rng);
+            tris.push_back(cguMath::Tri3<float>{ { planePoint(x, z, 1.0f), planePoint(x + 5.0f, z, 1.0f),
+                planePoint(x, z + 5.0f, 1.0f) } });
+        }
+        return tris;
+    }
+
+    /** Creates random query points on the grid plane and the plane of the overlapping triangles. */
+    std::vector<glm::vec3> createQueries(unsigned int size, unsigned int numQueries)
+    {
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<float> pos(-1.0f, static_cast<float>(size) + 1.0f);
+        std::vector<glm::vec3> queries;
+        for (unsigned int i = 0; i < numQueries; ++i) {
+            auto x = pos(rng), z = pos(rng);
+            queries.push_back(planePoint(x, z, i % 4 == 0 ? 1.0f : 0.0f));
+        }
+        return queries;
+    }
+
+    /** Gives the tests access to creating the geometry information of meshes and the scalar point location. */
+    class PointLocationTestMesh : public cgu::Mesh
+    {
+    public:
+        using Mesh::CreateGeomertyInfo;
+        using Mesh::FindContainingTriangleAll;
+    };
+
+    /**
+     * Creates a mesh of a jittered grid on the test plane split into three objects (the first one in the mesh
+     * itself) and large triangles overlapping it in a fourth object.
+     */
+    void createPointLocationMesh(PointLocationTestMesh& mesh, unsigned int size)
+    {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+        for (unsigned int z = 0; z <= size; ++z) {
+            for (unsigned int x = 0; x <= size; ++x) {
+                mesh.vertices.push_back(glm::vec4(planePoint(static_cast<float>(x) + jitter(rng),
+                    static_cast<float>(z) + jitter(rng), 0.0f), 1.0f));
+            }
+        }
+
+        std::vector<cgu::SubMesh*> objects{ &mesh, mesh.createSubMesh("object1"), mesh.createSubMesh("object2"),
+            mesh.createSubMesh("overlapping") };
+        auto addTriangle = [](cgu::SubMesh* submesh, unsigned int v0, unsigned int v1, unsigned int v2) {
+            submesh->trianglePtsIndices.push_back(cgu::MeshConnectTriangle(std::array<unsigned int, 3>{ { v0, v1, v2 } }));
+        };
+        for (unsigned int z = 0; z < size; ++z) {
+            for (unsigned int x = 0; x < size; ++x) {
+                auto i = z * (size + 1) + x;
+                addTriangle(objects[(3 * z) / size], i, i + 1, i + size + 2);
+                addTriangle(objects[(3 * z) / size], i, i + size + 2, i + size + 1);
+            }
+        }
+
+        std::uniform_real_distribution<float> pos(0.0f, static_cast<float>(size));
+        for (unsigned int i = 0; i < size; ++i) {
+            auto x = pos(rng), z = pos(rng);
+            auto first = static_cast<unsigned int>(mesh.vertices.size());
+            mesh.vertices.push_back(glm::vec4(planePoint(x, z, 1.0f), 1.0f));
+            mesh.vertices.push_back(glm::vec4(planePoint(x + 5.0f, z, 1.0f), 1.0f));
+            mesh.vertices.push_back(glm::vec4(planePoint(x, z + 5.0f, 1.0f), 1.0f));
+            addTriangle(objects[3], first, first + 1, first + 2);
+        }
+        mesh.CreateGeomertyInfo(1);
+    }
+
+    /** Builds the rtree the way the sub-meshes did before the BVH. */
+    void buildRTree(RTreeType& rtree, const std::vector<cguMath::Tri3<float>>& tris, unsigned int firstTriIndex)
+    {
+        for (unsigned int i = 0; i < tris.size(); ++i) {
+            auto bMin = glm::min(glm::min(tris[i][0], tris[i][1]), tris[i][2]);
+            auto bMax = glm::max(glm::max(tris[i][0], tris[i][1]), tris[i][2]);
+            rtree.insert(std::make_pair(box(point(bMin.x, bMin.y, bMin.z), point(bMax.x, bMax.y, bMax.z)),
+                firstTriIndex + i));
+        }
+    }
+
+    /** Finds a triangle with the rtree the way the sub-meshes did before the BVH. */
+    int findRTree(const RTreeType& rtree, const std::vector<cguMath::Tri3<float>>& tris, unsigned int firstTriIndex,
+        const glm::vec3& pt)
+    {
+        std::vector<polyIdxBox> hits;
+        rtree.query(bg::index::contains(point(pt.x, pt.y, pt.z)), std::back_inserter(hits));
+        for (const auto& polyBox : hits) {
+            if (cguMath::pointInTriangleTest<float>(tris[polyBox.second - firstTriIndex], pt, nullptr)) {
+                return static_cast<int>(polyBox.second);
+            }
+        }
+        return -1;
+    }
+}
+
+TEST(TriangleBVH, MatchesBruteForce)
+{
+    const unsigned int size = 60;
+    const unsigned int firstTriIndex = 17;
+    auto tris = createTriangles(size);
+    cgu::TriangleBVH bvh;
+    bvh.Build(tris, firstTriIndex);
+
+    auto numFound = 0;
+    for (const auto& pt : createQueries(size, 5000)) {
+        auto bruteForce = -1;
+        for (unsigned int i = 0; i < tris.size() && bruteForce == -1; ++i) {
+            if (cguMath::pointInTriangleTest<float>(tris[i], pt, nullptr)) bruteForce = static_cast<int>(i);
+        }
+
+        // points on shared edges are in several triangles, any of them is a valid result.
+        auto result = bvh.FindContainingTriangle(pt);
+        ASSERT_EQ(bruteForce == -1, result == -1);
+        if (result != -1) {
+            ASSERT_GE(result, static_cast<int>(firstTriIndex));
+            ASSERT_LT(result - firstTriIndex, tris.size());
+            EXPECT_TRUE(cguMath::pointInTriangleTest<float>(tris[result - firstTriIndex], pt, nullptr));
+            ++numFound;
+        }
+    }
+    EXPECT_GT(numFound, 0);
+
+    bvh.Clear();
+    EXPECT_EQ(-1, bvh.FindContainingTriangle(planePoint(1.0f, 1.0f, 0.0f)));
+}
+
+TEST(TriangleBVH, BatchedPointLocationMatchesScalar)
+{
+    const unsigned int size = 60;
+    PointLocationTestMesh mesh;
+    createPointLocationMesh(mesh, size);
+
+    // random points on both planes (some outside the grid), points on triangle edges and vertices and points
+    // off the planes.
+    auto points = createQueries(size, 12000);
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<std::size_t> triIdx(0, mesh.triangleConnect.size() - 1);
+    std::uniform_real_distribution<float> t(0.0f, 1.0f);
+    for (unsigned int i = 0; i < 6000; ++i) {
+        const auto& tri = mesh.triangleConnect[triIdx(rng)];
+        auto v0 = mesh.vertices[tri.vertex[i % 3]].xyz();
+        auto v1 = mesh.vertices[tri.vertex[(i + 1) % 3]].xyz();
+        points.push_back(i % 5 == 0 ? v0 : glm::mix(v0, v1, t(rng)));
+    }
+    std::uniform_real_distribution<float> pos(-10.0f, static_cast<float>(size) + 10.0f);
+    for (unsigned int i = 0; i < 2000; ++i) points.push_back(planePoint(pos(rng), pos(rng), i % 2 == 0 ? 0.5f : -3.0f));
+
+    std::vector<int> scalarIds(points.size());
+    std::vector<glm::vec3> scalarBarycentrics(points.size(), glm::vec3(0.0f));
+    auto numFound = 0U;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        scalarIds[i] = mesh.FindContainingTriangleAll(points[i]);
+        if (scalarIds[i] == -1) continue;
+        ++numFound;
+        const auto& tri = mesh.triangleConnect[scalarIds[i]];
+        cguMath::Tri3<float> triPts{ { mesh.vertices[tri.vertex[0]].xyz(), mesh.vertices[tri.vertex[1]].xyz(),
+            mesh.vertices[tri.vertex[2]].xyz() } };
+        scalarBarycentrics[i] = cguMath::barycentricCoordinates(triPts, points[i]);
+    }
+    EXPECT_LT(0U, numFound);
+    EXPECT_GT(points.size(), numFound);
+
+    unsigned int threadCounts[] = { 1, 4, 7 };
+    for (auto numThreads : threadCounts) {
+        std::vector<int> ids;
+        std::vector<glm::vec3> barycentrics;
+        mesh.FindContainingTriangles(points, ids, barycentrics, numThreads);
+        ASSERT_EQ(points.size(), ids.size());
+        ASSERT_EQ(points.size(), barycentrics.size());
+        auto numMismatches = 0U;
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (ids[i] != scalarIds[i] || barycentrics[i] != scalarBarycentrics[i]) ++numMismatches;
+        }
+        EXPECT_EQ(0U, numMismatches) << numThreads << " threads";
+    }
+}
+
+TEST(TriangleBVH, DISABLED_BenchmarkAgainstRTree)
+{
+    const unsigned int size = 400;
+    auto tris = createTriangles(size);
+    auto queries = createQueries(size, 200000);
+
+    cgu::TriangleBVH bvh;
+    auto bvhBuildMS = test_help::measureMS(3, [&]() { bvh.Build(tris, 0); });
+    auto bvhResults = 0ll;
+    auto bvhQueryMS = test_help::measureMS(3, [&]() {
+        bvhResults = 0;
+        for (const auto& pt : queries) bvhResults += bvh.FindContainingTriangle(pt) != -1 ? 1 : 0;
+    });
+
+    std::unique_ptr<RTreeType> rtree;
+    auto rtreeBuildMS = test_help::measureMS(3, [&]() {
+        rtree.reset();
+        rtree.reset(new RTreeType());
+        buildRTree(*rtree, tris, 0);
+    });
+    auto rtreeBytes = countedBytes;
+    auto rtreeResults = 0ll;
+    auto rtreeQueryMS = test_help::measureMS(3, [&]() {
+        rtreeResults = 0;
+        for (const auto& pt : queries) rtreeResults += findRTree(*rtree, tris, 0, pt) != -1 ? 1 : 0;
+    });
+    EXPECT_EQ(rtreeResults, bvhResults);
+
+    std::cout << tris.size() << " triangles, " << queries.size() << " queries:" << std::endl;
+    std::cout << "  BVH:   build " << bvhBuildMS << " ms, queries " << bvhQueryMS << " ms, "
+        << bvh.GetMemorySize() / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << "  rtree: build " << rtreeBuildMS << " ms, queries " << rtreeQueryMS << " ms, "
+        << rtreeBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+}
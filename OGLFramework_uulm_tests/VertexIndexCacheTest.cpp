@@ -0,0 +1,229 @@
+/**
+ * @file   VertexIndexCacheTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the map for deduplicating .obj vertices and benchmarks it against the former per position
+ *         lists of vertices.
+ */
+
+#include "test_helper.h"
+#include "gfx/VertexIndexCache.h"
+#include "gfx/Vertices.h"
+
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <tuple>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** The vertex data the index triples refer to. */
+    struct VertexData
+    {
+        /** Holds the positions. */
+        std::vector<glm::vec3> positions;
+        /** Holds the texture coordinates. */
+        std::vector<glm::vec2> texCoords;
+        /** Holds the normals. */
+        std::vector<glm::vec3> normals;
+        /** Holds the index triple of each face vertex use. */
+        std::vector<cgu::ObjVertexIndex> uses;
+    };
+
+    /** Creates a face vertex from its index triple. */
+    cgu::FaceVertex createFaceVertex(const VertexData& data, const cgu::ObjVertexIndex& key)
+    {
+        cgu::FaceVertex fv;
+        fv.pos = data.positions[key.pos - 1];
+        if (key.tex != 0) fv.tex = data.texCoords[key.tex - 1];
+        if (key.normal != 0) fv.normal = data.normals[key.normal - 1];
+        return fv;
+    }
+
+    /**
+     * Creates a grid of triangles, each position is used by up to six triangles.
+     * @param size the number of positions per side.
+     * @param flatShaded if every triangle has its own normal (so each position has up to six different vertices).
+     */
+    VertexData createGrid(unsigned int size, bool flatShaded, std::mt19937& rng)
+    {
+        VertexData data;
+        std::uniform_real_distribution<float> height(-1.0f, 1.0f);
+        for (unsigned int i = 0; i < size * size; ++i) {
+            data.positions.push_back(glm::vec3(static_cast<float>(i % size), static_cast<float>(i / size), height(rng)));
+            data.texCoords.push_back(glm::vec2(data.positions.back()) / static_cast<float>(size));
+        }
+        for (unsigned int y = 0; y + 1 < size; ++y) {
+            for (unsigned int x = 0; x + 1 < size; ++x) {
+                auto i = static_cast<int>(y * size + x) + 1;
+                int triangles[2][3] = { { i, i + 1, i + static_cast<int>(size) },
+                    { i + 1, i + static_cast<int>(size) + 1, i + static_cast<int>(size) } };
+                for (auto& tri : triangles) {
+                    if (flatShaded) data.normals.push_back(glm::vec3(0.0f, height(rng), 1.0f));
+                    for (auto v : tri) {
+                        cgu::ObjVertexIndex idx;
+                        idx.pos = v;
+                        idx.tex = v;
+                        idx.normal = flatShaded ? static_cast<int>(data.normals.size()) : 0;
+                        data.uses.push_back(idx);
+                    }
+                }
+            }
+        }
+        return data;
+    }
+
+    /**
+     * Creates triangle fans around hub positions with a texture seam at every triangle of the hub: each hub
+     * position has as many different vertices as triangles around it, the ring positions are shared by two
+     * triangles with the same vertex.
+     * @param numHubs the number of hub positions.
+     * @param valence the number of triangles around each hub.
+     */
+    VertexData createSeamFans(unsigned int numHubs, unsigned int valence, std::mt19937& rng)
+    {
+        VertexData data;
+        std::uniform_real_distribution<float> coord(-1.0f, 1.0f);
+        for (unsigned int h = 0; h < numHubs; ++h) {
+            auto hub = static_cast<int>(data.positions.size()) + 1;
+            auto firstTex = static_cast<int>(data.texCoords.size()) + 1;
+            data.positions.push_back(glm::vec3(coord(rng), coord(rng), coord(rng)));
+            for (unsigned int i = 0; i < valence; ++i) data.positions.push_back(glm::vec3(coord(rng), coord(rng), 0.0f));
+            for (unsigned int i = 0; i < 2 * valence; ++i) data.texCoords.push_back(glm::vec2(coord(rng), coord(rng)));
+            for (int i = 0; i < static_cast<int>(valence); ++i) {
+                auto next = (i + 1) % static_cast<int>(valence);
+                cgu::ObjVertexIndex tri[3];
+                tri[0].pos = hub;
+                tri[0].tex = firstTex + valence + i;
+                tri[1].pos = hub + 1 + i;
+                tri[1].tex = firstTex + i;
+                tri[2].pos = hub + 1 + next;
+                tri[2].tex = firstTex + next;
+                data.uses.insert(data.uses.end(), tri, tri + 3);
+            }
+        }
+        return data;
+    }
+
+    /** An entry of the former per position lists of vertices. */
+    struct CacheEntry
+    {
+        /** Holds the vertex index. */
+        int index;
+        /** Holds the next entry with the same position. */
+        std::unique_ptr<CacheEntry> next;
+    };
+
+    /**
+     * The former deduplication: a list of the vertices created for each position, compared by their data.
+     * @return the vertex index of each use.
+     */
+    std::vector<unsigned int> deduplicateWithLists(const VertexData& data, std::vector<cgu::FaceVertex>& vertices)
+    {
+        std::vector<std::unique_ptr<CacheEntry>> cache(data.positions.size());
+        std::vector<unsigned int> ids;
+        ids.reserve(data.uses.size());
+        for (const auto& use : data.uses) {
+            auto fv = createFaceVertex(data, use);
+            auto entry = &cache[use.pos - 1];
+            while (*entry && !(vertices[(*entry)->index] == fv)) entry = &(*entry)->next;
+            if (!*entry) {
+                entry->reset(new CacheEntry());
+                (*entry)->index = static_cast<int>(vertices.size());
+                vertices.push_back(fv);
+            }
+            ids.push_back(static_cast<unsigned int>((*entry)->index));
+        }
+        return ids;
+    }
+
+    /**
+     * The deduplication by index triples the parser uses.
+     * @return the vertex index of each use.
+     */
+    std::vector<unsigned int> deduplicateWithCache(const VertexData& data, std::vector<cgu::FaceVertex>& vertices)
+    {
+        cgu::VertexIndexCache cache(1, static_cast<int>(data.positions.size()) + 1);
+        std::vector<unsigned int> ids;
+        ids.reserve(data.uses.size());
+        for (const auto& use : data.uses) {
+            auto idx = cache.FindOrInsert(use, static_cast<unsigned int>(vertices.size()));
+            if (idx.second) vertices.push_back(createFaceVertex(data, use));
+            ids.push_back(idx.first);
+        }
+        return ids;
+    }
+}
+
+TEST(VertexIndexCache, MatchesMap)
+{
+    std::mt19937 rng(17);
+    const int firstPos = 1000, endPos = 4000;
+    std::map<std::tuple<int, int, int>, unsigned int> reference;
+    cgu::VertexIndexCache cache(firstPos, endPos);
+    for (unsigned int i = 0; i < 200000; ++i) {
+        // few texture coordinates and normals per position give many seams and repeated triples.
+        cgu::ObjVertexIndex key;
+        key.pos = firstPos + static_cast<int>(rng() % (endPos - firstPos));
+        key.tex = static_cast<int>(rng() % 4);
+        key.normal = static_cast<int>(rng() % 3);
+        auto newIndex = static_cast<unsigned int>(reference.size());
+        auto expected = reference.insert(std::make_pair(std::make_tuple(key.pos, key.tex, key.normal), newIndex));
+        auto actual = cache.FindOrInsert(key, newIndex);
+        ASSERT_EQ(expected.second, actual.second) << "key " << i;
+        ASSERT_EQ(expected.first->second, actual.first) << "key " << i;
+    }
+    EXPECT_EQ(reference.size(), cache.GetSize());
+}
+
+TEST(VertexIndexCache, SameVerticesAsLists)
+{
+    std::mt19937 rng(19);
+    VertexData inputs[] = { createGrid(40, false, rng), createGrid(40, true, rng), createSeamFans(20, 16, rng) };
+    for (const auto& data : inputs) {
+        std::vector<cgu::FaceVertex> listVertices, cacheVertices;
+        auto listIds = deduplicateWithLists(data, listVertices);
+        auto cacheIds = deduplicateWithCache(data, cacheVertices);
+        EXPECT_TRUE(listIds == cacheIds);
+        ASSERT_EQ(listVertices.size(), cacheVertices.size());
+        for (std::size_t i = 0; i < listVertices.size(); ++i) EXPECT_TRUE(listVertices[i] == cacheVertices[i]);
+    }
+}
+
+TEST(VertexIndexCache, DISABLED_Benchmark)
+{
+    std::mt19937 rng(3);
+    std::pair<const char*, VertexData> inputs[] = {
+        std::make_pair("grid, smooth", createGrid(1000, false, rng)),
+        std::make_pair("grid, flat shaded", createGrid(1000, true, rng)),
+        std::make_pair("fans, valence 8", createSeamFans(250000, 8, rng)),
+        std::make_pair("fans, valence 64", createSeamFans(30000, 64, rng)) };
+
+    std::cout << "ns per face vertex use:" << std::endl;
+    std::cout << std::setw(20) << "mesh" << std::setw(10) << "uses" << std::setw(10) << "vertices" << std::setw(10)
+        << "lists" << std::setw(10) << "map" << std::endl;
+    for (const auto& input : inputs) {
+        const auto& data = input.second;
+        std::size_t numVertices = 0;
+        auto listMS = test_help::measureMS(3, [&]() {
+            std::vector<cgu::FaceVertex> vertices;
+            deduplicateWithLists(data, vertices);
+            numVertices = vertices.size();
+        });
+        auto cacheMS = test_help::measureMS(3, [&]() {
+            std::vector<cgu::FaceVertex> vertices;
+            deduplicateWithCache(data, vertices);
+        });
+        auto toNS = [&data](double ms) { return 1.0e6 * ms / static_cast<double>(data.uses.size()); };
+        std::cout << std::setw(20) << input.first << std::setw(10) << data.uses.size() << std::setw(10) << numVertices
+            << std::fixed << std::setprecision(1) << std::setw(10) << toNS(listMS) << std::setw(10) << toNS(cacheMS)
+            << std::endl;
+    }
+}
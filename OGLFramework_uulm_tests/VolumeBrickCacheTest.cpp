@@ -0,0 +1,125 @@
+/**
+ * @file   VolumeBrickCacheTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests when the brick cache hashes the .raw file.
+ */
+
+#include "gfx/volumes/VolumeBrickCache.h"
+#include "gfx/volumes/VolumeMinMaxBuilder.h"
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+    /** Holds the hash of the test .raw file. */
+    const std::uint64_t testRawHash = 0x0123456789abcdefull;
+
+    /** Returns the key of the test volume. */
+    cgu::VolumeBrickCacheKey createKey(std::int64_t rawWriteTime)
+    {
+        cgu::VolumeBrickCacheKey key;
+        key.headerHash = 42;
+        key.rawSize = 1 << 20;
+        key.rawWriteTime = rawWriteTime;
+        key.rawHash = 0;
+        key.maxBrickSize = 64;
+        key.bytesPerVoxel = 1;
+        return key;
+    }
+
+    /** Returns the data of a test brick with all mip levels. */
+    std::vector<uint8_t> createBrickData(const glm::uvec3& texSize, unsigned int bytesPP)
+    {
+        std::size_t size = 0;
+        for (unsigned int level = 0; level < cgu::VolumeMinMaxBuilder::CalculateNumMipLevels(texSize); ++level) {
+            auto mipSize = cgu::VolumeMinMaxBuilder::CalculateMipSize(texSize, level);
+            size += static_cast<std::size_t>(mipSize.x) * mipSize.y * mipSize.z * bytesPP;
+        }
+        std::vector<uint8_t> data(size);
+        for (std::size_t i = 0; i < size; ++i) data[i] = static_cast<uint8_t>(i * 7);
+        return data;
+    }
+
+    /** Creates the cache file names in the temporary directory and removes the files afterwards. */
+    class VolumeBrickCacheTest : public ::testing::Test
+    {
+    protected:
+        VolumeBrickCacheTest() :
+            cacheFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string()),
+            texSize(8, 8, 8),
+            desc(4, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE),
+            numHashes(0)
+        {}
+
+        ~VolumeBrickCacheTest()
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(cacheFilename, ec);
+        }
+
+        /** Opens the cache and counts the hashes of the .raw file. */
+        std::unique_ptr<cgu::VolumeBrickCache> OpenCache(std::int64_t rawWriteTime, std::uint64_t rawHash)
+        {
+            return std::unique_ptr<cgu::VolumeBrickCache>(new cgu::VolumeBrickCache(cacheFilename,
+                createKey(rawWriteTime), [this, rawHash]() { ++numHashes; return rawHash; }, false));
+        }
+
+        /** Holds the name of the cache file. */
+        std::string cacheFilename;
+        /** Holds the size of the test brick. */
+        glm::uvec3 texSize;
+        /** Holds the texture descriptor of the test brick. */
+        cgu::TextureDescriptor desc;
+        /** Holds the number of times the .raw file was hashed. */
+        unsigned int numHashes;
+    };
+}
+
+TEST_F(VolumeBrickCacheTest, HashesRawFileOnlyIfChanged)
+{
+    auto brickData = createBrickData(texSize, desc.bytesPP);
+    {
+        auto cache = OpenCache(1000, testRawHash);
+        ASSERT_FALSE(cache->IsComplete());
+        cache->StoreBrick(texSize, desc, brickData);
+        cache->Finish();
+        EXPECT_EQ(1u, numHashes);
+    }
+
+    // warm start: same size and write time, the stored hash is used.
+    numHashes = 0;
+    {
+        auto cache = OpenCache(1000, testRawHash);
+        ASSERT_TRUE(cache->IsComplete());
+        EXPECT_EQ(0u, numHashes);
+        cgu::TextureDescriptor readDesc(0, 0, 0, 0);
+        auto brickId = cache->GetNextBrick(texSize, readDesc);
+        std::vector<uint8_t> readData(cache->GetBrickDataSize(brickId)), buffer;
+        cache->ReadBrick(brickId, readData.data(), buffer);
+        EXPECT_TRUE(readData == brickData);
+    }
+
+    // touched but unchanged file: hashed once, then the new write time is stored.
+    {
+        auto cache = OpenCache(2000, testRawHash);
+        EXPECT_TRUE(cache->IsComplete());
+        EXPECT_EQ(1u, numHashes);
+    }
+    numHashes = 0;
+    {
+        auto cache = OpenCache(2000, testRawHash);
+        EXPECT_TRUE(cache->IsComplete());
+        EXPECT_EQ(0u, numHashes);
+    }
+
+    // changed file: the hash differs and the volume is bricked again.
+    {
+        auto cache = OpenCache(3000, testRawHash + 1);
+        EXPECT_FALSE(cache->IsComplete());
+        EXPECT_EQ(1u, numHashes);
+    }
+}
@@ -0,0 +1,94 @@
+/**
+ * @file   VolumeBrickLodTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the screen space error level of detail selection for volume bricks.
+ */
+
+#include "gfx/volumes/VolumeBrickLod.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+    /** Holds the vertical field of view used by the tests. */
+    const float testFovY = 60.0f;
+
+    /** Returns the matrix mapping the unit cube to a brick of the given size at the origin. */
+    glm::mat4 brickLocalWorld(float size)
+    {
+        glm::mat4 localWorld(1.0f);
+        localWorld[0][0] = localWorld[1][1] = localWorld[2][2] = size;
+        return localWorld;
+    }
+
+    /** Returns the screen space error of a brick of size 1 with 64^3 voxels seen from the given distance in z. */
+    float testBrickError(float distance, float screenHeight)
+    {
+        return cgu::cguOctreeMath::brickScreenError(brickLocalWorld(1.0f), glm::vec3(64.0f),
+            glm::vec3(0.5f, 0.5f, 1.0f + distance), testFovY, screenHeight);
+    }
+}
+
+TEST(VolumeBrickLod, ScreenErrorIsProjectedVoxelSize)
+{
+    const float screenHeight = 1080.0f;
+    auto pixelsPerUnit = screenHeight / (2.0f * std::tan(0.5f * glm::radians(testFovY)));
+    EXPECT_FLOAT_EQ(pixelsPerUnit / (64.0f * 2.0f), testBrickError(2.0f, screenHeight));
+    EXPECT_FLOAT_EQ(2.0f * testBrickError(4.0f, screenHeight), testBrickError(2.0f, screenHeight));
+
+    // the largest voxel counts for non uniform bricks.
+    auto error = cgu::cguOctreeMath::brickScreenError(brickLocalWorld(1.0f), glm::vec3(64.0f, 32.0f, 64.0f),
+        glm::vec3(0.5f, 0.5f, 3.0f), testFovY, screenHeight);
+    EXPECT_FLOAT_EQ(2.0f * testBrickError(2.0f, screenHeight), error);
+
+    EXPECT_EQ(std::numeric_limits<float>::infinity(), cgu::cguOctreeMath::brickScreenError(brickLocalWorld(1.0f),
+        glm::vec3(64.0f), glm::vec3(0.5f), testFovY, screenHeight));
+}
+
+TEST(VolumeBrickLod, NoFlipInsideHysteresisBand)
+{
+    cgu::BrickLodSettings settings(1080.0f, 1.0f, 0.25f);
+    auto lower = settings.pixelError * (1.0f - settings.hysteresis);
+    auto upper = settings.pixelError * (1.0f + settings.hysteresis);
+    // inside [lower, upper] both states are kept.
+    for (auto error = 0.0f; error <= 2.0f; error += 1.0f / 64.0f) {
+        // a selected brick is only refined above the band.
+        EXPECT_EQ(error <= upper, cgu::cguOctreeMath::isBrickLodSufficient(error, true, settings)) << error;
+        // a refined brick is only selected again below the band.
+        EXPECT_EQ(error <= lower, cgu::cguOctreeMath::isBrickLodSufficient(error, false, settings)) << error;
+    }
+}
+
+TEST(VolumeBrickLod, CameraJitterDoesNotPop)
+{
+    cgu::BrickLodSettings settings(1080.0f, 1.0f, 0.25f);
+    // the distance at which the brick error equals the threshold.
+    auto thresholdDistance = 2.0f * testBrickError(2.0f, settings.screenHeight) / settings.pixelError;
+    ASSERT_FLOAT_EQ(settings.pixelError, testBrickError(thresholdDistance, settings.screenHeight));
+
+    // moving back and forth by 10% of the distance stays inside the band in both states.
+    bool initialStates[] = { true, false };
+    for (auto initial : initialStates) {
+        auto sufficient = initial;
+        for (unsigned int frame = 0; frame < 100; ++frame) {
+            auto distance = thresholdDistance * (frame % 2 == 0 ? 0.9f : 1.1f);
+            sufficient = cgu::cguOctreeMath::isBrickLodSufficient(testBrickError(distance, settings.screenHeight),
+                sufficient, settings);
+            EXPECT_EQ(initial, sufficient) << "frame " << frame;
+        }
+    }
+
+    // moving beyond the band flips the selection exactly once in each direction.
+    auto sufficient = true;
+    sufficient = cgu::cguOctreeMath::isBrickLodSufficient(testBrickError(thresholdDistance * 0.7f,
+        settings.screenHeight), sufficient, settings);
+    EXPECT_FALSE(sufficient);
+    sufficient = cgu::cguOctreeMath::isBrickLodSufficient(testBrickError(thresholdDistance * 1.1f,
+        settings.screenHeight), sufficient, settings);
+    EXPECT_FALSE(sufficient);
+    sufficient = cgu::cguOctreeMath::isBrickLodSufficient(testBrickError(thresholdDistance * 1.5f,
+        settings.screenHeight), sufficient, settings);
+    EXPECT_TRUE(sufficient);
+}
@@ -0,0 +1,145 @@
+/**
+ * @file   VolumeBrickPrefetchTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the camera prediction and the bookkeeping of prefetched bricks.
+ */
+
+#include "gfx/volumes/VolumeBrickPrefetch.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+    /** Expects two matrices to be equal up to a tolerance. */
+    void expectMatrixNear(const glm::mat4& expected, const glm::mat4& actual, float tolerance)
+    {
+        for (int c = 0; c < 4; ++c) {
+            for (int r = 0; r < 4; ++r) EXPECT_NEAR(expected[c][r], actual[c][r], tolerance) << "column " << c << ", row " << r;
+        }
+    }
+
+    /**
+     * Returns the view of a camera after some frames of constant motion.
+     * @param camera the camera (camera to world) in the first frame.
+     * @param frameMotion the motion of each frame relative to the camera.
+     * @param frame the frame.
+     */
+    glm::mat4 movedView(const glm::mat4& camera, const glm::mat4& frameMotion, unsigned int frame)
+    {
+        auto movedCamera = camera;
+        for (unsigned int i = 0; i < frame; ++i) movedCamera = movedCamera * frameMotion;
+        return glm::inverse(movedCamera);
+    }
+}
+
+TEST(VolumeBrickPrefetch, PredictsConstantTranslation)
+{
+    cgu::VolumeBrickPrefetch prefetch;
+    const glm::vec3 center(0.5f), up(0.0f, 1.0f, 0.0f), velocity(0.02f, -0.01f, 0.05f);
+    for (unsigned int frame = 0; frame < 3; ++frame) {
+        auto offset = static_cast<float>(frame) * velocity;
+        prefetch.AddCameraSample(glm::lookAt(glm::vec3(2.0f, 1.0f, 3.0f) + offset, center + offset, up));
+    }
+
+    const unsigned int framesAhead = 5;
+    glm::mat4 predictedView;
+    ASSERT_TRUE(prefetch.PredictView(framesAhead, predictedView));
+    auto offset = static_cast<float>(2 + framesAhead) * velocity;
+    expectMatrixNear(glm::lookAt(glm::vec3(2.0f, 1.0f, 3.0f) + offset, center + offset, up), predictedView, 1e-4f);
+}
+
+TEST(VolumeBrickPrefetch, PredictsConstantYaw)
+{
+    cgu::VolumeBrickPrefetch prefetch;
+    auto camera = glm::inverse(glm::lookAt(glm::vec3(2.0f, 1.0f, 3.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    auto yaw = glm::rotate(glm::mat4(), glm::radians(3.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    prefetch.AddCameraSample(movedView(camera, yaw, 0));
+    prefetch.AddCameraSample(movedView(camera, yaw, 1));
+
+    glm::mat4 predictedView;
+    ASSERT_TRUE(prefetch.PredictView(10, predictedView));
+    expectMatrixNear(movedView(camera, yaw, 11), predictedView, 1e-4f);
+    // the camera turns in place.
+    auto predictedCamera = glm::inverse(predictedView);
+    for (int i = 0; i < 3; ++i) EXPECT_NEAR(camera[3][i], predictedCamera[3][i], 1e-4f);
+}
+
+TEST(VolumeBrickPrefetch, PredictsTranslationWithYaw)
+{
+    // moving forward while turning follows a circle.
+    cgu::VolumeBrickPrefetch prefetch;
+    auto camera = glm::inverse(glm::lookAt(glm::vec3(0.0f, 0.5f, 4.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    auto frameMotion = glm::rotate(glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -0.1f)), glm::radians(2.0f),
+        glm::vec3(0.0f, 1.0f, 0.0f));
+    for (unsigned int frame = 0; frame < 4; ++frame) prefetch.AddCameraSample(movedView(camera, frameMotion, frame));
+
+    for (unsigned int framesAhead = 0; framesAhead <= 8; framesAhead += 4) {
+        glm::mat4 predictedView;
+        ASSERT_TRUE(prefetch.PredictView(framesAhead, predictedView));
+        expectMatrixNear(movedView(camera, frameMotion, 3 + framesAhead), predictedView, 1e-4f);
+    }
+}
+
+TEST(VolumeBrickPrefetch, StillCameraPredictsNothing)
+{
+    cgu::VolumeBrickPrefetch prefetch;
+    glm::mat4 predictedView;
+    EXPECT_FALSE(prefetch.PredictView(4, predictedView));
+
+    auto view = glm::lookAt(glm::vec3(2.0f, 1.0f, 3.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    prefetch.AddCameraSample(view);
+    EXPECT_FALSE(prefetch.PredictView(4, predictedView));
+    prefetch.AddCameraSample(view);
+    EXPECT_FALSE(prefetch.PredictView(4, predictedView));
+
+    // a moving camera that stops.
+    prefetch.AddCameraSample(glm::translate(view, glm::vec3(0.1f, 0.0f, 0.0f)));
+    EXPECT_TRUE(prefetch.PredictView(4, predictedView));
+    prefetch.AddCameraSample(glm::translate(view, glm::vec3(0.1f, 0.0f, 0.0f)));
+    EXPECT_FALSE(prefetch.PredictView(4, predictedView));
+}
+
+TEST(VolumeBrickPrefetch, UpdateRequestsReturnsStaleRequests)
+{
+    cgu::VolumeBrickPrefetch prefetch;
+    EXPECT_TRUE(prefetch.UpdateRequests({ 5, 3, 9 }).empty());
+    EXPECT_EQ(std::vector<unsigned int>({ 5 }), prefetch.UpdateRequests({ 9, 1, 3 }));
+    EXPECT_TRUE(prefetch.UpdateRequests({ 3, 9, 1, 12 }).empty());
+    EXPECT_EQ(std::vector<unsigned int>({ 1, 3, 9, 12 }), prefetch.UpdateRequests({}));
+    EXPECT_TRUE(prefetch.UpdateRequests({ 2 }).empty());
+}
+
+TEST(VolumeBrickPrefetch, CountsHitsAndWastedLoads)
+{
+    cgu::VolumeBrickPrefetch prefetch;
+    for (unsigned int i = 0; i < 5; ++i) prefetch.RecordRequest();
+    prefetch.RecordCancel();
+    prefetch.RecordLoad(1);
+    prefetch.RecordLoad(2);
+    prefetch.RecordLoad(3);
+    prefetch.RecordLoad(4);
+    EXPECT_EQ(0.0f, prefetch.GetStats().GetHitRate());
+
+    prefetch.RecordUse(1);
+    // a second use, the use of a brick that was not prefetched and its eviction are not counted.
+    prefetch.RecordUse(1);
+    prefetch.RecordUse(7);
+    prefetch.RecordEviction(7);
+    // a used brick is not wasted when it is evicted.
+    prefetch.RecordEviction(1);
+    prefetch.RecordEviction(2);
+    prefetch.RecordEviction(2);
+    prefetch.RecordUse(2);
+    prefetch.RecordUse(3);
+
+    const auto& stats = prefetch.GetStats();
+    EXPECT_EQ(5u, stats.numRequests);
+    EXPECT_EQ(1u, stats.numCancelled);
+    EXPECT_EQ(4u, stats.numLoaded);
+    EXPECT_EQ(2u, stats.numHits);
+    EXPECT_EQ(1u, stats.numWasted);
+    EXPECT_FLOAT_EQ(0.5f, stats.GetHitRate());
+}
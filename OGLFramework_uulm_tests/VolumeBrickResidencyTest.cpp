@@ -0,0 +1,131 @@
+/**
+ * @file   VolumeBrickResidencyTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the residency policy of the volume bricks.
+ */
+
+#include "gfx/volumes/VolumeBrickResidency.h"
+
+#include <gtest/gtest.h>
+
+namespace {
+
+    /** Holds the memory of a test brick. */
+    const std::size_t brickSize = 100;
+
+    /** Inserts bricks and releases them in the given order. */
+    void insertReleased(cgu::VolumeBrickResidency& residency, const std::vector<unsigned int>& brickIds)
+    {
+        for (auto brickId : brickIds) residency.Insert(brickId, brickSize);
+        for (auto brickId : brickIds) residency.Release(brickId);
+    }
+}
+
+TEST(VolumeBrickResidency, EvictsLeastRecentlyReleasedFirst)
+{
+    cgu::VolumeBrickResidency residency(3 * brickSize);
+    insertReleased(residency, { 4, 2, 7, 1 });
+    EXPECT_EQ(std::vector<unsigned int>({ 4 }), residency.CollectEvictions());
+
+    // using a brick again moves it to the end of the order once it is released.
+    EXPECT_TRUE(residency.Use(2));
+    residency.Release(2);
+    residency.SetBudget(brickSize);
+    EXPECT_EQ(std::vector<unsigned int>({ 7, 1 }), residency.CollectEvictions());
+    EXPECT_TRUE(residency.Use(2));
+    EXPECT_EQ(brickSize, residency.GetStats().residentSize);
+}
+
+TEST(VolumeBrickResidency, NeverEvictsPinnedBricks)
+{
+    cgu::VolumeBrickResidency residency(0);
+    residency.Insert(1, brickSize);
+    residency.Insert(2, brickSize);
+    residency.Insert(3, brickSize);
+    residency.Release(2);
+
+    EXPECT_EQ(std::vector<unsigned int>({ 2 }), residency.CollectEvictions());
+    EXPECT_TRUE(residency.CollectEvictions().empty());
+    // the budget stays exceeded by the pinned bricks.
+    EXPECT_EQ(2 * brickSize, residency.GetStats().residentSize);
+    EXPECT_TRUE(residency.Use(1));
+    EXPECT_TRUE(residency.Use(3));
+}
+
+TEST(VolumeBrickResidency, UsePinsReleasedBrick)
+{
+    cgu::VolumeBrickResidency residency(0);
+    insertReleased(residency, { 5 });
+    EXPECT_TRUE(residency.Use(5));
+    EXPECT_TRUE(residency.CollectEvictions().empty());
+
+    residency.Release(5);
+    EXPECT_EQ(std::vector<unsigned int>({ 5 }), residency.CollectEvictions());
+    EXPECT_FALSE(residency.Use(5));
+}
+
+TEST(VolumeBrickResidency, InsertReplacesResidentBrick)
+{
+    cgu::VolumeBrickResidency residency(1000);
+    residency.Insert(3, brickSize);
+    residency.Insert(3, 40);
+    EXPECT_EQ(40u, residency.GetStats().residentSize);
+
+    // a released brick inserted again is pinned and only counted once.
+    residency.Release(3);
+    residency.Insert(3, 60);
+    EXPECT_EQ(60u, residency.GetStats().residentSize);
+    residency.SetBudget(0);
+    EXPECT_TRUE(residency.CollectEvictions().empty());
+    residency.Release(3);
+    EXPECT_EQ(std::vector<unsigned int>({ 3 }), residency.CollectEvictions());
+    EXPECT_EQ(0u, residency.GetStats().residentSize);
+}
+
+TEST(VolumeBrickResidency, SetBudgetAppliesOnCollect)
+{
+    cgu::VolumeBrickResidency residency(10 * brickSize);
+    insertReleased(residency, { 1, 2, 3, 4, 5 });
+    EXPECT_TRUE(residency.CollectEvictions().empty());
+
+    residency.SetBudget(2 * brickSize + brickSize / 2);
+    EXPECT_EQ(2 * brickSize + brickSize / 2, residency.GetStats().budget);
+    EXPECT_EQ(5 * brickSize, residency.GetStats().residentSize);
+    EXPECT_EQ(std::vector<unsigned int>({ 1, 2, 3 }), residency.CollectEvictions());
+    EXPECT_EQ(2 * brickSize, residency.GetStats().residentSize);
+
+    // a larger budget does not bring evicted bricks back.
+    residency.SetBudget(10 * brickSize);
+    EXPECT_TRUE(residency.CollectEvictions().empty());
+    EXPECT_FALSE(residency.Use(1));
+    EXPECT_TRUE(residency.Use(4));
+}
+
+TEST(VolumeBrickResidency, CountsHitsMissesEvictionsAndPeak)
+{
+    cgu::VolumeBrickResidency residency(2 * brickSize);
+    EXPECT_FALSE(residency.Use(1));
+    residency.Insert(1, brickSize);
+    EXPECT_FALSE(residency.Use(2));
+    residency.Insert(2, brickSize);
+    EXPECT_FALSE(residency.Use(3));
+    residency.Insert(3, brickSize);
+    residency.Release(1);
+    residency.Release(2);
+    EXPECT_TRUE(residency.Use(2));
+    EXPECT_TRUE(residency.Use(3));
+    EXPECT_EQ(std::vector<unsigned int>({ 1 }), residency.CollectEvictions());
+    residency.Remove(3);
+    // the peak stays when the resident memory grows again below it.
+    residency.Insert(4, brickSize / 2);
+
+    const auto& stats = residency.GetStats();
+    EXPECT_EQ(2u, stats.numHits);
+    EXPECT_EQ(3u, stats.numMisses);
+    EXPECT_EQ(1u, stats.numEvictions);
+    EXPECT_EQ(brickSize + brickSize / 2, stats.residentSize);
+    EXPECT_EQ(3 * brickSize, stats.peakResidentSize);
+    EXPECT_EQ(2 * brickSize, stats.budget);
+}
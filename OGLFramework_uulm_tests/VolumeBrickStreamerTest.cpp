@@ -0,0 +1,356 @@
+/**
+ * @file   VolumeBrickStreamerTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the brick streamer against an upload sink with plain staging memory.
+ */
+
+#include "gfx/volumes/VolumeBrickCache.h"
+#include "gfx/volumes/VolumeBrickStreamer.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+namespace {
+
+    /** Holds the size of the test bricks. */
+    const glm::uvec3 texSize(16, 16, 16);
+    /** Holds the size of the data of a test brick. */
+    const std::size_t brickDataSize = 16 * 16 * 16;
+    /** Holds the offset of the first brick in the cache file (the header padded to the brick alignment). */
+    const std::size_t firstBrickOffset = 64;
+    /** Holds the value the staging memory is initialized with. */
+    const uint8_t stagingFill = 0xab;
+
+    /** An upload issued by the streamer. */
+    struct MockUpload
+    {
+        /** Holds the id of the brick. */
+        unsigned int brickId;
+        /** Holds the staging slot. */
+        unsigned int slot;
+        /** Holds the content of the staging slot when the upload was issued. */
+        std::vector<uint8_t> data;
+    };
+
+    /** The state of the mock sink, shared with the test as the streamer owns the sink. */
+    struct MockSinkState
+    {
+        explicit MockSinkState(unsigned int numSlots) :
+            slots(numSlots, std::vector<uint8_t>(brickDataSize, stagingFill)),
+            slotBusy(numSlots, false),
+            blockReads(false),
+            numReads(0)
+        {}
+
+        /** Holds the mutex protecting the state. */
+        std::mutex mutex;
+        /** Holds the condition blocked reads wait on. */
+        std::condition_variable readsReleased;
+        /** Holds the staging memory. */
+        std::vector<std::vector<uint8_t>> slots;
+        /** Holds whether the GPU is still reading a slot (set by uploads, cleared by the test). */
+        std::vector<bool> slotBusy;
+        /** Holds whether reads wait until the test releases them. */
+        bool blockReads;
+        /** Holds the number of reads started (calls to GetStagingMemory). */
+        unsigned int numReads;
+        /** Holds the uploads issued. */
+        std::vector<MockUpload> uploads;
+    };
+
+    /** Upload sink with plain staging memory, reads can be blocked and the GPU is finished when the test says so. */
+    class MockUploadSink : public cgu::BrickUploadSink
+    {
+    public:
+        explicit MockUploadSink(std::shared_ptr<MockSinkState> state) : state(std::move(state)) {}
+
+        void* GetStagingMemory(unsigned int slot) override
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            ++state->numReads;
+            state->readsReleased.wait(lock, [this]() { return !state->blockReads; });
+            return state->slots[slot].data();
+        }
+
+        void UploadBrick(unsigned int brickId, unsigned int slot, std::size_t size) override
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            EXPECT_FALSE(state->slotBusy[slot]);
+            state->slotBusy[slot] = true;
+            const auto& data = state->slots[slot];
+            state->uploads.push_back(MockUpload{ brickId, slot, std::vector<uint8_t>(data.begin(), data.begin() + size) });
+        }
+
+        bool IsStagingSlotFree(unsigned int slot) override
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            return !state->slotBusy[slot];
+        }
+
+    private:
+        /** Holds the shared state. */
+        std::shared_ptr<MockSinkState> state;
+    };
+
+    /** Returns the data of a test brick, each brick has its own ramp. */
+    std::vector<uint8_t> createBrickData(unsigned int brickId)
+    {
+        std::vector<uint8_t> data(brickDataSize);
+        for (std::size_t i = 0; i < brickDataSize; ++i) data[i] = static_cast<uint8_t>(i + 17 * brickId);
+        return data;
+    }
+
+    /** Creates the cache file and the mock sink and waits for the streamer. */
+    class VolumeBrickStreamerTest : public ::testing::Test
+    {
+    protected:
+        VolumeBrickStreamerTest() :
+            cacheFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string())
+        {}
+
+        ~VolumeBrickStreamerTest()
+        {
+            streamer.reset();
+            cache.reset();
+            boost::system::error_code ec;
+            boost::filesystem::remove(cacheFilename, ec);
+        }
+
+        /** Writes a complete cache with the test bricks. */
+        void WriteCache(unsigned int numBricks, bool compressBricks)
+        {
+            cgu::VolumeBrickCache writeCache(cacheFilename, createKey(), []() { return std::uint64_t(1); }, compressBricks);
+            ASSERT_FALSE(writeCache.IsComplete());
+            cgu::TextureDescriptor desc(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+            for (unsigned int i = 0; i < numBricks; ++i) writeCache.StoreBrick(texSize, desc, createBrickData(i));
+            writeCache.Finish();
+        }
+
+        /** Opens the cache and starts the streamer with a number of staging slots. */
+        void StartStreamer(unsigned int numStagingSlots)
+        {
+            cache = std::make_shared<cgu::VolumeBrickCache>(cacheFilename, createKey(),
+                []() { return std::uint64_t(1); }, false);
+            ASSERT_TRUE(cache->IsComplete());
+            sink = std::make_shared<MockSinkState>(numStagingSlots);
+            streamer.reset(new cgu::VolumeBrickStreamer(cache,
+                std::unique_ptr<cgu::BrickUploadSink>(new MockUploadSink(sink)), numStagingSlots));
+        }
+
+        /** Blocks or releases the reads of the I/O thread. */
+        void BlockReads(bool block)
+        {
+            {
+                std::lock_guard<std::mutex> lock(sink->mutex);
+                sink->blockReads = block;
+            }
+            sink->readsReleased.notify_all();
+        }
+
+        /** Marks the GPU as finished reading from a staging slot. */
+        void FinishSlot(unsigned int slot)
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            sink->slotBusy[slot] = false;
+        }
+
+        /** Waits until the I/O thread started a number of reads, returns false after a timeout. */
+        bool WaitForReads(unsigned int numReads)
+        {
+            return WaitFor([this, numReads]() { return sink->numReads >= numReads; });
+        }
+
+        /** Updates the streamer until a number of uploads were issued, returns false after a timeout. */
+        bool WaitForUploads(std::size_t numUploads)
+        {
+            return WaitFor([this, numUploads]() { return sink->uploads.size() >= numUploads; }, true);
+        }
+
+        /** Returns the ids of the uploaded bricks in upload order. */
+        std::vector<unsigned int> GetUploadedIds()
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            std::vector<unsigned int> ids;
+            for (const auto& upload : sink->uploads) ids.push_back(upload.brickId);
+            return ids;
+        }
+
+        /** Holds the name of the cache file. */
+        std::string cacheFilename;
+        /** Holds the brick cache. */
+        std::shared_ptr<cgu::VolumeBrickCache> cache;
+        /** Holds the state of the mock sink. */
+        std::shared_ptr<MockSinkState> sink;
+        /** Holds the streamer. */
+        std::unique_ptr<cgu::VolumeBrickStreamer> streamer;
+
+    private:
+        /** Returns the key of the test cache. */
+        static cgu::VolumeBrickCacheKey createKey()
+        {
+            cgu::VolumeBrickCacheKey key;
+            key.headerHash = 42;
+            key.rawSize = 1 << 20;
+            key.rawWriteTime = 1000;
+            key.rawHash = 0;
+            key.maxBrickSize = texSize.x;
+            key.bytesPerVoxel = 1;
+            return key;
+        }
+
+        /**
+         * Polls a condition on the sink state for up to 5 seconds.
+         * @param condition the condition, evaluated with the sink mutex locked.
+         * @param update whether the streamer is updated (like the render thread does each frame) while waiting.
+         */
+        template<typename Fn> bool WaitFor(Fn condition, bool update = false)
+        {
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (std::chrono::steady_clock::now() < timeout) {
+                if (update) streamer->Update(1);
+                {
+                    std::lock_guard<std::mutex> lock(sink->mutex);
+                    if (condition()) return true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return false;
+        }
+    };
+}
+
+TEST_F(VolumeBrickStreamerTest, PrefetchesAfterRequestsByPriority)
+{
+    WriteCache(6, false);
+    StartStreamer(1);
+
+    // the first request occupies the only slot while the others are queued.
+    BlockReads(true);
+    streamer->RequestBrick(0, 0.0f, false);
+    ASSERT_TRUE(WaitForReads(1));
+    streamer->RequestBrick(1, 1.0f, false);
+    streamer->RequestBrick(2, 3.0f, true);
+    streamer->RequestBrick(3, 2.0f, false);
+    streamer->RequestBrick(4, 5.0f, true);
+    streamer->RequestBrick(5, 4.0f, false);
+    BlockReads(false);
+
+    // the mock GPU finishes each upload immediately, so the slot is reused in the next update.
+    for (std::size_t i = 1; i <= 6; ++i) {
+        ASSERT_TRUE(WaitForUploads(i));
+        FinishSlot(0);
+    }
+    EXPECT_EQ(std::vector<unsigned int>({ 0, 5, 3, 1, 4, 2 }), GetUploadedIds());
+    for (const auto& upload : sink->uploads) {
+        EXPECT_EQ(0u, upload.slot);
+        EXPECT_TRUE(upload.data == createBrickData(upload.brickId)) << "brick " << upload.brickId;
+    }
+
+    auto stats = streamer->GetStats();
+    EXPECT_EQ(6u, stats.numRequested);
+    EXPECT_EQ(6u, stats.numStaged);
+    EXPECT_EQ(6u, stats.numUploaded);
+    EXPECT_EQ(0u, stats.numCancelled);
+}
+
+TEST_F(VolumeBrickStreamerTest, RequestUpgradesPrefetch)
+{
+    WriteCache(4, false);
+    StartStreamer(1);
+
+    BlockReads(true);
+    streamer->RequestBrick(0, 0.0f, false);
+    ASSERT_TRUE(WaitForReads(1));
+    streamer->RequestBrick(1, 1.0f, true);
+    streamer->RequestBrick(2, 5.0f, true);
+    streamer->RequestBrick(3, 2.0f, false);
+    // a regular request turns the prefetch into a regular request, a prefetch does not change a regular request.
+    streamer->RequestBrick(1, 0.5f, false);
+    streamer->RequestBrick(3, 9.0f, true);
+    BlockReads(false);
+
+    for (std::size_t i = 1; i <= 4; ++i) {
+        ASSERT_TRUE(WaitForUploads(i));
+        FinishSlot(0);
+    }
+    EXPECT_EQ(std::vector<unsigned int>({ 0, 3, 1, 2 }), GetUploadedIds());
+    EXPECT_EQ(4u, streamer->GetStats().numRequested);
+}
+
+TEST_F(VolumeBrickStreamerTest, CancelWhileReadingFreesSlot)
+{
+    WriteCache(2, false);
+    StartStreamer(1);
+
+    BlockReads(true);
+    streamer->RequestBrick(0, 1.0f, false);
+    ASSERT_TRUE(WaitForReads(1));
+    streamer->CancelBrick(0);
+    BlockReads(false);
+
+    // the read brick is discarded and its slot is free for the next request.
+    streamer->RequestBrick(1, 1.0f, false);
+    ASSERT_TRUE(WaitForUploads(1));
+    EXPECT_EQ(std::vector<unsigned int>({ 1 }), GetUploadedIds());
+    EXPECT_TRUE(sink->uploads[0].data == createBrickData(1));
+
+    auto stats = streamer->GetStats();
+    EXPECT_EQ(2u, stats.numRequested);
+    EXPECT_EQ(1u, stats.numStaged);
+    EXPECT_EQ(1u, stats.numUploaded);
+    EXPECT_EQ(1u, stats.numCancelled);
+}
+
+TEST_F(VolumeBrickStreamerTest, ReusesSlotAfterGpuFinished)
+{
+    WriteCache(2, false);
+    StartStreamer(1);
+
+    streamer->RequestBrick(0, 1.0f, false);
+    streamer->RequestBrick(1, 0.0f, false);
+    ASSERT_TRUE(WaitForUploads(1));
+
+    // the GPU still reads the only slot: updating must not hand it to the I/O thread.
+    for (unsigned int i = 0; i < 50; ++i) {
+        EXPECT_EQ(0u, streamer->Update(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sink->mutex);
+        EXPECT_EQ(1u, sink->numReads);
+        EXPECT_EQ(1u, sink->uploads.size());
+    }
+
+    FinishSlot(0);
+    ASSERT_TRUE(WaitForUploads(2));
+    EXPECT_EQ(std::vector<unsigned int>({ 0, 1 }), GetUploadedIds());
+    EXPECT_TRUE(sink->uploads[1].data == createBrickData(1));
+}
+
+TEST_F(VolumeBrickStreamerTest, DecodeFailureZeroesSlot)
+{
+    WriteCache(1, true);
+    {
+        // overwrite the start of the compressed brick with maximal lengths.
+        std::fstream cacheFile(cacheFilename, std::ios::in | std::ios::out | std::ios::binary);
+        ASSERT_TRUE(cacheFile.is_open());
+        cacheFile.seekp(firstBrickOffset);
+        for (unsigned int i = 0; i < 8; ++i) cacheFile.put(static_cast<char>(0xff));
+    }
+    StartStreamer(1);
+    std::vector<uint8_t> readData(brickDataSize), buffer;
+    ASSERT_THROW(cache->ReadBrick(0, readData.data(), buffer), std::runtime_error);
+
+    streamer->RequestBrick(0, 1.0f, false);
+    ASSERT_TRUE(WaitForUploads(1));
+    EXPECT_EQ(0u, sink->uploads[0].brickId);
+    EXPECT_TRUE(sink->uploads[0].data == std::vector<uint8_t>(brickDataSize, 0));
+}
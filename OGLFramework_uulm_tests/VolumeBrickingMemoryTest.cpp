@@ -0,0 +1,117 @@
+/**
+ * @file   VolumeBrickingMemoryTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests that bricking a volume larger than the slab budget keeps the resident memory bounded and benchmarks
+ *         bricking.
+ */
+
+#include "test_helper.h"
+#include "app/Configuration.h"
+#include "gfx/volumes/VolumeBrickCache.h"
+#include "gfx/volumes/VolumeBrickLayout.h"
+#include "gfx/volumes/VolumeMinMaxBuilder.h"
+#include "gfx/volumes/VolumeRawSlabReader.h"
+#include "gfx/volumes/VolumeRayCaster.h"
+
+#include <iostream>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Holds the maximum size of a brick. */
+    const unsigned int maxBrickSize = 64;
+    /** Holds the memory allowed for the process beyond the slab and the bricks in flight in MB. */
+    const double memoryOverheadMB = 16.0;
+}
+
+TEST(VolumeBricking, PeakMemoryBoundedBySlabBudget)
+{
+    cgu::Configuration config;
+    config.volumeSlabBudgetMB = 16;
+    const unsigned int numThreads = 4;
+    const glm::uvec3 volumeSize(512, 512, 512);
+    auto volumeMB = static_cast<double>(volumeSize.x) * volumeSize.y * volumeSize.z / (1024.0 * 1024.0);
+    ASSERT_GE(volumeMB, 4.0 * config.volumeSlabBudgetMB);
+
+    auto tempDir = boost::filesystem::temp_directory_path();
+    auto rawFilename = (tempDir / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.raw")).string();
+    auto cacheFilename = (tempDir / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string();
+    test_help::writeSyntheticVolume(rawFilename, volumeSize);
+
+    auto startMB = test_help::currentMemoryMB();
+    test_help::MemorySampler memorySampler;
+    std::size_t numBricks = 0, numLayoutBricks = 0;
+    unsigned int maxLevel = 0;
+    {
+        cgu::VolumeRawSlabReader reader(rawFilename, static_cast<std::size_t>(config.volumeSlabBudgetMB) << 20);
+        cgu::VolumeBrickCacheKey key{ 1, reader.GetFileSize(), reader.GetLastWriteTime(), 0, maxBrickSize, 1 };
+        auto cache = std::make_shared<cgu::VolumeBrickCache>(cacheFilename, key,
+            [&reader]() { return reader.CalculateHash(); }, true);
+        cgu::TextureDescriptor volumeDesc(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE);
+        cgu::VolumeMinMaxBuilder minMaxBuilder(volumeDesc, numThreads);
+        cgu::BrickLayoutSource source{ &reader, volumeSize, 1, 1, maxBrickSize,
+            static_cast<std::size_t>(config.volumeSlabBudgetMB) << 20 };
+        cgu::VolumeBrickLayout layout(source, glm::vec3(1.0f), minMaxBuilder, cache);
+        numBricks = cache->GetNumberOfBricks();
+        maxLevel = layout.GetMaxLevel();
+        std::vector<cgu::RayCastBrick> leaves;
+        layout.GetBricksAtLevel(maxLevel, glm::mat4(), leaves);
+        numLayoutBricks = leaves.size();
+    }
+    auto peakMB = memorySampler.Stop();
+    boost::filesystem::remove(rawFilename);
+    boost::filesystem::remove(cacheFilename);
+
+    // the children of each level wait for their parent with their level 0 min/max data (RGBA8) and combining decodes
+    // two bricks to float channels, the subtrees built in parallel beyond that get the slab budget.
+    auto brickVoxelsMB = static_cast<double>(maxBrickSize * maxBrickSize * maxBrickSize) / (1024.0 * 1024.0);
+    auto brickLevel0MB = 4.0 * brickVoxelsMB;
+    auto bricksInFlightMB = 8.0 * maxLevel * brickLevel0MB + 4.0 * brickLevel0MB + 2.0 * 3.0 * sizeof(float) * brickVoxelsMB
+        + config.volumeSlabBudgetMB;
+
+    EXPECT_LT(numLayoutBricks, numBricks);
+    auto minLeaves = static_cast<std::size_t>(volumeSize.x / maxBrickSize) * (volumeSize.y / maxBrickSize)
+        * (volumeSize.z / maxBrickSize);
+    EXPECT_LE(minLeaves, numLayoutBricks);
+    auto limitMB = startMB + config.volumeSlabBudgetMB + bricksInFlightMB + memoryOverheadMB;
+    std::cout << volumeMB << " MB volume, " << config.volumeSlabBudgetMB << " MB slab budget, " << numThreads
+        << " threads: " << numBricks << " bricks, resident memory " << startMB << " MB before, " << peakMB
+        << " MB peak, limit " << limitMB << " MB." << std::endl;
+    EXPECT_LT(peakMB, limitMB);
+}
+
+TEST(VolumeBricking, DISABLED_BenchmarkBricking)
+{
+    const glm::uvec3 volumeSize(384, 384, 384);
+    const std::size_t budget = static_cast<std::size_t>(256) << 20;
+    auto volumeMB = static_cast<double>(volumeSize.x) * volumeSize.y * volumeSize.z / (1024.0 * 1024.0);
+
+    auto tempDir = boost::filesystem::temp_directory_path();
+    auto rawFilename = (tempDir / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.raw")).string();
+    auto cacheFilename = (tempDir / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string();
+    test_help::writeSyntheticVolume(rawFilename, volumeSize);
+
+    unsigned int threadCounts[] = { 1, 2, 4, std::max(1u, std::thread::hardware_concurrency()) };
+    for (auto numThreads : threadCounts) {
+        auto ms = test_help::measureMS(3, [&]() {
+            cgu::VolumeRawSlabReader reader(rawFilename, budget);
+            cgu::VolumeBrickCacheKey key{ 1, reader.GetFileSize(), reader.GetLastWriteTime(), 0, maxBrickSize, 1 };
+            auto cache = std::make_shared<cgu::VolumeBrickCache>(cacheFilename, key,
+                [&reader]() { return reader.CalculateHash(); }, false);
+            cgu::VolumeMinMaxBuilder minMaxBuilder(cgu::TextureDescriptor(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE), numThreads);
+            cgu::BrickLayoutSource source{ &reader, volumeSize, 1, 1, maxBrickSize, budget };
+            cgu::VolumeBrickLayout layout(source, glm::vec3(1.0f), minMaxBuilder, cache);
+            boost::filesystem::remove(cacheFilename);
+        });
+        std::cout << volumeMB << " MB volume, " << numThreads << " threads: " << ms << " ms, "
+            << volumeMB / (ms / 1000.0) << " MB/s." << std::endl;
+    }
+    boost::filesystem::remove(rawFilename);
+}
@@ -0,0 +1,304 @@
+/**
+ * @file   VolumeMinMaxBuilderTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the min/max pyramids built on the CPU against an emulation of the former compute shaders.
+ */
+
+#include "test_helper.h"
+#include "gfx/volumes/VolumeMinMaxBuilder.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** The formats of the min/max images. */
+    enum class MinMaxFormat { UNORM8, HALF, FLOAT };
+
+    /** Rounds a float to a half float (to nearest even) and returns the bits. */
+    uint16_t referenceFloatToHalf(float value)
+    {
+        if (value == 0.0f) return 0;
+        int exponent;
+        auto mantissa = std::frexp(static_cast<double>(value), &exponent);
+        // normal halfs have 11 significant bits, denormals less.
+        auto significantBits = exponent < -13 ? 11 + (exponent + 13) : 11;
+        auto significand = std::nearbyint(std::ldexp(mantissa, significantBits));
+        if (exponent < -13) return static_cast<uint16_t>(significand);
+        if (significand == 2048.0) {
+            significand = 1024.0;
+            ++exponent;
+        }
+        return static_cast<uint16_t>(((exponent + 14) << 10) | (static_cast<int>(significand) - 1024));
+    }
+
+    /** Returns the float value of a half float. */
+    float referenceHalfToFloat(uint16_t bits)
+    {
+        auto exponent = (bits >> 10) & 0x1F;
+        auto mantissa = bits & 0x3FF;
+        if (exponent == 0) return static_cast<float>(std::ldexp(mantissa, -24));
+        return static_cast<float>(std::ldexp(mantissa + 1024, exponent - 25));
+    }
+
+    /** Converts a float to a stored component (imageStore). */
+    void storeComponent(MinMaxFormat format, float value, uint8_t* data)
+    {
+        if (format == MinMaxFormat::UNORM8) {
+            *data = static_cast<uint8_t>(std::lround(std::min(std::max(value, 0.0f), 1.0f) * 255.0f));
+        } else if (format == MinMaxFormat::HALF) {
+            auto bits = referenceFloatToHalf(value);
+            std::memcpy(data, &bits, sizeof(bits));
+        } else std::memcpy(data, &value, sizeof(value));
+    }
+
+    /** Returns the size of a stored component. */
+    std::size_t componentSize(MinMaxFormat format)
+    {
+        return format == MinMaxFormat::UNORM8 ? 1 : (format == MinMaxFormat::HALF ? 2 : 4);
+    }
+
+    /** Converts a stored component to a float (imageLoad). */
+    float loadComponent(MinMaxFormat format, const uint8_t* data)
+    {
+        if (format == MinMaxFormat::UNORM8) return static_cast<float>(*data) / 255.0f;
+        if (format == MinMaxFormat::HALF) {
+            uint16_t bits;
+            std::memcpy(&bits, data, sizeof(bits));
+            return referenceHalfToFloat(bits);
+        }
+        float value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    /** An RGBA image in its stored format as the shaders access it. */
+    struct ReferenceImage
+    {
+        ReferenceImage(MinMaxFormat format, const glm::uvec3& size) : format(format), size(size),
+            data(static_cast<std::size_t>(size.x) * size.y * size.z * 4 * componentSize(format), 0) {};
+
+        /** Returns the texel at a position clamped to [lower, size - 1]. */
+        glm::vec4 Load(int x, int y, int z, const glm::uvec3& lower) const
+        {
+            x = std::min(std::max(x, static_cast<int>(lower.x)), static_cast<int>(size.x) - 1);
+            y = std::min(std::max(y, static_cast<int>(lower.y)), static_cast<int>(size.y) - 1);
+            z = std::min(std::max(z, static_cast<int>(lower.z)), static_cast<int>(size.z) - 1);
+            auto texel = &data[((static_cast<std::size_t>(z) * size.y + y) * size.x + x) * 4 * componentSize(format)];
+            glm::vec4 result;
+            for (unsigned int c = 0; c < 4; ++c) result[c] = loadComponent(format, texel + c * componentSize(format));
+            return result;
+        }
+
+        /** Stores a texel. */
+        void Store(unsigned int x, unsigned int y, unsigned int z, const glm::vec4& value)
+        {
+            auto texel = &data[((static_cast<std::size_t>(z) * size.y + y) * size.x + x) * 4 * componentSize(format)];
+            for (unsigned int c = 0; c < 4; ++c) storeComponent(format, value[c], texel + c * componentSize(format));
+        }
+
+        /** Holds the format of the image. */
+        MinMaxFormat format;
+        /** Holds the size of the image. */
+        glm::uvec3 size;
+        /** Holds the images data. */
+        std::vector<uint8_t> data;
+    };
+
+    /** Reduces the eight texels read by an invocation as the shaders did (min and max start at 1 and 0). */
+    glm::vec4 reduceTexels(const ReferenceImage& src, const glm::uvec3& readBase, const glm::uvec3& lower)
+    {
+        auto avg = 0.0f;
+        auto minimum = 1.0f;
+        auto maximum = 0.0f;
+        for (unsigned int i = 0; i < 8; ++i) {
+            auto value = src.Load(readBase.x + ((i >> 2) & 1), readBase.y + ((i >> 1) & 1), readBase.z + (i & 1), lower);
+            avg += value.x;
+            minimum = std::min(minimum, value.y);
+            maximum = std::max(maximum, value.z);
+        }
+        avg /= 8.0f;
+        return glm::vec4(avg, minimum, maximum, 0.0f);
+    }
+
+    /** Emulates genMinMaxTexture*.cp: one invocation per texel storing the normalized value in r, g and b. */
+    ReferenceImage genMinMaxTexture(MinMaxFormat format, const std::vector<float>& values, const glm::uvec3& size)
+    {
+        ReferenceImage result(format, size);
+        for (unsigned int z = 0; z < size.z; ++z) {
+            for (unsigned int y = 0; y < size.y; ++y) {
+                for (unsigned int x = 0; x < size.x; ++x) {
+                    auto value = values[(static_cast<std::size_t>(z) * size.y + y) * size.x + x];
+                    result.Store(x, y, z, glm::vec4(value, value, value, 0.0f));
+                }
+            }
+        }
+        return result;
+    }
+
+    /** Emulates genMinMaxMipMaps*.cp for one level. */
+    ReferenceImage genMinMaxMipMaps(const ReferenceImage& orig, const glm::uvec3& nextLevelSize)
+    {
+        ReferenceImage result(orig.format, nextLevelSize);
+        auto ratio = glm::vec3(orig.size) / glm::vec3(nextLevelSize);
+        for (unsigned int z = 0; z < nextLevelSize.z; ++z) {
+            for (unsigned int y = 0; y < nextLevelSize.y; ++y) {
+                for (unsigned int x = 0; x < nextLevelSize.x; ++x) {
+                    glm::uvec3 readBase(static_cast<unsigned int>(static_cast<float>(x) * ratio.x),
+                        static_cast<unsigned int>(static_cast<float>(y) * ratio.y),
+                        static_cast<unsigned int>(static_cast<float>(z) * ratio.z));
+                    result.Store(x, y, z, reduceTexels(orig, readBase, glm::uvec3(0)));
+                }
+            }
+        }
+        return result;
+    }
+
+    /** Emulates a dispatch of combineChildTextures*.cp over the child in groups of 8 (maxChunkSize is the child size). */
+    void combineChildTextures(const ReferenceImage& child, const glm::uvec3& childShift, ReferenceImage& combine)
+    {
+        auto ratio = glm::vec3(child.size) / glm::vec3(combine.size);
+        auto numInvocations = ((child.size + glm::uvec3(7)) / 8u) * 8u;
+        for (unsigned int z = 0; z < numInvocations.z; ++z) {
+            for (unsigned int y = 0; y < numInvocations.y; ++y) {
+                for (unsigned int x = 0; x < numInvocations.x; ++x) {
+                    glm::uvec3 storePos(x + child.size.x * childShift.x, y + child.size.y * childShift.y,
+                        z + child.size.z * childShift.z);
+                    if (storePos.x >= combine.size.x || storePos.y >= combine.size.y || storePos.z >= combine.size.z) continue;
+                    glm::uvec3 readBase(static_cast<unsigned int>(static_cast<float>(x) * ratio.x) + childShift.x,
+                        static_cast<unsigned int>(static_cast<float>(y) * ratio.y) + childShift.y,
+                        static_cast<unsigned int>(static_cast<float>(z) * ratio.z) + childShift.z);
+                    combine.Store(storePos.x, storePos.y, storePos.z, reduceTexels(child, readBase, childShift));
+                }
+            }
+        }
+    }
+
+    /** Returns the data of all levels of a min/max pyramid created by the shaders from level 0. */
+    std::vector<uint8_t> referencePyramid(const ReferenceImage& level0)
+    {
+        auto data = level0.data;
+        auto level = level0;
+        for (unsigned int i = 1; i < cgu::VolumeMinMaxBuilder::CalculateNumMipLevels(level0.size); ++i) {
+            level = genMinMaxMipMaps(level, cgu::VolumeMinMaxBuilder::CalculateMipSize(level0.size, i));
+            data.insert(data.end(), level.data.begin(), level.data.end());
+        }
+        return data;
+    }
+
+    /** Describes the volume types tested. */
+    struct VolumeType
+    {
+        /** Holds the OpenGL type of the volume. */
+        GLenum type;
+        /** Holds the bytes per voxel. */
+        unsigned int bytesPerVoxel;
+        /** Holds the format of the min/max images. */
+        MinMaxFormat format;
+    };
+
+    /** Creates random raw volume data (including the extreme values) and the values normalized as by OpenGL. */
+    void createRawData(const VolumeType& volumeType, const glm::uvec3& size, unsigned int seed,
+        std::vector<uint8_t>& rawData, std::vector<float>& values)
+    {
+        std::mt19937 rng(seed);
+        std::size_t numVoxels = static_cast<std::size_t>(size.x) * size.y * size.z;
+        auto maxValue = volumeType.bytesPerVoxel == 4 ? 4294967295.0 : std::ldexp(1.0, 8 * volumeType.bytesPerVoxel) - 1.0;
+        rawData.resize(numVoxels * volumeType.bytesPerVoxel);
+        values.resize(numVoxels);
+        for (std::size_t i = 0; i < numVoxels; ++i) {
+            std::uint32_t value = rng();
+            if (i % 37 == 0) value = 0;
+            else if (i % 41 == 0) value = 0xFFFFFFFF;
+            value = static_cast<std::uint32_t>(value >> (32 - 8 * volumeType.bytesPerVoxel));
+            // little endian as the volume files.
+            for (unsigned int b = 0; b < volumeType.bytesPerVoxel; ++b) {
+                rawData[i * volumeType.bytesPerVoxel + b] = static_cast<uint8_t>(value >> (8 * b));
+            }
+            values[i] = static_cast<float>(static_cast<double>(value) / maxValue);
+        }
+    }
+
+    /** Returns the index of the first differing byte or -1. */
+    long long firstDifference(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+    {
+        if (a.size() != b.size()) return 0;
+        for (std::size_t i = 0; i < a.size(); ++i) if (a[i] != b[i]) return static_cast<long long>(i);
+        return -1;
+    }
+}
+
+TEST(VolumeMinMaxBuilder, MatchesShaderOutputExactly)
+{
+    const VolumeType volumeTypes[] = { { GL_UNSIGNED_BYTE, 1, MinMaxFormat::UNORM8 },
+        { GL_UNSIGNED_SHORT, 2, MinMaxFormat::HALF }, { GL_UNSIGNED_INT, 4, MinMaxFormat::FLOAT } };
+    unsigned int threadCounts[] = { 1, 4 };
+
+    for (const auto& volumeType : volumeTypes) {
+        for (auto numThreads : threadCounts) {
+            SCOPED_TRACE(testing::Message() << "volume type 0x" << std::hex << volumeType.type << std::dec << ", "
+                << numThreads << " threads");
+            cgu::VolumeMinMaxBuilder builder(cgu::TextureDescriptor(volumeType.bytesPerVoxel, 0, GL_RED, volumeType.type),
+                numThreads);
+
+            // children of different sizes: the parent size (24 + 12) / 2 = 18 gives non integer ratios, the z size
+            // reaches one before the other axes and the 24 texels wide levels use the vectorized reduction.
+            std::vector<ReferenceImage> referenceChildren;
+            std::vector<std::vector<uint8_t>> children;
+            std::vector<cgu::MinMaxChildBrick> childBricks;
+            glm::uvec3 shifts[] = { glm::uvec3(0), glm::uvec3(1) };
+            for (unsigned int i = 0; i < 2; ++i) {
+                auto childSize = shifts[i].x == 0 ? glm::uvec3(24, 20, 4) : glm::uvec3(12, 10, 2);
+                std::vector<uint8_t> rawData;
+                std::vector<float> values;
+                createRawData(volumeType, childSize, i + 1, rawData, values);
+
+                std::vector<uint8_t> brick;
+                builder.CreateMinMaxBrick(rawData, childSize, brick);
+                builder.GenerateMinMaxMaps(childSize, brick);
+                referenceChildren.push_back(genMinMaxTexture(volumeType.format, values, childSize));
+                auto reference = referencePyramid(referenceChildren.back());
+                ASSERT_EQ(-1, firstDifference(reference, brick)) << "leaf brick " << i;
+                children.push_back(std::move(brick));
+            }
+            for (unsigned int i = 0; i < 2; ++i) {
+                childBricks.push_back(cgu::MinMaxChildBrick{ children[i].data(), referenceChildren[i].size, shifts[i] });
+            }
+
+            auto parentSize = (referenceChildren[0].size + referenceChildren[1].size) / 2u;
+            std::vector<uint8_t> parent;
+            builder.CombineChildBricks(childBricks, parentSize, parent);
+            builder.GenerateMinMaxMaps(parentSize, parent);
+            ReferenceImage referenceParent(volumeType.format, parentSize);
+            for (unsigned int i = 0; i < 2; ++i) combineChildTextures(referenceChildren[i], shifts[i], referenceParent);
+            ASSERT_EQ(-1, firstDifference(referencePyramid(referenceParent), parent)) << "parent brick";
+        }
+    }
+}
+
+TEST(VolumeMinMaxBuilder, DISABLED_BenchmarkMipMaps)
+{
+    const glm::uvec3 size(256);
+    std::vector<uint8_t> rawData;
+    std::vector<float> values;
+    createRawData(VolumeType{ GL_UNSIGNED_SHORT, 2, MinMaxFormat::HALF }, size, 3, rawData, values);
+    cgu::VolumeMinMaxBuilder builder(cgu::TextureDescriptor(2, 0, GL_RED, GL_UNSIGNED_SHORT), 1);
+
+    std::vector<uint8_t> level0, brick;
+    builder.CreateMinMaxBrick(rawData, size, level0);
+    auto createMS = test_help::measureMS(3, [&]() { builder.CreateMinMaxBrick(rawData, size, brick); });
+    auto mipMapsMS = test_help::measureMS(3, [&]() {
+        brick = level0;
+        builder.GenerateMinMaxMaps(size, brick);
+    });
+    std::cout << "256^3 16 bit brick, 1 thread: level 0 " << createMS << " ms, mip maps " << mipMapsMS << " ms."
+        << std::endl;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file   VolumeRawSlabReaderTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests and benchmarks the rescaling of 16 bit values and the sub volume reads of the raw slab reader.
+ */
+
+#include "test_helper.h"
+#include "gfx/volumes/VolumeRawSlabReader.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** The scalar rescaling (reference). */
+    void copyScaledUShortsReference(const uint8_t* src, uint8_t* dst, std::size_t count, std::uint16_t scale)
+    {
+        for (std::size_t i = 0; i < count; ++i) {
+            std::uint16_t value;
+            std::memcpy(&value, src + 2 * i, sizeof(value));
+            value = static_cast<std::uint16_t>(value * scale);
+            std::memcpy(dst + 2 * i, &value, sizeof(value));
+        }
+    }
+
+    /** Copies a sub volume voxel by voxel out of the raw data (reference). */
+    void readSubVolumeReference(const std::vector<uint8_t>& raw, const glm::uvec3& volumeSize, unsigned int bytesPerVoxel,
+        const glm::uvec3& pos, const glm::uvec3& dataSize, const glm::uvec3& texSize, std::uint16_t ushortScale,
+        std::vector<uint8_t>& reference)
+    {
+        reference.assign(static_cast<std::size_t>(texSize.x) * texSize.y * texSize.z * bytesPerVoxel, 0);
+        for (unsigned int z = 0; z < dataSize.z; ++z) {
+            for (unsigned int y = 0; y < dataSize.y; ++y) {
+                for (unsigned int x = 0; x < dataSize.x; ++x) {
+                    auto offset = ((static_cast<std::size_t>(pos.z + z) * volumeSize.y + pos.y + y) * volumeSize.x
+                        + pos.x + x) * bytesPerVoxel;
+                    if (offset + bytesPerVoxel > raw.size()) continue;
+                    auto texOffset = ((static_cast<std::size_t>(z) * texSize.y + y) * texSize.x + x) * bytesPerVoxel;
+                    if (ushortScale == 1) std::memcpy(&reference[texOffset], &raw[offset], bytesPerVoxel);
+                    else copyScaledUShortsReference(&raw[offset], &reference[texOffset], 1, ushortScale);
+                }
+            }
+        }
+    }
+}
+
+TEST(VolumeRawSlabReader, CopyScaledUShortsAllValues)
+{
+    std::vector<uint8_t> values(65536 * 2);
+    for (unsigned int i = 0; i < 65536; ++i) {
+        auto value = static_cast<std::uint16_t>(i);
+        std::memcpy(&values[2 * i], &value, sizeof(value));
+    }
+
+    std::uint16_t scales[] = { 0, 1, 2, 3, 16, 255, 4096, 65535 };
+    for (auto scale : scales) {
+        std::vector<uint8_t> result(values.size()), reference(values.size());
+        cgu::VolumeRawSlabReader::CopyScaledUShorts(values.data(), result.data(), 65536, scale);
+        copyScaledUShortsReference(values.data(), reference.data(), 65536, scale);
+        EXPECT_TRUE(result == reference) << "scale " << scale;
+    }
+}
+
+TEST(VolumeRawSlabReader, CopyScaledUShortsUnaligned)
+{
+    std::mt19937 rng(7);
+    std::vector<uint8_t> src(1 << 14);
+    for (auto& c : src) c = static_cast<uint8_t>(rng());
+
+    for (unsigned int i = 0; i < 2000; ++i) {
+        auto srcOffset = rng() % 64, dstOffset = rng() % 64;
+        auto count = rng() % ((src.size() - srcOffset) / 2);
+        auto scale = static_cast<std::uint16_t>(rng());
+        std::vector<uint8_t> result(src.size() + 64, 0xAB), reference(src.size() + 64, 0xAB);
+        cgu::VolumeRawSlabReader::CopyScaledUShorts(src.data() + srcOffset, result.data() + dstOffset, count, scale);
+        copyScaledUShortsReference(src.data() + srcOffset, reference.data() + dstOffset, count, scale);
+        ASSERT_TRUE(result == reference) << "offsets " << srcOffset << ", " << dstOffset << ", count " << count;
+
+        auto inPlace = src, inPlaceReference = src;
+        cgu::VolumeRawSlabReader::CopyScaledUShorts(inPlace.data() + srcOffset, inPlace.data() + srcOffset, count, scale);
+        copyScaledUShortsReference(inPlaceReference.data() + srcOffset, inPlaceReference.data() + srcOffset, count, scale);
+        ASSERT_TRUE(inPlace == inPlaceReference) << "in place, offset " << srcOffset << ", count " << count;
+    }
+}
+
+TEST(VolumeRawSlabReader, ReadSubVolumeScales12BitValues)
+{
+    // a truncated 12 bit volume: the last voxels are missing and stay zero.
+    const glm::uvec3 volumeSize(100, 80, 37);
+    std::mt19937 rng(3);
+    std::vector<uint8_t> raw(static_cast<std::size_t>(volumeSize.x) * volumeSize.y * volumeSize.z * 2 - 1001);
+    for (std::size_t i = 0; i + 1 < raw.size(); i += 2) {
+        auto value = static_cast<std::uint16_t>(rng() & 0xFFF);
+        std::memcpy(&raw[i], &value, sizeof(value));
+    }
+    raw.back() = 0x5;
+    auto rawFilename = (boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.raw")).string();
+    {
+        std::ofstream rawFile(rawFilename, std::ios::binary);
+        rawFile.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+    }
+
+    {
+        // a small slab so the reads move it through the file.
+        cgu::VolumeRawSlabReader reader(rawFilename, 1 << 20);
+        std::vector<uint8_t> data;
+        for (unsigned int i = 0; i < 200; ++i) {
+            glm::uvec3 pos(rng() % volumeSize.x, rng() % volumeSize.y, rng() % volumeSize.z);
+            glm::uvec3 dataSize(1 + rng() % (volumeSize.x - pos.x), 1 + rng() % (volumeSize.y - pos.y),
+                1 + rng() % (volumeSize.z - pos.z));
+            glm::uvec3 texSize(dataSize.x + rng() % 3, dataSize.y + rng() % 3, dataSize.z + rng() % 3);
+
+            std::vector<uint8_t> reference;
+            readSubVolumeReference(raw, volumeSize, 2, pos, dataSize, texSize, 16, reference);
+            reader.ReadSubVolume(data, volumeSize, 2, pos, dataSize, texSize, 16);
+            ASSERT_TRUE(data == reference) << "sub volume " << i;
+        }
+    }
+    boost::filesystem::remove(rawFilename);
+}
+
+TEST(VolumeRawSlabReader, ReadSubVolumeFromMultipleThreads)
+{
+    // a volume of several slabs read at random positions from multiple threads, so the slab is replaced while other
+    // threads copy from it.
+    const glm::uvec3 volumeSize(256, 256, 80);
+    std::mt19937 rng(5);
+    std::vector<uint8_t> raw(static_cast<std::size_t>(volumeSize.x) * volumeSize.y * volumeSize.z);
+    for (auto& value : raw) value = static_cast<uint8_t>(rng());
+    auto rawFilename = (boost::filesystem::temp_directory_path()
+        / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.raw")).string();
+    {
+        std::ofstream rawFile(rawFilename, std::ios::binary);
+        rawFile.write(reinterpret_cast<const char*>(raw.data()), raw.size());
+    }
+
+    {
+        cgu::VolumeRawSlabReader reader(rawFilename, 1 << 20);
+        const unsigned int numThreads = 4;
+        std::vector<unsigned int> numMismatches(numThreads, 0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < numThreads; ++t) {
+            threads.emplace_back([&, t]() {
+                std::mt19937 threadRng(t);
+                std::vector<uint8_t> data, reference;
+                for (unsigned int i = 0; i < 100; ++i) {
+                    glm::uvec3 pos(threadRng() % volumeSize.x, threadRng() % volumeSize.y, threadRng() % volumeSize.z);
+                    glm::uvec3 dataSize(1 + threadRng() % std::min(64u, volumeSize.x - pos.x),
+                        1 + threadRng() % std::min(64u, volumeSize.y - pos.y), 1 + threadRng() % (volumeSize.z - pos.z));
+                    reader.ReadSubVolume(data, volumeSize, 1, pos, dataSize, dataSize, 1);
+                    readSubVolumeReference(raw, volumeSize, 1, pos, dataSize, dataSize, 1, reference);
+                    if (data != reference) ++numMismatches[t];
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        for (unsigned int t = 0; t < numThreads; ++t) EXPECT_EQ(0u, numMismatches[t]) << "thread " << t;
+    }
+    boost::filesystem::remove(rawFilename);
+}
+
+TEST(VolumeRawSlabReader, DISABLED_BenchmarkCopyScaledUShorts)
+{
+    const std::size_t count = 32 << 20;
+    // the scale is only known at run time as for the volumes.
+    volatile std::uint16_t scaleValue = 16;
+    std::uint16_t scale = scaleValue;
+    std::vector<uint8_t> src(2 * count), dst(2 * count);
+    for (std::size_t i = 0; i < count; ++i) {
+        auto value = static_cast<std::uint16_t>(i & 0xFFF);
+        std::memcpy(&src[2 * i], &value, sizeof(value));
+    }
+
+    auto memcpyMS = test_help::measureMS(10, [&]() { std::memcpy(dst.data(), src.data(), src.size()); });
+    auto referenceMS = test_help::measureMS(10, [&]() {
+        copyScaledUShortsReference(src.data(), dst.data(), count, scale);
+    });
+    auto simdMS = test_help::measureMS(10, [&]() {
+        cgu::VolumeRawSlabReader::CopyScaledUShorts(src.data(), dst.data(), count, scale);
+    });
+
+    auto toMBs = [&src](double ms) { return static_cast<double>(src.size()) / (1000.0 * ms); };
+    std::cout << src.size() / (1024 * 1024) << " MB of 12 bit values, scale 16:" << std::endl;
+    std::cout << "  memcpy:            " << toMBs(memcpyMS) << " MB/s" << std::endl;
+    std::cout << "  scalar reference:  " << toMBs(referenceMS) << " MB/s" << std::endl;
+    std::cout << "  CopyScaledUShorts: " << toMBs(simdMS) << " MB/s" << std::endl;
+}
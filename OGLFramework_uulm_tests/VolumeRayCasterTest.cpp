@@ -0,0 +1,403 @@
+/**
+ * @file   VolumeRayCasterTest.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Tests the CPU ray caster against analytic golden images and with and without empty space skipping,
+ *         benchmarks it on a bricked volume.
+ */
+
+#include "test_helper.h"
+#include "gfx/volumes/VolumeBrickCache.h"
+#include "gfx/volumes/VolumeBrickLayout.h"
+#include "gfx/volumes/VolumeMinMaxBuilder.h"
+#include "gfx/volumes/VolumeRawSlabReader.h"
+#include "gfx/volumes/VolumeRayCaster.h"
+#include "volumeScene/TransferFunction.h"
+
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <boost/filesystem.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <gtest/gtest.h>
+
+#undef min
+#undef max
+
+namespace {
+
+    /** Holds the value of the first test brick. */
+    const uint8_t valueA = 64;
+    /** Holds the value of the second test brick. */
+    const uint8_t valueB = 192;
+    /** Holds the color and opacity of the transfer function for values below 0.5 (8 bit exact). */
+    const glm::vec4 colorA(1.0f, 0.0f, 0.0f, 4.0f / 255.0f);
+    /** Holds the color and opacity of the transfer function for values from 0.5 on (8 bit exact). */
+    const glm::vec4 colorB(0.0f, 0.0f, 1.0f, 8.0f / 255.0f);
+
+    /**
+     * Stores two constant bricks of 16^3 texels in a brick cache: brick A covers [0, 1]^3 in world space, brick B
+     * [1, 2] x [0, 1] x [0, 1]. The bricks have no overlap, their texture space is [0, 1]^3.
+     */
+    class VolumeRayCasterTest : public ::testing::Test
+    {
+    protected:
+        VolumeRayCasterTest() :
+            cacheFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string())
+        {
+            cgu::VolumeBrickCacheKey key{ 1, 1, 1, 1, 16, 1 };
+            cache.reset(new cgu::VolumeBrickCache(cacheFilename, key, []() { return std::uint64_t(1); }, false));
+            cgu::VolumeMinMaxBuilder minMaxBuilder(cgu::TextureDescriptor(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE), 1);
+            AddBrick(minMaxBuilder, valueA, glm::vec3(0.0f));
+            AddBrick(minMaxBuilder, valueB, glm::vec3(1.0f, 0.0f, 0.0f));
+            cache->Finish();
+        }
+
+        ~VolumeRayCasterTest()
+        {
+            cache.reset();
+            boost::system::error_code ec;
+            boost::filesystem::remove(cacheFilename, ec);
+        }
+
+        /** Stores a constant brick and adds it at a position in world space. */
+        void AddBrick(const cgu::VolumeMinMaxBuilder& minMaxBuilder, uint8_t value, const glm::vec3& position)
+        {
+            glm::uvec3 texSize(16);
+            std::vector<uint8_t> rawData(static_cast<std::size_t>(texSize.x) * texSize.y * texSize.z, value);
+            std::vector<uint8_t> data;
+            minMaxBuilder.CreateMinMaxBrick(rawData, texSize, data);
+            minMaxBuilder.GenerateMinMaxMaps(texSize, data);
+            const auto& desc = minMaxBuilder.GetBrickTextureDescriptor();
+            auto brickId = cache->StoreBrick(texSize, desc, data);
+            bricks.push_back(cgu::RayCastBrick{ brickId, texSize, glm::vec3(0.0f), glm::vec3(1.0f),
+                glm::translate(glm::mat4(), position), desc });
+        }
+
+        /** Creates a ray caster with a transfer function that is colorA below 0.5 and colorB above (texel exact). */
+        std::unique_ptr<cgu::VolumeRayCaster> CreateRayCaster(unsigned int numThreads) const
+        {
+            std::unique_ptr<cgu::VolumeRayCaster> rayCaster(new cgu::VolumeRayCaster(*cache, bricks, numThreads));
+            cgu::tf::TransferFunction tf;
+            tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.0f, colorA });
+            tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.499f, colorA });
+            tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.501f, colorB });
+            tf.InsertControlPoint(cgu::tf::ControlPoint{ 1.0f, colorB });
+            rayCaster->SetTransferFunction(tf, 256);
+            return rayCaster;
+        }
+
+        /** Holds the name of the cache file. */
+        std::string cacheFilename;
+        /** Holds the brick cache. */
+        std::unique_ptr<cgu::VolumeBrickCache> cache;
+        /** Holds the bricks. */
+        std::vector<cgu::RayCastBrick> bricks;
+    };
+
+    /** Returns the color and opacity of a ray through a constant brick (renderVolume.fp steps of 1 / 512). */
+    glm::vec4 integrateBrick(const glm::vec4& tfColor)
+    {
+        auto alpha = 1.0f - std::pow(1.0f - tfColor.a * 100.0f / 512.0f, 512.0f);
+        return glm::vec4(glm::vec3(tfColor) * alpha, alpha);
+    }
+
+    /** Composites a color and opacity behind another one. */
+    glm::vec4 compositeBehind(const glm::vec4& front, const glm::vec4& back)
+    {
+        return front + (1.0f - front.a) * back;
+    }
+
+    /**
+     * Renders the bricks with an orthographic camera centered on the bricks and compares the image to a golden image.
+     * Pixels are 0.1 wide in world space, so no pixel center lies on a brick border.
+     * @param rayCaster the ray caster.
+     * @param eye the position of the camera.
+     * @param golden returns the golden pixel color for a world position on the plane through the bricks center.
+     */
+    template<class Golden>
+    void expectGoldenImage(const cgu::VolumeRayCaster& rayCaster, const glm::vec3& eye, Golden golden)
+    {
+        const glm::uvec2 imageSize(30, 20);
+        glm::vec3 center(1.0f, 0.5f, 0.5f);
+        auto view = glm::lookAt(eye, center, glm::vec3(0.0f, 1.0f, 0.0f));
+        auto projection = glm::ortho(-1.5f, 1.5f, -1.0f, 1.0f, 1.0f, 10.0f);
+        std::vector<glm::vec4> image;
+        auto stats = rayCaster.Render(view, projection, imageSize, 0.0f, image);
+        EXPECT_EQ(static_cast<std::uint64_t>(imageSize.x) * imageSize.y, stats.numRays);
+
+        auto invView = glm::inverse(view);
+        auto numMismatches = 0u, numCovered = 0u;
+        for (unsigned int y = 0; y < imageSize.y; ++y) {
+            for (unsigned int x = 0; x < imageSize.x; ++x) {
+                auto viewPos = glm::vec2(-1.5f, -1.0f) + (glm::vec2(x, y) + 0.5f) * 0.1f;
+                auto worldPos = glm::vec3(invView * glm::vec4(viewPos, -glm::length(eye - center), 1.0f));
+                auto expected = golden(worldPos);
+                const auto& pixel = image[y * imageSize.x + x];
+                if (expected.a > 0.0f) ++numCovered;
+                if (glm::any(glm::greaterThan(glm::abs(pixel - expected), glm::vec4(1e-4f)))) {
+                    if (numMismatches++ < 5) ADD_FAILURE() << "pixel (" << x << ", " << y << ") is (" << pixel.r << ", "
+                        << pixel.g << ", " << pixel.b << ", " << pixel.a << "), expected (" << expected.r << ", "
+                        << expected.g << ", " << expected.b << ", " << expected.a << ").";
+                }
+            }
+        }
+        EXPECT_EQ(0u, numMismatches);
+        EXPECT_LT(0u, numCovered);
+    }
+
+    /** Returns whether a coordinate lies in (min, max). */
+    bool inside(float value, float min, float max) { return value > min && value < max; }
+
+    /** Writes a .raw file of a volume. */
+    typedef void (*VolumeWriter)(const std::string& filename, const glm::uvec3& size);
+
+    /** Writes a volume falling off linearly from 255 in its center to 0 at a distance of half its width. */
+    void writeRadialVolume(const std::string& filename, const glm::uvec3& size)
+    {
+        std::ofstream file(filename, std::ios::binary);
+        std::vector<uint8_t> slice(static_cast<std::size_t>(size.x) * size.y);
+        auto center = glm::vec3(size) * 0.5f;
+        auto radius = 0.5f * static_cast<float>(size.x);
+        for (unsigned int z = 0; z < size.z; ++z) {
+            for (unsigned int y = 0; y < size.y; ++y) {
+                for (unsigned int x = 0; x < size.x; ++x) {
+                    auto value = glm::max(1.0f - glm::length(glm::vec3(x, y, z) - center) / radius, 0.0f);
+                    slice[static_cast<std::size_t>(y) * size.x + x] = static_cast<uint8_t>(255.0f * value + 0.5f);
+                }
+            }
+            file.write(reinterpret_cast<const char*>(slice.data()), slice.size());
+        }
+    }
+
+    /** Creates the file names of a synthetic volume and its brick cache and removes the files afterwards. */
+    class SyntheticVolumeFiles
+    {
+    public:
+        SyntheticVolumeFiles(const glm::uvec3& volumeSize, VolumeWriter writeVolume) :
+            rawFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.raw")).string()),
+            cacheFilename((boost::filesystem::temp_directory_path()
+                / boost::filesystem::unique_path("cgu_test_%%%%-%%%%.brickcache")).string())
+        {
+            writeVolume(rawFilename, volumeSize);
+        }
+
+        ~SyntheticVolumeFiles()
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(rawFilename, ec);
+            boost::filesystem::remove(cacheFilename, ec);
+        }
+
+        /** Holds the name of the .raw file. */
+        std::string rawFilename;
+        /** Holds the name of the brick cache file. */
+        std::string cacheFilename;
+    };
+
+    /** Bricks a synthetic volume of size^3 voxels headless (from the raw file) and ray casts its leaves. */
+    class SyntheticVolume
+    {
+    public:
+        SyntheticVolume(unsigned int size, unsigned int maxBrickSize, unsigned int numThreads,
+            VolumeWriter writeVolume = test_help::writeSyntheticVolume) :
+            volumeSize(size),
+            files(volumeSize, writeVolume),
+            reader(files.rawFilename, static_cast<std::size_t>(64) << 20),
+            minMaxBuilder(cgu::TextureDescriptor(1, GL_R8, GL_RED, GL_UNSIGNED_BYTE), numThreads)
+        {
+            cgu::VolumeBrickCacheKey key{ 1, reader.GetFileSize(), reader.GetLastWriteTime(), 0, maxBrickSize, 1 };
+            cache = std::make_shared<cgu::VolumeBrickCache>(files.cacheFilename, key,
+                [this]() { return reader.CalculateHash(); }, false);
+            cgu::BrickLayoutSource source{ &reader, volumeSize, 1, 1, maxBrickSize, static_cast<std::size_t>(64) << 20 };
+            layout.reset(new cgu::VolumeBrickLayout(source, glm::vec3(1.0f / static_cast<float>(size)), minMaxBuilder, cache));
+            layout->GetBricksAtLevel(layout->GetMaxLevel(), glm::mat4(), leaves);
+        }
+
+        /** Holds the size of the volume. */
+        glm::uvec3 volumeSize;
+        /** Holds the files of the volume. */
+        SyntheticVolumeFiles files;
+        /** Holds the reader of the raw file. */
+        cgu::VolumeRawSlabReader reader;
+        /** Holds the builder of the min/max data. */
+        cgu::VolumeMinMaxBuilder minMaxBuilder;
+        /** Holds the brick cache. */
+        std::shared_ptr<cgu::VolumeBrickCache> cache;
+        /** Holds the layout of the bricks. */
+        std::unique_ptr<cgu::VolumeBrickLayout> layout;
+        /** Holds the leaves of the layout in the unit cube. */
+        std::vector<cgu::RayCastBrick> leaves;
+    };
+}
+
+TEST_F(VolumeRayCasterTest, GoldenImageFromAbove)
+{
+    auto rayCaster = CreateRayCaster(2);
+    EXPECT_EQ(2u, rayCaster->GetNumberOfBricks());
+    expectGoldenImage(*rayCaster, glm::vec3(1.0f, 0.5f, 5.0f), [](const glm::vec3& pos) {
+        if (!inside(pos.y, 0.0f, 1.0f)) return glm::vec4(0.0f);
+        if (inside(pos.x, 0.0f, 1.0f)) return integrateBrick(colorA);
+        if (inside(pos.x, 1.0f, 2.0f)) return integrateBrick(colorB);
+        return glm::vec4(0.0f);
+    });
+}
+
+TEST_F(VolumeRayCasterTest, GoldenImageThroughBothBricks)
+{
+    // rays from the side pass brick B first, then brick A.
+    auto rayCaster = CreateRayCaster(3);
+    expectGoldenImage(*rayCaster, glm::vec3(5.0f, 0.5f, 0.5f), [](const glm::vec3& pos) {
+        if (!inside(pos.y, 0.0f, 1.0f) || !inside(pos.z, 0.0f, 1.0f)) return glm::vec4(0.0f);
+        return compositeBehind(integrateBrick(colorB), integrateBrick(colorA));
+    });
+    expectGoldenImage(*rayCaster, glm::vec3(-3.0f, 0.5f, 0.5f), [](const glm::vec3& pos) {
+        if (!inside(pos.y, 0.0f, 1.0f) || !inside(pos.z, 0.0f, 1.0f)) return glm::vec4(0.0f);
+        return compositeBehind(integrateBrick(colorA), integrateBrick(colorB));
+    });
+}
+
+TEST_F(VolumeRayCasterTest, SkippingEndsWithTheSegment)
+{
+    // brick A is transparent and its texture space ends before its last cell does (as with overlap), skipping it
+    // must not cut into brick B behind it.
+    auto overlapBricks = bricks;
+    overlapBricks[0].maxTexValue.x = 0.75f;
+    cgu::VolumeRayCaster rayCaster(*cache, overlapBricks, 2);
+    cgu::tf::TransferFunction tf;
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.0f, glm::vec4(0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.499f, glm::vec4(0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.501f, colorB });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 1.0f, colorB });
+    rayCaster.SetTransferFunction(tf, 256);
+    unsigned int skipLevels[] = { 0, cgu::VolumeRayCaster::DEFAULT_MAX_SKIP_LEVEL };
+    for (auto skipLevel : skipLevels) {
+        rayCaster.SetMaxSkipLevel(skipLevel);
+        expectGoldenImage(rayCaster, glm::vec3(-3.0f, 0.5f, 0.5f), [](const glm::vec3& pos) {
+            if (!inside(pos.y, 0.0f, 1.0f) || !inside(pos.z, 0.0f, 1.0f)) return glm::vec4(0.0f);
+            return integrateBrick(colorB);
+        });
+    }
+}
+
+TEST(VolumeRayCaster, EmptySpaceSkippingKeepsImage)
+{
+    SyntheticVolume volume(64, 32, 2);
+    ASSERT_LT(1u, volume.leaves.size());
+    // the air around the sphere and its lower values are transparent.
+    cgu::tf::TransferFunction tf;
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.3f, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 1.0f, glm::vec4(1.0f, 0.5f, 0.2f, 0.5f) });
+
+    cgu::VolumeRayCaster rayCaster(*volume.cache, volume.leaves, 2);
+    rayCaster.SetTransferFunction(tf, 256);
+    const glm::uvec2 imageSize(64, 64);
+    auto view = glm::lookAt(glm::vec3(1.3f, 1.1f, 2.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    auto projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f);
+
+    std::vector<glm::vec4> skippedImage, image;
+    auto skippedStats = rayCaster.Render(view, projection, imageSize, 0.0f, skippedImage);
+    rayCaster.SetMaxSkipLevel(0);
+    auto stats = rayCaster.Render(view, projection, imageSize, 0.0f, image);
+
+    auto maxDiff = 0.0f, maxAlpha = 0.0f;
+    for (std::size_t i = 0; i < image.size(); ++i) {
+        for (int c = 0; c < 4; ++c) maxDiff = glm::max(maxDiff, std::abs(skippedImage[i][c] - image[i][c]));
+        maxAlpha = glm::max(maxAlpha, image[i].a);
+    }
+    std::cout << rayCaster.GetNumberOfBricks() << " bricks: " << stats.numSamples << " samples without skipping, "
+        << skippedStats.numSamples << " with skipping (" << skippedStats.numSkips << " skips, "
+        << skippedStats.numSkippedSamples << " samples skipped), max difference " << maxDiff << "." << std::endl;
+    EXPECT_LT(0.5f, maxAlpha);
+    EXPECT_LT(maxDiff, 1e-4f);
+    EXPECT_EQ(0u, stats.numSkippedSamples);
+    EXPECT_LT(stats.numSamples / 4, skippedStats.numSkippedSamples);
+    // every skipped sample is one the ray caster takes without skipping (up to rounding at segment ends).
+    EXPECT_NEAR(static_cast<double>(stats.numSamples),
+        static_cast<double>(skippedStats.numSamples + skippedStats.numSkippedSamples), 1e-4 * stats.numSamples);
+}
+
+TEST(VolumeRayCaster, PreIntegrationKeepsImageWithLargerSteps)
+{
+    SyntheticVolume volume(64, 32, 2, writeRadialVolume);
+    // a thin shell (about a voxel) of the values around 0.5 changing from orange to blue.
+    cgu::tf::TransferFunction tf;
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.0f, glm::vec4(1.0f, 0.5f, 0.2f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.48f, glm::vec4(1.0f, 0.5f, 0.2f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.5f, glm::vec4(0.6f, 0.5f, 0.6f, 0.8f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.52f, glm::vec4(0.2f, 0.5f, 1.0f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 1.0f, glm::vec4(0.2f, 0.5f, 1.0f, 0.0f) });
+    const int resolution = 256;
+    const auto stepSize = 1.0f / 512.0f;
+    std::vector<glm::vec4> table(resolution * resolution);
+    tf.CreatePreIntegratedData(table.data(), resolution, stepSize * 100.0f);
+
+    cgu::VolumeRayCaster rayCaster(*volume.cache, volume.leaves, 2);
+    rayCaster.SetTransferFunction(tf, resolution);
+    const glm::uvec2 imageSize(64, 64);
+    auto view = glm::lookAt(glm::vec3(1.3f, 1.1f, 2.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    auto projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f);
+    auto maxDifference = [](const std::vector<glm::vec4>& image, const std::vector<glm::vec4>& reference) {
+        auto maxDiff = 0.0f;
+        for (std::size_t i = 0; i < image.size(); ++i) {
+            for (int c = 0; c < 4; ++c) maxDiff = glm::max(maxDiff, std::abs(image[i][c] - reference[i][c]));
+        }
+        return maxDiff;
+    };
+
+    // the reference is the original step size with the table.
+    std::vector<glm::vec4> reference, image;
+    rayCaster.SetPreIntegrationTable(table.data(), resolution, stepSize);
+    rayCaster.Render(view, projection, imageSize, 0.0f, reference);
+    auto maxAlpha = 0.0f;
+    for (const auto& pixel : reference) maxAlpha = glm::max(maxAlpha, pixel.a);
+    EXPECT_LT(0.5f, maxAlpha);
+
+    // 2x and 4x larger steps with the table created for the original step size.
+    for (auto lod = 1; lod <= 2; ++lod) {
+        rayCaster.SetPreIntegrationTable(nullptr, 0, stepSize);
+        rayCaster.Render(view, projection, imageSize, static_cast<float>(lod), image);
+        auto tfDiff = maxDifference(image, reference);
+        rayCaster.SetPreIntegrationTable(table.data(), resolution, stepSize);
+        rayCaster.Render(view, projection, imageSize, static_cast<float>(lod), image);
+        auto preIntDiff = maxDifference(image, reference);
+        std::cout << (1 << lod) << "x step size: max difference " << tfDiff << " without pre-integration, " << preIntDiff
+            << " with pre-integration." << std::endl;
+        EXPECT_LT(preIntDiff, 0.02f);
+        EXPECT_LT(2.0f * preIntDiff, tfDiff);
+    }
+}
+
+TEST(VolumeRayCaster, DISABLED_BenchmarkRayCasting)
+{
+    const glm::uvec2 imageSize(128, 128);
+    SyntheticVolume volume(256, 64, std::max(1u, std::thread::hardware_concurrency()));
+    cgu::tf::TransferFunction tf;
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 0.3f, glm::vec4(1.0f, 1.0f, 1.0f, 0.0f) });
+    tf.InsertControlPoint(cgu::tf::ControlPoint{ 1.0f, glm::vec4(1.0f, 0.5f, 0.2f, 0.5f) });
+
+    auto view = glm::lookAt(glm::vec3(1.3f, 1.1f, 2.0f), glm::vec3(0.5f), glm::vec3(0.0f, 1.0f, 0.0f));
+    auto projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 10.0f);
+    unsigned int threadCounts[] = { 1, 2, 4, std::max(1u, std::thread::hardware_concurrency()) };
+    for (auto numThreads : threadCounts) {
+        cgu::VolumeRayCaster rayCaster(*volume.cache, volume.leaves, numThreads);
+        rayCaster.SetTransferFunction(tf, 256);
+        unsigned int skipLevels[] = { 0, cgu::VolumeRayCaster::DEFAULT_MAX_SKIP_LEVEL };
+        for (auto skipLevel : skipLevels) {
+            rayCaster.SetMaxSkipLevel(skipLevel);
+            std::vector<glm::vec4> image;
+            cgu::RayCastStats stats;
+            auto ms = test_help::measureMS(3, [&]() { stats = rayCaster.Render(view, projection, imageSize, 0.0f, image); });
+            std::cout << rayCaster.GetNumberOfBricks() << " bricks, " << numThreads << " threads, skipping "
+                << (skipLevel > 0 ? "on" : "off") << ": " << ms << " ms, "
+                << static_cast<double>(stats.numRays) / (ms / 1000.0) << " rays/s, "
+                << static_cast<double>(stats.numSamples) / (ms * 1e3) << " Msamples/s, "
+                << stats.numSkippedSamples << " samples skipped." << std::endl;
+        }
+    }
+}
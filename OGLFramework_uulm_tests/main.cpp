@@ -0,0 +1,29 @@
+/**
+ * @file   main.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Entry point of the headless tests and benchmarks (no window or OpenGL context is created).
+ *
+ * The benchmarks are disabled tests, run them with
+ * <code>--gtest_also_run_disabled_tests --gtest_filter=*Benchmark*</code>.
+ */
+
+#include "main.h"
+
+#include <gtest/gtest.h>
+
+/**
+ * Runs the tests.
+ * @param argc the number of arguments.
+ * @param argv the arguments (passed to gtest).
+ * @return the gtest result.
+ */
+int main(int argc, char* argv[])
+{
+    g2LogWorker g2log("tests", "./", LOG_USE_TIMESTAMPS);
+    g2::initializeLogging(&g2log);
+
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,98 @@
+/**
+ * @file   test_helper.cpp
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Implementation of the helpers for the headless tests and benchmarks.
+ */
+
+#include "test_helper.h"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <Psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+namespace test_help
+{
+    /** Returns the current resident memory (working set) of this process in MB. */
+    double currentMemoryMB()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0.0;
+        return static_cast<double>(counters.WorkingSetSize) / (1024.0 * 1024.0);
+#else
+        std::ifstream statm("/proc/self/statm");
+        std::size_t size = 0, resident = 0;
+        if (!(statm >> size >> resident)) return 0.0;
+        return static_cast<double>(resident) * static_cast<double>(sysconf(_SC_PAGESIZE)) / (1024.0 * 1024.0);
+#endif
+    }
+
+    /**
+     * Writes a synthetic 8 bit volume slice by slice: air around a sphere with a gradient inside.
+     * @param filename the name of the .raw file.
+     * @param size the size of the volume.
+     */
+    void writeSyntheticVolume(const std::string& filename, const glm::uvec3& size)
+    {
+        std::ofstream file(filename, std::ios::binary);
+        std::vector<uint8_t> slice(static_cast<std::size_t>(size.x) * size.y);
+        auto center = glm::vec3(size) * 0.5f;
+        auto radius = 0.4f * static_cast<float>(size.x);
+        for (unsigned int z = 0; z < size.z; ++z) {
+            for (unsigned int y = 0; y < size.y; ++y) {
+                for (unsigned int x = 0; x < size.x; ++x) {
+                    auto inside = glm::length(glm::vec3(x, y, z) - center) < radius;
+                    slice[static_cast<std::size_t>(y) * size.x + x] = inside ? static_cast<uint8_t>(1 + (x + y + z) % 255) : 0;
+                }
+            }
+            file.write(reinterpret_cast<const char*>(slice.data()), slice.size());
+        }
+    }
+
+    /**
+     * Constructor, starts sampling the resident memory every millisecond.
+     */
+    MemorySampler::MemorySampler() :
+        running(true),
+        peakMB(currentMemoryMB())
+    {
+        sampler = std::thread([this]() {
+            while (running) {
+                peakMB = std::max(peakMB, currentMemoryMB());
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    /** Destructor, stops sampling. */
+    MemorySampler::~MemorySampler()
+    {
+        Stop();
+    }
+
+    /**
+     * Stops sampling.
+     * @return the maximum resident memory sampled in MB.
+     */
+    double MemorySampler::Stop()
+    {
+        if (sampler.joinable()) {
+            running = false;
+            sampler.join();
+            peakMB = std::max(peakMB, currentMemoryMB());
+        }
+        return peakMB;
+    }
+}
@@ -0,0 +1,63 @@
+/**
+ * @file   test_helper.h
+ * @author Sebastian Maisch <sebastian.maisch@uni-ulm.de>
+ * @date   2015.10.01
+ *
+ * @brief  Contains helpers for the headless tests and benchmarks.
+ */
+
+#ifndef TEST_HELPER_H
+#define TEST_HELPER_H
+
+#include "main.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+/** Contains helpers for the headless tests and benchmarks. */
+namespace test_help
+{
+    double currentMemoryMB();
+    void writeSyntheticVolume(const std::string& filename, const glm::uvec3& size);
+
+    /**
+     * Samples the resident memory of this process on a background thread until it is stopped.
+     * Measures the peak of a section of a test on all systems (the peak of the process can not be reset on Windows).
+     */
+    class MemorySampler
+    {
+    public:
+        MemorySampler();
+        ~MemorySampler();
+        double Stop();
+
+    private:
+        /** Holds whether the sampling thread is running. */
+        std::atomic<bool> running;
+        /** Holds the maximum resident memory sampled in MB. */
+        double peakMB;
+        /** Holds the sampling thread. */
+        std::thread sampler;
+    };
+
+    /**
+     * Runs a function several times and returns the fastest run.
+     * @param repetitions the number of runs.
+     * @param fn the function to measure.
+     * @return the time of the fastest run in milliseconds.
+     */
+    template<typename Fn> double measureMS(unsigned int repetitions, Fn fn)
+    {
+        auto best = 0.0;
+        for (unsigned int i = 0; i < repetitions; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (i == 0 || ms < best) best = ms;
+        }
+        return best;
+    }
+}
+
+#endif /* TEST_HELPER_H */